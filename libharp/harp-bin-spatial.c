@@ -40,6 +40,7 @@
 
 #define MAX_NAME_LENGTH 128
 #define LATLON_BLOCK_SIZE 1024
+#define WEIGHT_BLOCK_SIZE 256   /* number of samples per task when determining the grid cell weights */
 
 typedef enum binning_type_enum
 {
@@ -53,6 +54,26 @@ typedef enum binning_type_enum
     binning_time_average
 } binning_type;
 
+/* the grid cells and weights of the last area binning (see harp_set_option_bin_spatial_weight_cache())
+ * the cache is shared by all threads and should only be accessed while holding the harp_lock_bin_spatial_weights lock */
+typedef struct weight_cache_info_struct
+{
+    long num_latitude_edges;
+    double *latitude_edges;
+    long num_longitude_edges;
+    double *longitude_edges;
+    long num_elements;
+    long max_num_vertices;
+    double *latitude_bounds;    /* [num_elements, max_num_vertices] */
+    double *longitude_bounds;   /* [num_elements, max_num_vertices] */
+    long *num_latlon_index;     /* [num_elements] */
+    long num_cells;
+    long *latlon_cell_index;    /* [num_cells] */
+    double *latlon_weight;      /* [num_cells] */
+} weight_cache_info;
+
+static weight_cache_info weight_cache;
+
 
 static binning_type get_binning_type(harp_variable *variable)
 {
@@ -627,11 +648,12 @@ static double find_weight_for_polygon_and_cell(long num_points, double *poly_lat
     return poly_area / cell_area;
 }
 
-static int find_matching_cells_and_weights_for_bounds(harp_variable *latitude_bounds, harp_variable *longitude_bounds,
-                                                      long num_latitude_edges, double *latitude_edges,
-                                                      long num_longitude_edges, double *longitude_edges,
-                                                      long *num_latlon_index, long **latlon_cell_index,
-                                                      double **latlon_weight)
+/* determine matching cells and weights for the samples [first_element, first_element + num_elements) */
+static int find_matching_cells_and_weights_for_block(harp_variable *latitude_bounds, harp_variable *longitude_bounds,
+                                                     long first_element, long num_elements, long num_latitude_edges,
+                                                     double *latitude_edges, long num_longitude_edges,
+                                                     double *longitude_edges, long *num_latlon_index, long *num_cells,
+                                                     long **latlon_cell_index, double **latlon_weight)
 {
     double *temp_poly_latitude = NULL;
     double *temp_poly_longitude = NULL;
@@ -642,20 +664,11 @@ static int find_matching_cells_and_weights_for_bounds(harp_variable *latitude_bo
     long *min_lat_id = NULL, *max_lat_id = NULL;        /* min/max grid latitude index for each longitude grid row */
     long *min_lon_id = NULL, *max_lon_id = NULL;        /* min/max grid longitude index for each latitude grid row */
     long cumsum_index = 0;
-    long num_elements;
     long max_num_vertices;
     long i, j, k;
 
-    num_elements = latitude_bounds->dimension[0];
     max_num_vertices = latitude_bounds->dimension[latitude_bounds->num_dimensions - 1];
 
-    if (longitude_bounds->dimension[latitude_bounds->num_dimensions - 1] != max_num_vertices)
-    {
-        harp_set_error(HARP_ERROR_INVALID_VARIABLE, "latitude_bounds and longitude_bounds variables should have the "
-                       "same length for the inpendent dimension");
-        return -1;
-    }
-
     /* add 1 point to allow closing the polygon (i.e. repeat first point at the end) */
     /* and allow room for 2 more points to close polygons that cover a pole */
     poly_latitude = malloc((max_num_vertices + 3) * sizeof(double));
@@ -727,9 +740,9 @@ static int find_matching_cells_and_weights_for_bounds(harp_variable *latitude_bo
 
         num_latlon_index[i] = 0;
 
-        memcpy(poly_latitude, &latitude_bounds->data.double_data[i * max_num_vertices],
+        memcpy(poly_latitude, &latitude_bounds->data.double_data[(first_element + i) * max_num_vertices],
                max_num_vertices * sizeof(double));
-        memcpy(poly_longitude, &longitude_bounds->data.double_data[i * max_num_vertices],
+        memcpy(poly_longitude, &longitude_bounds->data.double_data[(first_element + i) * max_num_vertices],
                max_num_vertices * sizeof(double));
         while (num_vertices > 0 && harp_isnan(poly_latitude[num_vertices - 1]))
         {
@@ -1043,6 +1056,8 @@ static int find_matching_cells_and_weights_for_bounds(harp_variable *latitude_bo
     free(min_lon_id);
     free(max_lon_id);
 
+    *num_cells = cumsum_index;
+
     return 0;
 
   error:
@@ -1082,6 +1097,372 @@ static int find_matching_cells_and_weights_for_bounds(harp_variable *latitude_bo
     return -1;
 }
 
+typedef struct bounds_weight_info_struct
+{
+    harp_variable *latitude_bounds;
+    harp_variable *longitude_bounds;
+    long num_elements;
+    long num_latitude_edges;
+    double *latitude_edges;
+    long num_longitude_edges;
+    double *longitude_edges;
+    long *num_latlon_index;
+    long *block_num_cells;      /* number of matching cells for each block of samples */
+    long **block_cell_index;    /* flat latlon cell index for each matching cell for each block of samples */
+    double **block_weight;      /* weight for each matching cell for each block of samples */
+    int *block_result;  /* result of find_matching_cells_and_weights_for_block() for each block of samples */
+} bounds_weight_info;
+
+static void find_matching_cells_and_weights_task(void *context, long index)
+{
+    bounds_weight_info *info = (bounds_weight_info *)context;
+    long first_element = index * WEIGHT_BLOCK_SIZE;
+    long num_elements = WEIGHT_BLOCK_SIZE;
+
+    if (first_element + num_elements > info->num_elements)
+    {
+        num_elements = info->num_elements - first_element;
+    }
+    info->block_result[index] =
+        find_matching_cells_and_weights_for_block(info->latitude_bounds, info->longitude_bounds, first_element,
+                                                  num_elements, info->num_latitude_edges, info->latitude_edges,
+                                                  info->num_longitude_edges, info->longitude_edges,
+                                                  &info->num_latlon_index[first_element],
+                                                  &info->block_num_cells[index], &info->block_cell_index[index],
+                                                  &info->block_weight[index]);
+}
+
+static void bounds_weight_info_done(bounds_weight_info *info, long num_blocks)
+{
+    long i;
+
+    if (info->block_cell_index != NULL)
+    {
+        for (i = 0; i < num_blocks; i++)
+        {
+            if (info->block_cell_index[i] != NULL)
+            {
+                free(info->block_cell_index[i]);
+            }
+        }
+        free(info->block_cell_index);
+    }
+    if (info->block_weight != NULL)
+    {
+        for (i = 0; i < num_blocks; i++)
+        {
+            if (info->block_weight[i] != NULL)
+            {
+                free(info->block_weight[i]);
+            }
+        }
+        free(info->block_weight);
+    }
+    if (info->block_num_cells != NULL)
+    {
+        free(info->block_num_cells);
+    }
+    if (info->block_result != NULL)
+    {
+        free(info->block_result);
+    }
+}
+
+static int find_matching_cells_and_weights_for_bounds(harp_variable *latitude_bounds, harp_variable *longitude_bounds,
+                                                      long num_latitude_edges, double *latitude_edges,
+                                                      long num_longitude_edges, double *longitude_edges,
+                                                      long *num_latlon_index, long **latlon_cell_index,
+                                                      double **latlon_weight)
+{
+    bounds_weight_info info;
+    long max_num_vertices;
+    long num_blocks;
+    long num_cells = 0;
+    long i;
+
+    max_num_vertices = latitude_bounds->dimension[latitude_bounds->num_dimensions - 1];
+    if (longitude_bounds->dimension[latitude_bounds->num_dimensions - 1] != max_num_vertices)
+    {
+        harp_set_error(HARP_ERROR_INVALID_VARIABLE, "latitude_bounds and longitude_bounds variables should have the "
+                       "same length for the inpendent dimension");
+        return -1;
+    }
+
+    info.latitude_bounds = latitude_bounds;
+    info.longitude_bounds = longitude_bounds;
+    info.num_elements = latitude_bounds->dimension[0];
+    info.num_latitude_edges = num_latitude_edges;
+    info.latitude_edges = latitude_edges;
+    info.num_longitude_edges = num_longitude_edges;
+    info.longitude_edges = longitude_edges;
+    info.num_latlon_index = num_latlon_index;
+    info.block_num_cells = NULL;
+    info.block_cell_index = NULL;
+    info.block_weight = NULL;
+    info.block_result = NULL;
+
+    num_blocks = (info.num_elements + WEIGHT_BLOCK_SIZE - 1) / WEIGHT_BLOCK_SIZE;
+    if (num_blocks == 0)
+    {
+        return 0;
+    }
+
+    info.block_num_cells = malloc(num_blocks * sizeof(long));
+    if (info.block_num_cells == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_blocks * sizeof(long), __FILE__, __LINE__);
+        goto error;
+    }
+    info.block_cell_index = malloc(num_blocks * sizeof(long *));
+    if (info.block_cell_index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_blocks * sizeof(long *), __FILE__, __LINE__);
+        goto error;
+    }
+    info.block_weight = malloc(num_blocks * sizeof(double *));
+    if (info.block_weight == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_blocks * sizeof(double *), __FILE__, __LINE__);
+        goto error;
+    }
+    info.block_result = malloc(num_blocks * sizeof(int));
+    if (info.block_result == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_blocks * sizeof(int), __FILE__, __LINE__);
+        goto error;
+    }
+    for (i = 0; i < num_blocks; i++)
+    {
+        info.block_num_cells[i] = 0;
+        info.block_cell_index[i] = NULL;
+        info.block_weight[i] = NULL;
+    }
+
+    /* the polygon/cell overlap calculations dominate the spatial binning, so blocks of samples are processed in
+     * parallel; the per-block results are concatenated afterwards, so the result does not depend on the threading */
+    harp_parallel_for(num_blocks, info.num_elements * max_num_vertices * 2 * (long)sizeof(double),
+                      find_matching_cells_and_weights_task, &info);
+
+    for (i = 0; i < num_blocks; i++)
+    {
+        if (info.block_result[i] != 0)
+        {
+            /* the error message may have been set in another thread */
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not determine grid cells for spatial "
+                           "binning) (%s:%u)", __FILE__, __LINE__);
+            goto error;
+        }
+        num_cells += info.block_num_cells[i];
+    }
+
+    if (num_cells > 0)
+    {
+        *latlon_cell_index = malloc(num_cells * sizeof(long));
+        if (*latlon_cell_index == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_cells * sizeof(long), __FILE__, __LINE__);
+            goto error;
+        }
+        *latlon_weight = malloc(num_cells * sizeof(double));
+        if (*latlon_weight == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_cells * sizeof(double), __FILE__, __LINE__);
+            goto error;
+        }
+        num_cells = 0;
+        for (i = 0; i < num_blocks; i++)
+        {
+            if (info.block_num_cells[i] > 0)
+            {
+                memcpy(&(*latlon_cell_index)[num_cells], info.block_cell_index[i],
+                       info.block_num_cells[i] * sizeof(long));
+                memcpy(&(*latlon_weight)[num_cells], info.block_weight[i], info.block_num_cells[i] * sizeof(double));
+                num_cells += info.block_num_cells[i];
+            }
+        }
+    }
+
+    bounds_weight_info_done(&info, num_blocks);
+
+    return 0;
+
+  error:
+    bounds_weight_info_done(&info, num_blocks);
+    return -1;
+}
+
+static void weight_cache_clear(void)
+{
+    if (weight_cache.latitude_edges != NULL)
+    {
+        free(weight_cache.latitude_edges);
+    }
+    if (weight_cache.longitude_edges != NULL)
+    {
+        free(weight_cache.longitude_edges);
+    }
+    if (weight_cache.latitude_bounds != NULL)
+    {
+        free(weight_cache.latitude_bounds);
+    }
+    if (weight_cache.longitude_bounds != NULL)
+    {
+        free(weight_cache.longitude_bounds);
+    }
+    if (weight_cache.num_latlon_index != NULL)
+    {
+        free(weight_cache.num_latlon_index);
+    }
+    if (weight_cache.latlon_cell_index != NULL)
+    {
+        free(weight_cache.latlon_cell_index);
+    }
+    if (weight_cache.latlon_weight != NULL)
+    {
+        free(weight_cache.latlon_weight);
+    }
+    memset(&weight_cache, 0, sizeof(weight_cache));
+}
+
+void harp_bin_spatial_clear_weight_cache(void)
+{
+    harp_lock(harp_lock_bin_spatial_weights);
+    weight_cache_clear();
+    harp_unlock(harp_lock_bin_spatial_weights);
+}
+
+static int weight_cache_matches(harp_variable *latitude_bounds, harp_variable *longitude_bounds,
+                                long num_latitude_edges, double *latitude_edges, long num_longitude_edges,
+                                double *longitude_edges)
+{
+    if (weight_cache.num_latlon_index == NULL)
+    {
+        return 0;
+    }
+    if (weight_cache.num_elements != latitude_bounds->dimension[0] ||
+        weight_cache.max_num_vertices != latitude_bounds->dimension[latitude_bounds->num_dimensions - 1] ||
+        longitude_bounds->num_elements != latitude_bounds->num_elements ||
+        weight_cache.num_latitude_edges != num_latitude_edges ||
+        weight_cache.num_longitude_edges != num_longitude_edges)
+    {
+        return 0;
+    }
+    if (memcmp(weight_cache.latitude_edges, latitude_edges, num_latitude_edges * sizeof(double)) != 0 ||
+        memcmp(weight_cache.longitude_edges, longitude_edges, num_longitude_edges * sizeof(double)) != 0)
+    {
+        return 0;
+    }
+    if (memcmp(weight_cache.latitude_bounds, latitude_bounds->data.double_data,
+               latitude_bounds->num_elements * sizeof(double)) != 0 ||
+        memcmp(weight_cache.longitude_bounds, longitude_bounds->data.double_data,
+               longitude_bounds->num_elements * sizeof(double)) != 0)
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* returns 1 if the weights were taken from the cache, 0 if they were not in the cache, and -1 on error */
+static int weight_cache_find(harp_variable *latitude_bounds, harp_variable *longitude_bounds, long num_latitude_edges,
+                             double *latitude_edges, long num_longitude_edges, double *longitude_edges,
+                             long *num_latlon_index, long **latlon_cell_index, double **latlon_weight)
+{
+    harp_lock(harp_lock_bin_spatial_weights);
+    if (!weight_cache_matches(latitude_bounds, longitude_bounds, num_latitude_edges, latitude_edges,
+                              num_longitude_edges, longitude_edges))
+    {
+        harp_unlock(harp_lock_bin_spatial_weights);
+        return 0;
+    }
+    memcpy(num_latlon_index, weight_cache.num_latlon_index, weight_cache.num_elements * sizeof(long));
+    if (weight_cache.num_cells > 0)
+    {
+        *latlon_cell_index = malloc(weight_cache.num_cells * sizeof(long));
+        if (*latlon_cell_index == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           weight_cache.num_cells * sizeof(long), __FILE__, __LINE__);
+            harp_unlock(harp_lock_bin_spatial_weights);
+            return -1;
+        }
+        memcpy(*latlon_cell_index, weight_cache.latlon_cell_index, weight_cache.num_cells * sizeof(long));
+        *latlon_weight = malloc(weight_cache.num_cells * sizeof(double));
+        if (*latlon_weight == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           weight_cache.num_cells * sizeof(double), __FILE__, __LINE__);
+            harp_unlock(harp_lock_bin_spatial_weights);
+            return -1;
+        }
+        memcpy(*latlon_weight, weight_cache.latlon_weight, weight_cache.num_cells * sizeof(double));
+    }
+    harp_unlock(harp_lock_bin_spatial_weights);
+
+    return 1;
+}
+
+/* the cache is only an optimisation, so we just don't cache the weights if there is not enough memory */
+static void weight_cache_add(harp_variable *latitude_bounds, harp_variable *longitude_bounds, long num_latitude_edges,
+                             double *latitude_edges, long num_longitude_edges, double *longitude_edges,
+                             long *num_latlon_index, long *latlon_cell_index, double *latlon_weight)
+{
+    long num_elements = latitude_bounds->dimension[0];
+    long num_cells = 0;
+    long i;
+
+    for (i = 0; i < num_elements; i++)
+    {
+        num_cells += num_latlon_index[i];
+    }
+
+    harp_lock(harp_lock_bin_spatial_weights);
+    weight_cache_clear();
+    weight_cache.latitude_edges = malloc(num_latitude_edges * sizeof(double));
+    weight_cache.longitude_edges = malloc(num_longitude_edges * sizeof(double));
+    weight_cache.latitude_bounds = malloc(latitude_bounds->num_elements * sizeof(double));
+    weight_cache.longitude_bounds = malloc(longitude_bounds->num_elements * sizeof(double));
+    weight_cache.num_latlon_index = malloc(num_elements * sizeof(long));
+    if (num_cells > 0)
+    {
+        weight_cache.latlon_cell_index = malloc(num_cells * sizeof(long));
+        weight_cache.latlon_weight = malloc(num_cells * sizeof(double));
+    }
+    if (weight_cache.latitude_edges == NULL || weight_cache.longitude_edges == NULL ||
+        weight_cache.latitude_bounds == NULL || weight_cache.longitude_bounds == NULL ||
+        weight_cache.num_latlon_index == NULL ||
+        (num_cells > 0 && (weight_cache.latlon_cell_index == NULL || weight_cache.latlon_weight == NULL)))
+    {
+        weight_cache_clear();
+        harp_unlock(harp_lock_bin_spatial_weights);
+        return;
+    }
+    weight_cache.num_latitude_edges = num_latitude_edges;
+    memcpy(weight_cache.latitude_edges, latitude_edges, num_latitude_edges * sizeof(double));
+    weight_cache.num_longitude_edges = num_longitude_edges;
+    memcpy(weight_cache.longitude_edges, longitude_edges, num_longitude_edges * sizeof(double));
+    weight_cache.num_elements = num_elements;
+    weight_cache.max_num_vertices = latitude_bounds->dimension[latitude_bounds->num_dimensions - 1];
+    memcpy(weight_cache.latitude_bounds, latitude_bounds->data.double_data,
+           latitude_bounds->num_elements * sizeof(double));
+    memcpy(weight_cache.longitude_bounds, longitude_bounds->data.double_data,
+           longitude_bounds->num_elements * sizeof(double));
+    memcpy(weight_cache.num_latlon_index, num_latlon_index, num_elements * sizeof(long));
+    weight_cache.num_cells = num_cells;
+    if (num_cells > 0)
+    {
+        memcpy(weight_cache.latlon_cell_index, latlon_cell_index, num_cells * sizeof(long));
+        memcpy(weight_cache.latlon_weight, latlon_weight, num_cells * sizeof(double));
+    }
+    harp_unlock(harp_lock_bin_spatial_weights);
+}
+
 static int find_matching_cells_for_points(harp_variable *latitude, harp_variable *longitude, long num_latitude_edges,
                                           double *latitude_edges, long num_longitude_edges, double *longitude_edges,
                                           long *num_latlon_index, long **latlon_cell_index)
@@ -1131,6 +1512,207 @@ static int find_matching_cells_for_points(harp_variable *latitude, harp_variable
     return 0;
 }
 
+/* context for summing up all matching cells of one latitude band (i.e. one latitude row of one time bin) */
+typedef struct band_sum_info_struct
+{
+    binning_type bintype;
+    long spatial_block_length;
+    long num_sub_elements;
+    long *time_bin_index;
+    long *band_offset;  /* index into latlon_cell_index/latlon_weight/cell_sample for each band [num_bands + 1] */
+    long *latlon_cell_index;
+    double *latlon_weight;      /* NULL for point binning */
+    long *cell_sample;  /* sample index for each matching cell */
+    double *source;     /* variable data [num_time_elements, num_sub_elements] (NULL to only sum up the weights) */
+    double *target;     /* binned variable data [num_time_bins, num_latitude_cells, num_longitude_cells, ...] */
+    float *weight;
+    int *band_has_nan;  /* whether a NaN value was skipped for each band [num_bands] */
+} band_sum_info;
+
+/* Each band covers a separate range of the target grid, so bands can be summed up in parallel. Within a grid cell the
+ * samples are still added in sample order, so the result is identical to summing up all samples sequentially.
+ */
+static void sum_band_task(void *context, long band)
+{
+    band_sum_info *info = (band_sum_info *)context;
+    long num_sub_elements = info->num_sub_elements;
+    long cumsum_index;
+
+    info->band_has_nan[band] = 0;
+    for (cumsum_index = info->band_offset[band]; cumsum_index < info->band_offset[band + 1]; cumsum_index++)
+    {
+        long i = info->cell_sample[cumsum_index];
+        long target_index = info->time_bin_index[i] * info->spatial_block_length +
+            info->latlon_cell_index[cumsum_index];
+        double multiplication_factor = 1;
+        double sample_weight = 1;
+        long j;
+
+        if (info->latlon_weight != NULL)
+        {
+            sample_weight = info->latlon_weight[cumsum_index];
+            multiplication_factor = sample_weight;
+            if (info->bintype == binning_uncertainty)
+            {
+                multiplication_factor *= sample_weight;
+            }
+        }
+        if (info->source == NULL)
+        {
+            info->weight[target_index] += sample_weight;
+        }
+        else if (info->bintype == binning_angle)
+        {
+            /* for angle variables we use one weight element per vector pair */
+            for (j = 0; j < num_sub_elements; j += 2)
+            {
+                if (!harp_isnan(info->source[i * num_sub_elements + j]))
+                {
+                    info->weight[(target_index * num_sub_elements + j) / 2] += sample_weight;
+                    info->target[target_index * num_sub_elements + j] +=
+                        multiplication_factor * info->source[i * num_sub_elements + j];
+                    info->target[target_index * num_sub_elements + j + 1] +=
+                        multiplication_factor * info->source[i * num_sub_elements + j + 1];
+                }
+            }
+        }
+        else
+        {
+            for (j = 0; j < num_sub_elements; j++)
+            {
+                if (!harp_isnan(info->source[i * num_sub_elements + j]))
+                {
+                    info->weight[target_index * num_sub_elements + j] += sample_weight;
+                    info->target[target_index * num_sub_elements + j] +=
+                        multiplication_factor * info->source[i * num_sub_elements + j];
+                }
+                else
+                {
+                    info->band_has_nan[band] = 1;
+                }
+            }
+        }
+    }
+}
+
+/* Reorder the matching cells such that all cells of a latitude band (i.e. a latitude row of a time bin) are stored
+ * consecutively. This is a stable sort, so within a band the cells remain ordered by sample index.
+ * The sample index of each (reordered) matching cell is returned in cell_sample.
+ */
+static int sort_cells_by_band(long num_time_elements, long *time_bin_index, long *num_latlon_index,
+                              long num_latitude_cells, long num_longitude_cells, long num_bands, long *band_offset,
+                              long **latlon_cell_index, double **latlon_weight, long **cell_sample)
+{
+    long *band_position = NULL;
+    long *sorted_cell_index = NULL;
+    double *sorted_weight = NULL;
+    long num_cells = 0;
+    long cumsum_index;
+    long i, j;
+
+    for (j = 0; j <= num_bands; j++)
+    {
+        band_offset[j] = 0;
+    }
+
+    /* count the number of cells per band */
+    cumsum_index = 0;
+    for (i = 0; i < num_time_elements; i++)
+    {
+        for (j = 0; j < num_latlon_index[i]; j++)
+        {
+            band_offset[time_bin_index[i] * num_latitude_cells +
+                        (*latlon_cell_index)[cumsum_index] / num_longitude_cells + 1]++;
+            cumsum_index++;
+        }
+    }
+    num_cells = cumsum_index;
+    if (num_cells == 0)
+    {
+        return 0;
+    }
+    for (j = 0; j < num_bands; j++)
+    {
+        band_offset[j + 1] += band_offset[j];
+    }
+
+    band_position = malloc(num_bands * sizeof(long));
+    if (band_position == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_bands * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+
+    /* move the weights first (this still needs the original cell indices to determine the band) */
+    if (*latlon_weight != NULL)
+    {
+        sorted_weight = malloc(num_cells * sizeof(double));
+        if (sorted_weight == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_cells * sizeof(double), __FILE__, __LINE__);
+            free(band_position);
+            return -1;
+        }
+        memcpy(band_position, band_offset, num_bands * sizeof(long));
+        cumsum_index = 0;
+        for (i = 0; i < num_time_elements; i++)
+        {
+            for (j = 0; j < num_latlon_index[i]; j++)
+            {
+                long band = time_bin_index[i] * num_latitude_cells +
+                    (*latlon_cell_index)[cumsum_index] / num_longitude_cells;
+
+                sorted_weight[band_position[band]] = (*latlon_weight)[cumsum_index];
+                band_position[band]++;
+                cumsum_index++;
+            }
+        }
+        free(*latlon_weight);
+        *latlon_weight = sorted_weight;
+    }
+
+    /* move the cell indices and store the sample index for each cell */
+    *cell_sample = malloc(num_cells * sizeof(long));
+    if (*cell_sample == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_cells * sizeof(long), __FILE__, __LINE__);
+        free(band_position);
+        return -1;
+    }
+    sorted_cell_index = malloc(num_cells * sizeof(long));
+    if (sorted_cell_index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_cells * sizeof(long), __FILE__, __LINE__);
+        free(band_position);
+        return -1;
+    }
+    memcpy(band_position, band_offset, num_bands * sizeof(long));
+    cumsum_index = 0;
+    for (i = 0; i < num_time_elements; i++)
+    {
+        for (j = 0; j < num_latlon_index[i]; j++)
+        {
+            long band = time_bin_index[i] * num_latitude_cells +
+                (*latlon_cell_index)[cumsum_index] / num_longitude_cells;
+
+            sorted_cell_index[band_position[band]] = (*latlon_cell_index)[cumsum_index];
+            (*cell_sample)[band_position[band]] = i;
+            band_position[band]++;
+            cumsum_index++;
+        }
+    }
+    free(*latlon_cell_index);
+    *latlon_cell_index = sorted_cell_index;
+
+    free(band_position);
+
+    return 0;
+}
+
 /** \addtogroup harp_product
  * @{
  */
@@ -1152,6 +1734,9 @@ static int find_matching_cells_for_points(harp_variable *latitude, harp_variable
  * binning is performed. This means that each sample will be allocated to each lat/lon grid cell based on the amount of
  * overlap. This overlap calculation will treat lines between points as straight lines within the carthesian plane
  * (i.e. using a Plate Carree projection, and not using great circle arcs between points on a sphere).
+ * For large products the overlap calculation and the summation of the samples are performed using multiple threads
+ * (see harp_set_option_num_threads()). If harp_set_option_bin_spatial_weight_cache() is enabled, the grid cells and
+ * weights of the last area binning are reused when binning a product with the same latitude/longitude bounds.
  *
  * If the product doesn't have lat/lon bounds per sample, it should have latitude {time} and longitude {time} variables.
  * The binning onto the lat/lon grid will then be a point binning. This means that each sample is allocated to only one
@@ -1215,9 +1800,13 @@ LIBHARP_API int harp_product_bin_spatial(harp_product *product, long num_time_bi
     long weight_size;
     int32_t *bin_count = NULL;  /* number of contributing samples for each time bin [num_time_bins] */
     float *weight = NULL;       /* sum of weights per latlon cell and time [num_time_bins, num_latitude_edges-1, num_longitude_edges-1] */
-    long cumsum_index;  /* index into latlon_cell_index and latlon_weight */
+    long num_bands = num_time_bins * (num_latitude_edges - 1);  /* number of latitude rows for all time bins */
+    long *band_offset = NULL;   /* index into latlon_cell_index/latlon_weight for each latitude band [num_bands+1] */
+    long *cell_sample = NULL;   /* sample index for each matching cell (after sorting by band) */
+    int *band_has_nan = NULL;   /* whether a NaN value was skipped for each latitude band [num_bands] */
+    band_sum_info sum_info;
     int area_binning = 0;
-    long i, j, k, l;
+    long i, k;
 
     if (product->dimension[harp_dimension_latitude] > 0 || product->dimension[harp_dimension_longitude] > 0)
     {
@@ -1304,15 +1893,38 @@ LIBHARP_API int harp_product_bin_spatial(harp_product *product, long num_time_bi
         if (harp_product_get_derived_variable(product, "longitude_bounds", &data_type, "degree_east", 2, dimension_type,
                                               &longitude) == 0)
         {
+            int cached = 0;
+
             area_binning = 1;
-            /* determine matching cells and weighting factors */
-            if (find_matching_cells_and_weights_for_bounds(latitude, longitude, num_latitude_edges, latitude_edges,
-                                                           num_longitude_edges, longitude_edges, num_latlon_index,
-                                                           &latlon_cell_index, &latlon_weight) != 0)
+            if (harp_get_option_bin_spatial_weight_cache())
             {
-                harp_variable_delete(latitude);
-                harp_variable_delete(longitude);
-                goto error;
+                cached = weight_cache_find(latitude, longitude, num_latitude_edges, latitude_edges,
+                                           num_longitude_edges, longitude_edges, num_latlon_index,
+                                           &latlon_cell_index, &latlon_weight);
+                if (cached < 0)
+                {
+                    harp_variable_delete(latitude);
+                    harp_variable_delete(longitude);
+                    goto error;
+                }
+            }
+            if (!cached)
+            {
+                /* determine matching cells and weighting factors */
+                if (find_matching_cells_and_weights_for_bounds(latitude, longitude, num_latitude_edges,
+                                                               latitude_edges, num_longitude_edges, longitude_edges,
+                                                               num_latlon_index, &latlon_cell_index,
+                                                               &latlon_weight) != 0)
+                {
+                    harp_variable_delete(latitude);
+                    harp_variable_delete(longitude);
+                    goto error;
+                }
+                if (harp_get_option_bin_spatial_weight_cache())
+                {
+                    weight_cache_add(latitude, longitude, num_latitude_edges, latitude_edges, num_longitude_edges,
+                                     longitude_edges, num_latlon_index, latlon_cell_index, latlon_weight);
+                }
             }
             harp_variable_delete(longitude);
         }
@@ -1392,6 +2004,35 @@ LIBHARP_API int harp_product_bin_spatial(harp_product *product, long num_time_bi
                        weight_size * sizeof(float), __FILE__, __LINE__);
         goto error;
     }
+    band_offset = malloc((num_bands + 1) * sizeof(long));
+    if (band_offset == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (num_bands + 1) * sizeof(long), __FILE__, __LINE__);
+        goto error;
+    }
+    band_has_nan = malloc(num_bands * sizeof(int));
+    if (band_has_nan == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_bands * sizeof(int), __FILE__, __LINE__);
+        goto error;
+    }
+    /* group the matching cells per latitude band, so each band can be summed up independently */
+    if (sort_cells_by_band(num_time_elements, time_bin_index, num_latlon_index, num_latitude_edges - 1,
+                           num_longitude_edges - 1, num_bands, band_offset, &latlon_cell_index, &latlon_weight,
+                           &cell_sample) != 0)
+    {
+        goto error;
+    }
+    sum_info.spatial_block_length = spatial_block_length;
+    sum_info.time_bin_index = time_bin_index;
+    sum_info.band_offset = band_offset;
+    sum_info.latlon_cell_index = latlon_cell_index;
+    sum_info.latlon_weight = area_binning ? latlon_weight : NULL;
+    sum_info.cell_sample = cell_sample;
+    sum_info.weight = weight;
+    sum_info.band_has_nan = band_has_nan;
 
     /* for each time bin, store the index of the first sample that contributes to the bin */
     for (i = 0; i < num_time_bins; i++)
@@ -1473,17 +2114,11 @@ LIBHARP_API int harp_product_bin_spatial(harp_product *product, long num_time_bi
 
     /* create global weight variable */
     memset(weight, 0, num_time_bins * spatial_block_length * sizeof(float));
-    cumsum_index = 0;
-    for (i = 0; i < num_time_elements; i++)
-    {
-        long index_offset = time_bin_index[i] * spatial_block_length;
-
-        for (l = 0; l < num_latlon_index[i]; l++)
-        {
-            weight[index_offset + latlon_cell_index[cumsum_index]] += area_binning ? latlon_weight[cumsum_index] : 1;
-            cumsum_index++;
-        }
-    }
+    sum_info.bintype = binning_skip;
+    sum_info.num_sub_elements = 1;
+    sum_info.source = NULL;
+    sum_info.target = NULL;
+    harp_parallel_for(num_bands, band_offset[num_bands] * (long)sizeof(double), sum_band_task, &sum_info);
     dimension_type[0] = harp_dimension_time;
     dimension[0] = num_time_bins;
     dimension_type[1] = harp_dimension_latitude;
@@ -1619,58 +2254,18 @@ LIBHARP_API int harp_product_bin_spatial(harp_product *product, long num_time_bi
 
             /* sum up all values per cell */
             memset(weight, 0, weight_size * sizeof(float));
-            cumsum_index = 0;
-            for (i = 0; i < num_time_elements; i++)
+            sum_info.bintype = bintype[k];
+            sum_info.num_sub_elements = num_sub_elements;
+            sum_info.source = variable->data.double_data;
+            sum_info.target = new_variable->data.double_data;
+            harp_parallel_for(num_bands, band_offset[num_bands] * num_sub_elements * (long)sizeof(double),
+                              sum_band_task, &sum_info);
+            for (i = 0; i < num_bands; i++)
             {
-                long index_offset = time_bin_index[i] * spatial_block_length;
-
-                for (l = 0; l < num_latlon_index[i]; l++)
+                if (band_has_nan[i])
                 {
-                    long target_index = index_offset + latlon_cell_index[cumsum_index];
-                    double multiplication_factor = 1;
-                    double sample_weight = 1;
-
-                    if (area_binning)
-                    {
-                        sample_weight = latlon_weight[cumsum_index];
-                        multiplication_factor = sample_weight;
-                        if (bintype[k] == binning_uncertainty)
-                        {
-                            multiplication_factor *= sample_weight;
-                        }
-                    }
-                    if (bintype[k] == binning_angle)
-                    {
-                        /* for angle variables we use one weight element per vector pair */
-                        for (j = 0; j < num_sub_elements; j += 2)
-                        {
-                            if (!harp_isnan(variable->data.double_data[i * num_sub_elements + j]))
-                            {
-                                weight[(target_index * num_sub_elements + j) / 2] += sample_weight;
-                                new_variable->data.double_data[target_index * num_sub_elements + j] +=
-                                    multiplication_factor * variable->data.double_data[i * num_sub_elements + j];
-                                new_variable->data.double_data[target_index * num_sub_elements + j + 1] +=
-                                    multiplication_factor * variable->data.double_data[i * num_sub_elements + j + 1];
-                            }
-                        }
-                    }
-                    else
-                    {
-                        for (j = 0; j < num_sub_elements; j++)
-                        {
-                            if (!harp_isnan(variable->data.double_data[i * num_sub_elements + j]))
-                            {
-                                weight[target_index * num_sub_elements + j] += sample_weight;
-                                new_variable->data.double_data[target_index * num_sub_elements + j] +=
-                                    multiplication_factor * variable->data.double_data[i * num_sub_elements + j];
-                            }
-                            else
-                            {
-                                store_weight_variable = 1;
-                            }
-                        }
-                    }
-                    cumsum_index++;
+                    store_weight_variable = 1;
+                    break;
                 }
             }
 
@@ -1770,6 +2365,12 @@ LIBHARP_API int harp_product_bin_spatial(harp_product *product, long num_time_bi
     {
         free(latlon_weight);
     }
+    free(band_offset);
+    if (cell_sample != NULL)
+    {
+        free(cell_sample);
+    }
+    free(band_has_nan);
 
     /* add latitude_bounds and longitude_bounds variables */
     dimension_type[0] = harp_dimension_latitude;
@@ -1847,6 +2448,18 @@ LIBHARP_API int harp_product_bin_spatial(harp_product *product, long num_time_bi
     {
         free(latlon_weight);
     }
+    if (band_offset != NULL)
+    {
+        free(band_offset);
+    }
+    if (cell_sample != NULL)
+    {
+        free(cell_sample);
+    }
+    if (band_has_nan != NULL)
+    {
+        free(band_has_nan);
+    }
     return -1;
 }
 
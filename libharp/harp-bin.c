@@ -156,6 +156,22 @@ static binning_type get_binning_type(harp_variable *variable)
         }
     }
 
+    /* use plain averaging for the axis variables of a lat/lon grid (e.g. from a bin_spatial() result)
+     * these are the same for all samples of a grid and binning them as angles would add weight variables, which would
+     * prevent binned grids from being merged and binned again */
+    if (strcmp(variable->name, "latitude") == 0 || strcmp(variable->name, "longitude") == 0 ||
+        strcmp(variable->name, "latitude_bounds") == 0 || strcmp(variable->name, "longitude_bounds") == 0)
+    {
+        for (i = 1; i < variable->num_dimensions; i++)
+        {
+            if (variable->dimension_type[i] == harp_dimension_latitude ||
+                variable->dimension_type[i] == harp_dimension_longitude)
+            {
+                return binning_average;
+            }
+        }
+    }
+
     if (strstr(variable->name, "latitude") != NULL || strstr(variable->name, "longitude") != NULL ||
         strstr(variable->name, "angle") != NULL || strstr(variable->name, "direction") != NULL)
     {
@@ -1350,10 +1366,9 @@ int harp_product_bin_with_collocated_dataset(harp_product *product, harp_colloca
     {
         for (j = 0; j < num_bins; j++)
         {
-            if (filtered_collocation_result->pair[index[j]]->product_index_b ==
-                filtered_collocation_result->pair[i]->product_index_b &&
-                filtered_collocation_result->pair[index[j]]->sample_index_b ==
-                filtered_collocation_result->pair[i]->sample_index_b)
+            if (filtered_collocation_result->product_index_b[index[j]] ==
+                filtered_collocation_result->product_index_b[i] &&
+                filtered_collocation_result->sample_index_b[index[j]] == filtered_collocation_result->sample_index_b[i])
             {
                 break;
             }
@@ -1407,6 +1422,152 @@ int harp_product_bin_with_collocated_dataset(harp_product *product, harp_colloca
     return 0;
 }
 
+/* we use hash = hash * 1000003 ^ value (same as for the hashtable of names) */
+#define BIN_HASH_COMBINE(hash, value) (((hash) * 0xF4243) ^ (unsigned long)(value))
+
+static unsigned long get_double_hash(unsigned long hash, double value)
+{
+    const unsigned char *c = (const unsigned char *)&value;
+    int i;
+
+    if (harp_isnan(value))
+    {
+        /* all NaN values are considered equal */
+        return BIN_HASH_COMBINE(hash, 0x7FF8);
+    }
+    if (value == 0)
+    {
+        /* make sure that -0 and +0 end up with the same hash */
+        value = 0;
+    }
+    for (i = 0; i < (int)sizeof(double); i++)
+    {
+        hash = BIN_HASH_COMBINE(hash, c[i]);
+    }
+
+    return hash;
+}
+
+/* Calculate the hash value of the combination of values of the given variables for the given sample.
+ * The hash is consistent with samples_are_equal().
+ */
+static unsigned long get_sample_hash(int num_variables, harp_variable **variable, long index)
+{
+    unsigned long hash = 0;
+    int k;
+
+    for (k = 0; k < num_variables; k++)
+    {
+        switch (variable[k]->data_type)
+        {
+            case harp_type_int8:
+                hash = BIN_HASH_COMBINE(hash, variable[k]->data.int8_data[index]);
+                break;
+            case harp_type_int16:
+                hash = BIN_HASH_COMBINE(hash, variable[k]->data.int16_data[index]);
+                break;
+            case harp_type_int32:
+                hash = BIN_HASH_COMBINE(hash, variable[k]->data.int32_data[index]);
+                break;
+            case harp_type_float:
+                hash = get_double_hash(hash, variable[k]->data.float_data[index]);
+                break;
+            case harp_type_double:
+                hash = get_double_hash(hash, variable[k]->data.double_data[index]);
+                break;
+            case harp_type_string:
+                if (variable[k]->data.string_data[index] == NULL)
+                {
+                    hash = BIN_HASH_COMBINE(hash, 0xFFFF);
+                }
+                else
+                {
+                    const unsigned char *c = (const unsigned char *)variable[k]->data.string_data[index];
+
+                    while (*c != '\0')
+                    {
+                        hash = BIN_HASH_COMBINE(hash, *c++);
+                    }
+                    hash = BIN_HASH_COMBINE(hash, 0);
+                }
+                break;
+        }
+    }
+
+    /* final mixing step, such that the lower bits (which are used for the table lookup) depend on all bits */
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3B;
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+/* Returns whether two samples have the same combination of values for the given variables.
+ * NaN values are considered equal to other NaN values (and different from any other value).
+ */
+static int samples_are_equal(int num_variables, harp_variable **variable, long index1, long index2)
+{
+    int k;
+
+    for (k = 0; k < num_variables; k++)
+    {
+        int equal = 1;
+
+        switch (variable[k]->data_type)
+        {
+            case harp_type_int8:
+                equal = variable[k]->data.int8_data[index1] == variable[k]->data.int8_data[index2];
+                break;
+            case harp_type_int16:
+                equal = variable[k]->data.int16_data[index1] == variable[k]->data.int16_data[index2];
+                break;
+            case harp_type_int32:
+                equal = variable[k]->data.int32_data[index1] == variable[k]->data.int32_data[index2];
+                break;
+            case harp_type_float:
+                if (harp_isnan(variable[k]->data.float_data[index2]))
+                {
+                    equal = harp_isnan(variable[k]->data.float_data[index1]);
+                }
+                else
+                {
+                    equal = variable[k]->data.float_data[index1] == variable[k]->data.float_data[index2];
+                }
+                break;
+            case harp_type_double:
+                if (harp_isnan(variable[k]->data.double_data[index2]))
+                {
+                    equal = harp_isnan(variable[k]->data.double_data[index1]);
+                }
+                else
+                {
+                    equal = variable[k]->data.double_data[index1] == variable[k]->data.double_data[index2];
+                }
+                break;
+            case harp_type_string:
+                if (variable[k]->data.string_data[index2] == NULL)
+                {
+                    equal = variable[k]->data.string_data[index1] == NULL;
+                }
+                else if (variable[k]->data.string_data[index1] == NULL)
+                {
+                    equal = 0;
+                }
+                else
+                {
+                    equal = strcmp(variable[k]->data.string_data[index1], variable[k]->data.string_data[index2]) == 0;
+                }
+                break;
+        }
+        if (!equal)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 /** Bin the product's variables such that all samples that have the same combination of values from the given variables
  * are averaged together.
  *
@@ -1422,11 +1583,13 @@ int harp_product_bin_with_variable(harp_product *product, int num_variables, con
 {
     harp_variable **variable = NULL;
     harp_variable **variable_copy = NULL;
-    int *check_nan = NULL;
+    unsigned long *bin_hash = NULL; /* contains hash value for each bin */
+    long *table = NULL; /* hash table with bin numbers (-1 for empty slots) */
     long *index = NULL; /* contains index of first sample for each bin */
     long *bin_index = NULL;
     long num_elements;
     long num_bins;
+    long table_size;
     long i, j, k;
 
     if (num_variables < 1)
@@ -1486,104 +1649,64 @@ int harp_product_bin_with_variable(harp_product *product, int num_variables, con
         goto error;
     }
 
-    check_nan = malloc(num_variables * sizeof(int));
-    if (check_nan == NULL)
+    /* the hash table size is a power of two that is at least twice the number of samples */
+    table_size = 1;
+    while (table_size < 2 * num_elements)
+    {
+        table_size *= 2;
+    }
+    table = malloc(table_size * sizeof(long));
+    if (table == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       table_size * sizeof(long), __FILE__, __LINE__);
+        goto error;
+    }
+    for (j = 0; j < table_size; j++)
+    {
+        table[j] = -1;
+    }
+    bin_hash = malloc(num_elements * sizeof(unsigned long));
+    if (bin_hash == NULL)
     {
         harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       num_variables * sizeof(int), __FILE__, __LINE__);
+                       num_elements * sizeof(unsigned long), __FILE__, __LINE__);
         goto error;
     }
 
+    /* assign samples to bins using a hash table (with linear probing) that maps value combinations to bins;
+     * bins are numbered in order of the first sample that falls in each bin */
     num_bins = 0;
     for (i = 0; i < num_elements; i++)
     {
-        for (k = 0; k < num_variables; k++)
-        {
-            check_nan[k] = 0;
-            if (variable[k]->data_type == harp_type_float)
-            {
-                check_nan[k] = harp_isnan(variable[k]->data.float_data[i]);
-            }
-            else if (variable[k]->data_type == harp_type_double)
-            {
-                check_nan[k] = harp_isnan(variable[k]->data.double_data[i]);
-            }
-        }
-        for (j = 0; j < num_bins; j++)
+        unsigned long hash = get_sample_hash(num_variables, variable, i);
+
+        j = hash & (table_size - 1);
+        while (table[j] >= 0)
         {
-            for (k = 0; k < num_variables; k++)
-            {
-                int equal = 1;
+            long bin = table[j];
 
-                switch (variable[k]->data_type)
-                {
-                    case harp_type_int8:
-                        equal = variable[k]->data.int8_data[index[j]] == variable[k]->data.int8_data[i];
-                        break;
-                    case harp_type_int16:
-                        equal = variable[k]->data.int16_data[index[j]] == variable[k]->data.int16_data[i];
-                        break;
-                    case harp_type_int32:
-                        equal = variable[k]->data.int32_data[index[j]] == variable[k]->data.int32_data[i];
-                        break;
-                    case harp_type_float:
-                        if (check_nan)
-                        {
-                            equal = harp_isnan(variable[k]->data.float_data[index[j]]);
-                        }
-                        else
-                        {
-                            equal = variable[k]->data.float_data[index[j]] == variable[k]->data.float_data[i];
-                        }
-                        break;
-                    case harp_type_double:
-                        if (check_nan)
-                        {
-                            equal = harp_isnan(variable[k]->data.double_data[index[j]]);
-                        }
-                        else
-                        {
-                            equal = variable[k]->data.double_data[index[j]] == variable[k]->data.double_data[i];
-                        }
-                        break;
-                    case harp_type_string:
-                        if (variable[k]->data.string_data[i] == NULL)
-                        {
-                            equal = variable[k]->data.string_data[index[j]] == NULL;
-                        }
-                        else if (variable[k]->data.string_data[index[j]] == NULL)
-                        {
-                            equal = 0;
-                        }
-                        else
-                        {
-                            equal = strcmp(variable[k]->data.string_data[index[j]],
-                                           variable[k]->data.string_data[i]) == 0;
-                        }
-                        break;
-                }
-                if (!equal)
-                {
-                    break;
-                }
-            }
-            if (k == num_variables)
+            if (bin_hash[bin] == hash && samples_are_equal(num_variables, variable, index[bin], i))
             {
-                /* equal bin */
                 break;
             }
+            j = (j + 1) & (table_size - 1);
         }
-        if (j == num_bins)
+        if (table[j] < 0)
         {
-            /* add new value to bin */
+            /* add new bin */
+            table[j] = num_bins;
             index[num_bins] = i;
+            bin_hash[num_bins] = hash;
             num_bins++;
         }
-        bin_index[i] = j;
+        bin_index[i] = table[j];
     }
 
-    free(check_nan);
-    check_nan = NULL;
+    free(bin_hash);
+    bin_hash = NULL;
+    free(table);
+    table = NULL;
 
     for (k = 0; k < num_variables; k++)
     {
@@ -1628,9 +1751,13 @@ int harp_product_bin_with_variable(harp_product *product, int num_variables, con
     return 0;
 
   error:
-    if (check_nan != NULL)
+    if (bin_hash != NULL)
+    {
+        free(bin_hash);
+    }
+    if (table != NULL)
     {
-        free(check_nan);
+        free(table);
     }
     if (index != NULL)
     {
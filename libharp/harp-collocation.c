@@ -33,9 +33,16 @@
 #include "harp-csv.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #define COLLOCATION_RESULT_BLOCK_SIZE 1024
 
@@ -46,74 +53,380 @@
  * (using the source product name and measurement index within that product) and a measurement from dataset B.
  * Each collocation pair also gets a unique collocation_index sequence number.
  * For each collocation criteria used in the matchup the actual difference is stored as part of the pair as well.
- * Collocation results can be written to and read from a csv file.
+ * Collocation results can be written to and read from a csv file or a (memory mappable) binary file.
  */
 
-static void collocation_pair_swap_datasets(harp_collocation_pair *pair)
+/* Number of pairs for which space is allocated in the columns of a collocation result with num_pairs pairs */
+static long get_num_allocated_pairs(long num_pairs)
 {
-    long index_a = pair->product_index_a;
-    long sample_a = pair->sample_index_a;
+    return ((num_pairs + COLLOCATION_RESULT_BLOCK_SIZE - 1) / COLLOCATION_RESULT_BLOCK_SIZE) *
+        COLLOCATION_RESULT_BLOCK_SIZE;
+}
+
+static int resize_long_column(long **column, long num_elements)
+{
+    long *new_column;
+
+    new_column = realloc(*column, num_elements * sizeof(long));
+    if (new_column == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_elements * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+    *column = new_column;
 
-    pair->product_index_a = pair->product_index_b;
-    pair->sample_index_a = pair->sample_index_b;
-    pair->product_index_b = index_a;
-    pair->sample_index_b = sample_a;
+    return 0;
 }
 
-static void collocation_pair_delete(harp_collocation_pair *pair)
+/* Make sure there is space for num_pairs pairs in the columns (this does not change collocation_result->num_pairs) */
+static int collocation_result_reserve(harp_collocation_result *collocation_result, long num_pairs)
 {
-    if (pair != NULL)
+    long num_allocated;
+
+    /* the columns always have space for get_num_allocated_pairs(collocation_result->num_pairs) pairs */
+    num_allocated = get_num_allocated_pairs(num_pairs);
+    if (num_allocated <= get_num_allocated_pairs(collocation_result->num_pairs) &&
+        collocation_result->collocation_index != NULL)
+    {
+        return 0;
+    }
+
+    if (resize_long_column(&collocation_result->collocation_index, num_allocated) != 0)
+    {
+        return -1;
+    }
+    if (resize_long_column(&collocation_result->product_index_a, num_allocated) != 0)
+    {
+        return -1;
+    }
+    if (resize_long_column(&collocation_result->sample_index_a, num_allocated) != 0)
+    {
+        return -1;
+    }
+    if (resize_long_column(&collocation_result->product_index_b, num_allocated) != 0)
+    {
+        return -1;
+    }
+    if (resize_long_column(&collocation_result->sample_index_b, num_allocated) != 0)
+    {
+        return -1;
+    }
+    if (collocation_result->num_differences > 0)
     {
-        if (pair->difference != NULL)
+        double *new_difference;
+
+        new_difference = realloc(collocation_result->difference,
+                                 num_allocated * collocation_result->num_differences * sizeof(double));
+        if (new_difference == NULL)
         {
-            free(pair->difference);
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_allocated * collocation_result->num_differences * sizeof(double), __FILE__, __LINE__);
+            return -1;
         }
+        collocation_result->difference = new_difference;
+    }
+
+    return 0;
+}
+
+static int collocation_result_append_pair(harp_collocation_result *collocation_result, long collocation_index,
+                                          long product_index_a, long sample_index_a, long product_index_b,
+                                          long sample_index_b, const double *difference)
+{
+    long index = collocation_result->num_pairs;
+    int i;
 
-        free(pair);
+    if (collocation_result_reserve(collocation_result, index + 1) != 0)
+    {
+        return -1;
+    }
+
+    collocation_result->collocation_index[index] = collocation_index;
+    collocation_result->product_index_a[index] = product_index_a;
+    collocation_result->sample_index_a[index] = sample_index_a;
+    collocation_result->product_index_b[index] = product_index_b;
+    collocation_result->sample_index_b[index] = sample_index_b;
+    for (i = 0; i < collocation_result->num_differences; i++)
+    {
+        collocation_result->difference[index * collocation_result->num_differences + i] = difference[i];
     }
+    collocation_result->num_pairs++;
+
+    return 0;
 }
 
-static int collocation_pair_new(long collocation_index, long product_index_a, long sample_index_a, long product_index_b,
-                                long sample_index_b, int num_differences, const double *difference,
-                                harp_collocation_pair **new_pair)
+/* Copy the pair at index 'from' to index 'to' */
+static void collocation_result_move_pair(harp_collocation_result *collocation_result, long to, long from)
 {
-    harp_collocation_pair *pair;
+    int num_differences = collocation_result->num_differences;
+    double *difference = collocation_result->difference;
     int i;
 
-    pair = (harp_collocation_pair *)malloc(sizeof(harp_collocation_pair));
-    if (pair == NULL)
+    collocation_result->collocation_index[to] = collocation_result->collocation_index[from];
+    collocation_result->product_index_a[to] = collocation_result->product_index_a[from];
+    collocation_result->sample_index_a[to] = collocation_result->sample_index_a[from];
+    collocation_result->product_index_b[to] = collocation_result->product_index_b[from];
+    collocation_result->sample_index_b[to] = collocation_result->sample_index_b[from];
+    for (i = 0; i < num_differences; i++)
+    {
+        difference[to * num_differences + i] = difference[from * num_differences + i];
+    }
+}
+
+static int gather_long_column(long **column, long num_elements, const long *index)
+{
+    long *new_column;
+    long i;
+
+    new_column = malloc(get_num_allocated_pairs(num_elements) * sizeof(long));
+    if (new_column == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       get_num_allocated_pairs(num_elements) * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+    for (i = 0; i < num_elements; i++)
+    {
+        new_column[i] = (*column)[index[i]];
+    }
+    free(*column);
+    *column = new_column;
+
+    return 0;
+}
+
+/* Replace the pairs by the pairs index[0..num_pairs-1] (in that order) */
+static int collocation_result_gather(harp_collocation_result *collocation_result, long num_pairs, const long *index)
+{
+    int num_differences = collocation_result->num_differences;
+
+    if (num_pairs == 0)
+    {
+        /* keep the allocated columns */
+        collocation_result->num_pairs = 0;
+        return 0;
+    }
+
+    /* gather one column at a time to limit the amount of additional memory */
+    if (gather_long_column(&collocation_result->collocation_index, num_pairs, index) != 0)
+    {
+        return -1;
+    }
+    if (gather_long_column(&collocation_result->product_index_a, num_pairs, index) != 0)
+    {
+        return -1;
+    }
+    if (gather_long_column(&collocation_result->sample_index_a, num_pairs, index) != 0)
+    {
+        return -1;
+    }
+    if (gather_long_column(&collocation_result->product_index_b, num_pairs, index) != 0)
+    {
+        return -1;
+    }
+    if (gather_long_column(&collocation_result->sample_index_b, num_pairs, index) != 0)
+    {
+        return -1;
+    }
+    if (num_differences > 0)
+    {
+        double *difference;
+        long i;
+        int j;
+
+        difference = malloc(get_num_allocated_pairs(num_pairs) * num_differences * sizeof(double));
+        if (difference == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           get_num_allocated_pairs(num_pairs) * num_differences * sizeof(double), __FILE__, __LINE__);
+            return -1;
+        }
+        for (i = 0; i < num_pairs; i++)
+        {
+            for (j = 0; j < num_differences; j++)
+            {
+                difference[i * num_differences + j] = collocation_result->difference[index[i] * num_differences + j];
+            }
+        }
+        free(collocation_result->difference);
+        collocation_result->difference = difference;
+    }
+    collocation_result->num_pairs = num_pairs;
+
+    return 0;
+}
+
+/* Stable LSD radix sort (8 bits per pass) of the permutation 'index' using key[index[i]] as sort key.
+ * 'buffer' should have the same size as 'index'.
+ */
+static void radix_sort_index(long num_elements, const long *key, long *index, long *buffer)
+{
+    unsigned long range;
+    long min_key, max_key;
+    long count[256];
+    long *source = index;
+    long *target = buffer;
+    int shift;
+    long i;
+
+    if (num_elements < 2)
+    {
+        return;
+    }
+
+    min_key = key[index[0]];
+    max_key = min_key;
+    for (i = 1; i < num_elements; i++)
+    {
+        if (key[index[i]] < min_key)
+        {
+            min_key = key[index[i]];
+        }
+        else if (key[index[i]] > max_key)
+        {
+            max_key = key[index[i]];
+        }
+    }
+    range = (unsigned long)max_key - (unsigned long)min_key;
+
+    /* only perform passes for the bytes that are used by the (offset) keys */
+    for (shift = 0; shift < (int)(8 * sizeof(long)) && (range >> shift) != 0; shift += 8)
+    {
+        long *swap;
+        long offset;
+        int k;
+
+        for (k = 0; k < 256; k++)
+        {
+            count[k] = 0;
+        }
+        for (i = 0; i < num_elements; i++)
+        {
+            count[(((unsigned long)key[source[i]] - (unsigned long)min_key) >> shift) & 0xff]++;
+        }
+        offset = 0;
+        for (k = 0; k < 256; k++)
+        {
+            long num = count[k];
+
+            count[k] = offset;
+            offset += num;
+        }
+        for (i = 0; i < num_elements; i++)
+        {
+            target[count[(((unsigned long)key[source[i]] - (unsigned long)min_key) >> shift) & 0xff]++] = source[i];
+        }
+        swap = source;
+        source = target;
+        target = swap;
+    }
+    if (source != index)
+    {
+        memcpy(index, source, num_elements * sizeof(long));
+    }
+}
+
+/* Sort the pairs on the given keys (key[0] is the most significant key).
+ * The keys are first checked in O(n) to see if the pairs are already sorted.
+ */
+static int collocation_result_sort(harp_collocation_result *collocation_result, int num_keys, const long **key)
+{
+    long num_pairs = collocation_result->num_pairs;
+    long *index;
+    long *buffer;
+    long i;
+    int k;
+
+    for (i = 1; i < num_pairs; i++)
+    {
+        for (k = 0; k < num_keys; k++)
+        {
+            if (key[k][i - 1] != key[k][i])
+            {
+                break;
+            }
+        }
+        if (k < num_keys && key[k][i - 1] > key[k][i])
+        {
+            break;
+        }
+    }
+    if (i >= num_pairs)
+    {
+        /* already sorted */
+        return 0;
+    }
+
+    index = malloc(num_pairs * sizeof(long));
+    if (index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_pairs * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+    buffer = malloc(num_pairs * sizeof(long));
+    if (buffer == NULL)
     {
         harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       sizeof(harp_collocation_pair), __FILE__, __LINE__);
+                       num_pairs * sizeof(long), __FILE__, __LINE__);
+        free(index);
         return -1;
     }
+    for (i = 0; i < num_pairs; i++)
+    {
+        index[i] = i;
+    }
 
-    pair->collocation_index = collocation_index;
+    /* sort from the least significant key to the most significant key (each sort is stable) */
+    for (k = num_keys - 1; k >= 0; k--)
+    {
+        radix_sort_index(num_pairs, key[k], index, buffer);
+    }
+    free(buffer);
 
-    pair->product_index_a = product_index_a;
-    pair->sample_index_a = sample_index_a;
+    if (collocation_result_gather(collocation_result, num_pairs, index) != 0)
+    {
+        free(index);
+        return -1;
+    }
+    free(index);
 
-    pair->product_index_b = product_index_b;
-    pair->sample_index_b = sample_index_b;
+    return 0;
+}
 
-    pair->num_differences = num_differences;
-    pair->difference = NULL;
+/* Create key[i] = rank of the source product of product_index[i] when sorting the source products by name */
+static int get_product_rank_key(const harp_dataset *dataset, long num_pairs, const long *product_index, long **key)
+{
+    long *rank;
+    long i;
 
-    pair->difference = malloc(num_differences * sizeof(double));
-    if (pair->difference == NULL)
+    rank = malloc((dataset->num_products > 0 ? dataset->num_products : 1) * sizeof(long));
+    if (rank == NULL)
     {
         harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       sizeof(harp_collocation_pair), __FILE__, __LINE__);
-        collocation_pair_delete(pair);
+                       dataset->num_products * sizeof(long), __FILE__, __LINE__);
         return -1;
     }
+    for (i = 0; i < dataset->num_products; i++)
+    {
+        rank[dataset->sorted_index[i]] = i;
+    }
 
-    for (i = 0; i < num_differences; i++)
+    *key = malloc((num_pairs > 0 ? num_pairs : 1) * sizeof(long));
+    if (*key == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_pairs * sizeof(long), __FILE__, __LINE__);
+        free(rank);
+        return -1;
+    }
+    for (i = 0; i < num_pairs; i++)
     {
-        pair->difference[i] = difference[i];
+        (*key)[i] = rank[product_index[i]];
     }
+    free(rank);
 
-    *new_pair = pair;
     return 0;
 }
 
@@ -151,7 +464,12 @@ LIBHARP_API int harp_collocation_result_new(harp_collocation_result **new_colloc
     collocation_result->difference_variable_name = NULL;
     collocation_result->difference_unit = NULL;
     collocation_result->num_pairs = 0;
-    collocation_result->pair = NULL;
+    collocation_result->collocation_index = NULL;
+    collocation_result->product_index_a = NULL;
+    collocation_result->sample_index_a = NULL;
+    collocation_result->product_index_b = NULL;
+    collocation_result->sample_index_b = NULL;
+    collocation_result->difference = NULL;
 
     if (harp_dataset_new(&collocation_result->dataset_a) != 0)
     {
@@ -190,6 +508,7 @@ LIBHARP_API int harp_collocation_result_new(harp_collocation_result **new_colloc
         {
             collocation_result->difference_unit[i] = NULL;
         }
+        collocation_result->num_differences = num_differences;
         if (difference_variable_name != NULL)
         {
             for (i = 0; i < num_differences; i++)
@@ -269,15 +588,29 @@ LIBHARP_API void harp_collocation_result_delete(harp_collocation_result *colloca
         free(collocation_result->difference_unit);
     }
 
-    if (collocation_result->pair)
+    if (collocation_result->collocation_index != NULL)
     {
-        long i;
-
-        for (i = 0; i < collocation_result->num_pairs; i++)
-        {
-            collocation_pair_delete(collocation_result->pair[i]);
-        }
-        free(collocation_result->pair);
+        free(collocation_result->collocation_index);
+    }
+    if (collocation_result->product_index_a != NULL)
+    {
+        free(collocation_result->product_index_a);
+    }
+    if (collocation_result->sample_index_a != NULL)
+    {
+        free(collocation_result->sample_index_a);
+    }
+    if (collocation_result->product_index_b != NULL)
+    {
+        free(collocation_result->product_index_b);
+    }
+    if (collocation_result->sample_index_b != NULL)
+    {
+        free(collocation_result->sample_index_b);
+    }
+    if (collocation_result->difference != NULL)
+    {
+        free(collocation_result->difference);
     }
 
     free(collocation_result);
@@ -293,6 +626,12 @@ int harp_collocation_result_add_difference(harp_collocation_result *collocation_
     char **new_string_array;
     int index;
 
+    if (collocation_result->num_pairs > 0)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "cannot add difference to collocation result that contains pairs");
+        return -1;
+    }
+
     new_string_array = realloc(collocation_result->difference_variable_name,
                                (collocation_result->num_differences + 1) * sizeof(char *));
     if (new_string_array == NULL)
@@ -325,160 +664,111 @@ int harp_collocation_result_add_difference(harp_collocation_result *collocation_
                        __FILE__, __LINE__);
         return -1;
     }
-    collocation_result->difference_unit[index] = strdup(difference_unit);
-    if (collocation_result->difference_unit[index] == NULL)
+    if (difference_unit != NULL)
     {
-        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)",
-                       __FILE__, __LINE__);
-        return -1;
+        collocation_result->difference_unit[index] = strdup(difference_unit);
+        if (collocation_result->difference_unit[index] == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)",
+                           __FILE__, __LINE__);
+            return -1;
+        }
     }
 
     return 0;
 }
 
-static harp_dataset *sort_dataset_a = NULL;
-static harp_dataset *sort_dataset_b = NULL;
+/** \addtogroup harp_collocation
+ * @{
+ */
 
-static int compare_by_a(const void *a, const void *b)
+/** Sort the collocation result pairs by dataset A
+ * Results will be sorted first by product index of A and then by sample index of A
+ * \param collocation_result Result set that will be sorted in place.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_collocation_result_sort_by_a(harp_collocation_result *collocation_result)
 {
-    harp_collocation_pair *pair_a = *(harp_collocation_pair **)a;
-    harp_collocation_pair *pair_b = *(harp_collocation_pair **)b;
+    const long *key[4];
+    long *product_key_a;
+    long *product_key_b;
+    int result;
 
-    if (pair_a->product_index_a != pair_b->product_index_a)
-    {
-        return strcmp(sort_dataset_a->source_product[pair_a->product_index_a],
-                      sort_dataset_a->source_product[pair_b->product_index_a]);
-    }
-    if (pair_a->sample_index_a < pair_b->sample_index_a)
+    /* products are ordered by source product name; if a is equal, then further sort by b to get a fixed ordering */
+    if (get_product_rank_key(collocation_result->dataset_a, collocation_result->num_pairs,
+                             collocation_result->product_index_a, &product_key_a) != 0)
     {
         return -1;
     }
-    if (pair_a->sample_index_a > pair_b->sample_index_a)
-    {
-        return 1;
-    }
-
-    /* If a is equal, then further sort by b to get a fixed ordering. */
-    if (pair_a->product_index_b != pair_b->product_index_b)
-    {
-        return strcmp(sort_dataset_b->source_product[pair_a->product_index_b],
-                      sort_dataset_b->source_product[pair_b->product_index_b]);
-    }
-    if (pair_a->sample_index_b < pair_b->sample_index_b)
+    if (get_product_rank_key(collocation_result->dataset_b, collocation_result->num_pairs,
+                             collocation_result->product_index_b, &product_key_b) != 0)
     {
+        free(product_key_a);
         return -1;
     }
-    if (pair_a->sample_index_b > pair_b->sample_index_b)
-    {
-        return 1;
-    }
+    key[0] = product_key_a;
+    key[1] = collocation_result->sample_index_a;
+    key[2] = product_key_b;
+    key[3] = collocation_result->sample_index_b;
+    result = collocation_result_sort(collocation_result, 4, key);
+    free(product_key_b);
+    free(product_key_a);
 
-    return 0;
+    return result;
 }
 
-static int compare_by_b(const void *a, const void *b)
+/** Sort the collocation result pairs by dataset B
+ * Results will be sorted first by product index of B and then by sample index of B
+ * \param collocation_result Result set that will be sorted in place.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_collocation_result_sort_by_b(harp_collocation_result *collocation_result)
 {
-    harp_collocation_pair *pair_a = *(harp_collocation_pair **)a;
-    harp_collocation_pair *pair_b = *(harp_collocation_pair **)b;
+    const long *key[4];
+    long *product_key_a;
+    long *product_key_b;
+    int result;
 
-    if (pair_a->product_index_b != pair_b->product_index_b)
-    {
-        return strcmp(sort_dataset_b->source_product[pair_a->product_index_b],
-                      sort_dataset_b->source_product[pair_b->product_index_b]);
-    }
-    if (pair_a->sample_index_b < pair_b->sample_index_b)
+    /* products are ordered by source product name; if b is equal, then further sort by a to get a fixed ordering */
+    if (get_product_rank_key(collocation_result->dataset_a, collocation_result->num_pairs,
+                             collocation_result->product_index_a, &product_key_a) != 0)
     {
         return -1;
     }
-    if (pair_a->sample_index_b > pair_b->sample_index_b)
-    {
-        return 1;
-    }
-
-    /* If b is equal, then further sort by a to get a fixed ordering. */
-    if (pair_a->product_index_a != pair_b->product_index_a)
-    {
-        return strcmp(sort_dataset_a->source_product[pair_a->product_index_a],
-                      sort_dataset_a->source_product[pair_b->product_index_a]);
-    }
-    if (pair_a->sample_index_a < pair_b->sample_index_a)
+    if (get_product_rank_key(collocation_result->dataset_b, collocation_result->num_pairs,
+                             collocation_result->product_index_b, &product_key_b) != 0)
     {
+        free(product_key_a);
         return -1;
     }
-    if (pair_a->sample_index_a > pair_b->sample_index_a)
-    {
-        return 1;
-    }
+    key[0] = product_key_b;
+    key[1] = collocation_result->sample_index_b;
+    key[2] = product_key_a;
+    key[3] = collocation_result->sample_index_a;
+    result = collocation_result_sort(collocation_result, 4, key);
+    free(product_key_b);
+    free(product_key_a);
 
-    return 0;
+    return result;
 }
 
-static int compare_by_collocation_index(const void *a, const void *b)
+/** Sort the collocation result pairs by collocation index
+ * \param collocation_result Result set that will be sorted in place.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_collocation_result_sort_by_collocation_index(harp_collocation_result *collocation_result)
 {
-    harp_collocation_pair *pair_a = *(harp_collocation_pair **)a;
-    harp_collocation_pair *pair_b = *(harp_collocation_pair **)b;
+    const long *key[1];
 
-    if (pair_a->collocation_index < pair_b->collocation_index)
-    {
-        return -1;
-    }
-    if (pair_a->collocation_index > pair_b->collocation_index)
-    {
-        return 1;
-    }
-
-    return 0;
-}
-
-/** \addtogroup harp_collocation
- * @{
- */
-
-/** Sort the collocation result pairs by dataset A
- * Results will be sorted first by product index of A and then by sample index of A
- * \param collocation_result Result set that will be sorted in place.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
- */
-LIBHARP_API int harp_collocation_result_sort_by_a(harp_collocation_result *collocation_result)
-{
-    sort_dataset_a = collocation_result->dataset_a;
-    sort_dataset_b = collocation_result->dataset_b;
-    qsort(collocation_result->pair, collocation_result->num_pairs, sizeof(harp_collocation_pair *), compare_by_a);
-    sort_dataset_a = NULL;
-    sort_dataset_b = NULL;
-    return 0;
-}
-
-/** Sort the collocation result pairs by dataset B
- * Results will be sorted first by product index of B and then by sample index of B
- * \param collocation_result Result set that will be sorted in place.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
- */
-LIBHARP_API int harp_collocation_result_sort_by_b(harp_collocation_result *collocation_result)
-{
-    sort_dataset_a = collocation_result->dataset_a;
-    sort_dataset_b = collocation_result->dataset_b;
-    qsort(collocation_result->pair, collocation_result->num_pairs, sizeof(harp_collocation_pair *), compare_by_b);
-    sort_dataset_a = NULL;
-    sort_dataset_b = NULL;
-    return 0;
-}
+    key[0] = collocation_result->collocation_index;
 
-/** Sort the collocation result pairs by collocation index
- * \param collocation_result Result set that will be sorted in place.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
- */
-LIBHARP_API int harp_collocation_result_sort_by_collocation_index(harp_collocation_result *collocation_result)
-{
-    qsort(collocation_result->pair, collocation_result->num_pairs, sizeof(harp_collocation_pair *),
-          compare_by_collocation_index);
-    return 0;
+    return collocation_result_sort(collocation_result, 1, key);
 }
 
 /** Filter collocation result set for a specific product from dataset A
@@ -493,24 +783,25 @@ LIBHARP_API int harp_collocation_result_filter_for_source_product_a(harp_colloca
                                                                     const char *source_product)
 {
     long product_index;
-    long i, j;
+    long num_pairs = 0;
+    long i;
 
     if (harp_dataset_get_index_from_source_product(collocation_result->dataset_a, source_product, &product_index) != 0)
     {
         return -1;
     }
-    for (i = collocation_result->num_pairs - 1; i >= 0; i--)
+    for (i = 0; i < collocation_result->num_pairs; i++)
     {
-        if (collocation_result->pair[i]->product_index_a != product_index)
+        if (collocation_result->product_index_a[i] == product_index)
         {
-            collocation_pair_delete(collocation_result->pair[i]);
-            for (j = i + 1; j < collocation_result->num_pairs; j++)
+            if (num_pairs != i)
             {
-                collocation_result->pair[j - 1] = collocation_result->pair[j];
+                collocation_result_move_pair(collocation_result, num_pairs, i);
             }
-            collocation_result->num_pairs--;
+            num_pairs++;
         }
     }
+    collocation_result->num_pairs = num_pairs;
     return 0;
 }
 
@@ -526,24 +817,25 @@ LIBHARP_API int harp_collocation_result_filter_for_source_product_b(harp_colloca
                                                                     const char *source_product)
 {
     long product_index;
-    long i, j;
+    long num_pairs = 0;
+    long i;
 
     if (harp_dataset_get_index_from_source_product(collocation_result->dataset_b, source_product, &product_index) != 0)
     {
         return -1;
     }
-    for (i = collocation_result->num_pairs - 1; i >= 0; i--)
+    for (i = 0; i < collocation_result->num_pairs; i++)
     {
-        if (collocation_result->pair[i]->product_index_b != product_index)
+        if (collocation_result->product_index_b[i] == product_index)
         {
-            collocation_pair_delete(collocation_result->pair[i]);
-            for (j = i + 1; j < collocation_result->num_pairs; j++)
+            if (num_pairs != i)
             {
-                collocation_result->pair[j - 1] = collocation_result->pair[j];
+                collocation_result_move_pair(collocation_result, num_pairs, i);
             }
-            collocation_result->num_pairs--;
+            num_pairs++;
         }
     }
+    collocation_result->num_pairs = num_pairs;
     return 0;
 }
 
@@ -567,14 +859,14 @@ static int find_collocation_pair_for_collocation_index(harp_collocation_result *
         long pivot_index = lower_index + ((upper_index - lower_index) / 2);
 
         /* If the pivot equals the key, terminate early. */
-        if (collocation_result->pair[pivot_index]->collocation_index == collocation_index)
+        if (collocation_result->collocation_index[pivot_index] == collocation_index)
         {
             *index = pivot_index;
             return 0;
         }
 
         /* If the pivot is smaller than the key, search the upper sub array, otherwise search the lower sub array. */
-        if (collocation_result->pair[pivot_index]->collocation_index < collocation_index)
+        if (collocation_result->collocation_index[pivot_index] < collocation_index)
         {
             lower_index = pivot_index + 1;
         }
@@ -606,8 +898,8 @@ static int find_collocation_pair_for_collocation_index(harp_collocation_result *
 LIBHARP_API int harp_collocation_result_filter_for_collocation_indices(harp_collocation_result *collocation_result,
                                                                        long num_indices, int32_t *collocation_index)
 {
-    harp_collocation_pair **pair = NULL;
-    long num_pairs = 0;
+    uint8_t *selected = NULL;
+    long *index = NULL;
     long i;
 
     if (harp_collocation_result_sort_by_collocation_index(collocation_result) != 0)
@@ -615,49 +907,72 @@ LIBHARP_API int harp_collocation_result_filter_for_collocation_indices(harp_coll
         return -1;
     }
 
-    /* create a temporary array to store all pairs */
-    pair = malloc(collocation_result->num_pairs * sizeof(harp_collocation_pair *));
-    if (!pair)
+    if (num_indices > 0)
     {
-        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       collocation_result->num_pairs * sizeof(harp_collocation_pair *), __FILE__, __LINE__);
-        return -1;
+        index = malloc(num_indices * sizeof(long));
+        if (index == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_indices * sizeof(long), __FILE__, __LINE__);
+            return -1;
+        }
+    }
+    if (collocation_result->num_pairs > 0)
+    {
+        selected = calloc(collocation_result->num_pairs, sizeof(uint8_t));
+        if (selected == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           collocation_result->num_pairs * sizeof(uint8_t), __FILE__, __LINE__);
+            if (index != NULL)
+            {
+                free(index);
+            }
+            return -1;
+        }
     }
 
     for (i = 0; i < num_indices; i++)
     {
-        long index;
-        long j;
-
-        if (find_collocation_pair_for_collocation_index(collocation_result, collocation_index[i], &index) != 0)
+        if (find_collocation_pair_for_collocation_index(collocation_result, collocation_index[i], &index[i]) != 0)
         {
             goto error;
         }
-        pair[num_pairs] = collocation_result->pair[index];
-        num_pairs++;
-        for (j = index + 1; j < collocation_result->num_pairs; j++)
+        /* each pair can only be selected once */
+        if (selected[index[i]])
         {
-            collocation_result->pair[j - 1] = collocation_result->pair[j];
+            harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "cannot find collocation index %d in collocation results",
+                           collocation_index[i]);
+            goto error;
         }
-        collocation_result->num_pairs--;
+        selected[index[i]] = 1;
     }
 
-    for (i = 0; i < collocation_result->num_pairs; i++)
+    if (collocation_result_gather(collocation_result, num_indices, index) != 0)
     {
-        collocation_pair_delete(collocation_result->pair[i]);
+        goto error;
+    }
+
+    if (selected != NULL)
+    {
+        free(selected);
+    }
+    if (index != NULL)
+    {
+        free(index);
     }
-    free(collocation_result->pair);
-    collocation_result->pair = pair;
-    collocation_result->num_pairs = num_pairs;
 
     return 0;
 
   error:
-    for (i = 0; i < num_pairs; i++)
+    if (selected != NULL)
+    {
+        free(selected);
+    }
+    if (index != NULL)
     {
-        collocation_pair_delete(pair[i]);
+        free(index);
     }
-    free(pair);
 
     return -1;
 }
@@ -682,7 +997,6 @@ LIBHARP_API int harp_collocation_result_add_pair(harp_collocation_result *colloc
                                                  const char *source_product_b, long index_b, int num_differences,
                                                  const double *difference)
 {
-    harp_collocation_pair *pair;
     long product_index_a, product_index_b;
 
     if (num_differences != collocation_result->num_differences)
@@ -713,32 +1027,40 @@ LIBHARP_API int harp_collocation_result_add_pair(harp_collocation_result *colloc
     {
         return -1;
     }
-    if (collocation_pair_new(collocation_index, product_index_a, index_a, product_index_b, index_b, num_differences,
-                             difference, &pair) != 0)
+
+    return collocation_result_append_pair(collocation_result, collocation_index, product_index_a, index_a,
+                                          product_index_b, index_b, difference);
+}
+
+/** Retrieve a collocation result entry from a result set
+ * The \a difference field of \a pair will point to the differences inside the collocation result (which are only
+ * valid as long as the collocation result is not modified).
+ * \param collocation_result Result set from which to retrieve the entry
+ * \param index Zero-based index in the collocation result set of the entry that should be retrieved
+ * \param pair Pointer to the C variable where the pair will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_collocation_result_get_pair(const harp_collocation_result *collocation_result, long index,
+                                                 harp_collocation_pair *pair)
+{
+    if (index < 0 || index >= collocation_result->num_pairs)
     {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "index (%ld) is not in the range of collocation results [0,%ld)",
+                       index, collocation_result->num_pairs);
         return -1;
     }
 
-    if (collocation_result->num_pairs % COLLOCATION_RESULT_BLOCK_SIZE == 0)
-    {
-        harp_collocation_pair **new_pair = NULL;
-
-        new_pair = realloc(collocation_result->pair, (collocation_result->num_pairs + COLLOCATION_RESULT_BLOCK_SIZE) *
-                           sizeof(harp_collocation_pair *));
-        if (new_pair == NULL)
-        {
-            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                           (long)(collocation_result->num_pairs + COLLOCATION_RESULT_BLOCK_SIZE) *
-                           sizeof(harp_collocation_pair *), __FILE__, __LINE__);
-            collocation_pair_delete(pair);
-            return -1;
-        }
-
-        collocation_result->pair = new_pair;
-    }
+    pair->collocation_index = collocation_result->collocation_index[index];
+    pair->product_index_a = collocation_result->product_index_a[index];
+    pair->sample_index_a = collocation_result->sample_index_a[index];
+    pair->product_index_b = collocation_result->product_index_b[index];
+    pair->sample_index_b = collocation_result->sample_index_b[index];
+    pair->num_differences = collocation_result->num_differences;
+    pair->difference = collocation_result->num_differences > 0 ?
+        &collocation_result->difference[index * collocation_result->num_differences] : NULL;
 
-    collocation_result->pair[collocation_result->num_pairs] = pair;
-    collocation_result->num_pairs++;
     return 0;
 }
 
@@ -760,16 +1082,47 @@ LIBHARP_API int harp_collocation_result_remove_pair_at_index(harp_collocation_re
         return -1;
     }
 
-    collocation_pair_delete(collocation_result->pair[index]);
     for (i = index + 1; i < collocation_result->num_pairs; i++)
     {
-        collocation_result->pair[i - 1] = collocation_result->pair[i];
+        collocation_result_move_pair(collocation_result, i - 1, i);
     }
     collocation_result->num_pairs--;
 
     return 0;
 }
 
+/** Remove all collocation result entries from a result set for which the mask value is zero
+ * The order of the remaining entries is preserved.
+ * This function is more efficient than repeated calls to harp_collocation_result_remove_pair_at_index() when many
+ * entries need to be removed.
+ * \param collocation_result Result set from which to remove the entries
+ * \param mask Array of length \a num_pairs with a non-zero value for each entry that should be kept
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_collocation_result_filter_with_mask(harp_collocation_result *collocation_result,
+                                                         const uint8_t *mask)
+{
+    long num_pairs = 0;
+    long i;
+
+    for (i = 0; i < collocation_result->num_pairs; i++)
+    {
+        if (mask[i])
+        {
+            if (num_pairs != i)
+            {
+                collocation_result_move_pair(collocation_result, num_pairs, i);
+            }
+            num_pairs++;
+        }
+    }
+    collocation_result->num_pairs = num_pairs;
+
+    return 0;
+}
+
 /**
  * @}
  */
@@ -998,169 +1351,1097 @@ static int read_pair(FILE *file, long min_collocation_index, long max_collocatio
     return 0;
 }
 
-int harp_collocation_result_read_range(const char *collocation_result_filename, long min_collocation_index,
-                                       long max_collocation_index, const char *source_product_a,
-                                       const char *source_product_b, harp_collocation_result **new_collocation_result)
+/* Binary collocation result format
+ *
+ * All integer and floating point values are stored in the byte order of the system that wrote the file (the
+ * byte_order field of the header is used to detect files that were written with a different byte order).
+ * The file starts with a header of BINARY_HEADER_SIZE bytes:
+ *   offset  0: char[8] magic ("HARPCOLB")
+ *   offset  8: int32 version (BINARY_VERSION)
+ *   offset 12: int32 byte_order (BINARY_BYTE_ORDER)
+ *   offset 16: int64 num_pairs
+ *   offset 24: int64 num_differences
+ *   offset 32: int64 num_products_a
+ *   offset 40: int64 num_products_b
+ *   offset 48: int64 string_table_size
+ *   offset 56: int64 footer_offset
+ * The header is followed by the string table, which contains the zero terminated variable name and unit of each
+ * difference (a unit is prefixed by '['; a missing unit is stored as an empty string), and then the zero terminated
+ * source product names of dataset A and of dataset B (in product index order).
+ * After padding to a multiple of 8 bytes the pairs follow, sorted by collocation_index and stored per column (each
+ * column has num_pairs values): int64 collocation_index, int64 product_index_a, int64 sample_index_a,
+ * int64 product_index_b, int64 sample_index_b, and a double column for each difference.
+ * The footer contains the int64 minimum and maximum collocation_index of all pairs, followed by an int64 minimum
+ * collocation_index, maximum collocation_index, and number of pairs for each product of dataset A and then for each
+ * product of dataset B (minimum and maximum are -1 for products without pairs).
+ */
+#define BINARY_MAGIC "HARPCOLB"
+#define BINARY_VERSION 1
+#define BINARY_BYTE_ORDER 0x01020304
+#define BINARY_HEADER_SIZE 64
+#define BINARY_NUM_INDEX_COLUMNS 5
+#define BINARY_WRITE_BLOCK_SIZE 1024
+
+typedef struct binary_file_struct
 {
-    harp_collocation_result *collocation_result = NULL;
-    FILE *file;
-    int result = 0;
+    const char *filename;
+    char *data;
+    int64_t size;
+    int is_mmap;
+    int swap;
+    int64_t num_pairs;
+    int64_t num_differences;
+    int64_t num_products_a;
+    int64_t num_products_b;
+    int64_t string_table_size;
+    int64_t column_offset;
+    int64_t footer_offset;
+} binary_file;
+
+static void swap8(void *value)
+{
+    char *v = (char *)value;
+    char tmp;
+    int i;
 
-    if (collocation_result_filename == NULL)
+    for (i = 0; i < 4; i++)
     {
-        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "collocation_result_filename is NULL");
-        return -1;
+        tmp = v[i];
+        v[i] = v[7 - i];
+        v[7 - i] = tmp;
     }
+}
 
-    /* Open the collocation result file */
-    file = fopen(collocation_result_filename, "r");
-    if (file == NULL)
-    {
-        harp_set_error(HARP_ERROR_FILE_OPEN, "error opening collocation result file '%s'", collocation_result_filename);
-        return -1;
-    }
+static int64_t binary_file_get_int64(const binary_file *file, int64_t offset)
+{
+    int64_t value;
 
-    /* Start new collocation result */
-    if (harp_collocation_result_new(&collocation_result, 0, NULL, NULL) != 0)
+    memcpy(&value, &file->data[offset], sizeof(int64_t));
+    if (file->swap)
     {
-        fclose(file);
-        return -1;
+        swap8(&value);
     }
 
-    /* Initialize the collocation result and update the collocation differences with the information in the header */
-    if (read_header(file, collocation_result) != 0)
-    {
-        harp_collocation_result_delete(collocation_result);
-        fclose(file);
-        return -1;
-    }
+    return value;
+}
 
-    /* Read the matching pairs */
-    while (result == 0)
-    {
-        result = read_pair(file, min_collocation_index, max_collocation_index, source_product_a, source_product_b,
-                           collocation_result);
-    }
-    if (result < 0)
+static double binary_file_get_double(const binary_file *file, int64_t offset)
+{
+    double value;
+
+    memcpy(&value, &file->data[offset], sizeof(double));
+    if (file->swap)
     {
-        harp_collocation_result_delete(collocation_result);
-        fclose(file);
-        return -1;
+        swap8(&value);
     }
 
-    /* Close the collocation result file */
-    fclose(file);
-
-    *new_collocation_result = collocation_result;
-    return 0;
+    return value;
 }
 
-/** \addtogroup harp_collocation
- * @{
- */
-
-/** Read collocation result set from a csv file
- * The csv file should follow the HARP format for collocation result files.
- * \param collocation_result_filename Full file path to the csv file.
- * \param new_collocation_result Pointer to the C variable where the new result set will be stored.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
- */
-LIBHARP_API int harp_collocation_result_read(const char *collocation_result_filename,
-                                             harp_collocation_result **new_collocation_result)
+/* offset of the value in the given column (0..4 are the index columns, followed by the difference columns) */
+static int64_t binary_file_get_offset(const binary_file *file, int64_t column, int64_t row)
 {
-    return harp_collocation_result_read_range(collocation_result_filename, -1, -1, NULL, NULL, new_collocation_result);
+    return file->column_offset + (column * file->num_pairs + row) * 8;
 }
 
-/**
- * @}
- */
-
-static void write_header(FILE *file, const harp_collocation_result *collocation_result)
+static void binary_file_close(binary_file *file)
 {
-    int i;
-
-    fprintf(file, "collocation_index,source_product_a,index_a,source_product_b,index_b");
-    for (i = 0; i < collocation_result->num_differences; i++)
+    if (file->data != NULL)
     {
-        fprintf(file, ",%s", collocation_result->difference_variable_name[i]);
-        if (collocation_result->difference_unit[i] != NULL)
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+        if (file->is_mmap)
         {
-            fprintf(file, " [%s]", collocation_result->difference_unit[i]);
+            munmap(file->data, (size_t)file->size);
+        }
+        else
+        {
+            free(file->data);
         }
+#else
+        free(file->data);
+#endif
+        file->data = NULL;
     }
-    fprintf(file, "\n");
 }
 
-static void write_pair(FILE *file, const harp_collocation_result *collocation_result, long index)
+static int binary_file_parse_header(binary_file *file)
 {
-    harp_collocation_pair *pair;
-    int i;
-
-    assert(collocation_result->pair != NULL);
-    assert(index >= 0 && index < collocation_result->num_pairs);
-    assert(collocation_result->pair[index] != NULL);
-
-    pair = collocation_result->pair[index];
+    int32_t byte_order;
+    int32_t version;
 
-    /* Write filenames and measurement indices */
-    fprintf(file, "%ld,%s,%ld,%s,%ld", pair->collocation_index,
-            collocation_result->dataset_a->source_product[pair->product_index_a], pair->sample_index_a,
-            collocation_result->dataset_b->source_product[pair->product_index_b], pair->sample_index_b);
-
-    /* Write differences */
-    for (i = 0; i < pair->num_differences; i++)
+    if (file->size < BINARY_HEADER_SIZE || memcmp(file->data, BINARY_MAGIC, 8) != 0)
+    {
+        harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid header in binary collocation result file '%s'",
+                       file->filename);
+        return -1;
+    }
+    memcpy(&version, &file->data[8], sizeof(int32_t));
+    memcpy(&byte_order, &file->data[12], sizeof(int32_t));
+    if (byte_order != BINARY_BYTE_ORDER)
     {
-        fprintf(file, ",%.8g", pair->difference[i]);
+        /* a swapped byte order marker means that all values need to be swapped */
+        if (byte_order != 0x04030201)
+        {
+            harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid byte order in binary collocation result file '%s'",
+                           file->filename);
+            return -1;
+        }
+        file->swap = 1;
+        version = (int32_t)((((uint32_t)version & 0xff) << 24) | (((uint32_t)version & 0xff00) << 8) |
+                            (((uint32_t)version >> 8) & 0xff00) | ((uint32_t)version >> 24));
+    }
+    if (version != BINARY_VERSION)
+    {
+        harp_set_error(HARP_ERROR_INVALID_FORMAT, "unsupported version (%d) of binary collocation result file '%s'",
+                       (int)version, file->filename);
+        return -1;
     }
-    fprintf(file, "\n");
-}
-
-/** \addtogroup harp_collocation
- * @{
- */
 
-/** Read collocation result set to a csv file
- * The csv file will follow the HARP format for collocation result files.
- * \param collocation_result_filename Full file path to the csv file.
- * \param collocation_result Collocation result set that will be written to file.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
- */
-LIBHARP_API int harp_collocation_result_write(const char *collocation_result_filename,
-                                              harp_collocation_result *collocation_result)
-{
-    FILE *file;
-    long i;
+    file->num_pairs = binary_file_get_int64(file, 16);
+    file->num_differences = binary_file_get_int64(file, 24);
+    file->num_products_a = binary_file_get_int64(file, 32);
+    file->num_products_b = binary_file_get_int64(file, 40);
+    file->string_table_size = binary_file_get_int64(file, 48);
+    file->footer_offset = binary_file_get_int64(file, 56);
 
-    if (collocation_result_filename == NULL)
+    /* verify that all sections fit exactly in the file (individual checks prevent overflow in the total sizes) */
+    if (file->num_pairs < 0 || file->num_pairs > file->size / 8 || file->num_differences < 0 ||
+        file->num_differences > file->size / 8 || file->num_products_a < 0 || file->num_products_a > file->size / 24 ||
+        file->num_products_b < 0 || file->num_products_b > file->size / 24 || file->string_table_size < 0 ||
+        file->string_table_size > file->size)
     {
-        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "collocation_result_filename is NULL");
+        harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid header in binary collocation result file '%s'",
+                       file->filename);
         return -1;
     }
-    if (collocation_result == NULL)
+    file->column_offset = BINARY_HEADER_SIZE + ((file->string_table_size + 7) / 8) * 8;
+    if (file->num_pairs > 0 && (BINARY_NUM_INDEX_COLUMNS + file->num_differences) > file->size / 8 / file->num_pairs)
     {
-        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "collocation_result is NULL");
+        harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid header in binary collocation result file '%s'",
+                       file->filename);
         return -1;
     }
-
-    /* Open the collocation result file */
-    file = fopen(collocation_result_filename, "w");
-    if (file == NULL)
+    if (file->footer_offset != binary_file_get_offset(file, BINARY_NUM_INDEX_COLUMNS + file->num_differences, 0) ||
+        file->size != file->footer_offset + 16 + 24 * (file->num_products_a + file->num_products_b))
     {
-        harp_set_error(HARP_ERROR_FILE_OPEN, "error opening collocation result file '%s'", collocation_result_filename);
+        harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid file size for binary collocation result file '%s'",
+                       file->filename);
         return -1;
     }
 
-    /* Write the header */
-    write_header(file, collocation_result);
+    return 0;
+}
 
-    /* Write the matching pairs */
-    for (i = 0; i < collocation_result->num_pairs; i++)
+static int binary_file_open(const char *filename, binary_file *file)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    struct stat statbuf;
+    int fd;
+#else
+    FILE *stream;
+    long size;
+#endif
+
+    file->filename = filename;
+    file->data = NULL;
+    file->size = 0;
+    file->is_mmap = 0;
+    file->swap = 0;
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        harp_set_error(HARP_ERROR_FILE_OPEN, "error opening collocation result file '%s' (%s)", filename,
+                       strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &statbuf) != 0)
     {
-        write_pair(file, collocation_result, i);
+        harp_set_error(HARP_ERROR_FILE_READ, "could not retrieve size of collocation result file '%s' (%s)",
+                       filename, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    file->size = (int64_t)statbuf.st_size;
+    if (file->size > 0)
+    {
+        void *data;
+
+        data = mmap(NULL, (size_t)file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            harp_set_error(HARP_ERROR_FILE_READ, "could not map collocation result file '%s' (%s)", filename,
+                           strerror(errno));
+            close(fd);
+            return -1;
+        }
+        file->data = (char *)data;
+        file->is_mmap = 1;
+    }
+    close(fd);
+#else
+    stream = fopen(filename, "rb");
+    if (stream == NULL)
+    {
+        harp_set_error(HARP_ERROR_FILE_OPEN, "error opening collocation result file '%s'", filename);
+        return -1;
+    }
+    if (fseek(stream, 0, SEEK_END) != 0 || (size = ftell(stream)) < 0 || fseek(stream, 0, SEEK_SET) != 0)
+    {
+        harp_set_error(HARP_ERROR_FILE_READ, "could not retrieve size of collocation result file '%s'", filename);
+        fclose(stream);
+        return -1;
+    }
+    file->size = size;
+    if (file->size > 0)
+    {
+        file->data = malloc((size_t)file->size);
+        if (file->data == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           (long)file->size, __FILE__, __LINE__);
+            fclose(stream);
+            return -1;
+        }
+        if (fread(file->data, (size_t)file->size, 1, stream) != 1)
+        {
+            harp_set_error(HARP_ERROR_FILE_READ, "error reading collocation result file '%s'", filename);
+            binary_file_close(file);
+            fclose(stream);
+            return -1;
+        }
+    }
+    fclose(stream);
+#endif
+
+    if (binary_file_parse_header(file) != 0)
+    {
+        binary_file_close(file);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Retrieve the next zero terminated string from the string table */
+static int binary_file_get_string(const binary_file *file, int64_t *offset, const char **str)
+{
+    int64_t end = BINARY_HEADER_SIZE + file->string_table_size;
+    int64_t length = 0;
+
+    while (*offset + length < end && file->data[*offset + length] != '\0')
+    {
+        length++;
+    }
+    if (*offset + length >= end)
+    {
+        harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid string table in binary collocation result file '%s'",
+                       file->filename);
+        return -1;
+    }
+    *str = &file->data[*offset];
+    *offset += length + 1;
+
+    return 0;
+}
+
+/* Narrow [min_collocation_index, max_collocation_index] to the range of the product from the footer.
+ * Sets product_index to -1 if the product does not occur in the file.
+ */
+static void binary_file_restrict_range_for_product(const binary_file *file, int64_t footer_offset,
+                                                   long num_products, const char **product_name,
+                                                   const char *source_product, long *product_index,
+                                                   long *min_collocation_index, long *max_collocation_index)
+{
+    long min_index, max_index;
+    long i;
+
+    *product_index = -1;
+    for (i = 0; i < num_products; i++)
+    {
+        if (strcmp(product_name[i], source_product) == 0)
+        {
+            break;
+        }
+    }
+    if (i == num_products || binary_file_get_int64(file, footer_offset + 24 * i + 16) == 0)
+    {
+        return;
+    }
+    *product_index = i;
+
+    min_index = (long)binary_file_get_int64(file, footer_offset + 24 * i);
+    max_index = (long)binary_file_get_int64(file, footer_offset + 24 * i + 8);
+    if (*min_collocation_index < min_index)
+    {
+        *min_collocation_index = min_index;
+    }
+    if (*max_collocation_index < 0 || *max_collocation_index > max_index)
+    {
+        *max_collocation_index = max_index;
+    }
+}
+
+/* Add the product from the file to the dataset (if needed) and return its index in the dataset */
+static int binary_file_map_product(harp_dataset *dataset, const char **product_name, long *product_index_map,
+                                   long file_product_index, long *product_index)
+{
+    if (product_index_map[file_product_index] < 0)
+    {
+        if (harp_dataset_add_product(dataset, product_name[file_product_index], NULL) != 0)
+        {
+            return -1;
+        }
+        if (harp_dataset_get_index_from_source_product(dataset, product_name[file_product_index],
+                                                       &product_index_map[file_product_index]) != 0)
+        {
+            return -1;
+        }
+    }
+    *product_index = product_index_map[file_product_index];
+
+    return 0;
+}
+
+static int read_binary_pairs(const binary_file *file, long min_collocation_index, long max_collocation_index,
+                             const char *source_product_a, const char *source_product_b,
+                             harp_collocation_result *collocation_result)
+{
+    const char **product_name = NULL;
+    long *product_index_map = NULL;
+    double *difference = NULL;
+    int64_t footer_offset = file->footer_offset;
+    int64_t offset = BINARY_HEADER_SIZE;
+    long num_products = (long)(file->num_products_a + file->num_products_b);
+    long product_index_a = -1;
+    long product_index_b = -1;
+    long previous_collocation_index;
+    long first, last;
+    long row;
+    long i;
+    int result = 0;
+
+    /* differences */
+    for (i = 0; i < file->num_differences; i++)
+    {
+        const char *variable_name;
+        const char *unit;
+
+        if (binary_file_get_string(file, &offset, &variable_name) != 0)
+        {
+            return -1;
+        }
+        if (binary_file_get_string(file, &offset, &unit) != 0)
+        {
+            return -1;
+        }
+        if (harp_collocation_result_add_difference(collocation_result, variable_name, unit[0] == '[' ? &unit[1] :
+                                                   NULL) != 0)
+        {
+            return -1;
+        }
+    }
+
+    if (file->num_pairs == 0)
+    {
+        return 0;
+    }
+
+    /* interned source product names of dataset A followed by those of dataset B */
+    if (num_products > 0)
+    {
+        product_name = malloc(num_products * sizeof(char *));
+        if (product_name == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_products * sizeof(char *), __FILE__, __LINE__);
+            return -1;
+        }
+        product_index_map = malloc(num_products * sizeof(long));
+        if (product_index_map == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_products * sizeof(long), __FILE__, __LINE__);
+            free(product_name);
+            return -1;
+        }
+        for (i = 0; i < num_products; i++)
+        {
+            if (binary_file_get_string(file, &offset, &product_name[i]) != 0)
+            {
+                free(product_index_map);
+                free(product_name);
+                return -1;
+            }
+            product_index_map[i] = -1;
+        }
+    }
+    if (collocation_result->num_differences > 0)
+    {
+        difference = malloc(collocation_result->num_differences * sizeof(double));
+        if (difference == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           collocation_result->num_differences * sizeof(double), __FILE__, __LINE__);
+            free(product_index_map);
+            free(product_name);
+            return -1;
+        }
+    }
+
+    /* use the footer to restrict the collocation index range to that of the requested products */
+    if (source_product_a != NULL)
+    {
+        binary_file_restrict_range_for_product(file, footer_offset + 16, (long)file->num_products_a, product_name,
+                                               source_product_a, &product_index_a, &min_collocation_index,
+                                               &max_collocation_index);
+    }
+    if (source_product_b != NULL && (source_product_a == NULL || product_index_a >= 0))
+    {
+        binary_file_restrict_range_for_product(file, footer_offset + 16 + 24 * file->num_products_a,
+                                               (long)file->num_products_b, &product_name[file->num_products_a],
+                                               source_product_b, &product_index_b, &min_collocation_index,
+                                               &max_collocation_index);
+    }
+    if ((source_product_a != NULL && product_index_a < 0) || (source_product_b != NULL && product_index_b < 0) ||
+        (min_collocation_index >= 0 && min_collocation_index > binary_file_get_int64(file, footer_offset + 8)) ||
+        (max_collocation_index >= 0 && max_collocation_index < binary_file_get_int64(file, footer_offset)) ||
+        (max_collocation_index >= 0 && max_collocation_index < min_collocation_index))
+    {
+        /* no pairs match */
+        if (difference != NULL)
+        {
+            free(difference);
+        }
+        free(product_index_map);
+        free(product_name);
+        return 0;
+    }
+
+    /* binary search for the first pair with a collocation_index >= min_collocation_index */
+    first = 0;
+    if (min_collocation_index >= 0)
+    {
+        last = (long)file->num_pairs;
+        while (first < last)
+        {
+            long middle = first + (last - first) / 2;
+
+            if (binary_file_get_int64(file, binary_file_get_offset(file, 0, middle)) < min_collocation_index)
+            {
+                first = middle + 1;
+            }
+            else
+            {
+                last = middle;
+            }
+        }
+    }
+
+    previous_collocation_index = -1;
+    for (row = first; row < file->num_pairs; row++)
+    {
+        long collocation_index;
+        long file_product_index_a, file_product_index_b;
+        long pair_product_index_a, pair_product_index_b;
+
+        collocation_index = (long)binary_file_get_int64(file, binary_file_get_offset(file, 0, row));
+        if (collocation_index < previous_collocation_index)
+        {
+            harp_set_error(HARP_ERROR_INVALID_FORMAT, "pairs in binary collocation result file '%s' are not sorted "
+                           "by collocation_index", file->filename);
+            result = -1;
+            break;
+        }
+        previous_collocation_index = collocation_index;
+        if (max_collocation_index >= 0 && collocation_index > max_collocation_index)
+        {
+            break;
+        }
+        file_product_index_a = (long)binary_file_get_int64(file, binary_file_get_offset(file, 1, row));
+        file_product_index_b = (long)binary_file_get_int64(file, binary_file_get_offset(file, 3, row));
+        if (file_product_index_a < 0 || file_product_index_a >= file->num_products_a || file_product_index_b < 0 ||
+            file_product_index_b >= file->num_products_b)
+        {
+            harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid product index for pair %ld in binary collocation "
+                           "result file '%s'", row, file->filename);
+            result = -1;
+            break;
+        }
+        if ((product_index_a >= 0 && file_product_index_a != product_index_a) ||
+            (product_index_b >= 0 && file_product_index_b != product_index_b))
+        {
+            continue;
+        }
+        file_product_index_b += (long)file->num_products_a;
+
+        if (binary_file_map_product(collocation_result->dataset_a, product_name, product_index_map,
+                                    file_product_index_a, &pair_product_index_a) != 0)
+        {
+            result = -1;
+            break;
+        }
+        if (binary_file_map_product(collocation_result->dataset_b, product_name, product_index_map,
+                                    file_product_index_b, &pair_product_index_b) != 0)
+        {
+            result = -1;
+            break;
+        }
+        for (i = 0; i < collocation_result->num_differences; i++)
+        {
+            difference[i] = binary_file_get_double(file, binary_file_get_offset(file, BINARY_NUM_INDEX_COLUMNS + i,
+                                                                                row));
+        }
+        if (collocation_result_append_pair(collocation_result, collocation_index, pair_product_index_a,
+                                           (long)binary_file_get_int64(file, binary_file_get_offset(file, 2, row)),
+                                           pair_product_index_b,
+                                           (long)binary_file_get_int64(file, binary_file_get_offset(file, 4, row)),
+                                           difference) != 0)
+        {
+            result = -1;
+            break;
+        }
+    }
+
+    if (difference != NULL)
+    {
+        free(difference);
+    }
+    free(product_index_map);
+    free(product_name);
+
+    return result;
+}
+
+static int read_binary(const char *collocation_result_filename, long min_collocation_index,
+                       long max_collocation_index, const char *source_product_a, const char *source_product_b,
+                       harp_collocation_result *collocation_result)
+{
+    binary_file file;
+
+    if (binary_file_open(collocation_result_filename, &file) != 0)
+    {
+        return -1;
+    }
+    if (read_binary_pairs(&file, min_collocation_index, max_collocation_index, source_product_a, source_product_b,
+                          collocation_result) != 0)
+    {
+        binary_file_close(&file);
+        return -1;
+    }
+    binary_file_close(&file);
+
+    return 0;
+}
+
+int harp_collocation_result_read_range(const char *collocation_result_filename, long min_collocation_index,
+                                       long max_collocation_index, const char *source_product_a,
+                                       const char *source_product_b, harp_collocation_result **new_collocation_result)
+{
+    harp_collocation_result *collocation_result = NULL;
+    char magic[8];
+    FILE *file;
+    int result = 0;
+
+    if (collocation_result_filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "collocation_result_filename is NULL");
+        return -1;
+    }
+
+    /* Open the collocation result file */
+    file = fopen(collocation_result_filename, "r");
+    if (file == NULL)
+    {
+        harp_set_error(HARP_ERROR_FILE_OPEN, "error opening collocation result file '%s'", collocation_result_filename);
+        return -1;
+    }
+
+    /* Start new collocation result */
+    if (harp_collocation_result_new(&collocation_result, 0, NULL, NULL) != 0)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    /* Check whether this is a binary collocation result file */
+    if (fread(magic, 8, 1, file) == 1 && memcmp(magic, BINARY_MAGIC, 8) == 0)
+    {
+        fclose(file);
+        if (read_binary(collocation_result_filename, min_collocation_index, max_collocation_index, source_product_a,
+                        source_product_b, collocation_result) != 0)
+        {
+            harp_collocation_result_delete(collocation_result);
+            return -1;
+        }
+        *new_collocation_result = collocation_result;
+        return 0;
+    }
+
+    /* Initialize the collocation result and update the collocation differences with the information in the header */
+    if (read_header(file, collocation_result) != 0)
+    {
+        harp_collocation_result_delete(collocation_result);
+        fclose(file);
+        return -1;
+    }
+
+    /* Read the matching pairs */
+    while (result == 0)
+    {
+        result = read_pair(file, min_collocation_index, max_collocation_index, source_product_a, source_product_b,
+                           collocation_result);
+    }
+    if (result < 0)
+    {
+        harp_collocation_result_delete(collocation_result);
+        fclose(file);
+        return -1;
+    }
+
+    /* Close the collocation result file */
+    fclose(file);
+
+    *new_collocation_result = collocation_result;
+    return 0;
+}
+
+/** \addtogroup harp_collocation
+ * @{
+ */
+
+/** Read collocation result set from a csv file
+ * The csv file should follow the HARP format for collocation result files.
+ * Binary collocation result files (as written by harp_collocation_result_write_binary()) are detected automatically.
+ * For these files the pairs will be sorted by collocation_index.
+ * \param collocation_result_filename Full file path to the csv or binary file.
+ * \param new_collocation_result Pointer to the C variable where the new result set will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_collocation_result_read(const char *collocation_result_filename,
+                                             harp_collocation_result **new_collocation_result)
+{
+    return harp_collocation_result_read_range(collocation_result_filename, -1, -1, NULL, NULL, new_collocation_result);
+}
+
+/**
+ * @}
+ */
+
+static void write_header(FILE *file, const harp_collocation_result *collocation_result)
+{
+    int i;
+
+    fprintf(file, "collocation_index,source_product_a,index_a,source_product_b,index_b");
+    for (i = 0; i < collocation_result->num_differences; i++)
+    {
+        fprintf(file, ",%s", collocation_result->difference_variable_name[i]);
+        if (collocation_result->difference_unit[i] != NULL)
+        {
+            fprintf(file, " [%s]", collocation_result->difference_unit[i]);
+        }
+    }
+    fprintf(file, "\n");
+}
+
+static void write_pair(FILE *file, const harp_collocation_result *collocation_result, long index)
+{
+    const double *difference;
+    int i;
+
+    assert(index >= 0 && index < collocation_result->num_pairs);
+
+    /* Write filenames and measurement indices */
+    fprintf(file, "%ld,%s,%ld,%s,%ld", collocation_result->collocation_index[index],
+            collocation_result->dataset_a->source_product[collocation_result->product_index_a[index]],
+            collocation_result->sample_index_a[index],
+            collocation_result->dataset_b->source_product[collocation_result->product_index_b[index]],
+            collocation_result->sample_index_b[index]);
+
+    /* Write differences */
+    difference = &collocation_result->difference[index * collocation_result->num_differences];
+    for (i = 0; i < collocation_result->num_differences; i++)
+    {
+        fprintf(file, ",%.8g", difference[i]);
+    }
+    fprintf(file, "\n");
+}
+
+static int binary_write(FILE *file, const char *filename, const void *data, size_t size)
+{
+    if (size > 0 && fwrite(data, size, 1, file) != 1)
+    {
+        harp_set_error(HARP_ERROR_FILE_WRITE, "error writing collocation result file '%s'", filename);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int binary_write_int64(FILE *file, const char *filename, int64_t value)
+{
+    return binary_write(file, filename, &value, sizeof(int64_t));
+}
+
+static int binary_write_string_table(FILE *file, const char *filename,
+                                     const harp_collocation_result *collocation_result)
+{
+    long i;
+
+    for (i = 0; i < collocation_result->num_differences; i++)
+    {
+        const char *variable_name = collocation_result->difference_variable_name[i];
+        const char *unit = collocation_result->difference_unit[i];
+
+        if (binary_write(file, filename, variable_name, strlen(variable_name) + 1) != 0)
+        {
+            return -1;
+        }
+        if (unit != NULL)
+        {
+            if (binary_write(file, filename, "[", 1) != 0)
+            {
+                return -1;
+            }
+            if (binary_write(file, filename, unit, strlen(unit) + 1) != 0)
+            {
+                return -1;
+            }
+        }
+        else if (binary_write(file, filename, "", 1) != 0)
+        {
+            return -1;
+        }
+    }
+    for (i = 0; i < collocation_result->dataset_a->num_products; i++)
+    {
+        const char *source_product = collocation_result->dataset_a->source_product[i];
+
+        if (binary_write(file, filename, source_product, strlen(source_product) + 1) != 0)
+        {
+            return -1;
+        }
+    }
+    for (i = 0; i < collocation_result->dataset_b->num_products; i++)
+    {
+        const char *source_product = collocation_result->dataset_b->source_product[i];
+
+        if (binary_write(file, filename, source_product, strlen(source_product) + 1) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Write column 'column' (0..4 are the index columns, followed by the difference columns) for all pairs in the
+ * order given by 'order'
+ */
+static int binary_write_column(FILE *file, const char *filename, const harp_collocation_result *collocation_result,
+                               const long *order, int column)
+{
+    union
+    {
+        int64_t int64_data[BINARY_WRITE_BLOCK_SIZE];
+        double double_data[BINARY_WRITE_BLOCK_SIZE];
+    } block;
+    const long *index_column = NULL;
+    long num_pairs = collocation_result->num_pairs;
+    long i;
+
+    switch (column)
+    {
+        case 0:
+            index_column = collocation_result->collocation_index;
+            break;
+        case 1:
+            index_column = collocation_result->product_index_a;
+            break;
+        case 2:
+            index_column = collocation_result->sample_index_a;
+            break;
+        case 3:
+            index_column = collocation_result->product_index_b;
+            break;
+        case 4:
+            index_column = collocation_result->sample_index_b;
+            break;
+        default:
+            break;
+    }
+
+    for (i = 0; i < num_pairs; i++)
+    {
+        long j = i % BINARY_WRITE_BLOCK_SIZE;
+
+        if (index_column != NULL)
+        {
+            block.int64_data[j] = index_column[order[i]];
+        }
+        else
+        {
+            block.double_data[j] = collocation_result->difference[order[i] * collocation_result->num_differences +
+                                                                  column - BINARY_NUM_INDEX_COLUMNS];
+        }
+        if (j == BINARY_WRITE_BLOCK_SIZE - 1 || i == num_pairs - 1)
+        {
+            if (binary_write(file, filename, &block, (j + 1) * 8) != 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Write the footer with the collocation_index range and number of pairs per product */
+static int binary_write_footer(FILE *file, const char *filename, const harp_collocation_result *collocation_result,
+                               const long *order)
+{
+    long num_products_a = collocation_result->dataset_a->num_products;
+    long num_products_b = collocation_result->dataset_b->num_products;
+    int64_t *product_info;
+    long num_products;
+    long i;
+
+    long num_pairs = collocation_result->num_pairs;
+
+    if (binary_write_int64(file, filename, num_pairs > 0 ? collocation_result->collocation_index[order[0]] : -1) != 0)
+    {
+        return -1;
+    }
+    if (binary_write_int64(file, filename, num_pairs > 0 ?
+                           collocation_result->collocation_index[order[num_pairs - 1]] : -1) != 0)
+    {
+        return -1;
+    }
+
+    num_products = num_products_a + num_products_b;
+    if (num_products == 0)
+    {
+        return 0;
+    }
+    product_info = malloc(3 * num_products * sizeof(int64_t));
+    if (product_info == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       3 * num_products * sizeof(int64_t), __FILE__, __LINE__);
+        return -1;
+    }
+    for (i = 0; i < num_products; i++)
+    {
+        product_info[3 * i] = -1;
+        product_info[3 * i + 1] = -1;
+        product_info[3 * i + 2] = 0;
+    }
+
+    /* pairs are sorted by collocation_index, so the first occurrence of a product gives its minimum */
+    for (i = 0; i < num_pairs; i++)
+    {
+        long index = order[i];
+        int64_t *info_a = &product_info[3 * collocation_result->product_index_a[index]];
+        int64_t *info_b = &product_info[3 * (num_products_a + collocation_result->product_index_b[index])];
+
+        if (info_a[2] == 0)
+        {
+            info_a[0] = collocation_result->collocation_index[index];
+        }
+        info_a[1] = collocation_result->collocation_index[index];
+        info_a[2]++;
+        if (info_b[2] == 0)
+        {
+            info_b[0] = collocation_result->collocation_index[index];
+        }
+        info_b[1] = collocation_result->collocation_index[index];
+        info_b[2]++;
+    }
+
+    if (binary_write(file, filename, product_info, 3 * num_products * sizeof(int64_t)) != 0)
+    {
+        free(product_info);
+        return -1;
+    }
+    free(product_info);
+
+    return 0;
+}
+
+static int write_binary(FILE *file, const char *filename, const harp_collocation_result *collocation_result)
+{
+    long num_pairs = collocation_result->num_pairs;
+    long *order = NULL;
+    int64_t string_table_size;
+    int64_t footer_offset;
+    int32_t value;
+    long num_columns;
+    long i;
+
+    /* the pairs are stored sorted by collocation_index (without changing the order in collocation_result) */
+    order = malloc((num_pairs > 0 ? num_pairs : 1) * sizeof(long));
+    if (order == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_pairs * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+    for (i = 0; i < num_pairs; i++)
+    {
+        order[i] = i;
+    }
+    for (i = 1; i < num_pairs; i++)
+    {
+        if (collocation_result->collocation_index[i] < collocation_result->collocation_index[i - 1])
+        {
+            break;
+        }
+    }
+    if (i < num_pairs)
+    {
+        long *buffer;
+
+        buffer = malloc(num_pairs * sizeof(long));
+        if (buffer == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_pairs * sizeof(long), __FILE__, __LINE__);
+            free(order);
+            return -1;
+        }
+        radix_sort_index(num_pairs, collocation_result->collocation_index, order, buffer);
+        free(buffer);
+    }
+
+    string_table_size = 0;
+    for (i = 0; i < collocation_result->num_differences; i++)
+    {
+        string_table_size += strlen(collocation_result->difference_variable_name[i]) + 2;
+        if (collocation_result->difference_unit[i] != NULL)
+        {
+            string_table_size += strlen(collocation_result->difference_unit[i]) + 1;
+        }
+    }
+    for (i = 0; i < collocation_result->dataset_a->num_products; i++)
+    {
+        string_table_size += strlen(collocation_result->dataset_a->source_product[i]) + 1;
+    }
+    for (i = 0; i < collocation_result->dataset_b->num_products; i++)
+    {
+        string_table_size += strlen(collocation_result->dataset_b->source_product[i]) + 1;
+    }
+    num_columns = BINARY_NUM_INDEX_COLUMNS + collocation_result->num_differences;
+    footer_offset = BINARY_HEADER_SIZE + ((string_table_size + 7) / 8) * 8 +
+        (int64_t)num_columns * collocation_result->num_pairs * 8;
+
+    /* header */
+    if (binary_write(file, filename, BINARY_MAGIC, 8) != 0)
+    {
+        goto error;
+    }
+    value = BINARY_VERSION;
+    if (binary_write(file, filename, &value, sizeof(int32_t)) != 0)
+    {
+        goto error;
+    }
+    value = BINARY_BYTE_ORDER;
+    if (binary_write(file, filename, &value, sizeof(int32_t)) != 0)
+    {
+        goto error;
+    }
+    if (binary_write_int64(file, filename, collocation_result->num_pairs) != 0 ||
+        binary_write_int64(file, filename, collocation_result->num_differences) != 0 ||
+        binary_write_int64(file, filename, collocation_result->dataset_a->num_products) != 0 ||
+        binary_write_int64(file, filename, collocation_result->dataset_b->num_products) != 0 ||
+        binary_write_int64(file, filename, string_table_size) != 0 ||
+        binary_write_int64(file, filename, footer_offset) != 0)
+    {
+        goto error;
+    }
+
+    /* string table (padded to a multiple of 8 bytes) */
+    if (binary_write_string_table(file, filename, collocation_result) != 0)
+    {
+        goto error;
+    }
+    if (string_table_size % 8 != 0)
+    {
+        if (binary_write(file, filename, "\0\0\0\0\0\0\0", (size_t)(8 - string_table_size % 8)) != 0)
+        {
+            goto error;
+        }
+    }
+
+    /* columns */
+    for (i = 0; i < num_columns; i++)
+    {
+        if (binary_write_column(file, filename, collocation_result, order, (int)i) != 0)
+        {
+            goto error;
+        }
+    }
+
+    if (binary_write_footer(file, filename, collocation_result, order) != 0)
+    {
+        goto error;
+    }
+
+    free(order);
+
+    return 0;
+
+  error:
+    free(order);
+    return -1;
+}
+
+/** \addtogroup harp_collocation
+ * @{
+ */
+
+/** Read collocation result set to a csv file
+ * The csv file will follow the HARP format for collocation result files.
+ * \param collocation_result_filename Full file path to the csv file.
+ * \param collocation_result Collocation result set that will be written to file.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_collocation_result_write(const char *collocation_result_filename,
+                                              harp_collocation_result *collocation_result)
+{
+    FILE *file;
+    long i;
+
+    if (collocation_result_filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "collocation_result_filename is NULL");
+        return -1;
+    }
+    if (collocation_result == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "collocation_result is NULL");
+        return -1;
+    }
+
+    /* Open the collocation result file */
+    file = fopen(collocation_result_filename, "w");
+    if (file == NULL)
+    {
+        harp_set_error(HARP_ERROR_FILE_OPEN, "error opening collocation result file '%s'", collocation_result_filename);
+        return -1;
+    }
+
+    /* Write the header */
+    write_header(file, collocation_result);
+
+    /* Write the matching pairs */
+    for (i = 0; i < collocation_result->num_pairs; i++)
+    {
+        write_pair(file, collocation_result, i);
     }
 
     /* Close the collocation result file */
@@ -1169,6 +2450,58 @@ LIBHARP_API int harp_collocation_result_write(const char *collocation_result_fil
     return 0;
 }
 
+/** Write collocation result set to a binary file
+ * The binary format stores the pairs column-wise, sorted by collocation_index, together with a table of the source
+ * products and a footer with the collocation_index range per source product. This allows
+ * harp_collocation_result_read() and the collocate_left/collocate_right operations to read only the pairs that are
+ * needed, and to memory map the file instead of parsing it.
+ * \param collocation_result_filename Full file path to the binary file.
+ * \param collocation_result Collocation result set that will be written to file.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_collocation_result_write_binary(const char *collocation_result_filename,
+                                                     harp_collocation_result *collocation_result)
+{
+    FILE *file;
+
+    if (collocation_result_filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "collocation_result_filename is NULL");
+        return -1;
+    }
+    if (collocation_result == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "collocation_result is NULL");
+        return -1;
+    }
+
+    /* Open the collocation result file */
+    file = fopen(collocation_result_filename, "wb");
+    if (file == NULL)
+    {
+        harp_set_error(HARP_ERROR_FILE_OPEN, "error opening collocation result file '%s'", collocation_result_filename);
+        return -1;
+    }
+
+    if (write_binary(file, collocation_result_filename, collocation_result) != 0)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    /* Close the collocation result file */
+    if (fclose(file) != 0)
+    {
+        harp_set_error(HARP_ERROR_FILE_CLOSE, "error closing collocation result file '%s'",
+                       collocation_result_filename);
+        return -1;
+    }
+
+    return 0;
+}
+
 /** Swap the columns of this collocation result inplace.
  *
  * This swaps datasets A and B (such that A becomes B and B becomes A).
@@ -1176,13 +2509,16 @@ LIBHARP_API int harp_collocation_result_write(const char *collocation_result_fil
  */
 LIBHARP_API void harp_collocation_result_swap_datasets(harp_collocation_result *collocation_result)
 {
-    long i;
     harp_dataset *data_a;
+    long *index_a;
 
-    for (i = 0; i < collocation_result->num_pairs; i++)
-    {
-        collocation_pair_swap_datasets(collocation_result->pair[i]);
-    }
+    index_a = collocation_result->product_index_a;
+    collocation_result->product_index_a = collocation_result->product_index_b;
+    collocation_result->product_index_b = index_a;
+
+    index_a = collocation_result->sample_index_a;
+    collocation_result->sample_index_a = collocation_result->sample_index_b;
+    collocation_result->sample_index_b = index_a;
 
     data_a = collocation_result->dataset_a;
 
@@ -1194,12 +2530,26 @@ LIBHARP_API void harp_collocation_result_swap_datasets(harp_collocation_result *
  * @}
  */
 
-/* Creates a shallow copy of a collocation result for filtering purposes */
+static int copy_long_column(const long *column, long num_elements, long **new_column)
+{
+    *new_column = malloc(get_num_allocated_pairs(num_elements) * sizeof(long));
+    if (*new_column == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       get_num_allocated_pairs(num_elements) * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+    memcpy(*new_column, column, num_elements * sizeof(long));
+
+    return 0;
+}
+
+/* Creates a shallow copy of a collocation result for filtering purposes (only the pairs are copied) */
 int harp_collocation_result_shallow_copy(const harp_collocation_result *collocation_result,
                                          harp_collocation_result **new_result)
 {
     harp_collocation_result *result = NULL;
-    long i;
+    long num_pairs = collocation_result->num_pairs;
 
     /* allocate memory for the result struct */
     result = (harp_collocation_result *)malloc(sizeof(harp_collocation_result));
@@ -1214,33 +2564,41 @@ int harp_collocation_result_shallow_copy(const harp_collocation_result *collocat
     result->num_differences = collocation_result->num_differences;
     result->difference_variable_name = collocation_result->difference_variable_name;
     result->difference_unit = collocation_result->difference_unit;
-    result->num_pairs = collocation_result->num_pairs;
-    result->pair = NULL;
-
-    result->pair = malloc(collocation_result->num_pairs * sizeof(harp_collocation_pair *));
-    if (result->pair == NULL)
-    {
-        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       collocation_result->num_pairs * sizeof(harp_collocation_pair *), __FILE__, __LINE__);
-        harp_collocation_result_shallow_delete(result);
-        return -1;
-    }
-    for (i = 0; i < collocation_result->num_pairs; i++)
-    {
-        result->pair[i] = NULL;
-    }
-
-    for (i = 0; i < collocation_result->num_pairs; i++)
-    {
-        harp_collocation_pair *pair = collocation_result->pair[i];
-
-        if (collocation_pair_new(pair->collocation_index, pair->product_index_a, pair->sample_index_a,
-                                 pair->product_index_b, pair->sample_index_b, pair->num_differences, pair->difference,
-                                 &result->pair[i]) != 0)
+    result->num_pairs = 0;
+    result->collocation_index = NULL;
+    result->product_index_a = NULL;
+    result->sample_index_a = NULL;
+    result->product_index_b = NULL;
+    result->sample_index_b = NULL;
+    result->difference = NULL;
+
+    if (num_pairs > 0)
+    {
+        if (copy_long_column(collocation_result->collocation_index, num_pairs, &result->collocation_index) != 0 ||
+            copy_long_column(collocation_result->product_index_a, num_pairs, &result->product_index_a) != 0 ||
+            copy_long_column(collocation_result->sample_index_a, num_pairs, &result->sample_index_a) != 0 ||
+            copy_long_column(collocation_result->product_index_b, num_pairs, &result->product_index_b) != 0 ||
+            copy_long_column(collocation_result->sample_index_b, num_pairs, &result->sample_index_b) != 0)
         {
             harp_collocation_result_shallow_delete(result);
             return -1;
         }
+        if (result->num_differences > 0)
+        {
+            size_t size = get_num_allocated_pairs(num_pairs) * result->num_differences * sizeof(double);
+
+            result->difference = malloc(size);
+            if (result->difference == NULL)
+            {
+                harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                               size, __FILE__, __LINE__);
+                harp_collocation_result_shallow_delete(result);
+                return -1;
+            }
+            memcpy(result->difference, collocation_result->difference,
+                   num_pairs * result->num_differences * sizeof(double));
+        }
+        result->num_pairs = num_pairs;
     }
 
     *new_result = result;
@@ -1252,16 +2610,29 @@ void harp_collocation_result_shallow_delete(harp_collocation_result *collocation
 {
     if (collocation_result != NULL)
     {
-        if (collocation_result->pair != NULL)
+        if (collocation_result->collocation_index != NULL)
         {
-            long i;
-
-            for (i = 0; i < collocation_result->num_pairs; i++)
-            {
-                collocation_pair_delete(collocation_result->pair[i]);
-            }
-
-            free(collocation_result->pair);
+            free(collocation_result->collocation_index);
+        }
+        if (collocation_result->product_index_a != NULL)
+        {
+            free(collocation_result->product_index_a);
+        }
+        if (collocation_result->sample_index_a != NULL)
+        {
+            free(collocation_result->sample_index_a);
+        }
+        if (collocation_result->product_index_b != NULL)
+        {
+            free(collocation_result->product_index_b);
+        }
+        if (collocation_result->sample_index_b != NULL)
+        {
+            free(collocation_result->sample_index_b);
+        }
+        if (collocation_result->difference != NULL)
+        {
+            free(collocation_result->difference);
         }
 
         free(collocation_result);
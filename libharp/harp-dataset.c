@@ -302,8 +302,929 @@ static int add_path_file(harp_dataset *dataset, const char *filename, const char
     return 0;
 }
 
+/* Persistent per-directory index of product metadata.
+ * The index is stored as a (hidden) file in each directory and contains for each product file the file size and
+ * modification time together with the product metadata, such that the metadata only has to be extracted again for
+ * files that are new or that have changed.
+ */
+#define DATASET_INDEX_FILENAME ".harp_dataset_index"
+#define DATASET_INDEX_HEADER "HARP_DATASET_INDEX,1"
+#define DATASET_INDEX_OPTIONS_PREFIX "options,"
+#define DATASET_INDEX_COLUMNS "filename,size,mtime,format,datetime_start,datetime_stop,time,latitude,longitude," \
+    "vertical,spectral,source_product"
+
+typedef struct dataset_index_entry_struct
+{
+    char *name; /* filename (without directory component) */
+    long size;
+    long mtime;
+    char *format;
+    double datetime_start;
+    double datetime_stop;
+    long dimension[HARP_NUM_DIM_TYPES];
+    char *source_product;
+    int used;   /* set if the file was found when scanning the directory */
+} dataset_index_entry;
+
+typedef struct dataset_index_struct
+{
+    hashtable *name_to_index;
+    long num_entries;
+    dataset_index_entry **entry;
+    int modified;       /* set if the index file needs to be (re)written */
+} dataset_index;
+
+static void dataset_index_entry_delete(dataset_index_entry *entry)
+{
+    if (entry != NULL)
+    {
+        if (entry->name != NULL)
+        {
+            free(entry->name);
+        }
+        if (entry->format != NULL)
+        {
+            free(entry->format);
+        }
+        if (entry->source_product != NULL)
+        {
+            free(entry->source_product);
+        }
+        free(entry);
+    }
+}
+
+static int dataset_index_entry_new(const char *name, dataset_index_entry **new_entry)
+{
+    dataset_index_entry *entry;
+    int i;
+
+    entry = (dataset_index_entry *)malloc(sizeof(dataset_index_entry));
+    if (entry == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(dataset_index_entry), __FILE__, __LINE__);
+        return -1;
+    }
+    entry->name = NULL;
+    entry->size = 0;
+    entry->mtime = 0;
+    entry->format = NULL;
+    entry->datetime_start = 0;
+    entry->datetime_stop = 0;
+    for (i = 0; i < HARP_NUM_DIM_TYPES; i++)
+    {
+        entry->dimension[i] = 0;
+    }
+    entry->source_product = NULL;
+    entry->used = 0;
+
+    entry->name = strdup(name);
+    if (entry->name == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        dataset_index_entry_delete(entry);
+        return -1;
+    }
+
+    *new_entry = entry;
+
+    return 0;
+}
+
+/* Store the metadata fields in the entry (replacing any previous values). */
+static int dataset_index_entry_set_metadata(dataset_index_entry *entry, const harp_product_metadata *metadata)
+{
+    char *format = NULL;
+    char *source_product;
+    int i;
+
+    if (metadata->format != NULL)
+    {
+        format = strdup(metadata->format);
+        if (format == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                           __LINE__);
+            return -1;
+        }
+    }
+    source_product = strdup(metadata->source_product);
+    if (source_product == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        if (format != NULL)
+        {
+            free(format);
+        }
+        return -1;
+    }
+
+    if (entry->format != NULL)
+    {
+        free(entry->format);
+    }
+    entry->format = format;
+    if (entry->source_product != NULL)
+    {
+        free(entry->source_product);
+    }
+    entry->source_product = source_product;
+    entry->datetime_start = metadata->datetime_start;
+    entry->datetime_stop = metadata->datetime_stop;
+    for (i = 0; i < HARP_NUM_DIM_TYPES; i++)
+    {
+        entry->dimension[i] = metadata->dimension[i];
+    }
+
+    return 0;
+}
+
+static int dataset_index_entry_get_metadata(const dataset_index_entry *entry, const char *filename,
+                                            harp_product_metadata **new_metadata)
+{
+    harp_product_metadata *metadata;
+    int i;
+
+    if (harp_product_metadata_new(&metadata) != 0)
+    {
+        return -1;
+    }
+    metadata->filename = strdup(filename);
+    if (metadata->filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        harp_product_metadata_delete(metadata);
+        return -1;
+    }
+    if (entry->format != NULL)
+    {
+        metadata->format = strdup(entry->format);
+        if (metadata->format == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                           __LINE__);
+            harp_product_metadata_delete(metadata);
+            return -1;
+        }
+    }
+    metadata->source_product = strdup(entry->source_product);
+    if (metadata->source_product == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        harp_product_metadata_delete(metadata);
+        return -1;
+    }
+    metadata->datetime_start = entry->datetime_start;
+    metadata->datetime_stop = entry->datetime_stop;
+    for (i = 0; i < HARP_NUM_DIM_TYPES; i++)
+    {
+        metadata->dimension[i] = entry->dimension[i];
+    }
+
+    *new_metadata = metadata;
+
+    return 0;
+}
+
+static void dataset_index_delete(dataset_index *index)
+{
+    if (index != NULL)
+    {
+        if (index->name_to_index != NULL)
+        {
+            hashtable_delete(index->name_to_index);
+        }
+        if (index->entry != NULL)
+        {
+            long i;
+
+            for (i = 0; i < index->num_entries; i++)
+            {
+                dataset_index_entry_delete(index->entry[i]);
+            }
+            free(index->entry);
+        }
+        free(index);
+    }
+}
+
+static int dataset_index_new(dataset_index **new_index)
+{
+    dataset_index *index;
+
+    index = (dataset_index *)malloc(sizeof(dataset_index));
+    if (index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(dataset_index), __FILE__, __LINE__);
+        return -1;
+    }
+    index->num_entries = 0;
+    index->entry = NULL;
+    index->modified = 0;
+
+    index->name_to_index = hashtable_new(1);
+    if (index->name_to_index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not create hashtable) (%s:%u)", __FILE__,
+                       __LINE__);
+        dataset_index_delete(index);
+        return -1;
+    }
+
+    *new_index = index;
+
+    return 0;
+}
+
+/* The index takes ownership of the entry. */
+static int dataset_index_add_entry(dataset_index *index, dataset_index_entry *entry)
+{
+    if (index->num_entries % BLOCK_SIZE == 0)
+    {
+        dataset_index_entry **new_entry;
+
+        new_entry = realloc(index->entry, (index->num_entries + BLOCK_SIZE) * sizeof(dataset_index_entry *));
+        if (new_entry == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           (index->num_entries + BLOCK_SIZE) * sizeof(dataset_index_entry *), __FILE__, __LINE__);
+            return -1;
+        }
+        index->entry = new_entry;
+    }
+    if (hashtable_add_name(index->name_to_index, entry->name) != 0)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "duplicate entry '%s' in dataset index", entry->name);
+        return -1;
+    }
+    index->entry[index->num_entries] = entry;
+    index->num_entries++;
+
+    return 0;
+}
+
+static int parse_dataset_index_line(char *line, dataset_index_entry **new_entry)
+{
+    dataset_index_entry *entry;
+    char *string;
+
+    if (harp_csv_parse_string(&line, &string) != 0)
+    {
+        return -1;
+    }
+    if (dataset_index_entry_new(string, &entry) != 0)
+    {
+        return -1;
+    }
+    if (harp_csv_parse_long(&line, &entry->size) != 0 || harp_csv_parse_long(&line, &entry->mtime) != 0)
+    {
+        dataset_index_entry_delete(entry);
+        return -1;
+    }
+    if (harp_csv_parse_string(&line, &string) != 0)
+    {
+        dataset_index_entry_delete(entry);
+        return -1;
+    }
+    if (string[0] != '\0')
+    {
+        entry->format = strdup(string);
+        if (entry->format == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                           __LINE__);
+            dataset_index_entry_delete(entry);
+            return -1;
+        }
+    }
+    if (harp_csv_parse_double(&line, &entry->datetime_start) != 0 ||
+        harp_csv_parse_double(&line, &entry->datetime_stop) != 0 ||
+        harp_csv_parse_long(&line, &entry->dimension[harp_dimension_time]) != 0 ||
+        harp_csv_parse_long(&line, &entry->dimension[harp_dimension_latitude]) != 0 ||
+        harp_csv_parse_long(&line, &entry->dimension[harp_dimension_longitude]) != 0 ||
+        harp_csv_parse_long(&line, &entry->dimension[harp_dimension_vertical]) != 0 ||
+        harp_csv_parse_long(&line, &entry->dimension[harp_dimension_spectral]) != 0)
+    {
+        dataset_index_entry_delete(entry);
+        return -1;
+    }
+    if (harp_csv_parse_string(&line, &string) != 0)
+    {
+        dataset_index_entry_delete(entry);
+        return -1;
+    }
+    entry->source_product = strdup(string);
+    if (entry->source_product == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        dataset_index_entry_delete(entry);
+        return -1;
+    }
+
+    *new_entry = entry;
+
+    return 0;
+}
+
+static int read_dataset_index_lines(dataset_index *index, FILE *stream, const char *options)
+{
+    char line[HARP_CSV_LINE_LENGTH + 1];
+    int line_number = 0;
+
+    while (fgets(line, HARP_CSV_LINE_LENGTH + 1, stream) != NULL)
+    {
+        dataset_index_entry *entry;
+        long length = (long)strlen(line);
+
+        /* Trim the line */
+        while (length > 0 && (line[length - 1] == '\r' || line[length - 1] == '\n'))
+        {
+            length--;
+        }
+        line[length] = '\0';
+        line_number++;
+
+        if (length == HARP_CSV_LINE_LENGTH)
+        {
+            harp_set_error(HARP_ERROR_INVALID_FORMAT, "line exceeds max line length (%ld)", HARP_CSV_LINE_LENGTH);
+            return -1;
+        }
+
+        switch (line_number)
+        {
+            case 1:
+                if (strcmp(line, DATASET_INDEX_HEADER) != 0)
+                {
+                    harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid header");
+                    return -1;
+                }
+                break;
+            case 2:
+                if (strncmp(line, DATASET_INDEX_OPTIONS_PREFIX, strlen(DATASET_INDEX_OPTIONS_PREFIX)) != 0 ||
+                    strcmp(&line[strlen(DATASET_INDEX_OPTIONS_PREFIX)], options) != 0)
+                {
+                    /* index was created using different ingestion options */
+                    harp_set_error(HARP_ERROR_INVALID_FORMAT, "options do not match");
+                    return -1;
+                }
+                break;
+            case 3:
+                if (strcmp(line, DATASET_INDEX_COLUMNS) != 0)
+                {
+                    harp_set_error(HARP_ERROR_INVALID_FORMAT, "invalid header");
+                    return -1;
+                }
+                break;
+            default:
+                if (parse_dataset_index_line(line, &entry) != 0)
+                {
+                    return -1;
+                }
+                if (dataset_index_add_entry(index, entry) != 0)
+                {
+                    dataset_index_entry_delete(entry);
+                    return -1;
+                }
+                break;
+        }
+    }
+
+    return 0;
+}
+
+/* Read the index of the directory. If there is no (valid) index, an empty index is returned. */
+static int read_dataset_index(const char *pathname, const char *options, dataset_index **new_index)
+{
+    dataset_index *index;
+    char *filename;
+    FILE *stream;
+
+    if (dataset_index_new(&index) != 0)
+    {
+        return -1;
+    }
+
+    filename = malloc(strlen(pathname) + 1 + strlen(DATASET_INDEX_FILENAME) + 1);
+    if (filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (long)strlen(pathname) + 1 + strlen(DATASET_INDEX_FILENAME) + 1, __FILE__, __LINE__);
+        dataset_index_delete(index);
+        return -1;
+    }
+    sprintf(filename, "%s/%s", pathname, DATASET_INDEX_FILENAME);
+
+    stream = fopen(filename, "r");
+    free(filename);
+    if (stream == NULL)
+    {
+        /* no index yet */
+        index->modified = 1;
+        *new_index = index;
+        return 0;
+    }
+
+    if (read_dataset_index_lines(index, stream, options) != 0)
+    {
+        /* ignore the content of an invalid or outdated index; it will be recreated */
+        fclose(stream);
+        dataset_index_delete(index);
+        if (dataset_index_new(&index) != 0)
+        {
+            return -1;
+        }
+        index->modified = 1;
+        *new_index = index;
+        return 0;
+    }
+    fclose(stream);
+
+    *new_index = index;
+
+    return 0;
+}
+
+static int can_store_in_dataset_index(const char *str)
+{
+    return strchr(str, ',') == NULL && strchr(str, '\n') == NULL && strchr(str, '\r') == NULL &&
+        strlen(str) < HARP_CSV_LINE_LENGTH / 4;
+}
+
+/* Write the index to a temporary file and move it in place (only entries for files that still exist are kept). */
+static int write_dataset_index(const dataset_index *index, const char *pathname, const char *options)
+{
+    char *filename;
+    char *tmp_filename;
+    FILE *stream;
+    long i;
+
+    filename = malloc(strlen(pathname) + 1 + strlen(DATASET_INDEX_FILENAME) + 1);
+    if (filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (long)strlen(pathname) + 1 + strlen(DATASET_INDEX_FILENAME) + 1, __FILE__, __LINE__);
+        return -1;
+    }
+    sprintf(filename, "%s/%s", pathname, DATASET_INDEX_FILENAME);
+    tmp_filename = malloc(strlen(filename) + 4 + 1);
+    if (tmp_filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (long)strlen(filename) + 4 + 1, __FILE__, __LINE__);
+        free(filename);
+        return -1;
+    }
+    sprintf(tmp_filename, "%s.tmp", filename);
+
+    stream = fopen(tmp_filename, "w");
+    if (stream == NULL)
+    {
+        harp_set_error(HARP_ERROR_FILE_OPEN, "could not create '%s' (%s)", tmp_filename, strerror(errno));
+        free(tmp_filename);
+        free(filename);
+        return -1;
+    }
+
+    fprintf(stream, "%s\n%s%s\n%s\n", DATASET_INDEX_HEADER, DATASET_INDEX_OPTIONS_PREFIX, options,
+            DATASET_INDEX_COLUMNS);
+    for (i = 0; i < index->num_entries; i++)
+    {
+        dataset_index_entry *entry = index->entry[i];
+
+        if (!entry->used)
+        {
+            continue;
+        }
+        fprintf(stream, "%s,%ld,%ld,%s,%.17g,%.17g,%ld,%ld,%ld,%ld,%ld,%s\n", entry->name, entry->size,
+                entry->mtime, entry->format == NULL ? "" : entry->format, entry->datetime_start,
+                entry->datetime_stop, entry->dimension[harp_dimension_time],
+                entry->dimension[harp_dimension_latitude], entry->dimension[harp_dimension_longitude],
+                entry->dimension[harp_dimension_vertical], entry->dimension[harp_dimension_spectral],
+                entry->source_product);
+    }
+
+    if (fclose(stream) != 0)
+    {
+        harp_set_error(HARP_ERROR_FILE_WRITE, "could not write '%s' (%s)", tmp_filename, strerror(errno));
+        remove(tmp_filename);
+        free(tmp_filename);
+        free(filename);
+        return -1;
+    }
+#ifdef WIN32
+    /* rename() on Windows does not replace an existing file */
+    remove(filename);
+#endif
+    if (rename(tmp_filename, filename) != 0)
+    {
+        harp_set_error(HARP_ERROR_FILE_WRITE, "could not rename '%s' (%s)", tmp_filename, strerror(errno));
+        remove(tmp_filename);
+        free(tmp_filename);
+        free(filename);
+        return -1;
+    }
+
+    free(tmp_filename);
+    free(filename);
+
+    return 0;
+}
+
+/* The files of a directory for which the metadata needs to be determined.
+ * The metadata of product files that are not in the directory index (or that have changed since the index was created)
+ * is read using multiple threads (see harp_parallel_for()).
+ */
+typedef struct directory_scan_struct
+{
+    const char *options;
+    long num_files;
+    char **filepath;
+    int *is_product_file;       /* 0 for hidden files, .pth files, directories, and other non-regular files */
+    long *size; /* file size of each product file */
+    long *mtime;        /* file modification time of each product file */
+    int *from_index;    /* set if the metadata was taken from the directory index */
+    harp_product_metadata **metadata;
+    int *error_code;    /* harp_errno for product files whose metadata could not be read */
+    char **error_message;
+} directory_scan;
+
+static void directory_scan_delete(directory_scan *scan)
+{
+    long i;
+
+    for (i = 0; i < scan->num_files; i++)
+    {
+        if (scan->filepath != NULL && scan->filepath[i] != NULL)
+        {
+            free(scan->filepath[i]);
+        }
+        if (scan->metadata != NULL && scan->metadata[i] != NULL)
+        {
+            harp_product_metadata_delete(scan->metadata[i]);
+        }
+        if (scan->error_message != NULL && scan->error_message[i] != NULL)
+        {
+            free(scan->error_message[i]);
+        }
+    }
+    if (scan->filepath != NULL)
+    {
+        free(scan->filepath);
+    }
+    if (scan->is_product_file != NULL)
+    {
+        free(scan->is_product_file);
+    }
+    if (scan->size != NULL)
+    {
+        free(scan->size);
+    }
+    if (scan->mtime != NULL)
+    {
+        free(scan->mtime);
+    }
+    if (scan->from_index != NULL)
+    {
+        free(scan->from_index);
+    }
+    if (scan->metadata != NULL)
+    {
+        free(scan->metadata);
+    }
+    if (scan->error_code != NULL)
+    {
+        free(scan->error_code);
+    }
+    if (scan->error_message != NULL)
+    {
+        free(scan->error_message);
+    }
+}
+
+static int directory_scan_init(directory_scan *scan, const char *pathname, long num_names, char **name,
+                               const char *options)
+{
+    long i;
+
+    scan->options = options;
+    scan->num_files = num_names;
+    scan->filepath = NULL;
+    scan->is_product_file = NULL;
+    scan->size = NULL;
+    scan->mtime = NULL;
+    scan->from_index = NULL;
+    scan->metadata = NULL;
+    scan->error_code = NULL;
+    scan->error_message = NULL;
+    if (num_names == 0)
+    {
+        return 0;
+    }
+
+    scan->filepath = calloc(num_names, sizeof(char *));
+    scan->is_product_file = calloc(num_names, sizeof(int));
+    scan->size = calloc(num_names, sizeof(long));
+    scan->mtime = calloc(num_names, sizeof(long));
+    scan->from_index = calloc(num_names, sizeof(int));
+    scan->metadata = calloc(num_names, sizeof(harp_product_metadata *));
+    scan->error_code = calloc(num_names, sizeof(int));
+    scan->error_message = calloc(num_names, sizeof(char *));
+    if (scan->filepath == NULL || scan->is_product_file == NULL || scan->size == NULL || scan->mtime == NULL ||
+        scan->from_index == NULL || scan->metadata == NULL || scan->error_code == NULL || scan->error_message == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate directory scan for %ld files) "
+                       "(%s:%u)", num_names, __FILE__, __LINE__);
+        return -1;
+    }
+
+    for (i = 0; i < num_names; i++)
+    {
+        struct stat statbuf;
+        long length = (long)strlen(name[i]);
+
+        /* Add path before filename */
+        scan->filepath[i] = malloc(strlen(pathname) + 1 + length + 1);
+        if (scan->filepath[i] == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           (long)strlen(pathname) + 1 + length + 1, __FILE__, __LINE__);
+            return -1;
+        }
+#ifdef WIN32
+        sprintf(scan->filepath[i], "%s\\%s", pathname, name[i]);
+#else
+        sprintf(scan->filepath[i], "%s/%s", pathname, name[i]);
+#endif
+
+        if (name[i][0] != '.' && !(length > 4 && strcmp(&name[i][length - 4], ".pth") == 0) &&
+            stat(scan->filepath[i], &statbuf) == 0 && (statbuf.st_mode & S_IFREG))
+        {
+            scan->is_product_file[i] = 1;
+            scan->size[i] = (long)statbuf.st_size;
+            scan->mtime[i] = (long)statbuf.st_mtime;
+        }
+    }
+
+    return 0;
+}
+
+/* Task for harp_parallel_for() that reads the metadata of a product file */
+static void directory_scan_read_metadata(void *context, long index)
+{
+    directory_scan *scan = (directory_scan *)context;
+
+    if (!scan->is_product_file[index] || scan->metadata[index] != NULL)
+    {
+        return;
+    }
+    if (harp_import_product_metadata(scan->filepath[index], scan->options, &scan->metadata[index]) != 0)
+    {
+        scan->metadata[index] = NULL;
+        scan->error_code[index] = harp_errno;
+        scan->error_message[index] = strdup(harp_errno_to_string(harp_errno));
+    }
+}
+
+/* Take the metadata of a product file from the directory index if the file has not changed since the index was
+ * created.
+ */
+static int get_metadata_from_index(dataset_index *index, directory_scan *scan, const char *name, long file_index)
+{
+    dataset_index_entry *entry;
+    long entry_index;
+
+    entry_index = hashtable_get_index_from_name(index->name_to_index, name);
+    if (entry_index < 0)
+    {
+        return 0;
+    }
+    entry = index->entry[entry_index];
+    if (entry->size == scan->size[file_index] && entry->mtime == scan->mtime[file_index])
+    {
+        if (dataset_index_entry_get_metadata(entry, scan->filepath[file_index], &scan->metadata[file_index]) != 0)
+        {
+            return -1;
+        }
+        scan->from_index[file_index] = 1;
+        entry->used = 1;
+    }
+
+    return 0;
+}
+
+/* Store the metadata of a new or changed product file in the directory index */
+static int update_index(dataset_index *index, const directory_scan *scan, const char *name, long file_index)
+{
+    const harp_product_metadata *metadata = scan->metadata[file_index];
+    dataset_index_entry *entry = NULL;
+    long entry_index;
+
+    index->modified = 1;
+    if (!can_store_in_dataset_index(name) || !can_store_in_dataset_index(metadata->source_product) ||
+        (metadata->format != NULL && !can_store_in_dataset_index(metadata->format)))
+    {
+        return 0;
+    }
+
+    entry_index = hashtable_get_index_from_name(index->name_to_index, name);
+    if (entry_index >= 0)
+    {
+        entry = index->entry[entry_index];
+    }
+    else
+    {
+        if (dataset_index_entry_new(name, &entry) != 0)
+        {
+            return -1;
+        }
+        if (dataset_index_add_entry(index, entry) != 0)
+        {
+            dataset_index_entry_delete(entry);
+            return -1;
+        }
+    }
+    entry->size = scan->size[file_index];
+    entry->mtime = scan->mtime[file_index];
+    if (dataset_index_entry_set_metadata(entry, metadata) != 0)
+    {
+        return -1;
+    }
+    entry->used = 1;
+
+    return 0;
+}
+
+static int add_directory_files(harp_dataset *dataset, const char *pathname, long num_names, char **name,
+                               const char *options)
+{
+    dataset_index *index = NULL;
+    directory_scan scan;
+    long work_size = 0;
+    long i;
+
+    if (harp_option_dataset_index)
+    {
+        if (options == NULL)
+        {
+            options = "";
+        }
+        if (read_dataset_index(pathname, options, &index) != 0)
+        {
+            return -1;
+        }
+    }
+
+    if (directory_scan_init(&scan, pathname, num_names, name, options) != 0)
+    {
+        directory_scan_delete(&scan);
+        dataset_index_delete(index);
+        return -1;
+    }
+
+    for (i = 0; i < scan.num_files; i++)
+    {
+        if (scan.is_product_file[i])
+        {
+            if (index != NULL)
+            {
+                if (get_metadata_from_index(index, &scan, name[i], i) != 0)
+                {
+                    directory_scan_delete(&scan);
+                    dataset_index_delete(index);
+                    return -1;
+                }
+            }
+            if (scan.metadata[i] == NULL)
+            {
+                work_size += scan.size[i];
+            }
+        }
+    }
+
+    /* read the metadata of all product files that were not taken from the index */
+    harp_parallel_for(scan.num_files, work_size, directory_scan_read_metadata, &scan);
+
+    /* add the products to the dataset in directory order (such that the last product with a given source_product
+     * value wins) and stop at the first file that could not be imported */
+    for (i = 0; i < scan.num_files; i++)
+    {
+        if (!scan.is_product_file[i])
+        {
+            if (harp_dataset_import(dataset, scan.filepath[i], options) != 0)
+            {
+                directory_scan_delete(&scan);
+                dataset_index_delete(index);
+                return -1;
+            }
+            continue;
+        }
+        if (scan.metadata[i] == NULL)
+        {
+            if (scan.error_message[i] != NULL)
+            {
+                harp_set_error(scan.error_code[i], "%s", scan.error_message[i]);
+            }
+            else
+            {
+                harp_set_error(scan.error_code[i], NULL);
+            }
+            directory_scan_delete(&scan);
+            dataset_index_delete(index);
+            return -1;
+        }
+        if (index != NULL && !scan.from_index[i])
+        {
+            if (update_index(index, &scan, name[i], i) != 0)
+            {
+                directory_scan_delete(&scan);
+                dataset_index_delete(index);
+                return -1;
+            }
+        }
+        if (harp_dataset_add_product(dataset, scan.metadata[i]->source_product, scan.metadata[i]) != 0)
+        {
+            directory_scan_delete(&scan);
+            dataset_index_delete(index);
+            return -1;
+        }
+        /* the dataset is now the owner of the metadata */
+        scan.metadata[i] = NULL;
+    }
+    directory_scan_delete(&scan);
+
+    if (index != NULL)
+    {
+        for (i = 0; i < index->num_entries; i++)
+        {
+            if (!index->entry[i]->used)
+            {
+                /* file was removed */
+                index->modified = 1;
+            }
+        }
+        if (index->modified)
+        {
+            /* the index is only a cache, so failing to write it (e.g. for a read-only directory) is not an error */
+            write_dataset_index(index, pathname, options);
+        }
+        dataset_index_delete(index);
+    }
+
+    return 0;
+}
+
+static void free_names(long num_names, char **name)
+{
+    long i;
+
+    if (name != NULL)
+    {
+        for (i = 0; i < num_names; i++)
+        {
+            free(name[i]);
+        }
+        free(name);
+    }
+}
+
+static int add_name(long *num_names, char ***name, const char *new_name)
+{
+    if (*num_names % BLOCK_SIZE == 0)
+    {
+        char **new_name_list;
+
+        new_name_list = realloc(*name, (*num_names + BLOCK_SIZE) * sizeof(char *));
+        if (new_name_list == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           (*num_names + BLOCK_SIZE) * sizeof(char *), __FILE__, __LINE__);
+            return -1;
+        }
+        *name = new_name_list;
+    }
+    (*name)[*num_names] = strdup(new_name);
+    if ((*name)[*num_names] == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        return -1;
+    }
+    (*num_names)++;
+
+    return 0;
+}
+
 static int add_directory(harp_dataset *dataset, const char *pathname, const char *options)
 {
+    char **name = NULL;
+    long num_names = 0;
 #ifdef WIN32
     WIN32_FIND_DATA FileData;
     HANDLE hSearch;
@@ -337,24 +1258,12 @@ static int add_directory(harp_dataset *dataset, const char *pathname, const char
     {
         if (!(FileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
         {
-            char *filepath;
-
-            filepath = malloc(strlen(pathname) + 1 + strlen(FileData.cFileName) + 1);
-            if (filepath == NULL)
-            {
-                harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                               (long)strlen(pathname) + 1 + strlen(FileData.cFileName) + 1, __FILE__, __LINE__);
-                FindClose(hSearch);
-                return -1;
-            }
-            sprintf(filepath, "%s\\%s", pathname, FileData.cFileName);
-            if (harp_dataset_import(dataset, filepath, options) != 0)
+            if (add_name(&num_names, &name, FileData.cFileName) != 0)
             {
-                free(filepath);
+                free_names(num_names, name);
                 FindClose(hSearch);
                 return -1;
             }
-            free(filepath);
         }
 
         if (!FindNextFile(hSearch, &FileData))
@@ -366,6 +1275,7 @@ static int add_directory(harp_dataset *dataset, const char *pathname, const char
             else
             {
                 harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "could not retrieve directory entry");
+                free_names(num_names, name);
                 FindClose(hSearch);
                 return -1;
             }
@@ -385,40 +1295,35 @@ static int add_directory(harp_dataset *dataset, const char *pathname, const char
         return -1;
     }
 
-    /* Walk through files in directory and add filenames to dataset */
+    /* Walk through files in directory and collect the filenames */
     while ((dp = readdir(dirp)) != NULL)
     {
-        char *filepath = NULL;
-
         /* Skip '.' and '..' */
         if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
         {
             continue;
         }
 
-        /* Add path before filename */
-        filepath = malloc(strlen(pathname) + 1 + strlen(dp->d_name) + 1);
-        if (filepath == NULL)
-        {
-            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                           (long)strlen(pathname) + 1 + strlen(dp->d_name) + 1, __FILE__, __LINE__);
-            closedir(dirp);
-            return -1;
-        }
-        sprintf(filepath, "%s/%s", pathname, dp->d_name);
-
-        if (harp_dataset_import(dataset, filepath, options) != 0)
+        if (add_name(&num_names, &name, dp->d_name) != 0)
         {
-            free(filepath);
+            free_names(num_names, name);
             closedir(dirp);
             return -1;
         }
-        free(filepath);
     }
 
     closedir(dirp);
 #endif
 
+    /* add files to dataset */
+    if (add_directory_files(dataset, pathname, num_names, name, options) != 0)
+    {
+        free_names(num_names, name);
+        return -1;
+    }
+
+    free_names(num_names, name);
+
     return 0;
 }
 
@@ -758,11 +1663,11 @@ LIBHARP_API int harp_dataset_add_product(harp_dataset *dataset, const char *sour
 
 /** @} */
 
-static harp_dataset *sort_dataset = NULL;
-
-static int compare_source_product(const void *a, const void *b)
+static int compare_source_product(const void *context, long index_a, long index_b)
 {
-    return strcmp(sort_dataset->source_product[*(long *)a], sort_dataset->source_product[*(long *)b]);
+    const harp_dataset *dataset = (const harp_dataset *)context;
+
+    return strcmp(dataset->source_product[index_a], dataset->source_product[index_b]);
 }
 
 int harp_dataset_filter(harp_dataset *dataset, uint8_t *mask)
@@ -807,8 +1712,10 @@ int harp_dataset_filter(harp_dataset *dataset, uint8_t *mask)
     dataset->num_products = new_num_products;
 
     /* resort sorted_index */
-    sort_dataset = dataset;
-    qsort(dataset->sorted_index, dataset->num_products, sizeof(long), compare_source_product);
+    if (harp_index_sort(dataset->num_products, dataset->sorted_index, compare_source_product, dataset) != 0)
+    {
+        return -1;
+    }
 
     /* rebuild hashtable */
     hashtable_delete(dataset->product_to_index);
@@ -8287,6 +8287,8 @@ void harp_derived_variable_list_done(void)
 {
     if (harp_derived_variable_conversions != NULL)
     {
+        /* cached conversion plans refer to the conversions in the list */
+        harp_derived_variable_clear_conversion_plans();
         if (harp_derived_variable_conversions->hash_data != NULL)
         {
             hashtable_delete(harp_derived_variable_conversions->hash_data);
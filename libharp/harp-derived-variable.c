@@ -50,10 +50,57 @@ typedef struct conversion_info_struct
     int depth;
     int max_depth;
     harp_variable *variable;
+    harp_derived_variable_cache *cache;  /* (optional) cache of intermediate variables */
+    long plan_parent;   /* plan of the conversion that needs this variable (-1: top level, -2: don't use plans) */
+    long plan_generation;       /* generation of the plan cache that plan_parent refers to */
+    long plan_index;    /* plan for this variable (set by find_and_execute_conversion(); -2 if not available) */
 } conversion_info;
 
+/* maximum number of conversion plans that are kept; the plan cache is emptied when this number is reached */
+#define MAX_NUM_CONVERSION_PLANS 4096
+
+/* The conversion plan cache stores the result of the search for the best conversion of a variable.
+ * For a top level variable the plan is keyed on the name and dimensions of the variable that is to be derived and on
+ * the signature of the product (the names/dimensions of all its variables and the options that enable conversions).
+ * For a source variable of a conversion, the plan is keyed on the plan of the conversion that needs it (which defines
+ * the chain of variables that is being derived) and the name and dimensions of the source variable.
+ */
+typedef struct conversion_plan_cache_struct
+{
+    hashtable *hash_data;
+    long num_plans;
+    char **key;
+    harp_variable_conversion **conversion;      /* best conversion (NULL if the variable can not be derived) */
+    long generation;    /* increased each time the cache is emptied */
+} conversion_plan_cache;
+
+static conversion_plan_cache plan_cache = { NULL, 0, NULL, NULL, 0 };
+
+struct harp_derived_variable_cache_struct
+{
+    hashtable *hash_data;
+    int num_variables;
+    char **key;
+    harp_variable **variable;
+};
+
 static int find_and_execute_conversion(conversion_info *info);
 
+/* The conversion list is published before it is fully populated, so the NULL check needs to happen under the lock */
+static int derived_variable_list_init(void)
+{
+    int result = 0;
+
+    harp_lock(harp_lock_init);
+    if (harp_derived_variable_conversions == NULL)
+    {
+        result = harp_derived_variable_list_init();
+    }
+    harp_unlock(harp_lock_init);
+
+    return result;
+}
+
 static void set_variable_not_found_error(conversion_info *info)
 {
     int i;
@@ -160,6 +207,10 @@ static int conversion_info_init(conversion_info *info, const harp_product *produ
     info->depth = 0;
     info->max_depth = 10;
     info->variable = NULL;
+    info->cache = NULL;
+    info->plan_parent = -2;
+    info->plan_generation = 0;
+    info->plan_index = -2;
 
     info->skip = malloc(harp_derived_variable_conversions->num_variables);
     if (info->skip == NULL)
@@ -228,6 +279,363 @@ static void conversion_info_done(conversion_info *info)
     }
 }
 
+static void plan_cache_clear(void)
+{
+    long i;
+
+    if (plan_cache.hash_data != NULL)
+    {
+        hashtable_delete(plan_cache.hash_data);
+        plan_cache.hash_data = NULL;
+    }
+    for (i = 0; i < plan_cache.num_plans; i++)
+    {
+        free(plan_cache.key[i]);
+    }
+    plan_cache.num_plans = 0;
+    plan_cache.generation++;
+}
+
+void harp_derived_variable_clear_conversion_plans(void)
+{
+    harp_lock(harp_lock_conversion_plans);
+    plan_cache_clear();
+    if (plan_cache.key != NULL)
+    {
+        free(plan_cache.key);
+        plan_cache.key = NULL;
+    }
+    if (plan_cache.conversion != NULL)
+    {
+        free(plan_cache.conversion);
+        plan_cache.conversion = NULL;
+    }
+    harp_unlock(harp_lock_conversion_plans);
+}
+
+/* Returns the key for the plan of the variable in info (or NULL if the plan cache should not be used).
+ * Sets *skip to 1 if the plan cache should not be used.
+ */
+static char *get_plan_key(const conversion_info *info, int *skip)
+{
+    const harp_product *product = info->product;
+    size_t length;
+    char *key;
+    char *ptr;
+    int i;
+
+    *skip = 0;
+    if (info->plan_parent == -2)
+    {
+        *skip = 1;
+        return NULL;
+    }
+
+    if (info->plan_parent >= 0)
+    {
+        key = malloc(32 + HARP_MAX_NUM_DIMS + strlen(info->variable_name) + 1);
+        if (key == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           32 + HARP_MAX_NUM_DIMS + strlen(info->variable_name) + 1, __FILE__, __LINE__);
+            return NULL;
+        }
+        sprintf(key, "#%ld\n%s", info->plan_parent, info->dimsvar_name);
+        return key;
+    }
+
+    /* the options are part of the key since they determine which conversions are enabled */
+    length = 32 + HARP_MAX_NUM_DIMS + strlen(info->variable_name) + 1;
+    for (i = 0; i < product->num_variables; i++)
+    {
+        length += HARP_MAX_NUM_DIMS + strlen(product->variable[i]->name) + 21 * product->variable[i]->num_dimensions +
+            1;
+    }
+    key = malloc(length);
+    if (key == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)", length,
+                       __FILE__, __LINE__);
+        return NULL;
+    }
+    ptr = key;
+    ptr += sprintf(ptr, "%d%d%s\n", harp_get_option_enable_aux_afgl86(), harp_get_option_enable_aux_usstd76(),
+                   info->dimsvar_name);
+    for (i = 0; i < product->num_variables; i++)
+    {
+        const harp_variable *variable = product->variable[i];
+        char *dimsvar_name;
+        int j;
+
+        dimsvar_name = get_dimsvar_name(variable->name, variable->num_dimensions, variable->dimension_type);
+        if (dimsvar_name == NULL)
+        {
+            free(key);
+            return NULL;
+        }
+        strcpy(ptr, dimsvar_name);
+        ptr += strlen(dimsvar_name);
+        free(dimsvar_name);
+        for (j = 0; j < variable->num_dimensions; j++)
+        {
+            if (variable->dimension_type[j] == harp_dimension_independent)
+            {
+                ptr += sprintf(ptr, ":%ld", variable->dimension[j]);
+            }
+        }
+        *ptr++ = '\n';
+    }
+    *ptr = '\0';
+
+    return key;
+}
+
+/* Returns the index of the plan for key (or -1 if there is no plan yet).
+ * *conversion will be set to the best conversion and *generation to the generation of the cache that the index
+ * refers to.
+ */
+static long plan_cache_find(const char *key, long *generation, const conversion_info *info,
+                            harp_variable_conversion **conversion)
+{
+    long index = -1;
+
+    harp_lock(harp_lock_conversion_plans);
+    if (plan_cache.hash_data != NULL && (info->plan_parent < 0 || *generation == plan_cache.generation))
+    {
+        index = hashtable_get_index_from_name(plan_cache.hash_data, key);
+        if (index >= 0)
+        {
+            *conversion = plan_cache.conversion[index];
+            *generation = plan_cache.generation;
+        }
+    }
+    harp_unlock(harp_lock_conversion_plans);
+
+    return index;
+}
+
+/* Store the plan for key (the cache takes ownership of key); returns the index of the plan or -2 if it was not stored.
+ * *generation will be set to the generation of the cache that the index refers to.
+ */
+static long plan_cache_add(char *key, long *generation, const conversion_info *info,
+                           harp_variable_conversion *conversion)
+{
+    long index;
+
+    harp_lock(harp_lock_conversion_plans);
+    if (info->plan_parent >= 0 && *generation != plan_cache.generation)
+    {
+        /* the plan of the parent is no longer available */
+        harp_unlock(harp_lock_conversion_plans);
+        free(key);
+        return -2;
+    }
+    if (plan_cache.num_plans == MAX_NUM_CONVERSION_PLANS)
+    {
+        plan_cache_clear();
+        if (info->plan_parent >= 0)
+        {
+            harp_unlock(harp_lock_conversion_plans);
+            free(key);
+            return -2;
+        }
+    }
+    if (plan_cache.key == NULL)
+    {
+        plan_cache.key = malloc(MAX_NUM_CONVERSION_PLANS * sizeof(char *));
+        plan_cache.conversion = malloc(MAX_NUM_CONVERSION_PLANS * sizeof(harp_variable_conversion *));
+        if (plan_cache.key == NULL || plan_cache.conversion == NULL)
+        {
+            /* just don't cache the plan */
+            if (plan_cache.key != NULL)
+            {
+                free(plan_cache.key);
+                plan_cache.key = NULL;
+            }
+            harp_unlock(harp_lock_conversion_plans);
+            free(key);
+            return -2;
+        }
+    }
+    if (plan_cache.hash_data == NULL)
+    {
+        plan_cache.hash_data = hashtable_new(1);
+        if (plan_cache.hash_data == NULL)
+        {
+            harp_unlock(harp_lock_conversion_plans);
+            free(key);
+            return -2;
+        }
+    }
+    index = plan_cache.num_plans;
+    if (hashtable_add_name(plan_cache.hash_data, key) != 0)
+    {
+        /* another thread already stored the plan */
+        index = hashtable_get_index_from_name(plan_cache.hash_data, key);
+        free(key);
+    }
+    else
+    {
+        plan_cache.key[index] = key;
+        plan_cache.conversion[index] = conversion;
+        plan_cache.num_plans++;
+    }
+    *generation = plan_cache.generation;
+    harp_unlock(harp_lock_conversion_plans);
+
+    return index;
+}
+
+int harp_derived_variable_cache_new(harp_derived_variable_cache **new_cache)
+{
+    harp_derived_variable_cache *cache;
+
+    cache = (harp_derived_variable_cache *)malloc(sizeof(harp_derived_variable_cache));
+    if (cache == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(harp_derived_variable_cache), __FILE__, __LINE__);
+        return -1;
+    }
+    cache->hash_data = NULL;
+    cache->num_variables = 0;
+    cache->key = NULL;
+    cache->variable = NULL;
+
+    *new_cache = cache;
+    return 0;
+}
+
+void harp_derived_variable_cache_clear(harp_derived_variable_cache *cache)
+{
+    int i;
+
+    if (cache->hash_data != NULL)
+    {
+        hashtable_delete(cache->hash_data);
+        cache->hash_data = NULL;
+    }
+    for (i = 0; i < cache->num_variables; i++)
+    {
+        free(cache->key[i]);
+        harp_variable_delete(cache->variable[i]);
+    }
+    if (cache->key != NULL)
+    {
+        free(cache->key);
+        cache->key = NULL;
+    }
+    if (cache->variable != NULL)
+    {
+        free(cache->variable);
+        cache->variable = NULL;
+    }
+    cache->num_variables = 0;
+}
+
+void harp_derived_variable_cache_delete(harp_derived_variable_cache *cache)
+{
+    if (cache != NULL)
+    {
+        harp_derived_variable_cache_clear(cache);
+        free(cache);
+    }
+}
+
+/* Returns the cached variable for the variable in info (or NULL if there is no usable cached variable) */
+static harp_variable *derived_variable_cache_get(const conversion_info *info)
+{
+    harp_variable *variable;
+    long index;
+    int i;
+
+    if (info->cache == NULL || info->cache->hash_data == NULL)
+    {
+        return NULL;
+    }
+    index = hashtable_get_index_from_name(info->cache->hash_data, info->dimsvar_name);
+    if (index < 0)
+    {
+        return NULL;
+    }
+    variable = info->cache->variable[index];
+
+    /* the dimensions of the product should still match */
+    for (i = 0; i < variable->num_dimensions; i++)
+    {
+        if (variable->dimension_type[i] != harp_dimension_independent &&
+            variable->dimension[i] != info->product->dimension[variable->dimension_type[i]])
+        {
+            return NULL;
+        }
+    }
+
+    return variable;
+}
+
+/* Add the variable in info to the cache (the cache takes ownership of the variable).
+ * Returns 1 if the variable was added, 0 if it was not added (because it was already there), -1 on error.
+ */
+static int derived_variable_cache_add(conversion_info *info)
+{
+    harp_derived_variable_cache *cache = info->cache;
+    char *key;
+
+    if (cache->hash_data == NULL)
+    {
+        cache->hash_data = hashtable_new(1);
+        if (cache->hash_data == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not create hashtable) (%s:%u)", __FILE__,
+                           __LINE__);
+            return -1;
+        }
+    }
+    if (hashtable_get_index_from_name(cache->hash_data, info->dimsvar_name) >= 0)
+    {
+        return 0;
+    }
+    if (cache->num_variables % BLOCK_SIZE == 0)
+    {
+        harp_variable **new_variable;
+        char **new_key;
+
+        new_key = realloc(cache->key, (cache->num_variables + BLOCK_SIZE) * sizeof(char *));
+        if (new_key == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           (cache->num_variables + BLOCK_SIZE) * sizeof(char *), __FILE__, __LINE__);
+            return -1;
+        }
+        cache->key = new_key;
+        new_variable = realloc(cache->variable, (cache->num_variables + BLOCK_SIZE) * sizeof(harp_variable *));
+        if (new_variable == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           (cache->num_variables + BLOCK_SIZE) * sizeof(harp_variable *), __FILE__, __LINE__);
+            return -1;
+        }
+        cache->variable = new_variable;
+    }
+    key = strdup(info->dimsvar_name);
+    if (key == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        return -1;
+    }
+    if (hashtable_add_name(cache->hash_data, key) != 0)
+    {
+        free(key);
+        return 0;
+    }
+    cache->key[cache->num_variables] = key;
+    cache->variable[cache->num_variables] = info->variable;
+    cache->num_variables++;
+
+    return 1;
+}
+
 static int create_variable(conversion_info *info)
 {
     const harp_variable_conversion *conversion = info->conversion;
@@ -321,6 +729,44 @@ static int get_source_variable(conversion_info *info, harp_data_type data_type,
         info->variable = NULL;
     }
 
+    if (info->cache != NULL)
+    {
+        /* use (or keep) the intermediate variable from the cache */
+        info->variable = derived_variable_cache_get(info);
+        if (info->variable == NULL)
+        {
+            int result;
+
+            if (find_and_execute_conversion(info) != 0)
+            {
+                return -1;
+            }
+            result = derived_variable_cache_add(info);
+            if (result < 0)
+            {
+                return -1;
+            }
+            *is_temp = (result == 0);
+        }
+        if (unit != NULL && !harp_variable_has_unit(info->variable, unit))
+        {
+            if (!*is_temp)
+            {
+                if (harp_variable_copy(info->variable, &info->variable) != 0)
+                {
+                    info->variable = NULL;
+                    return -1;
+                }
+                *is_temp = 1;
+            }
+            if (harp_variable_convert_unit(info->variable, unit) != 0)
+            {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
     *is_temp = 1;
 
     if (find_and_execute_conversion(info) != 0)
@@ -359,6 +805,9 @@ static int perform_conversion(conversion_info *info)
         }
         memcpy(source_info.skip, info->skip, harp_derived_variable_conversions->num_variables);
         source_info.depth = info->depth + 1;
+        source_info.cache = info->cache;
+        source_info.plan_parent = info->plan_index;
+        source_info.plan_generation = info->plan_generation;
 
         if (get_source_variable(&source_info, source_definition->data_type, source_definition->unit, &is_temp[i]) != 0)
         {
@@ -533,6 +982,7 @@ static int find_and_execute_conversion(conversion_info *info)
 {
     int index;
 
+    info->plan_index = -2;
     index = hashtable_get_index_from_name(harp_derived_variable_conversions->hash_data, info->dimsvar_name);
     if (index >= 0)
     {
@@ -540,9 +990,28 @@ static int find_and_execute_conversion(conversion_info *info)
             harp_derived_variable_conversions->conversions_for_variable[index];
         harp_variable_conversion *best_conversion = NULL;
         double best_cost;
+        char *plan_key;
+        int skip_plan;
         int i;
 
-        for (i = 0; i < conversion_list->num_conversions; i++)
+        plan_key = get_plan_key(info, &skip_plan);
+        if (plan_key == NULL && !skip_plan)
+        {
+            return -1;
+        }
+        if (plan_key != NULL)
+        {
+            info->plan_index = plan_cache_find(plan_key, &info->plan_generation, info, &best_conversion);
+            if (info->plan_index >= 0)
+            {
+                /* the plan is known, so no need to search for the best conversion */
+                free(plan_key);
+                plan_key = NULL;
+                conversion_list = NULL;
+            }
+        }
+
+        for (i = 0; conversion_list != NULL && i < conversion_list->num_conversions; i++)
         {
             harp_variable_conversion *conversion = conversion_list->conversion[i];
             double budget = best_conversion == NULL ? harp_plusinf() : best_cost;
@@ -588,6 +1057,11 @@ static int find_and_execute_conversion(conversion_info *info)
             info->skip[index] = 0;
         }
 
+        if (plan_key != NULL)
+        {
+            info->plan_index = plan_cache_add(plan_key, &info->plan_generation, info, best_conversion);
+        }
+
         if (best_conversion != NULL)
         {
             int result;
@@ -1044,12 +1518,9 @@ LIBHARP_API int harp_doc_list_conversions(const harp_product *product, const cha
     conversion_info info;
     int i, j;
 
-    if (harp_derived_variable_conversions == NULL)
+    if (derived_variable_list_init() != 0)
     {
-        if (harp_derived_variable_list_init() != 0)
-        {
-            return -1;
-        }
+        return -1;
     }
 
     if (product == NULL)
@@ -1184,28 +1655,9 @@ LIBHARP_API int harp_doc_list_conversions(const harp_product *product, const cha
     return 0;
 }
 
-/** Retrieve a new variable based on the set of automatic conversions that are supported by HARP.
- * \ingroup harp_product
- * If the product already contained a variable with the given name, you will get a copy of that variable (and converted
- * to the specified data type and unit). Otherwise the function will try to create a new variable based on the data
- * found in the product or on available auxiliary data (e.g. built-in climatology).
- * The caller of this function will be responsible for the memory management of the returned variable.
- * \note setting unit to NULL returns a variable in the original unit
- * \note pointers to axis variables are passed through unmodified.
- * \param product Product from which to derive the new variable.
- * \param name Name of the variable that should be created.
- * \param data_type Data type (optional) of the variable that should be created.
- * \param unit Unit (optional) of the variable that should be created.
- * \param num_dimensions Number of dimensions of the variable that should be created.
- * \param dimension_type Type of dimension for each of the dimensions of the variable that should be created.
- * \param variable Pointer to the C variable where the derived HARP variable will be stored.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
- */
-LIBHARP_API int harp_product_get_derived_variable(const harp_product *product, const char *name,
-                                                  const harp_data_type *data_type, const char *unit, int num_dimensions,
-                                                  const harp_dimension_type *dimension_type, harp_variable **variable)
+static int get_derived_variable(const harp_product *product, harp_derived_variable_cache *cache, const char *name,
+                                const harp_data_type *data_type, const char *unit, int num_dimensions,
+                                const harp_dimension_type *dimension_type, harp_variable **variable)
 {
     conversion_info info;
 
@@ -1259,20 +1711,30 @@ LIBHARP_API int harp_product_get_derived_variable(const harp_product *product, c
         }
     }
 
-    if (harp_derived_variable_conversions == NULL)
+    if (derived_variable_list_init() != 0)
     {
-        if (harp_derived_variable_list_init() != 0)
-        {
-            return -1;
-        }
+        return -1;
     }
 
     if (conversion_info_init_with_variable(&info, product, name, num_dimensions, dimension_type) != 0)
     {
         return -1;
     }
+    info.cache = cache;
+    info.plan_parent = -1;
 
-    if (find_and_execute_conversion(&info) != 0)
+    info.variable = derived_variable_cache_get(&info);
+    if (info.variable != NULL)
+    {
+        /* the variable was already derived as intermediate variable */
+        if (harp_variable_copy(info.variable, &info.variable) != 0)
+        {
+            info.variable = NULL;
+            conversion_info_done(&info);
+            return -1;
+        }
+    }
+    else if (find_and_execute_conversion(&info) != 0)
     {
         conversion_info_done(&info);
         return -1;
@@ -1306,26 +1768,13 @@ LIBHARP_API int harp_product_get_derived_variable(const harp_product *product, c
     return 0;
 }
 
-/** Create a derived variable and add it to the product.
- * \ingroup harp_product
- * If a similar named variable with the right dimensions was already in the product then that variable
- * will be modified to match the given unit
- * (and in case \a unit is NULL, then the function will just leave the product unmodified).
- * Otherwise the function will call harp_product_get_derived_variable() and add the new variable using
- * harp_product_add_variable() (removing any existing variable with the same name, but different dimensions)
- * \param product Product from which to derive the new variable and into which the derived variable should be placed.
- * \param name Name of the variable that should be added.
- * \param data_type Data type (optional) of the variable that should be added.
- * \param unit Unit (optional) of the variable that should be added.
- * \param num_dimensions Number of dimensions of the variable that should be created.
- * \param dimension_type Type of dimension for each of the dimensions of the variable that should be created.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
+/* Same as harp_product_add_derived_variable(), but using (and updating) a cache of intermediate variables.
+ * The cache can be kept for subsequent calls as long as the product is not modified in between (other than by adding
+ * derived variables).
  */
-LIBHARP_API int harp_product_add_derived_variable(harp_product *product, const char *name,
-                                                  const harp_data_type *data_type, const char *unit, int num_dimensions,
-                                                  const harp_dimension_type *dimension_type)
+int harp_product_add_derived_variable_with_cache(harp_product *product, harp_derived_variable_cache *cache,
+                                                 const char *name, const harp_data_type *data_type, const char *unit,
+                                                 int num_dimensions, const harp_dimension_type *dimension_type)
 {
     harp_variable *new_variable;
     harp_variable *variable = NULL;
@@ -1367,17 +1816,13 @@ LIBHARP_API int harp_product_add_derived_variable(harp_product *product, const c
         }
     }
 
-    if (harp_derived_variable_conversions == NULL)
+    if (derived_variable_list_init() != 0)
     {
-        if (harp_derived_variable_list_init() != 0)
-        {
-            return -1;
-        }
+        return -1;
     }
 
     /* variable with right dimensions does not yet exist -> create and add it */
-    if (harp_product_get_derived_variable(product, name, data_type, unit, num_dimensions, dimension_type, &new_variable)
-        != 0)
+    if (get_derived_variable(product, cache, name, data_type, unit, num_dimensions, dimension_type, &new_variable) != 0)
     {
         return -1;
     }
@@ -1398,3 +1843,54 @@ LIBHARP_API int harp_product_add_derived_variable(harp_product *product, const c
 
     return 0;
 }
+
+/** Retrieve a new variable based on the set of automatic conversions that are supported by HARP.
+ * \ingroup harp_product
+ * If the product already contained a variable with the given name, you will get a copy of that variable (and converted
+ * to the specified data type and unit). Otherwise the function will try to create a new variable based on the data
+ * found in the product or on available auxiliary data (e.g. built-in climatology).
+ * The caller of this function will be responsible for the memory management of the returned variable.
+ * \note setting unit to NULL returns a variable in the original unit
+ * \note pointers to axis variables are passed through unmodified.
+ * \param product Product from which to derive the new variable.
+ * \param name Name of the variable that should be created.
+ * \param data_type Data type (optional) of the variable that should be created.
+ * \param unit Unit (optional) of the variable that should be created.
+ * \param num_dimensions Number of dimensions of the variable that should be created.
+ * \param dimension_type Type of dimension for each of the dimensions of the variable that should be created.
+ * \param variable Pointer to the C variable where the derived HARP variable will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_product_get_derived_variable(const harp_product *product, const char *name,
+                                                  const harp_data_type *data_type, const char *unit, int num_dimensions,
+                                                  const harp_dimension_type *dimension_type, harp_variable **variable)
+{
+    return get_derived_variable(product, NULL, name, data_type, unit, num_dimensions, dimension_type, variable);
+}
+
+/** Create a derived variable and add it to the product.
+ * \ingroup harp_product
+ * If a similar named variable with the right dimensions was already in the product then that variable
+ * will be modified to match the given unit
+ * (and in case \a unit is NULL, then the function will just leave the product unmodified).
+ * Otherwise the function will call harp_product_get_derived_variable() and add the new variable using
+ * harp_product_add_variable() (removing any existing variable with the same name, but different dimensions)
+ * \param product Product from which to derive the new variable and into which the derived variable should be placed.
+ * \param name Name of the variable that should be added.
+ * \param data_type Data type (optional) of the variable that should be added.
+ * \param unit Unit (optional) of the variable that should be added.
+ * \param num_dimensions Number of dimensions of the variable that should be created.
+ * \param dimension_type Type of dimension for each of the dimensions of the variable that should be created.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_product_add_derived_variable(harp_product *product, const char *name,
+                                                  const harp_data_type *data_type, const char *unit, int num_dimensions,
+                                                  const harp_dimension_type *dimension_type)
+{
+    return harp_product_add_derived_variable_with_cache(product, NULL, name, data_type, unit, num_dimensions,
+                                                        dimension_type);
+}
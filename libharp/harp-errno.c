@@ -38,13 +38,20 @@
 
 #define MAX_ERROR_INFO_LENGTH	4096
 
+#ifndef THREAD_LOCAL
+#define THREAD_LOCAL
+#endif
+
 static int (*harp_warning_handler)(const char *, va_list ap) = NULL;
-static char harp_error_message_buffer[MAX_ERROR_INFO_LENGTH + 1];
+
+/* the error state is kept per thread */
+static THREAD_LOCAL int harp_errno_value = HARP_SUCCESS;
+static THREAD_LOCAL char harp_error_message_buffer[MAX_ERROR_INFO_LENGTH + 1];
 
 /** \defgroup harp_error HARP Error
  * With a few exceptions almost all HARP functions return an integer that indicate whether the function was able to
  * perform its operations successfully. The return value will be 0 on success and -1 otherwise. In case you get a -1
- * you can look at the global variable #harp_errno for a precise error code. Each error code and its meaning is
+ * you can look at #harp_errno for a precise error code. Each error code and its meaning is
  * described in this section. You will also be able to retrieve a character string with an error description via
  * the harp_errno_to_string() function. This function will return either the default error message for the error
  * code, or a custom error message. A custom error message will only be returned if the error code you pass to
@@ -172,11 +179,22 @@ static char harp_error_message_buffer[MAX_ERROR_INFO_LENGTH + 1];
 
 /** @} */
 
-/** Variable that contains the error type.
+/** \def harp_errno
+ * Variable that contains the error type.
  * If no error has occurred the variable contains #HARP_SUCCESS (0).
+ * The error state (#harp_errno and the error message) is kept per thread, so a failing HARP function call in one
+ * thread will not change the error state of other threads.
  * \hideinitializer
  */
-LIBHARP_API int harp_errno = HARP_SUCCESS;
+
+/** Retrieve a pointer to the #harp_errno variable of the current thread.
+ * You should normally not call this function directly, but use #harp_errno instead.
+ * \return Pointer to the error code of the current thread.
+ */
+LIBHARP_API int *harp_get_errno(void)
+{
+    return &harp_errno_value;
+}
 
 /** @} */
 
@@ -155,9 +155,9 @@ static void collocation_mask_sort_by_collocation_index(harp_collocation_mask *ma
     qsort(mask->index_pair, mask->num_index_pairs, sizeof(harp_collocation_index_pair), compare_by_collocation_index);
 }
 
-static int collocation_mask_from_result(const harp_collocation_result *collocation_result,
-                                        harp_collocation_filter_type filter_type, const char *source_product,
-                                        harp_collocation_mask **new_mask)
+int harp_collocation_mask_from_result(const harp_collocation_result *collocation_result,
+                                      harp_collocation_filter_type filter_type, const char *source_product,
+                                      harp_collocation_mask **new_mask)
 {
     harp_collocation_mask *mask;
     long product_index = -1;
@@ -207,20 +207,19 @@ static int collocation_mask_from_result(const harp_collocation_result *collocati
     /* if product_index is -1, no match will be found */
     for (i = 0; i < collocation_result->num_pairs && product_index >= 0; i++)
     {
-        const harp_collocation_pair *pair;
         double datetime_diff;
 
-        pair = collocation_result->pair[i];
-        datetime_diff = datetime_diff_index >= 0 ? pair->difference[datetime_diff_index] : harp_nan();
+        datetime_diff = datetime_diff_index >= 0 ?
+            collocation_result->difference[i * collocation_result->num_differences + datetime_diff_index] : harp_nan();
         if (filter_type == harp_collocation_left)
         {
-            if (pair->product_index_a != product_index)
+            if (collocation_result->product_index_a[i] != product_index)
             {
                 continue;
             }
 
-            if (collocation_mask_add_index_pair(mask, pair->collocation_index, pair->sample_index_a, -datetime_diff) !=
-                0)
+            if (collocation_mask_add_index_pair(mask, collocation_result->collocation_index[i],
+                                                collocation_result->sample_index_a[i], -datetime_diff) != 0)
             {
                 harp_collocation_mask_delete(mask);
                 return -1;
@@ -228,13 +227,13 @@ static int collocation_mask_from_result(const harp_collocation_result *collocati
         }
         else
         {
-            if (pair->product_index_b != product_index)
+            if (collocation_result->product_index_b[i] != product_index)
             {
                 continue;
             }
 
-            if (collocation_mask_add_index_pair(mask, pair->collocation_index, pair->sample_index_b, datetime_diff) !=
-                0)
+            if (collocation_mask_add_index_pair(mask, collocation_result->collocation_index[i],
+                                                collocation_result->sample_index_b[i], datetime_diff) != 0)
             {
                 harp_collocation_mask_delete(mask);
                 return -1;
@@ -260,6 +259,7 @@ static int collocation_mask_from_result(const harp_collocation_result *collocati
                 mask->index_pair[i].datetime_diff =
                     harp_unit_converter_convert_double(unit_converter, mask->index_pair[i].datetime_diff);
             }
+            harp_unit_converter_delete(unit_converter);
         }
     }
 
@@ -296,7 +296,7 @@ int harp_collocation_mask_import(const char *filename, harp_collocation_filter_t
         return -1;
     }
 
-    if (collocation_mask_from_result(collocation_result, filter_type, source_product, &mask) != 0)
+    if (harp_collocation_mask_from_result(collocation_result, filter_type, source_product, &mask) != 0)
     {
         harp_collocation_result_delete(collocation_result);
         return -1;
@@ -610,7 +610,7 @@ static int get_collocated_product(harp_collocation_result *collocation_result, c
     harp_collocation_mask *mask;
     harp_product_metadata *product_metadata;
     harp_product *collocated_product;
-    harp_collocation_pair *pair;
+    long product_index_b;
 
     if (harp_collocation_result_filter_for_source_product_b(collocation_result, source_product_b) != 0)
     {
@@ -622,16 +622,16 @@ static int get_collocated_product(harp_collocation_result *collocation_result, c
         return 0;
     }
     /* use product b reference from first pair to find and import product */
-    pair = collocation_result->pair[0];
-    product_metadata = collocation_result->dataset_b->metadata[pair->product_index_b];
+    product_index_b = collocation_result->product_index_b[0];
+    product_metadata = collocation_result->dataset_b->metadata[product_index_b];
     if (product_metadata == NULL)
     {
         harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "missing product metadata for product %s",
-                       collocation_result->dataset_b->source_product[pair->product_index_b]);
+                       collocation_result->dataset_b->source_product[product_index_b]);
         return -1;
     }
 
-    if (collocation_mask_from_result(collocation_result, harp_collocation_right, source_product_b, &mask) != 0)
+    if (harp_collocation_mask_from_result(collocation_result, harp_collocation_right, source_product_b, &mask) != 0)
     {
         return -1;
     }
@@ -544,6 +544,7 @@ int harp_variable_filter(harp_variable *variable, const harp_dimension_mask_set
 
 int harp_product_filter(harp_product *product, const harp_dimension_mask_set *dimension_mask_set)
 {
+    harp_dimension_type mask_type = harp_dimension_independent;
     int i;
 
     if (dimension_mask_set == NULL)
@@ -563,6 +564,28 @@ int harp_product_filter(harp_product *product, const harp_dimension_mask_set *di
         }
     }
 
+    /* A single 1-D mask can be applied to all variables of the product in one go. */
+    for (i = 0; i < HARP_NUM_DIM_TYPES; i++)
+    {
+        if (dimension_mask_set[i] != NULL)
+        {
+            if (mask_type != harp_dimension_independent || dimension_mask_set[i]->num_dimensions != 1 ||
+                dimension_mask_set[i]->num_elements != product->dimension[i])
+            {
+                break;
+            }
+            mask_type = (harp_dimension_type)i;
+        }
+    }
+    if (i == HARP_NUM_DIM_TYPES)
+    {
+        if (mask_type == harp_dimension_independent)
+        {
+            return 0;
+        }
+        return harp_product_filter_dimension(product, mask_type, dimension_mask_set[mask_type]->mask);
+    }
+
     /* Filter all variables in the product. */
     for (i = 0; i < product->num_variables; i++)
     {
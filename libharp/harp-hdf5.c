@@ -30,6 +30,7 @@
  */
 
 #include "harp-internal.h"
+#include "harp-program.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -38,6 +39,10 @@
 #include "hdf5.h"
 #include "hdf5_hl.h"
 
+#ifdef HAVE_ZLIB_H
+#include "zlib.h"
+#endif
+
 /* String value used in netCDF-4 files as the NAME attribute for dimension scales without coordinate variables. This
  * #define statement was copied verbatim from netcdf.h and should be kept in sync with future updates of the netCDF-4
  * library.
@@ -57,6 +62,16 @@
  */
 #define NC_DIMID_ATT_NAME "_Netcdf4Dimid"
 
+/* Identifiers of the HDF5 filter plugins for LZ4 and Zstandard compression (as registered with The HDF Group). */
+#define HDF5_FILTER_LZ4 32004
+#define HDF5_FILTER_ZSTD 32015
+
+/* Maximum number of elements in an HDF5 chunk. */
+#define MAX_CHUNK_NUM_ELEMENTS 4294967295
+
+/* Maximum amount of uncompressed data (in bytes) for which the chunks of a variable are compressed in one go. */
+#define MAX_CHUNK_BATCH_SIZE (64 * 1024 * 1024)
+
 /* List of shared dimensions. */
 typedef struct hdf5_dimensions_struct
 {
@@ -371,57 +386,481 @@ static int get_link_iteration_index_type(hid_t group_id, H5_index_t * index_type
     return 0;
 }
 
-static int set_compression(hid_t plist_id, harp_variable *variable)
+/* Determine the chunk dimensions for a compressed variable.
+ * If a target chunk size is set, the variable is split along its first dimension. Otherwise we want to use the largest
+ * block possible while staying within the 2^32-1 elements per chunk limit.
+ */
+static void get_chunk_dimensions(const harp_variable *variable, long element_size, hsize_t *chunk_dimension)
+{
+    int chunk_size = harp_get_option_hdf5_chunk_size();
+    long num_elements = variable->num_elements;
+    int i;
+
+    for (i = 0; i < variable->num_dimensions; i++)
+    {
+        chunk_dimension[i] = variable->dimension[i];
+    }
+    if (chunk_size > 0 && variable->dimension[0] > 1)
+    {
+        long slice_size = (num_elements / variable->dimension[0]) * element_size;
+
+        if (slice_size > 0)
+        {
+            long length = chunk_size / slice_size;
+
+            if (length < 1)
+            {
+                length = 1;
+            }
+            if (length < variable->dimension[0])
+            {
+                chunk_dimension[0] = length;
+                num_elements = (num_elements / variable->dimension[0]) * length;
+            }
+        }
+    }
+    if (num_elements > MAX_CHUNK_NUM_ELEMENTS)
+    {
+        i = 0;
+        while (i < variable->num_dimensions - 1)
+        {
+            num_elements /= (long)chunk_dimension[i];
+            if (num_elements <= MAX_CHUNK_NUM_ELEMENTS)
+            {
+                chunk_dimension[i] = MAX_CHUNK_NUM_ELEMENTS / num_elements;
+                num_elements *= (long)chunk_dimension[i];
+                break;
+            }
+            chunk_dimension[i] = 1;
+            i++;
+        }
+        if (num_elements > MAX_CHUNK_NUM_ELEMENTS)
+        {
+            chunk_dimension[i] = MAX_CHUNK_NUM_ELEMENTS;
+        }
+    }
+}
+
+static int check_filter_available(H5Z_filter_t filter_id, const char *name)
+{
+    unsigned int filter_config;
+
+    if (H5Zfilter_avail(filter_id) <= 0 || H5Zget_filter_info(filter_id, &filter_config) < 0 ||
+        !(filter_config & H5Z_FILTER_CONFIG_ENCODE_ENABLED))
+    {
+        harp_set_error(HARP_ERROR_EXPORT, "HDF5 compression filter '%s' is not available", name);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Set chunking and compression for a variable (if compression is enabled).
+ * On return, *use_direct_chunk_write is set to 1 if the chunks of the variable should be compressed by HARP itself
+ * (see write_chunks()) instead of by the HDF5 filter pipeline.
+ */
+static int set_compression(hid_t plist_id, harp_variable *variable, long element_size, hsize_t *chunk_dimension,
+                           int *use_direct_chunk_write)
 {
     int level = harp_get_option_hdf5_compression();
 
+    *use_direct_chunk_write = 0;
+
     if (level > 0 && variable->num_dimensions > 0)
     {
-        long max_length = 4294967295;
-        hsize_t dimension[HARP_MAX_NUM_DIMS];
+        int filter = harp_get_option_hdf5_compression_filter();
+        long chunk_num_elements = 1;
+        long num_chunks = 1;
         int i;
 
+        /* strings are always compressed using deflate */
+        if (variable->data_type == harp_type_string)
+        {
+            filter = 0;
+        }
+
         /* set chunk configuration (we need chunking to enable compression) */
-        /* we want to use the largest block possible while staying within the 2^32-1 elements per chunk limit */
+        get_chunk_dimensions(variable, element_size, chunk_dimension);
         for (i = 0; i < variable->num_dimensions; i++)
         {
-            dimension[i] = variable->dimension[i];
+            chunk_num_elements *= (long)chunk_dimension[i];
+            if (chunk_dimension[i] > 0)
+            {
+                num_chunks *= (variable->dimension[i] - 1) / (long)chunk_dimension[i] + 1;
+            }
         }
-        if (variable->num_elements > max_length)
+        if (H5Pset_chunk(plist_id, variable->num_dimensions, chunk_dimension) < 0)
         {
-            long num_elements = variable->num_elements;
-            int i = 0;
+            harp_set_error(HARP_ERROR_HDF5, NULL);
+            return -1;
+        }
 
-            while (i < variable->num_dimensions - 1)
+        if (harp_get_option_hdf5_shuffle())
+        {
+            if (H5Pset_shuffle(plist_id) < 0)
             {
-                num_elements /= (long)dimension[i];
-                if (num_elements <= max_length)
+                harp_set_error(HARP_ERROR_HDF5, NULL);
+                return -1;
+            }
+        }
+
+        if (filter == 1 && chunk_num_elements < 2)
+        {
+            /* szip needs at least two elements per block */
+            filter = 0;
+        }
+        switch (filter)
+        {
+            case 1:
                 {
-                    dimension[i] = max_length / num_elements;
-                    num_elements *= (long)dimension[i];
-                    break;
+                    unsigned int pixels_per_block = 32;
+
+                    if (check_filter_available(H5Z_FILTER_SZIP, "szip") != 0)
+                    {
+                        return -1;
+                    }
+                    while (pixels_per_block > chunk_num_elements)
+                    {
+                        pixels_per_block /= 2;
+                    }
+                    if (H5Pset_szip(plist_id, H5_SZIP_NN_OPTION_MASK, pixels_per_block) < 0)
+                    {
+                        harp_set_error(HARP_ERROR_HDF5, NULL);
+                        return -1;
+                    }
+                }
+                break;
+            case 2:
+                if (check_filter_available(HDF5_FILTER_LZ4, "lz4") != 0)
+                {
+                    return -1;
+                }
+                if (H5Pset_filter(plist_id, HDF5_FILTER_LZ4, H5Z_FLAG_MANDATORY, 0, NULL) < 0)
+                {
+                    harp_set_error(HARP_ERROR_HDF5, NULL);
+                    return -1;
+                }
+                break;
+            case 3:
+                {
+                    unsigned int cd_values[1];
+
+                    if (check_filter_available(HDF5_FILTER_ZSTD, "zstd") != 0)
+                    {
+                        return -1;
+                    }
+                    cd_values[0] = level;
+                    if (H5Pset_filter(plist_id, HDF5_FILTER_ZSTD, H5Z_FLAG_MANDATORY, 1, cd_values) < 0)
+                    {
+                        harp_set_error(HARP_ERROR_HDF5, NULL);
+                        return -1;
+                    }
+                }
+                break;
+            default:
+                if (H5Pset_deflate(plist_id, level) < 0)
+                {
+                    harp_set_error(HARP_ERROR_HDF5, NULL);
+                    return -1;
+                }
+#ifdef HAVE_ZLIB_H
+                /* with multiple chunks we compress the chunks ourselves, such that this can be done in parallel */
+                *use_direct_chunk_write = variable->num_elements > 0 && num_chunks > 1 &&
+                    chunk_num_elements * element_size <= 0x7fffffff;
+#endif
+                break;
+        }
+    }
+    return 0;
+}
+
+#ifdef HAVE_ZLIB_H
+typedef struct chunk_compression_info_struct
+{
+    int num_dimensions;
+    hsize_t dimension[HARP_MAX_NUM_DIMS];
+    const hsize_t *chunk_dimension;
+    hsize_t num_chunks[HARP_MAX_NUM_DIMS];
+    long element_size;
+    long chunk_num_elements;
+    long chunk_size;
+    long max_compressed_size;
+    const char *data;
+    const char *fill_value;
+    int shuffle;
+    int level;
+    long first_chunk;
+    char *buffer;
+    char *compressed_buffer;
+    uLongf *compressed_size;
+    int *result;
+} chunk_compression_info;
+
+/* Determine the (element) offset of a chunk within the variable. */
+static void get_chunk_offset(const chunk_compression_info *info, long chunk_index, hsize_t *offset)
+{
+    int i;
+
+    for (i = info->num_dimensions - 1; i >= 0; i--)
+    {
+        offset[i] = (chunk_index % info->num_chunks[i]) * info->chunk_dimension[i];
+        chunk_index /= (long)info->num_chunks[i];
+    }
+}
+
+/* Copy the elements of a chunk into a contiguous buffer (applying the byte shuffle if needed) and compress it. */
+static void compress_chunk(void *context, long index)
+{
+    chunk_compression_info *info = (chunk_compression_info *)context;
+    char *buffer = &info->buffer[index * info->chunk_size];
+    hsize_t offset[HARP_MAX_NUM_DIMS];
+    long chunk_index[HARP_MAX_NUM_DIMS];
+    long row_length;
+    long element_index = 0;
+    int last = info->num_dimensions - 1;
+    int is_edge_chunk = 0;
+    int i;
+
+    get_chunk_offset(info, info->first_chunk + index, offset);
+    for (i = 0; i < info->num_dimensions; i++)
+    {
+        if (offset[i] + info->chunk_dimension[i] > info->dimension[i])
+        {
+            is_edge_chunk = 1;
+        }
+        chunk_index[i] = 0;
+    }
+    if (is_edge_chunk)
+    {
+        /* the part of an edge chunk that lies outside the variable is set to the fill value (as HDF5 would do) */
+        if (info->fill_value == NULL)
+        {
+            memset(buffer, 0, info->chunk_size);
+        }
+        else if (info->shuffle)
+        {
+            for (i = 0; i < info->element_size; i++)
+            {
+                memset(&buffer[i * info->chunk_num_elements], info->fill_value[i], info->chunk_num_elements);
+            }
+        }
+        else
+        {
+            long j;
+
+            for (j = 0; j < info->chunk_num_elements; j++)
+            {
+                memcpy(&buffer[j * info->element_size], info->fill_value, info->element_size);
+            }
+        }
+    }
+
+    row_length = (long)info->chunk_dimension[last];
+    if (offset[last] + row_length > info->dimension[last])
+    {
+        row_length = (long)(info->dimension[last] - offset[last]);
+    }
+
+    /* loop over all rows (i.e. the elements along the last dimension) of the chunk */
+    for (;;)
+    {
+        int in_variable = 1;
+        long source_index = 0;
+
+        for (i = 0; i < info->num_dimensions; i++)
+        {
+            if (offset[i] + chunk_index[i] >= info->dimension[i])
+            {
+                in_variable = 0;
+                break;
+            }
+            source_index = source_index * (long)info->dimension[i] + (long)offset[i] + chunk_index[i];
+        }
+        if (in_variable)
+        {
+            const char *source = &info->data[source_index * info->element_size];
+
+            if (info->shuffle)
+            {
+                long j, k;
+
+                for (j = 0; j < row_length; j++)
+                {
+                    for (k = 0; k < info->element_size; k++)
+                    {
+                        buffer[k * info->chunk_num_elements + element_index + j] = source[j * info->element_size + k];
+                    }
                 }
-                dimension[i] = 1;
-                i++;
             }
-            if (num_elements > max_length)
+            else
             {
-                dimension[i] = max_length;
+                memcpy(&buffer[element_index * info->element_size], source, row_length * info->element_size);
             }
         }
-        if (H5Pset_chunk(plist_id, variable->num_dimensions, dimension) < 0)
+        element_index += (long)info->chunk_dimension[last];
+
+        /* go to the next row */
+        i = last - 1;
+        while (i >= 0)
         {
-            harp_set_error(HARP_ERROR_HDF5, NULL);
-            return -1;
+            chunk_index[i]++;
+            if (chunk_index[i] < (long)info->chunk_dimension[i])
+            {
+                break;
+            }
+            chunk_index[i] = 0;
+            i--;
         }
-        if (H5Pset_deflate(plist_id, level) < 0)
+        if (i < 0)
         {
-            harp_set_error(HARP_ERROR_HDF5, NULL);
-            return -1;
+            break;
+        }
+    }
+
+    info->compressed_size[index] = (uLongf)info->max_compressed_size;
+    info->result[index] = compress2((Bytef *)&info->compressed_buffer[index * info->max_compressed_size],
+                                    &info->compressed_size[index], (Bytef *)buffer, (uLong)info->chunk_size,
+                                    info->level);
+}
+
+/* Write the data of a chunked variable by compressing the chunks ourselves (using multiple threads) and writing the
+ * compressed chunks directly to the file. The result is the same as when the HDF5 shuffle (if enabled) and deflate
+ * filters are applied by the HDF5 library.
+ */
+static int write_chunks(hid_t dataset_id, const harp_variable *variable, long element_size, const void *data,
+                        const hsize_t *chunk_dimension)
+{
+    chunk_compression_info info;
+    float float_fill_value = (float)harp_nan();
+    double double_fill_value = harp_nan();
+    long total_num_chunks = 1;
+    long batch_num_chunks;
+    long i;
+
+    info.num_dimensions = variable->num_dimensions;
+    info.chunk_dimension = chunk_dimension;
+    info.chunk_num_elements = 1;
+    for (i = 0; i < variable->num_dimensions; i++)
+    {
+        info.dimension[i] = variable->dimension[i];
+        info.num_chunks[i] = (variable->dimension[i] - 1) / chunk_dimension[i] + 1;
+        info.chunk_num_elements *= (long)chunk_dimension[i];
+        total_num_chunks *= (long)info.num_chunks[i];
+    }
+    info.element_size = element_size;
+    info.chunk_size = info.chunk_num_elements * element_size;
+    info.max_compressed_size = (long)compressBound((uLong)info.chunk_size);
+    info.data = (const char *)data;
+    info.fill_value = NULL;
+    if (variable->data_type == harp_type_float)
+    {
+        info.fill_value = (const char *)&float_fill_value;
+    }
+    else if (variable->data_type == harp_type_double)
+    {
+        info.fill_value = (const char *)&double_fill_value;
+    }
+    info.shuffle = harp_get_option_hdf5_shuffle() && element_size > 1;
+    info.level = harp_get_option_hdf5_compression();
+
+    batch_num_chunks = MAX_CHUNK_BATCH_SIZE / info.chunk_size;
+    if (batch_num_chunks < 1)
+    {
+        batch_num_chunks = 1;
+    }
+    if (batch_num_chunks > total_num_chunks)
+    {
+        batch_num_chunks = total_num_chunks;
+    }
+
+    info.buffer = (char *)malloc(batch_num_chunks * info.chunk_size);
+    if (info.buffer == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (long)(batch_num_chunks * info.chunk_size), __FILE__, __LINE__);
+        return -1;
+    }
+    info.compressed_buffer = (char *)malloc(batch_num_chunks * info.max_compressed_size);
+    if (info.compressed_buffer == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (long)(batch_num_chunks * info.max_compressed_size), __FILE__, __LINE__);
+        free(info.buffer);
+        return -1;
+    }
+    info.compressed_size = (uLongf *)malloc(batch_num_chunks * sizeof(uLongf));
+    if (info.compressed_size == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (long)(batch_num_chunks * sizeof(uLongf)), __FILE__, __LINE__);
+        free(info.compressed_buffer);
+        free(info.buffer);
+        return -1;
+    }
+    info.result = (int *)malloc(batch_num_chunks * sizeof(int));
+    if (info.result == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (long)(batch_num_chunks * sizeof(int)), __FILE__, __LINE__);
+        free(info.compressed_size);
+        free(info.compressed_buffer);
+        free(info.buffer);
+        return -1;
+    }
+
+    for (info.first_chunk = 0; info.first_chunk < total_num_chunks; info.first_chunk += batch_num_chunks)
+    {
+        long num_chunks = batch_num_chunks;
+
+        if (info.first_chunk + num_chunks > total_num_chunks)
+        {
+            num_chunks = total_num_chunks - info.first_chunk;
+        }
+
+        harp_parallel_for(num_chunks, num_chunks * info.chunk_size, compress_chunk, &info);
+
+        for (i = 0; i < num_chunks; i++)
+        {
+            hsize_t offset[HARP_MAX_NUM_DIMS];
+            herr_t status;
+
+            if (info.result[i] != Z_OK)
+            {
+                harp_set_error(HARP_ERROR_EXPORT, "could not compress chunk (zlib error %d)", info.result[i]);
+                free(info.result);
+                free(info.compressed_size);
+                free(info.compressed_buffer);
+                free(info.buffer);
+                return -1;
+            }
+            get_chunk_offset(&info, info.first_chunk + i, offset);
+#if H5_VERSION_GE(1, 10, 3)
+            status = H5Dwrite_chunk(dataset_id, H5P_DEFAULT, 0, offset, info.compressed_size[i],
+                                    &info.compressed_buffer[i * info.max_compressed_size]);
+#else
+            status = H5DOwrite_chunk(dataset_id, H5P_DEFAULT, 0, offset, info.compressed_size[i],
+                                     &info.compressed_buffer[i * info.max_compressed_size]);
+#endif
+            if (status < 0)
+            {
+                harp_set_error(HARP_ERROR_HDF5, NULL);
+                free(info.result);
+                free(info.compressed_size);
+                free(info.compressed_buffer);
+                free(info.buffer);
+                return -1;
+            }
         }
     }
+
+    free(info.result);
+    free(info.compressed_size);
+    free(info.compressed_buffer);
+    free(info.buffer);
+
     return 0;
 }
+#endif
 
 static int read_string_attribute(hid_t obj_id, const char *name, char **data)
 {
@@ -781,16 +1220,105 @@ static int read_variable_dimensions(const char *variable_name, hid_t dataset_id,
     return 0;
 }
 
+/* Read the data of a dataset; if a time mask is given then only the selected samples of the time dimension (which
+ * should be the first dimension) are read, using one hyperslab read per contiguous range of selected samples.
+ */
+static int read_variable_data(hid_t dataset_id, hid_t mem_type_id, int num_dimensions, const long *dimension,
+                              const harp_dimension_mask *time_mask, void *buffer)
+{
+    hsize_t file_start[HARP_MAX_NUM_DIMS];
+    hsize_t mem_start[HARP_MAX_NUM_DIMS];
+    hsize_t count[HARP_MAX_NUM_DIMS];
+    hid_t file_space_id;
+    hid_t mem_space_id;
+    long i;
+    int k;
+
+    if (time_mask == NULL)
+    {
+        if (H5Dread(dataset_id, mem_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer) < 0)
+        {
+            harp_set_error(HARP_ERROR_HDF5, NULL);
+            return -1;
+        }
+        return 0;
+    }
+
+    assert(num_dimensions > 0 && time_mask->masked_dimension_length > 0);
+
+    file_space_id = H5Dget_space(dataset_id);
+    if (file_space_id < 0)
+    {
+        harp_set_error(HARP_ERROR_HDF5, NULL);
+        return -1;
+    }
+
+    for (k = 0; k < num_dimensions; k++)
+    {
+        file_start[k] = 0;
+        mem_start[k] = 0;
+        count[k] = (hsize_t)dimension[k];
+    }
+    count[0] = (hsize_t)time_mask->masked_dimension_length;
+    mem_space_id = H5Screate_simple(num_dimensions, count, NULL);
+    if (mem_space_id < 0)
+    {
+        harp_set_error(HARP_ERROR_HDF5, NULL);
+        H5Sclose(file_space_id);
+        return -1;
+    }
+
+    i = 0;
+    while (i < time_mask->num_elements)
+    {
+        if (!time_mask->mask[i])
+        {
+            i++;
+            continue;
+        }
+        file_start[0] = i;
+        while (i < time_mask->num_elements && time_mask->mask[i])
+        {
+            i++;
+        }
+        count[0] = i - file_start[0];
+
+        if (H5Sselect_hyperslab(file_space_id, H5S_SELECT_SET, file_start, NULL, count, NULL) < 0 ||
+            H5Sselect_hyperslab(mem_space_id, H5S_SELECT_SET, mem_start, NULL, count, NULL) < 0)
+        {
+            harp_set_error(HARP_ERROR_HDF5, NULL);
+            H5Sclose(mem_space_id);
+            H5Sclose(file_space_id);
+            return -1;
+        }
+        if (H5Dread(dataset_id, mem_type_id, mem_space_id, file_space_id, H5P_DEFAULT, buffer) < 0)
+        {
+            harp_set_error(HARP_ERROR_HDF5, NULL);
+            H5Sclose(mem_space_id);
+            H5Sclose(file_space_id);
+            return -1;
+        }
+        mem_start[0] += count[0];
+    }
+
+    H5Sclose(mem_space_id);
+    H5Sclose(file_space_id);
+
+    return 0;
+}
+
 static int read_variable(hid_t dataset_id, const char *name, const hdf5_dimension_ids *dimension_ids,
-                         harp_product *product)
+                         harp_product *product, const harp_dimension_mask *time_mask)
 {
     const char *variable_name;
     harp_variable *variable;
     harp_dimension_type dimension_type[HARP_MAX_NUM_DIMS];
     long dimension[HARP_MAX_NUM_DIMS];
+    long file_dimension[HARP_MAX_NUM_DIMS];
     harp_data_type data_type;
     int num_dimensions;
     herr_t result;
+    int k;
 
     if (read_variable_data_type(dataset_id, &data_type) != 0)
     {
@@ -807,6 +1335,33 @@ static int read_variable(hid_t dataset_id, const char *name, const hdf5_dimensio
     {
         variable_name = &name[15];
     }
+
+    for (k = 0; k < num_dimensions; k++)
+    {
+        file_dimension[k] = dimension[k];
+    }
+    if (time_mask != NULL)
+    {
+        if (num_dimensions > 0 && dimension_type[0] == harp_dimension_time)
+        {
+            dimension[0] = time_mask->masked_dimension_length;
+        }
+        else
+        {
+            /* variable does not depend on time */
+            time_mask = NULL;
+        }
+        for (k = 1; k < num_dimensions; k++)
+        {
+            if (dimension_type[k] == harp_dimension_time)
+            {
+                harp_set_error(HARP_ERROR_IMPORT, "variable '%s' should have time dimension as first dimension",
+                               variable_name);
+                return -1;
+            }
+        }
+    }
+
     if (harp_variable_new(variable_name, data_type, num_dimensions, dimension_type, dimension, &variable) != 0)
     {
         return -1;
@@ -874,9 +1429,8 @@ static int read_variable(hid_t dataset_id, const char *name, const hdf5_dimensio
             return -1;
         }
 
-        if (H5Dread(dataset_id, mem_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer) < 0)
+        if (read_variable_data(dataset_id, mem_type_id, num_dimensions, file_dimension, time_mask, buffer) != 0)
         {
-            harp_set_error(HARP_ERROR_HDF5, NULL);
             free(buffer);
             H5Tclose(mem_type_id);
             return -1;
@@ -906,10 +1460,9 @@ static int read_variable(hid_t dataset_id, const char *name, const hdf5_dimensio
     }
     else
     {
-        if (H5Dread(dataset_id, get_hdf5_type(variable->data_type), H5S_ALL, H5S_ALL, H5P_DEFAULT,
-                    variable->data.ptr) < 0)
+        if (read_variable_data(dataset_id, get_hdf5_type(variable->data_type), num_dimensions, file_dimension,
+                               time_mask, variable->data.ptr) != 0)
         {
-            harp_set_error(HARP_ERROR_HDF5, NULL);
             return -1;
         }
     }
@@ -1136,31 +1689,19 @@ static int find_dimensions(hid_t group_id, hdf5_dimension_ids *dimension_ids)
     return 0;
 }
 
-/* Additional arguments for hdf5_read_variable_func(), which is a visitor function that is called for all variables in
- * the root group via H5Literate(), see also read_variables().
+/* Open the dataset of a variable in the root group.
+ * Returns 1 if the link refers to a variable (in which case dataset_id is set), 0 if the link should be skipped, and -1
+ * on error.
  */
-typedef struct hdf5_read_variable_func_args_struct
+static int open_variable_dataset(hid_t group_id, const char *name, hid_t *dataset_id)
 {
-    hdf5_dimension_ids *dimension_ids;
-    harp_product *product;
-} hdf5_read_variable_func_args;
-
-/* don't use -1 on error, otherwise the HDF5 library starts printing error messages to the console */
-static herr_t hdf5_read_variable_func(hid_t group_id, const char *name, const H5L_info_t * info, void *user_data)
-{
-    hdf5_read_variable_func_args *args;
     H5O_info_t object_info;
-    hid_t dataset_id;
     htri_t is_dimension_scale;
 
-    (void)info;
-
-    args = (hdf5_read_variable_func_args *)user_data;
-
     if (H5Oget_info_by_name(group_id, name, &object_info, H5P_DEFAULT) < 0)
     {
         harp_set_error(HARP_ERROR_HDF5, NULL);
-        return 1;
+        return -1;
     }
 
     if (object_info.type != H5O_TYPE_DATASET)
@@ -1169,41 +1710,112 @@ static herr_t hdf5_read_variable_func(hid_t group_id, const char *name, const H5
         return 0;
     }
 
-    dataset_id = H5Dopen(group_id, name);
-    if (dataset_id < 0)
+    *dataset_id = H5Dopen(group_id, name);
+    if (*dataset_id < 0)
     {
         harp_set_error(HARP_ERROR_HDF5, NULL);
-        return 1;
+        return -1;
     }
 
-    is_dimension_scale = H5DSis_scale(dataset_id);
+    is_dimension_scale = H5DSis_scale(*dataset_id);
     if (is_dimension_scale < 0)
     {
         harp_set_error(HARP_ERROR_HDF5, NULL);
-        H5Dclose(dataset_id);
-        return 1;
+        H5Dclose(*dataset_id);
+        return -1;
     }
 
     if (is_dimension_scale)
     {
         char scale_name[255];
 
-        if (H5DSget_scale_name(dataset_id, scale_name, sizeof(scale_name)) < 0)
+        if (H5DSget_scale_name(*dataset_id, scale_name, sizeof(scale_name)) < 0)
         {
             harp_set_error(HARP_ERROR_HDF5, NULL);
-            H5Dclose(dataset_id);
-            return 1;
+            H5Dclose(*dataset_id);
+            return -1;
         }
 
         if (strncmp(scale_name, DIM_WITHOUT_VARIABLE, sizeof(DIM_WITHOUT_VARIABLE) - 1) == 0)
         {
             /* Skip dimension scales without a coordinate variable. */
+            H5Dclose(*dataset_id);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* Additional arguments for hdf5_read_variable_func() and hdf5_add_import_mask_variable_func(), which are visitor
+ * functions that are called for all variables in the root group via H5Literate(), see also read_variables().
+ */
+typedef struct hdf5_read_variable_func_args_struct
+{
+    hdf5_dimension_ids *dimension_ids;
+    harp_product *product;
+    /* only used when importing with a program */
+    harp_program_import_mask *mask;
+    const uint8_t *variable_mask;       /* only read the variables for which the mask is set */
+    const harp_dimension_mask *time_mask;       /* only read the time samples for which the mask is set */
+    harp_product *filter_product;       /* variables that were already read for the filter operations */
+    int index;
+} hdf5_read_variable_func_args;
+
+/* don't use -1 on error, otherwise the HDF5 library starts printing error messages to the console */
+static herr_t hdf5_read_variable_func(hid_t group_id, const char *name, const H5L_info_t * info, void *user_data)
+{
+    hdf5_read_variable_func_args *args;
+    hid_t dataset_id;
+    int result;
+
+    (void)info;
+
+    args = (hdf5_read_variable_func_args *)user_data;
+
+    result = open_variable_dataset(group_id, name, &dataset_id);
+    if (result <= 0)
+    {
+        return (result < 0 ? 1 : 0);
+    }
+
+    if (args->variable_mask != NULL)
+    {
+        int index = args->index++;
+
+        if (!args->variable_mask[index])
+        {
             H5Dclose(dataset_id);
             return 0;
         }
+        if (args->filter_product != NULL && args->mask->filter_variable_mask[index])
+        {
+            H5Dclose(dataset_id);
+            /* move the variable that was already read for the filter operations */
+            if (harp_program_import_mask_move_variable(args->mask, index, args->filter_product, args->product) != 0)
+            {
+                return 1;
+            }
+            return 0;
+        }
+        if (args->filter_product != NULL && args->time_mask == NULL && args->mask->time_mask != NULL)
+        {
+            /* read the full variable and filter it afterwards */
+            if (read_variable(dataset_id, name, args->dimension_ids, args->filter_product, NULL) != 0)
+            {
+                H5Dclose(dataset_id);
+                return 1;
+            }
+            H5Dclose(dataset_id);
+            if (harp_program_import_mask_move_variable(args->mask, index, args->filter_product, args->product) != 0)
+            {
+                return 1;
+            }
+            return 0;
+        }
     }
 
-    if (read_variable(dataset_id, name, args->dimension_ids, args->product) != 0)
+    if (read_variable(dataset_id, name, args->dimension_ids, args->product, args->time_mask) != 0)
     {
         H5Dclose(dataset_id);
         return 1;
@@ -1214,7 +1826,142 @@ static herr_t hdf5_read_variable_func(hid_t group_id, const char *name, const H5
     return 0;
 }
 
-static int read_variables(hid_t group_id, hdf5_dimension_ids *dimension_ids, harp_product *product)
+/* don't use -1 on error, otherwise the HDF5 library starts printing error messages to the console */
+static herr_t hdf5_add_import_mask_variable_func(hid_t group_id, const char *name, const H5L_info_t * info,
+                                                 void *user_data)
+{
+    hdf5_read_variable_func_args *args;
+    const char *variable_name;
+    harp_dimension_type dimension_type[HARP_MAX_NUM_DIMS];
+    long dimension[HARP_MAX_NUM_DIMS];
+    int num_dimensions;
+    hid_t dataset_id;
+    int result;
+
+    (void)info;
+
+    args = (hdf5_read_variable_func_args *)user_data;
+
+    result = open_variable_dataset(group_id, name, &dataset_id);
+    if (result <= 0)
+    {
+        return (result < 0 ? 1 : 0);
+    }
+
+    if (read_variable_dimensions(name, dataset_id, args->dimension_ids, &num_dimensions, dimension_type, dimension)
+        != 0)
+    {
+        H5Dclose(dataset_id);
+        return 1;
+    }
+
+    H5Dclose(dataset_id);
+
+    variable_name = name;
+    if (strncmp(name, "_nc4_non_coord_", 15) == 0)
+    {
+        variable_name = &name[15];
+    }
+    if (harp_program_import_mask_add_variable(args->mask, variable_name, num_dimensions, dimension_type, dimension)
+        != 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Only read the variables (and the time samples) that remain after the leading keep/exclude/filter operations of the
+ * program. The variables needed for the filters are read first; on success program->current_index is moved beyond the
+ * operations that were applied.
+ */
+static int read_variables_with_program(hid_t group_id, H5_index_t index_type, hdf5_dimension_ids *dimension_ids,
+                                       harp_product *product, harp_program *program)
+{
+    hdf5_read_variable_func_args args;
+    harp_program_import_mask *mask;
+    harp_product *filter_product = NULL;
+
+    if (harp_program_import_mask_new(&mask) != 0)
+    {
+        return -1;
+    }
+
+    args.dimension_ids = dimension_ids;
+    args.product = NULL;
+    args.mask = mask;
+    args.variable_mask = NULL;
+    args.time_mask = NULL;
+    args.filter_product = NULL;
+    args.index = 0;
+
+    if (H5Literate(group_id, index_type, H5_ITER_INC, NULL, hdf5_add_import_mask_variable_func, &args) != 0)
+    {
+        harp_program_import_mask_delete(mask);
+        return -1;
+    }
+
+    if (harp_program_import_mask_apply_variable_operations(mask, program) != 0)
+    {
+        harp_program_import_mask_delete(mask);
+        return -1;
+    }
+
+    if (mask->has_filter)
+    {
+        if (harp_product_new(&filter_product) != 0)
+        {
+            harp_program_import_mask_delete(mask);
+            return -1;
+        }
+        args.product = filter_product;
+        args.variable_mask = mask->filter_variable_mask;
+        args.index = 0;
+        if (H5Literate(group_id, index_type, H5_ITER_INC, NULL, hdf5_read_variable_func, &args) != 0)
+        {
+            harp_product_delete(filter_product);
+            harp_program_import_mask_delete(mask);
+            return -1;
+        }
+        if (harp_program_import_mask_apply_filter_operations(mask, program, filter_product) != 0)
+        {
+            harp_product_delete(filter_product);
+            harp_program_import_mask_delete(mask);
+            return -1;
+        }
+    }
+
+    if (!mask->is_empty && mask->num_variables > 0)
+    {
+        args.product = product;
+        args.variable_mask = mask->variable_mask;
+        args.time_mask = (mask->read_time_ranges ? mask->time_mask : NULL);
+        args.filter_product = filter_product;
+        args.index = 0;
+        if (H5Literate(group_id, index_type, H5_ITER_INC, NULL, hdf5_read_variable_func, &args) != 0)
+        {
+            if (filter_product != NULL)
+            {
+                harp_product_delete(filter_product);
+            }
+            harp_program_import_mask_delete(mask);
+            return -1;
+        }
+    }
+
+    program->current_index += mask->num_operations;
+
+    if (filter_product != NULL)
+    {
+        harp_product_delete(filter_product);
+    }
+    harp_program_import_mask_delete(mask);
+
+    return 0;
+}
+
+static int read_variables(hid_t group_id, hdf5_dimension_ids *dimension_ids, harp_product *product,
+                          harp_program *program)
 {
     hdf5_read_variable_func_args args;
     H5_index_t index_type;
@@ -1224,8 +1971,18 @@ static int read_variables(hid_t group_id, hdf5_dimension_ids *dimension_ids, har
         return -1;
     }
 
+    if (program != NULL && program->current_index < program->num_operations)
+    {
+        return read_variables_with_program(group_id, index_type, dimension_ids, product, program);
+    }
+
     args.dimension_ids = dimension_ids;
     args.product = product;
+    args.mask = NULL;
+    args.variable_mask = NULL;
+    args.time_mask = NULL;
+    args.filter_product = NULL;
+    args.index = 0;
 
     return (H5Literate(group_id, index_type, H5_ITER_INC, NULL, hdf5_read_variable_func, &args) != 0 ? -1 : 0);
 }
@@ -1265,7 +2022,7 @@ static int read_attributes(hid_t group_id, harp_product *product)
     return 0;
 }
 
-static int read_product(hid_t file_id, harp_product *product)
+static int read_product(hid_t file_id, harp_product *product, harp_program *program)
 {
     hdf5_dimension_ids dimension_ids = { {0}, {{0, 0}}, {0} };
     hid_t root_id;
@@ -1285,7 +2042,7 @@ static int read_product(hid_t file_id, harp_product *product)
     }
 
     /* Read variables. */
-    if (read_variables(root_id, &dimension_ids, product) != 0)
+    if (read_variables(root_id, &dimension_ids, product, program) != 0)
     {
         H5Gclose(root_id);
         return -1;
@@ -1335,7 +2092,7 @@ static int verify_product(hid_t file_id)
     return -1;
 }
 
-int harp_import_hdf5(const char *filename, harp_product **product)
+int harp_import_hdf5(const char *filename, harp_program *program, harp_product **product)
 {
     harp_product *new_product;
     hid_t file_id;
@@ -1360,7 +2117,7 @@ int harp_import_hdf5(const char *filename, harp_product **product)
         return -1;
     }
 
-    if (read_product(file_id, new_product) != 0)
+    if (read_product(file_id, new_product, program) != 0)
     {
         harp_add_error_message(" (%s)", filename);
         harp_product_delete(new_product);
@@ -1691,9 +2448,11 @@ static int write_numeric_attribute(hid_t obj_id, const char *name, harp_data_typ
 static int write_variable(hid_t group_id, const char *name, harp_variable *variable)
 {
     hsize_t dimension[HARP_MAX_NUM_DIMS];
+    hsize_t chunk_dimension[HARP_MAX_NUM_DIMS];
     hid_t space_id;
     hid_t dcpl_id;
     hid_t dataset_id;
+    int use_direct_chunk_write;
     int i;
 
     for (i = 0; i < variable->num_dimensions; i++)
@@ -1767,7 +2526,7 @@ static int write_variable(hid_t group_id, const char *name, harp_variable *varia
             return -1;
         }
 
-        if (set_compression(dcpl_id, variable) != 0)
+        if (set_compression(dcpl_id, variable, length, chunk_dimension, &use_direct_chunk_write) != 0)
         {
             H5Pclose(dcpl_id);
             H5Sclose(space_id);
@@ -1790,6 +2549,19 @@ static int write_variable(hid_t group_id, const char *name, harp_variable *varia
         H5Pclose(dcpl_id);
         H5Sclose(space_id);
 
+#ifdef HAVE_ZLIB_H
+        if (use_direct_chunk_write)
+        {
+            if (write_chunks(dataset_id, variable, length, buffer, chunk_dimension) != 0)
+            {
+                H5Dclose(dataset_id);
+                H5Tclose(data_type_id);
+                free(buffer);
+                return -1;
+            }
+        }
+        else
+#endif
         if (H5Dwrite(dataset_id, data_type_id, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer) < 0)
         {
             harp_set_error(HARP_ERROR_HDF5, NULL);
@@ -1828,9 +2600,9 @@ static int write_variable(hid_t group_id, const char *name, harp_variable *varia
             return -1;
         }
 
-        if (set_compression(dcpl_id, variable) != 0)
+        if (set_compression(dcpl_id, variable, harp_get_size_for_type(variable->data_type), chunk_dimension,
+                            &use_direct_chunk_write) != 0)
         {
-            harp_set_error(HARP_ERROR_HDF5, NULL);
             H5Pclose(dcpl_id);
             H5Sclose(space_id);
             return -1;
@@ -1862,6 +2634,18 @@ static int write_variable(hid_t group_id, const char *name, harp_variable *varia
         H5Pclose(dcpl_id);
         H5Sclose(space_id);
 
+#ifdef HAVE_ZLIB_H
+        if (use_direct_chunk_write)
+        {
+            if (write_chunks(dataset_id, variable, harp_get_size_for_type(variable->data_type), variable->data.ptr,
+                             chunk_dimension) != 0)
+            {
+                H5Dclose(dataset_id);
+                return -1;
+            }
+        }
+        else
+#endif
         if (H5Dwrite(dataset_id, get_hdf5_type(variable->data_type), H5S_ALL, H5S_ALL, H5P_DEFAULT,
                      variable->data.ptr) < 0)
         {
@@ -787,7 +787,6 @@ static int ingestion_init(const harp_ingestion_module *module, coda_product *pro
 
     (void)options;
 
-    nan = coda_NaN();
     info = malloc(sizeof(ingest_info));
     if (info == NULL)
     {
@@ -998,6 +997,8 @@ static void register_ace_fts_iso(void)
 
 int harp_ingestion_module_ace_fts_l2_init(void)
 {
+    nan = coda_NaN();
+
     register_ace_fts_main();
     register_ace_fts_iso();
 
@@ -747,8 +747,6 @@ static int ingestion_init(const harp_ingestion_module *module, coda_product *pro
     *definition = *module->product_definition;
     *user_data = info;
 
-    nan = harp_nan();
-
     return 0;
 }
 
@@ -1216,6 +1214,8 @@ static void register_merged_layer_l2(void)
 
 int harp_ingestion_module_calipso_l2_init(void)
 {
+    nan = harp_nan();
+
     register_aerosol_layer_l2();
     register_aerosol_profile_l2();
     register_cloud_layer_l2();
@@ -294,8 +294,6 @@ static int ingestion_init(const harp_ingestion_module *module, coda_product *pro
     *definition = *module->product_definition;
     *user_data = info;
 
-    coda_nan = coda_NaN();
-
     return 0;
 }
 
@@ -308,6 +306,8 @@ int harp_ingestion_module_cci_l3_o3_lntoc_init(void)
     const char *description;
     const char *path;
 
+    coda_nan = coda_NaN();
+
     module = harp_ingestion_register_module("ESACCI_OZONE_L3_LNTOC", "Ozone CCI", "ESACCI_OZONE", "L3_LNTOC",
                                             "CCI L3 O3 limb nadir tropospheric columns", ingestion_init,
                                             ingestion_done);
@@ -324,8 +324,6 @@ static int ingestion_init(const harp_ingestion_module *module, coda_product *pro
     *definition = *module->product_definition;
     *user_data = info;
 
-    coda_nan = coda_NaN();
-
     return 0;
 }
 
@@ -338,6 +336,8 @@ int harp_ingestion_module_cci_l3_o3_ttoc_init(void)
     const char *description;
     const char *path;
 
+    coda_nan = coda_NaN();
+
     module = harp_ingestion_register_module("ESACCI_OZONE_L3_TTOC", "Ozone CCI", "ESACCI_OZONE", "L3_TTOC",
                                             "CCI L3 O3 tropical tropospheric ozone", ingestion_init, ingestion_done);
 
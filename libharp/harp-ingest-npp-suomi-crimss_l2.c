@@ -441,8 +441,6 @@ static int ingestion_init(const harp_ingestion_module *module, coda_product *pro
 
     *definition = module->product_definition[info->dataset];
 
-    nan = coda_NaN();
-
     return 0;
 }
 
@@ -614,6 +612,8 @@ int harp_ingestion_module_npp_suomi_crimss_l2_init(void)
     harp_ingestion_module *module;
     const char *dataset_options[] = { "temp", "press" };
 
+    nan = coda_NaN();
+
     module = harp_ingestion_register_module("NPP_SUOMI_L2_CRIMSS_EDR_REDR", "NPP", "NPP_SUOMI", "CRIMSS_EDR_REDR_L2",
                                             "NPP Suomi CRIMSS EDR Atmospheric Vertical Profile", ingestion_init,
                                             ingestion_done);
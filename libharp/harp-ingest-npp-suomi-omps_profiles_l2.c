@@ -507,8 +507,6 @@ static int ingestion_init(const harp_ingestion_module *module, coda_product *pro
     *definition = *module->product_definition;
     *user_data = info;
 
-    nan = coda_NaN();
-
     return 0;
 }
 
@@ -636,6 +634,8 @@ int harp_ingestion_module_npp_suomi_omps_profiles_l2_init(void)
 {
     harp_ingestion_module *module;
 
+    nan = coda_NaN();
+
     /* Ingestion of Nadir Profile Ozone IP (product type IMOP) */
     module = harp_ingestion_register_module("NPP_SUOMI_L2_OMPS_IP_IMOP", "NPP", "NPP_SUOMI", "OMPS_IP_IMOP_L2",
                                             "NPP Suomi OMPS IP Nadir Profile Ozone", ingestion_init, ingestion_done);
@@ -457,8 +457,6 @@ static int ingestion_init(const harp_ingestion_module *module, coda_product *pro
     *definition = *module->product_definition;
     *user_data = info;
 
-    nan = coda_NaN();
-
     return 0;
 }
 
@@ -474,6 +472,8 @@ int harp_ingestion_module_npp_suomi_omps_totals_l2_init(void)
     const char *description;
     const char *path;
 
+    nan = coda_NaN();
+
     module = harp_ingestion_register_module("NPP_SUOMI_L2_OMPS_EDR_OOTC", "NPP", "NPP_SUOMI", "OMPS_EDR_OOTC_L2",
                                             "NPP Suomi OMPS EDR Ozone Total Column", ingestion_init, ingestion_done);
     product_definition = harp_ingestion_register_product(module, "NPP_SUOMI_L2_OMPS_EDR_OOTC", NULL, read_dimensions);
@@ -706,8 +706,6 @@ static int ingestion_init(const harp_ingestion_module *module, coda_product *pro
     *definition = *module->product_definition;
     *user_data = info;
 
-    nan = coda_NaN();
-
     return 0;
 }
 
@@ -1017,6 +1015,8 @@ static void register_cloud_product_type(const char *product_type, const char *pr
 
 int harp_ingestion_module_npp_suomi_viirs_l2_init(void)
 {
+    nan = coda_NaN();
+
     register_aeros_product_type("VIIRS_EDR_VAOO_L2");
     register_cloud_product_type("VIIRS_EDR_VCBH_L2", "NPP_SUOMI_L2_VIIRS_EDR_VCBH", CLOUD_BASE_HEIGHT);
     register_cloud_product_type("VIIRS_EDR_VCCL_L2", "NPP_SUOMI_L2_VIIRS_EDR_VCCL", CLOUD_FRACTION);
@@ -1290,16 +1290,10 @@ int harp_ingestion_find_module(const char *filename, harp_ingestion_module **mod
     return -1;
 }
 
-int harp_ingestion_init(void)
+static int module_register_init(void)
 {
     int i;
 
-    if (module_register != NULL)
-    {
-        /* Already initialized. */
-        return 0;
-    }
-
     if (coda_init() != 0)
     {
         harp_set_error(HARP_ERROR_CODA, NULL);
@@ -1355,6 +1349,21 @@ int harp_ingestion_init(void)
     return 0;
 }
 
+int harp_ingestion_init(void)
+{
+    int result = 0;
+
+    /* the ingestion modules are registered only once, also if ingestions are started concurrently */
+    harp_lock(harp_lock_init);
+    if (module_register == NULL)
+    {
+        result = module_register_init();
+    }
+    harp_unlock(harp_lock_init);
+
+    return result;
+}
+
 void harp_ingestion_done(void)
 {
     if (module_register != NULL)
@@ -45,6 +45,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* maximum size (in bytes) of a gap of unselected blocks between two ranges of selected blocks for which it is cheaper
+ * to read both ranges (and the gap) with a single read_range() call than to use a read_range() call for each range */
+#define MAX_RANGE_READ_GAP_SIZE (16 * 1024)
+
+/* number of ingestions that are in progress (protected by harp_lock_init); the libcoda options are only set by the
+ * first and restored by the last of a set of concurrently running ingestions */
+static int num_active_ingestions = 0;
+static int saved_perform_conversions;
+static int saved_perform_boundary_checks;
+
 typedef struct read_buffer_struct
 {
     harp_data_type data_type;
@@ -203,6 +213,37 @@ static void ingestion_done(ingest_info *info)
     }
 }
 
+static void set_coda_options(void)
+{
+    harp_lock(harp_lock_init);
+    if (num_active_ingestions == 0)
+    {
+        /* all ingestion routines that use CODA are build on the assumption that 'perform conversions' is enabled, so
+         * we explicitly enable it here just in case it was disabled somewhere else */
+        saved_perform_conversions = coda_get_option_perform_conversions();
+        coda_set_option_perform_conversions(1);
+
+        /* we also disable the boundary checks of libcoda for increased ingestion performance */
+        saved_perform_boundary_checks = coda_get_option_perform_boundary_checks();
+        coda_set_option_perform_boundary_checks(0);
+    }
+    num_active_ingestions++;
+    harp_unlock(harp_lock_init);
+}
+
+static void restore_coda_options(void)
+{
+    harp_lock(harp_lock_init);
+    num_active_ingestions--;
+    if (num_active_ingestions == 0)
+    {
+        /* set the libcoda options back to their original values */
+        coda_set_option_perform_boundary_checks(saved_perform_boundary_checks);
+        coda_set_option_perform_conversions(saved_perform_conversions);
+    }
+    harp_unlock(harp_lock_init);
+}
+
 static int ingestion_init(ingest_info **new_info)
 {
     ingest_info *info;
@@ -227,6 +268,7 @@ static int ingestion_init(ingest_info **new_info)
     info->product = NULL;
     info->block_buffer = NULL;
     info->block_buffer_read_all = NULL;
+    info->block_buffer_read_range = NULL;
 
     if (harp_dimension_mask_set_new(&info->dimension_mask_set) != 0)
     {
@@ -238,6 +280,27 @@ static int ingestion_init(ingest_info **new_info)
     return 0;
 }
 
+/* Returns the byte size of a single block (i.e. the data for a single index of the first dimension) of a variable */
+static long get_block_size(ingest_info *info, const harp_variable_definition *variable_def)
+{
+    long block_size = harp_get_size_for_type(variable_def->data_type);
+    int i;
+
+    for (i = 1; i < variable_def->num_dimensions; i++)
+    {
+        if (variable_def->dimension_type[i] == harp_dimension_independent)
+        {
+            block_size *= variable_def->dimension[i];
+        }
+        else
+        {
+            block_size *= info->dimension[variable_def->dimension_type[i]];
+        }
+    }
+
+    return block_size;
+}
+
 static int read_all(ingest_info *info, const harp_variable_definition *variable_def, harp_array data)
 {
     long dimension[HARP_MAX_NUM_DIMS];
@@ -437,6 +500,131 @@ static int read_block(ingest_info *info, const harp_variable_definition *variabl
     return 0;
 }
 
+/* Read the blocks in the range [first_block, first_block + num_blocks) for which the mask is set into consecutive
+ * blocks of data using the read_range() callback (a mask of NULL selects all blocks).
+ * Each run of consecutive selected blocks is read with a single read_range() call directly into the target buffer.
+ * Runs that are separated by a small gap of unselected blocks are combined into a single read_range() call (into an
+ * intermediate buffer) if reading the gap is cheaper than performing an additional call.
+ */
+static int read_masked_ranges(ingest_info *info, const harp_variable_definition *variable_def, long first_block,
+                              long num_blocks, const uint8_t *mask, harp_array data)
+{
+    read_buffer *buffer = NULL;
+    long block_size;
+    long max_range_length;
+    long max_gap_length;
+    long last_block = first_block + num_blocks;
+    long start = first_block;
+
+    assert(variable_def->read_range != NULL);
+
+    block_size = get_block_size(info, variable_def);
+    max_gap_length = 0;
+    if (block_size > 0)
+    {
+        max_gap_length = MAX_RANGE_READ_GAP_SIZE / block_size;
+    }
+    /* ranges that include gaps are limited to the optimal range length (which determines the buffer size) */
+    max_range_length = variable_def->get_optimal_range_length(info->user_data);
+    if (max_range_length > num_blocks)
+    {
+        max_range_length = num_blocks;
+    }
+    if (max_range_length < 1)
+    {
+        max_range_length = 1;
+    }
+
+    while (start < last_block)
+    {
+        long end;
+        int has_gaps = 0;
+        long i;
+
+        if (mask != NULL && !mask[start])
+        {
+            start++;
+            continue;
+        }
+
+        /* determine the end of the range (exclusive) */
+        end = start + 1;
+        for (;;)
+        {
+            long gap_end;
+
+            while (end < last_block && (mask == NULL || mask[end]) && (!has_gaps || end - start < max_range_length))
+            {
+                end++;
+            }
+            if (end == last_block || mask == NULL || mask[end])
+            {
+                /* end of data or maximum range length reached */
+                break;
+            }
+            gap_end = end + 1;
+            while (gap_end < last_block && !mask[gap_end])
+            {
+                gap_end++;
+            }
+            if (gap_end == last_block || gap_end - end > max_gap_length || gap_end - start >= max_range_length)
+            {
+                break;
+            }
+            has_gaps = 1;
+            end = gap_end;
+        }
+
+        if (!has_gaps)
+        {
+            if (variable_def->read_range(info->user_data, start, end - start, data) != 0)
+            {
+                read_buffer_delete(buffer);
+                return -1;
+            }
+            data.ptr = (void *)(((char *)data.ptr) + (end - start) * block_size);
+            start = end;
+            continue;
+        }
+
+        if (buffer == NULL)
+        {
+            if (read_buffer_new(variable_def->data_type,
+                                max_range_length * (block_size / harp_get_size_for_type(variable_def->data_type)),
+                                &buffer) != 0)
+            {
+                return -1;
+            }
+        }
+        if (variable_def->read_range(info->user_data, start, end - start, buffer->data) != 0)
+        {
+            read_buffer_delete(buffer);
+            return -1;
+        }
+        for (i = start; i < end; i++)
+        {
+            if (mask[i])
+            {
+                char *block = (char *)&buffer->data.int8_data[(i - start) * block_size];
+
+                memcpy(data.ptr, block, block_size);
+                if (variable_def->data_type == harp_type_string)
+                {
+                    /* ownership of the strings has moved to the target buffer */
+                    memset(block, 0, block_size);
+                }
+                data.ptr = (void *)(((char *)data.ptr) + block_size);
+            }
+        }
+        read_buffer_free_string_data(buffer);
+        start = end;
+    }
+
+    read_buffer_delete(buffer);
+
+    return 0;
+}
+
 static int get_variable(ingest_info *info, const harp_variable_definition *variable_def,
                         const harp_dimension_mask_set *dimension_mask_set, harp_variable **new_variable)
 {
@@ -635,10 +823,26 @@ static int get_variable(ingest_info *info, const harp_variable_definition *varia
                     const uint8_t *mask[HARP_MAX_NUM_DIMS];
                     long mask_stride[HARP_MAX_NUM_DIMS - 1];
                     long num_buffer_elements;
+                    long window_length = 1;
                     read_buffer *buffer;
 
+                    /* variables that can only be read using read_range() are read per window of (at most) the optimal
+                     * range length of selected blocks, such that the ranges of selected blocks can be combined */
+                    if (variable_def->read_block == NULL && variable_def->read_all == NULL)
+                    {
+                        window_length = variable_def->get_optimal_range_length(info->user_data);
+                        if (window_length > dimension[0])
+                        {
+                            window_length = dimension[0];
+                        }
+                        if (window_length < 1)
+                        {
+                            window_length = 1;
+                        }
+                    }
+
                     num_buffer_elements = harp_get_num_elements(variable_def->num_dimensions - 1, &dimension[1]);
-                    if (read_buffer_new(variable->data_type, num_buffer_elements, &buffer) != 0)
+                    if (read_buffer_new(variable->data_type, window_length * num_buffer_elements, &buffer) != 0)
                     {
                         harp_variable_delete(variable);
                         return -1;
@@ -666,35 +870,80 @@ static int get_variable(ingest_info *info, const harp_variable_definition *varia
                         }
                     }
 
-                    for (i = 0; i < dimension[0]; i++)
+                    i = 0;
+                    while (i < dimension[0])
                     {
-                        if (mask[0] == NULL || mask[0][i])
+                        long window_start = i;
+                        long window_end = i;
+                        long num_selected = 0;
+                        harp_array source;
+
+                        /* determine the window of blocks that contains the next window_length selected blocks */
+                        while (window_end < dimension[0] && num_selected < window_length)
                         {
-                            if (read_block(info, variable_def, i, buffer->data) != 0)
+                            if (mask[0] == NULL || mask[0][window_end])
+                            {
+                                num_selected++;
+                            }
+                            window_end++;
+                        }
+
+                        if (window_length > 1)
+                        {
+                            if (read_masked_ranges(info, variable_def, window_start, window_end - window_start, mask[0],
+                                                   buffer->data) != 0)
+                            {
+                                read_buffer_delete(buffer);
+                                harp_variable_delete(variable);
+                                return -1;
+                            }
+                        }
+                        else if (num_selected > 0)
+                        {
+                            if (read_block(info, variable_def, window_end - 1, buffer->data) != 0)
                             {
                                 read_buffer_delete(buffer);
                                 harp_variable_delete(variable);
                                 return -1;
                             }
-
-                            harp_array_filter(variable->data_type, variable_def->num_dimensions - 1, &dimension[1],
-                                              &mask[1], buffer->data, &masked_dimension[1], block);
-                            read_buffer_free_string_data(buffer);
-
-                            block.ptr = (void *)(((char *)block.ptr) + block_stride);
                         }
 
-                        for (j = 1; j < variable->num_dimensions; j++)
+                        source = buffer->data;
+                        for (i = window_start; i < window_end; i++)
                         {
-                            if (mask[j] != NULL)
+                            if (mask[0] == NULL || mask[0][i])
                             {
-                                mask[j] += mask_stride[j];
+                                harp_array_filter(variable->data_type, variable_def->num_dimensions - 1,
+                                                  &dimension[1], &mask[1], source, &masked_dimension[1], block);
+
+                                source.ptr = (void *)(((char *)source.ptr) + num_buffer_elements *
+                                                      harp_get_size_for_type(variable->data_type));
+                                block.ptr = (void *)(((char *)block.ptr) + block_stride);
+                            }
+
+                            for (j = 1; j < variable->num_dimensions; j++)
+                            {
+                                if (mask[j] != NULL)
+                                {
+                                    mask[j] += mask_stride[j];
+                                }
                             }
                         }
+                        read_buffer_free_string_data(buffer);
                     }
 
                     read_buffer_delete(buffer);
                 }
+                else if (variable_def->read_block == NULL && variable_def->read_all == NULL)
+                {
+                    /* only read the ranges that contain selected blocks (directly into the variable) */
+                    assert(dimension_mask[0] != NULL);
+                    if (read_masked_ranges(info, variable_def, 0, dimension[0], dimension_mask[0]->mask, block) != 0)
+                    {
+                        harp_variable_delete(variable);
+                        return -1;
+                    }
+                }
                 else
                 {
                     /* we can read directly into the variable */
@@ -886,7 +1135,8 @@ static int execute_value_filter(ingest_info *info, harp_program *program)
     const char *variable_name;
     int num_operations = 1;
     int data_type_size;
-    long i, j;
+    long num_masked;
+    long i;
     int k;
 
     if (info->product_mask == 0)
@@ -957,34 +1207,16 @@ static int execute_value_filter(ingest_info *info, harp_program *program)
             return -1;
         }
 
-        for (k = 0; k < num_operations; k++)
+        num_masked = harp_operation_value_filters_update_mask(num_operations,
+                                                              &program->operation[program->current_index],
+                                                              variable_def->num_enum_values, variable_def->enum_name,
+                                                              variable_def->data_type, 1, buffer->data.ptr,
+                                                              &info->product_mask);
+        read_buffer_delete(buffer);
+        if (num_masked < 0)
         {
-            int result;
-
-            if (harp_operation_is_string_value_filter(program->operation[program->current_index + k]))
-            {
-                harp_operation_string_value_filter *operation;
-
-                operation = (harp_operation_string_value_filter *)program->operation[program->current_index + k];
-                result = operation->eval(operation, variable_def->num_enum_values, variable_def->enum_name,
-                                         variable_def->data_type, buffer->data.ptr);
-            }
-            else
-            {
-                harp_operation_numeric_value_filter *operation;
-
-                operation = (harp_operation_numeric_value_filter *)program->operation[program->current_index + k];
-                result = operation->eval(operation, variable_def->data_type, buffer->data.ptr);
-            }
-            if (result < 0)
-            {
-                read_buffer_delete(buffer);
-                return -1;
-            }
-            info->product_mask = result;
+            return -1;
         }
-
-        read_buffer_delete(buffer);
     }
     else if (variable_def->num_dimensions == 1 && variable_def->dimension_type[0] != harp_dimension_independent)
     {
@@ -1013,7 +1245,8 @@ static int execute_value_filter(ingest_info *info, harp_program *program)
             }
         }
 
-        if (read_buffer_new(variable_def->data_type, 1, &buffer) != 0)
+        /* read all values that are still included so the filters can be applied in a single pass */
+        if (read_buffer_new(variable_def->data_type, info->dimension[dimension_type], &buffer) != 0)
         {
             if (info->dimension_mask_set[dimension_type]->num_dimensions == 2)
             {
@@ -1026,7 +1259,10 @@ static int execute_value_filter(ingest_info *info, harp_program *program)
         {
             if (dimension_mask->mask[i])
             {
-                if (read_block(info, variable_def, i, buffer->data) != 0)
+                harp_array element;
+
+                element.int8_data = &buffer->data.int8_data[i * data_type_size];
+                if (read_block(info, variable_def, i, element) != 0)
                 {
                     if (info->dimension_mask_set[dimension_type]->num_dimensions == 2)
                     {
@@ -1035,48 +1271,24 @@ static int execute_value_filter(ingest_info *info, harp_program *program)
                     read_buffer_delete(buffer);
                     return -1;
                 }
+            }
+        }
 
-                for (k = 0; k < num_operations; k++)
-                {
-                    if (dimension_mask->mask[i])
-                    {
-                        int result;
-
-                        if (harp_operation_is_string_value_filter(program->operation[program->current_index + k]))
-                        {
-                            harp_operation_string_value_filter *operation;
-
-                            operation =
-                                (harp_operation_string_value_filter *)program->operation[program->current_index + k];
-                            result = operation->eval(operation, variable_def->num_enum_values, variable_def->enum_name,
-                                                     variable_def->data_type, buffer->data.int8_data);
-                        }
-                        else
-                        {
-                            harp_operation_numeric_value_filter *operation;
-
-                            operation =
-                                (harp_operation_numeric_value_filter *)program->operation[program->current_index + k];
-                            result = operation->eval(operation, variable_def->data_type, buffer->data.int8_data);
-                        }
-                        if (result < 0)
-                        {
-                            if (info->dimension_mask_set[dimension_type]->num_dimensions == 2)
-                            {
-                                harp_dimension_mask_delete(dimension_mask);
-                            }
-                            read_buffer_delete(buffer);
-                            return -1;
-                        }
-                        dimension_mask->mask[i] = result;
-                    }
-                }
-                if (!dimension_mask->mask[i])
-                {
-                    dimension_mask->masked_dimension_length--;
-                }
+        num_masked = harp_operation_value_filters_update_mask(num_operations,
+                                                              &program->operation[program->current_index],
+                                                              variable_def->num_enum_values, variable_def->enum_name,
+                                                              variable_def->data_type, info->dimension[dimension_type],
+                                                              buffer->data.ptr, dimension_mask->mask);
+        if (num_masked < 0)
+        {
+            if (info->dimension_mask_set[dimension_type]->num_dimensions == 2)
+            {
+                harp_dimension_mask_delete(dimension_mask);
             }
+            read_buffer_delete(buffer);
+            return -1;
         }
+        dimension_mask->masked_dimension_length = num_masked;
 
         read_buffer_delete(buffer);
 
@@ -1146,7 +1358,7 @@ static int execute_value_filter(ingest_info *info, harp_program *program)
         {
             if (time_mask->mask[i])
             {
-                long new_dimension_length = 0;
+                long new_dimension_length;
 
                 if (read_block(info, variable_def, i, buffer->data) != 0)
                 {
@@ -1154,49 +1366,18 @@ static int execute_value_filter(ingest_info *info, harp_program *program)
                     return -1;
                 }
 
-                for (j = 0; j < info->dimension[dimension_type]; j++)
+                new_dimension_length =
+                    harp_operation_value_filters_update_mask(num_operations,
+                                                             &program->operation[program->current_index],
+                                                             variable_def->num_enum_values, variable_def->enum_name,
+                                                             variable_def->data_type, info->dimension[dimension_type],
+                                                             buffer->data.ptr, &dimension_mask->mask[index]);
+                if (new_dimension_length < 0)
                 {
-                    if (dimension_mask->mask[index])
-                    {
-                        for (k = 0; k < num_operations; k++)
-                        {
-                            if (dimension_mask->mask[index])
-                            {
-                                harp_operation *operation = program->operation[program->current_index + k];
-                                int result;
-
-                                if (harp_operation_is_string_value_filter(operation))
-                                {
-                                    harp_operation_string_value_filter *string_operation;
-
-                                    string_operation = (harp_operation_string_value_filter *)operation;
-                                    result = string_operation->eval(string_operation, variable_def->num_enum_values,
-                                                                    variable_def->enum_name, variable_def->data_type,
-                                                                    &buffer->data.int8_data[j * data_type_size]);
-                                }
-                                else
-                                {
-                                    harp_operation_numeric_value_filter *numeric_operation;
-
-                                    numeric_operation = (harp_operation_numeric_value_filter *)operation;
-                                    result = numeric_operation->eval(numeric_operation, variable_def->data_type,
-                                                                     &buffer->data.int8_data[j * data_type_size]);
-                                }
-                                if (result < 0)
-                                {
-                                    read_buffer_delete(buffer);
-                                    return -1;
-                                }
-                                dimension_mask->mask[index] = result;
-                            }
-                        }
-                        if (dimension_mask->mask[index])
-                        {
-                            new_dimension_length++;
-                        }
-                    }
-                    index++;
+                    read_buffer_delete(buffer);
+                    return -1;
                 }
+                index += info->dimension[dimension_type];
 
                 read_buffer_free_string_data(buffer);
 
@@ -1896,7 +2077,7 @@ static int get_product(ingest_info *info, harp_program *program)
     }
 
     /* perform remaining operations */
-    if (harp_product_execute_program(info->product, program) != 0)
+    if (harp_product_continue_program(info->product, program) != 0)
     {
         return -1;
     }
@@ -1948,12 +2129,11 @@ static int ingest(const char *filename, harp_program *program, const harp_ingest
     return 0;
 }
 
-int harp_ingest(const char *filename, const char *operations, const char *options, harp_product **product)
+/* the program is optional (can be NULL); it will be executed from the operation at program->current_index */
+int harp_ingest(const char *filename, harp_program *program, const char *options, harp_product **product)
 {
-    harp_program *program;
+    harp_program *empty_program = NULL;
     harp_ingestion_options *option_list;
-    int perform_conversions;
-    int perform_boundary_checks;
     int status;
 
     if (filename == NULL)
@@ -1973,26 +2153,20 @@ int harp_ingest(const char *filename, const char *operations, const char *option
         return -1;
     }
 
-    if (operations == NULL)
+    if (program == NULL)
     {
-        if (harp_program_new(&program) != 0)
-        {
-            return -1;
-        }
-    }
-    else
-    {
-        if (harp_program_from_string(operations, &program) != 0)
+        if (harp_program_new(&empty_program) != 0)
         {
             return -1;
         }
+        program = empty_program;
     }
 
     if (options == NULL)
     {
         if (harp_ingestion_options_new(&option_list) != 0)
         {
-            harp_program_delete(program);
+            harp_program_delete(empty_program);
             return -1;
         }
     }
@@ -2000,28 +2174,19 @@ int harp_ingest(const char *filename, const char *operations, const char *option
     {
         if (harp_ingestion_options_from_string(options, &option_list) != 0)
         {
-            harp_program_delete(program);
+            harp_program_delete(empty_program);
             return -1;
         }
     }
 
-    /* all ingestion routines that use CODA are build on the assumption that 'perform conversions' is enabled, so we
-     * explicitly enable it here just in case it was disabled somewhere else */
-    perform_conversions = coda_get_option_perform_conversions();
-    coda_set_option_perform_conversions(1);
-
-    /* we also disable the boundary checks of libcoda for increased ingestion performance */
-    perform_boundary_checks = coda_get_option_perform_boundary_checks();
-    coda_set_option_perform_boundary_checks(0);
+    set_coda_options();
 
     status = ingest(filename, program, option_list, product);
 
-    /* set the libcoda options back to their original values */
-    coda_set_option_perform_boundary_checks(perform_boundary_checks);
-    coda_set_option_perform_conversions(perform_conversions);
+    restore_coda_options();
 
     harp_ingestion_options_delete(option_list);
-    harp_program_delete(program);
+    harp_program_delete(empty_program);
     return status;
 }
 
@@ -2159,8 +2324,6 @@ static int ingest_metadata(const char *filename, const harp_ingestion_options *o
 int harp_ingest_metadata(const char *filename, const char *options, harp_product_metadata *metadata)
 {
     harp_ingestion_options *option_list;
-    int perform_conversions;
-    int perform_boundary_checks;
     int status;
 
     if (filename == NULL)
@@ -2189,20 +2352,11 @@ int harp_ingest_metadata(const char *filename, const char *options, harp_product
         }
     }
 
-    /* all ingestion routines that use CODA are build on the assumption that 'perform conversions' is enabled, so we
-     * explicitly enable it here just in case it was disabled somewhere else */
-    perform_conversions = coda_get_option_perform_conversions();
-    coda_set_option_perform_conversions(1);
-
-    /* we also disable the boundary checks of libcoda for increased ingestion performance */
-    perform_boundary_checks = coda_get_option_perform_boundary_checks();
-    coda_set_option_perform_boundary_checks(0);
+    set_coda_options();
 
     status = ingest_metadata(filename, option_list, metadata);
 
-    /* set the libcoda options back to their original values */
-    coda_set_option_perform_boundary_checks(perform_boundary_checks);
-    coda_set_option_perform_conversions(perform_conversions);
+    restore_coda_options();
 
     harp_ingestion_options_delete(option_list);
 
@@ -2231,8 +2385,6 @@ int harp_ingest_test(const char *filename, int (*print)(const char *, ...))
     const char *product_class = NULL;
     const char *product_type = NULL;
     coda_format format;
-    int perform_conversions;
-    int perform_boundary_checks;
     int num_options = 0;
     int *option_choice = NULL;
     int version;
@@ -2273,14 +2425,7 @@ int harp_ingest_test(const char *filename, int (*print)(const char *, ...))
         return -1;
     }
 
-    /* all ingestion routines that use CODA are build on the assumption that 'perform conversions' is enabled, so we
-     * explicitly enable it here just in case it was disabled somewhere else */
-    perform_conversions = coda_get_option_perform_conversions();
-    coda_set_option_perform_conversions(1);
-
-    /* we also disable the boundary checks of libcoda for increased ingestion performance */
-    perform_boundary_checks = coda_get_option_perform_boundary_checks();
-    coda_set_option_perform_boundary_checks(0);
+    set_coda_options();
 
     result = harp_ingestion_find_module(filename, &module, &product);
     if (result == 0)
@@ -2406,9 +2551,7 @@ int harp_ingest_test(const char *filename, int (*print)(const char *, ...))
         coda_close(product);
     }
 
-    /* set the libcoda options back to their original values */
-    coda_set_option_perform_boundary_checks(perform_boundary_checks);
-    coda_set_option_perform_conversions(perform_conversions);
+    restore_coda_options();
 
     harp_ingestion_options_delete(option_list);
     harp_program_delete(program);
@@ -65,8 +65,24 @@
 /* clamp function */
 #define HARP_CLAMP(var, min, max) if (var < min) var = min; if (var > max) var = max;
 
+extern int harp_option_dataset_index;
 extern int harp_option_enable_aux_afgl86;
 extern int harp_option_enable_aux_usstd76;
+extern int harp_option_num_threads;
+
+/* HARP options that can be changed by a set() operation of a program */
+typedef struct harp_program_options_struct
+{
+    int bin_spatial_weight_cache;
+    int create_collocation_datetime;
+    int enable_aux_afgl86;
+    int enable_aux_usstd76;
+    int propagate_uncertainty;
+    int regrid_out_of_bounds;
+    int regrid_precision;
+} harp_program_options;
+
+harp_program_options *harp_set_program_options(harp_program_options *options);
 
 typedef int (*harp_conversion_function)(harp_variable *variable, const harp_variable **source_variable);
 typedef int (*harp_conversion_enabled_function)(void);
@@ -142,6 +158,25 @@ void harp_array_replace_fill_value(harp_data_type data_type, long num_elements,
 int harp_array_invert(harp_data_type data_type, int dim_id, int num_dimensions, const long *dimension, harp_array data);
 int harp_array_transpose(harp_data_type data_type, int num_dimensions, const long *dimension, const int *order,
                          harp_array data);
+int harp_index_sort(long num_elements, long *index, int (*compare)(const void *context, long index_a, long index_b),
+                    const void *context);
+
+/* Thread safety */
+typedef enum harp_lock_id_enum
+{
+    harp_lock_init,     /* lazy initialisation of global state (ingestion modules, derived variables, coda options) */
+    harp_lock_io,       /* access to the netCDF/HDF4/HDF5 libraries */
+    harp_lock_operation_parser, /* the (non-reentrant) operation parser */
+    harp_lock_units,    /* udunits2 unit system and unit converter cache */
+    harp_lock_conversion_plans, /* cache of conversion plans for derived variables */
+    harp_lock_bin_spatial_weights       /* cache of grid cell weights for spatial binning */
+} harp_lock_id;
+
+#define HARP_NUM_LOCKS 6
+
+void harp_lock(harp_lock_id id);
+void harp_unlock(harp_lock_id id);
+void harp_parallel_for(long num_tasks, long work_size, void (*task)(void *context, long index), void *context);
 
 /* Auxiliary data sources */
 int harp_aux_afgl86_get_profile(const char *name, double datetime, double latitude, int *num_vertical,
@@ -176,11 +211,13 @@ int harp_product_rearrange_dimension(harp_product *product, harp_dimension_type
 int harp_product_filter_by_index(harp_product *product, const char *index_variable, long num_elements, int32_t *index);
 int harp_product_filter_dimension(harp_product *product, harp_dimension_type dimension_type, const uint8_t *mask);
 int harp_product_remove_dimension(harp_product *product, harp_dimension_type dimension_type);
+int harp_product_prepare_append(const harp_product *product, harp_product *other_product, int *compatible);
 void harp_product_remove_all_variables(harp_product *product);
 int harp_product_get_datetime_range(const harp_product *product, double *datetime_start, double *datetime_stop);
 int harp_product_get_derived_bounds_for_grid(harp_product *product, harp_variable *grid, harp_variable **bounds);
 int harp_product_get_storage_size(const harp_product *product, int with_attributes, int64_t *size);
 int harp_product_bin_full(harp_product *product);
+void harp_bin_spatial_clear_weight_cache(void);
 int harp_product_bin_spatial_full(harp_product *product, long num_latitude_edges, double *latitude_edges,
                                   long num_longitude_edges, double *longitude_edges);
 int harp_product_bin_with_collocated_dataset(harp_product *product, harp_collocation_result *collocation_result);
@@ -194,9 +231,9 @@ int harp_product_clamp_dimension(harp_product *product, harp_dimension_type dime
 int harp_import_hdf4(const char *filename, harp_product **product);
 #endif
 #ifdef HAVE_HDF5
-int harp_import_hdf5(const char *filename, harp_product **product);
+int harp_import_hdf5(const char *filename, harp_program *program, harp_product **product);
 #endif
-int harp_import_netcdf(const char *filename, harp_product **product);
+int harp_import_netcdf(const char *filename, harp_program *program, harp_product **product);
 
 #ifdef HAVE_HDF4
 int harp_export_hdf4(const char *filename, const harp_product *product);
@@ -205,6 +242,10 @@ int harp_export_hdf4(const char *filename, const harp_product *product);
 int harp_export_hdf5(const char *filename, const harp_product *product);
 #endif
 int harp_export_netcdf(const char *filename, const harp_product *product);
+typedef struct harp_netcdf_stream_struct harp_netcdf_stream;
+int harp_export_netcdf_stream_open(const char *filename, const harp_product *product, harp_netcdf_stream **stream);
+int harp_export_netcdf_stream_append(harp_netcdf_stream *stream, const harp_product *product, int *appended);
+int harp_export_netcdf_stream_close(harp_netcdf_stream *stream);
 
 #ifdef HAVE_HDF4
 int harp_import_metadata_hdf4(const char *filename, harp_product_metadata *metadata);
@@ -216,7 +257,7 @@ int harp_import_metadata_netcdf(const char *filename, harp_product_metadata *met
 int harp_parse_file_convention(const char *str, int *major, int *minor);
 
 /* Ingest */
-int harp_ingest(const char *filename, const char *operations, const char *options, harp_product **product);
+int harp_ingest(const char *filename, harp_program *program, const char *options, harp_product **product);
 int harp_ingest_test(const char *filename, int (*print)(const char *, ...));
 int harp_ingest_metadata(const char *filename, const char *options, harp_product_metadata *metadata);
 void harp_ingestion_done(void);
@@ -227,6 +268,9 @@ int harp_unit_converter_new(const char *from_unit, const char *to_unit, harp_uni
 void harp_unit_converter_delete(harp_unit_converter *unit_converter);
 float harp_unit_converter_convert_float(const harp_unit_converter *unit_converter, float value);
 double harp_unit_converter_convert_double(const harp_unit_converter *unit_converter, double value);
+void harp_unit_converter_convert_array_float(const harp_unit_converter *unit_converter, long num_values, float *value);
+void harp_unit_converter_convert_array_double(const harp_unit_converter *unit_converter, long num_values,
+                                              double *value);
 int harp_unit_compare(const char *unit_a, const char *unit_b);
 int harp_unit_is_valid(const char *str);
 void harp_unit_done(void);
@@ -248,6 +292,19 @@ void harp_variable_conversion_delete(harp_variable_conversion *conversion);
 int harp_derived_variable_list_init(void);
 int harp_derived_variable_list_add_conversion(harp_variable_conversion *conversion);
 void harp_derived_variable_list_done(void);
+void harp_derived_variable_clear_conversion_plans(void);
+
+/* Cache of intermediate variables that were derived for a product.
+ * A cache can only be used as long as the product is not modified (other than by adding derived variables).
+ */
+typedef struct harp_derived_variable_cache_struct harp_derived_variable_cache;
+
+int harp_derived_variable_cache_new(harp_derived_variable_cache **new_cache);
+void harp_derived_variable_cache_clear(harp_derived_variable_cache *cache);
+void harp_derived_variable_cache_delete(harp_derived_variable_cache *cache);
+int harp_product_add_derived_variable_with_cache(harp_product *product, harp_derived_variable_cache *cache,
+                                                 const char *name, const harp_data_type *data_type, const char *unit,
+                                                 int num_dimensions, const harp_dimension_type *dimension_type);
 
 /* Analysis functions */
 double harp_angstrom_exponent_from_aod(long num_wavelengths, const double *wavelength, const double *aod);
@@ -350,6 +407,20 @@ void harp_interpolate_array_logloglinear(long source_length, const double *sourc
 void harp_interval_interpolate_array_linear(long source_length, const double *source_grid_boundaries,
                                             const double *source_array, long target_length,
                                             const double *target_grid_boundaries, double *target_array);
+/* Precomputed interpolation from a source grid to a target grid (for applying the same interpolation to many arrays) */
+typedef struct harp_interpolation_plan_struct harp_interpolation_plan;
+int harp_interpolation_plan_new_linear(long source_length, const double *source_grid, long target_length,
+                                       const double *target_grid, int out_of_bound_flag,
+                                       harp_interpolation_plan **new_plan);
+int harp_interpolation_plan_new_logloglinear(long source_length, const double *source_grid, long target_length,
+                                             const double *target_grid, int out_of_bound_flag,
+                                             harp_interpolation_plan **new_plan);
+int harp_interval_interpolation_plan_new_linear(long source_length, const double *source_grid_boundaries,
+                                                long target_length, const double *target_grid_boundaries,
+                                                harp_interpolation_plan **new_plan);
+void harp_interpolation_plan_apply(const harp_interpolation_plan *plan, long num_elements, const double *source_array,
+                                   double *target_array);
+void harp_interpolation_plan_delete(harp_interpolation_plan *plan);
 void harp_bounds_from_midpoints_linear(long num_midpoints, const double *midpoints, int extrapolate, double *intervals);
 void harp_bounds_from_midpoints_loglinear(long num_midpoints, const double *midpoints, int extrapolate,
                                           double *intervals);
@@ -839,6 +839,409 @@ void harp_interval_interpolate_array_linear(long source_length, const double *so
     }
 }
 
+typedef enum interpolation_step_type_enum
+{
+    step_nan,   /* target value is NaN */
+    step_copy,  /* target value is source_array[index] */
+    step_interpolate,   /* interpolate between source_array[index] and source_array[index + 1] */
+    step_extrapolate    /* extrapolate from source_array[index] away from source_array[index2] */
+} interpolation_step_type;
+
+typedef struct interval_contribution_struct
+{
+    long index; /* index of the source interval */
+    double weight;      /* fraction of the source interval that overlaps with the target interval */
+} interval_contribution;
+
+struct harp_interpolation_plan_struct
+{
+    long source_length;
+    long target_length;
+    int logarithmic;    /* apply the point interpolation on log(source_array) */
+    /* point interpolation: one step per target element (all arrays share the memory block of 'v') */
+    double *v;
+    long *index;
+    long *index2;
+    interpolation_step_type *step_type;
+    /* interval interpolation: the contributions of target element i are in [offset[i], offset[i + 1]) */
+    long *offset;
+    interval_contribution *contribution;
+};
+
+static int interpolation_plan_new(long source_length, long target_length, harp_interpolation_plan **new_plan)
+{
+    harp_interpolation_plan *plan;
+
+    plan = (harp_interpolation_plan *)malloc(sizeof(harp_interpolation_plan));
+    if (plan == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(harp_interpolation_plan), __FILE__, __LINE__);
+        return -1;
+    }
+    plan->source_length = source_length;
+    plan->target_length = target_length;
+    plan->logarithmic = 0;
+    plan->v = NULL;
+    plan->index = NULL;
+    plan->index2 = NULL;
+    plan->step_type = NULL;
+    plan->offset = NULL;
+    plan->contribution = NULL;
+
+    *new_plan = plan;
+
+    return 0;
+}
+
+/* Create a plan for point interpolation that gives exactly the same results as
+ * harp_interpolate_array_linear() (logarithmic == 0) or harp_interpolate_array_logloglinear() (logarithmic == 1).
+ */
+static int interpolation_plan_new_point(long source_length, const double *source_grid, long target_length,
+                                        const double *target_grid, int out_of_bound_flag, int logarithmic,
+                                        harp_interpolation_plan **new_plan)
+{
+    harp_interpolation_plan *plan;
+    long pos = 0;
+    long i;
+
+    assert(out_of_bound_flag == 0 || out_of_bound_flag == 1 || out_of_bound_flag == 2);
+
+    if (interpolation_plan_new(source_length, target_length, &plan) != 0)
+    {
+        return -1;
+    }
+    plan->logarithmic = logarithmic;
+    if (target_length == 0)
+    {
+        *new_plan = plan;
+        return 0;
+    }
+    assert(source_length > 1);
+
+    plan->v = (double *)malloc(target_length * (sizeof(double) + 2 * sizeof(long) + sizeof(interpolation_step_type)));
+    if (plan->v == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       target_length * (sizeof(double) + 2 * sizeof(long) + sizeof(interpolation_step_type)),
+                       __FILE__, __LINE__);
+        harp_interpolation_plan_delete(plan);
+        return -1;
+    }
+    plan->index = (long *)&plan->v[target_length];
+    plan->index2 = &plan->index[target_length];
+    plan->step_type = (interpolation_step_type *)&plan->index2[target_length];
+
+    for (i = 0; i < target_length; i++)
+    {
+        double target_grid_point = target_grid[i];
+
+        plan->step_type[i] = step_nan;
+        plan->index[i] = 0;
+        plan->index2[i] = 0;
+        plan->v[i] = 0;
+
+        harp_interpolate_find_index(source_length, source_grid, target_grid_point, &pos);
+
+        if (pos == -1 || pos == source_length)
+        {
+            /* grid point is before source_grid[0] or after source_grid[source_length - 1] */
+            long edge = pos == -1 ? 0 : source_length - 1;
+            long next = pos == -1 ? 1 : source_length - 2;
+
+            if (out_of_bound_flag == 1)
+            {
+                plan->step_type[i] = step_copy;
+                plan->index[i] = edge;
+            }
+            else if (out_of_bound_flag == 2)
+            {
+                plan->step_type[i] = step_extrapolate;
+                plan->index[i] = edge;
+                plan->index2[i] = next;
+                if (logarithmic)
+                {
+                    plan->v[i] = log(target_grid_point / source_grid[edge]) /
+                        log(source_grid[edge] / source_grid[next]);
+                }
+                else
+                {
+                    plan->v[i] = (target_grid_point - source_grid[edge]) / (source_grid[edge] - source_grid[next]);
+                }
+            }
+        }
+        else if (target_grid_point == source_grid[pos])
+        {
+            /* don't interpolate, but take exact point */
+            plan->step_type[i] = step_copy;
+            plan->index[i] = pos;
+        }
+        else if (target_grid_point == source_grid[pos + 1])
+        {
+            /* don't interpolate, but take exact point */
+            plan->step_type[i] = step_copy;
+            plan->index[i] = pos + 1;
+        }
+        else
+        {
+            /* grid point is between source_grid[pos] and source_grid[pos + 1] */
+            plan->step_type[i] = step_interpolate;
+            plan->index[i] = pos;
+            if (logarithmic)
+            {
+                plan->v[i] = log(target_grid_point / source_grid[pos]) / log(source_grid[pos + 1] / source_grid[pos]);
+            }
+            else
+            {
+                plan->v[i] = (target_grid_point - source_grid[pos]) / (source_grid[pos + 1] - source_grid[pos]);
+            }
+        }
+    }
+
+    *new_plan = plan;
+
+    return 0;
+}
+
+/* Create a plan for interpolating arrays from source grid to target grid using linear interpolation.
+ * Applying the plan gives the same results as harp_interpolate_array_linear(), but the lookup of the source grid
+ * positions is only performed once (which pays off when the same grids are used for many arrays).
+ */
+int harp_interpolation_plan_new_linear(long source_length, const double *source_grid, long target_length,
+                                       const double *target_grid, int out_of_bound_flag,
+                                       harp_interpolation_plan **new_plan)
+{
+    return interpolation_plan_new_point(source_length, source_grid, target_length, target_grid, out_of_bound_flag, 0,
+                                        new_plan);
+}
+
+/* Create a plan for interpolating arrays from source grid to target grid using log/log linear interpolation.
+ * Applying the plan gives the same results as harp_interpolate_array_logloglinear().
+ */
+int harp_interpolation_plan_new_logloglinear(long source_length, const double *source_grid, long target_length,
+                                             const double *target_grid, int out_of_bound_flag,
+                                             harp_interpolation_plan **new_plan)
+{
+    return interpolation_plan_new_point(source_length, source_grid, target_length, target_grid, out_of_bound_flag, 1,
+                                        new_plan);
+}
+
+/* Create a plan for interpolating arrays from source grid to target grid using interval interpolation.
+ * Applying the plan gives the same results as harp_interval_interpolate_array_linear().
+ */
+int harp_interval_interpolation_plan_new_linear(long source_length, const double *source_grid_boundaries,
+                                                long target_length, const double *target_grid_boundaries,
+                                                harp_interpolation_plan **new_plan)
+{
+    harp_interpolation_plan *plan;
+    long num_contributions = 0;
+    long max_contributions;
+    long i, j;
+
+    if (interpolation_plan_new(source_length, target_length, &plan) != 0)
+    {
+        return -1;
+    }
+    plan->offset = (long *)malloc((target_length + 1) * sizeof(long));
+    if (plan->offset == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (target_length + 1) * sizeof(long), __FILE__, __LINE__);
+        harp_interpolation_plan_delete(plan);
+        return -1;
+    }
+
+    /* for monotonic grids the number of overlapping intervals is at most source_length + target_length - 1 */
+    max_contributions = source_length + target_length;
+
+    for (i = 0; i < target_length; i++)
+    {
+        double xminb, xmaxb;
+
+        plan->offset[i] = num_contributions;
+
+        if (target_grid_boundaries[2 * i] < target_grid_boundaries[2 * i + 1])
+        {
+            xminb = target_grid_boundaries[2 * i];
+            xmaxb = target_grid_boundaries[2 * i + 1];
+        }
+        else
+        {
+            xminb = target_grid_boundaries[2 * i + 1];
+            xmaxb = target_grid_boundaries[2 * i];
+        }
+
+        for (j = 0; j < source_length; j++)
+        {
+            double xmina, xmaxa;
+
+            if (source_grid_boundaries[2 * j] < source_grid_boundaries[2 * j + 1])
+            {
+                xmina = source_grid_boundaries[2 * j];
+                xmaxa = source_grid_boundaries[2 * j + 1];
+            }
+            else
+            {
+                xmina = source_grid_boundaries[2 * j + 1];
+                xmaxa = source_grid_boundaries[2 * j];
+            }
+
+            if (!(xmina >= xmaxb || xminb >= xmaxa))
+            {
+                double xminc, xmaxc;
+
+                if (plan->contribution == NULL || num_contributions == max_contributions)
+                {
+                    interval_contribution *contribution;
+
+                    if (plan->contribution != NULL)
+                    {
+                        max_contributions *= 2;
+                    }
+                    contribution = (interval_contribution *)realloc(plan->contribution,
+                                                                    max_contributions * sizeof(interval_contribution));
+                    if (contribution == NULL)
+                    {
+                        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) "
+                                       "(%s:%u)", max_contributions * sizeof(interval_contribution), __FILE__,
+                                       __LINE__);
+                        harp_interpolation_plan_delete(plan);
+                        return -1;
+                    }
+                    plan->contribution = contribution;
+                }
+
+                /* calculate intersection interval C of intervals A and B */
+                xminc = xmina < xminb ? xminb : xmina;
+                xmaxc = xmaxa > xmaxb ? xmaxb : xmaxa;
+
+                plan->contribution[num_contributions].index = j;
+                plan->contribution[num_contributions].weight = (xmaxc - xminc) / (xmaxa - xmina);
+                num_contributions++;
+            }
+        }
+    }
+    plan->offset[target_length] = num_contributions;
+
+    *new_plan = plan;
+
+    return 0;
+}
+
+/* Apply an interpolation plan to a set of arrays.
+ * source_array is treated as a [source_length, num_elements] array and target_array as a
+ * [target_length, num_elements] array, where each of the num_elements columns is interpolated independently.
+ */
+void harp_interpolation_plan_apply(const harp_interpolation_plan *plan, long num_elements, const double *source_array,
+                                   double *target_array)
+{
+    double nan_value = harp_nan();
+    long i, l;
+
+    if (plan->offset != NULL)
+    {
+        for (i = 0; i < plan->target_length; i++)
+        {
+            double *target = &target_array[i * num_elements];
+
+            for (l = 0; l < num_elements; l++)
+            {
+                long num_valid_contributions = 0;
+                double sum = 0.0;
+                long j;
+
+                for (j = plan->offset[i]; j < plan->offset[i + 1]; j++)
+                {
+                    double value = source_array[plan->contribution[j].index * num_elements + l];
+
+                    if (!harp_isnan(value))
+                    {
+                        sum += plan->contribution[j].weight * value;
+                        num_valid_contributions++;
+                    }
+                }
+                target[l] = num_valid_contributions != 0 ? sum : nan_value;
+            }
+        }
+        return;
+    }
+
+    for (i = 0; i < plan->target_length; i++)
+    {
+        const double *source = &source_array[plan->index[i] * num_elements];
+        const double *source2;
+        double *target = &target_array[i * num_elements];
+        double v = plan->v[i];
+
+        switch (plan->step_type[i])
+        {
+            case step_nan:
+                for (l = 0; l < num_elements; l++)
+                {
+                    target[l] = nan_value;
+                }
+                break;
+            case step_copy:
+                for (l = 0; l < num_elements; l++)
+                {
+                    target[l] = source[l];
+                }
+                break;
+            case step_interpolate:
+                source2 = &source_array[(plan->index[i] + 1) * num_elements];
+                if (plan->logarithmic)
+                {
+                    for (l = 0; l < num_elements; l++)
+                    {
+                        target[l] = exp((1 - v) * log(source[l]) + v * log(source2[l]));
+                    }
+                }
+                else
+                {
+                    for (l = 0; l < num_elements; l++)
+                    {
+                        target[l] = (1 - v) * source[l] + v * source2[l];
+                    }
+                }
+                break;
+            case step_extrapolate:
+                source2 = &source_array[plan->index2[i] * num_elements];
+                if (plan->logarithmic)
+                {
+                    for (l = 0; l < num_elements; l++)
+                    {
+                        target[l] = exp((1 + v) * log(source[l]) - v * log(source2[l]));
+                    }
+                }
+                else
+                {
+                    for (l = 0; l < num_elements; l++)
+                    {
+                        target[l] = source[l] + v * (source[l] - source2[l]);
+                    }
+                }
+                break;
+        }
+    }
+}
+
+void harp_interpolation_plan_delete(harp_interpolation_plan *plan)
+{
+    if (plan->v != NULL)
+    {
+        free(plan->v);
+    }
+    if (plan->offset != NULL)
+    {
+        free(plan->offset);
+    }
+    if (plan->contribution != NULL)
+    {
+        free(plan->contribution);
+    }
+    free(plan);
+}
+
 /* Determine boundary intervals based on linear inter-/extrapolation of mid points.
  * Any trailing NaN values in the mid point array will be ignored (and corresponding bounds values will be set to NaN).
  * The bounds array will be treated as a [num_midpoints,2] array and should thus be allocated
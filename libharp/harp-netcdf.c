@@ -30,6 +30,7 @@
  */
 
 #include "harp-internal.h"
+#include "harp-program.h"
 
 #include <assert.h>
 #include <stdio.h>
@@ -425,19 +426,15 @@ static int read_numeric_attribute(int ncid, int varid, const char *name, harp_da
     return 0;
 }
 
-static int read_variable(harp_product *product, int ncid, int varid, netcdf_dimensions *dimensions)
+static int read_variable_definition(int ncid, int varid, netcdf_dimensions *dimensions, char *netcdf_name,
+                                    harp_data_type *data_type, int *num_dimensions,
+                                    harp_dimension_type *dimension_type, long *dimension, size_t *netcdf_dimension)
 {
-    harp_variable *variable;
-    harp_data_type data_type;
-    int num_dimensions;
-    harp_dimension_type dimension_type[HARP_MAX_NUM_DIMS];
-    long dimension[HARP_MAX_NUM_DIMS];
-    char netcdf_name[NC_MAX_NAME + 1];
     nc_type netcdf_data_type;
     int netcdf_num_dimensions;
     int netcdf_dim_id[NC_MAX_VAR_DIMS];
     int result;
-    long i;
+    int i;
 
     result = nc_inq_var(ncid, varid, netcdf_name, &netcdf_data_type, &netcdf_num_dimensions, netcdf_dim_id, NULL);
     if (result != NC_NOERR)
@@ -446,41 +443,41 @@ static int read_variable(harp_product *product, int ncid, int varid, netcdf_dime
         return -1;
     }
 
-    if (get_harp_type(netcdf_data_type, &data_type) != 0)
+    if (get_harp_type(netcdf_data_type, data_type) != 0)
     {
         harp_add_error_message(" (variable '%s')", netcdf_name);
         return -1;
     }
 
-    num_dimensions = netcdf_num_dimensions;
+    *num_dimensions = netcdf_num_dimensions;
 
-    if (data_type == harp_type_string)
+    if (*data_type == harp_type_string)
     {
-        if (num_dimensions == 0)
+        if (*num_dimensions == 0)
         {
             harp_set_error(HARP_ERROR_IMPORT, "variable '%s' of type '%s' has 0 dimensions; expected >= 1",
                            netcdf_name, harp_get_data_type_name(harp_type_string));
             return -1;
         }
 
-        if (dimensions->type[netcdf_dim_id[num_dimensions - 1]] != netcdf_dimension_string)
+        if (dimensions->type[netcdf_dim_id[*num_dimensions - 1]] != netcdf_dimension_string)
         {
             harp_set_error(HARP_ERROR_IMPORT, "inner-most dimension of variable '%s' is of type '%s'; expected '%s'",
-                           netcdf_name, get_dimension_type_name(dimensions->type[netcdf_dim_id[num_dimensions - 1]]),
+                           netcdf_name, get_dimension_type_name(dimensions->type[netcdf_dim_id[*num_dimensions - 1]]),
                            get_dimension_type_name(netcdf_dimension_string));
             return -1;
         }
 
-        num_dimensions--;
+        (*num_dimensions)--;
     }
 
-    if (num_dimensions > HARP_MAX_NUM_DIMS)
+    if (*num_dimensions > HARP_MAX_NUM_DIMS)
     {
         harp_set_error(HARP_ERROR_IMPORT, "variable '%s' has too many dimensions", netcdf_name);
         return -1;
     }
 
-    for (i = 0; i < num_dimensions; i++)
+    for (i = 0; i < *num_dimensions; i++)
     {
         if (get_harp_dimension_type(dimensions->type[netcdf_dim_id[i]], &dimension_type[i]) != 0)
         {
@@ -489,11 +486,181 @@ static int read_variable(harp_product *product, int ncid, int varid, netcdf_dime
         }
     }
 
-    for (i = 0; i < num_dimensions; i++)
+    for (i = 0; i < *num_dimensions; i++)
     {
         dimension[i] = dimensions->length[netcdf_dim_id[i]];
     }
 
+    if (netcdf_dimension != NULL)
+    {
+        for (i = 0; i < netcdf_num_dimensions; i++)
+        {
+            netcdf_dimension[i] = (size_t)dimensions->length[netcdf_dim_id[i]];
+        }
+    }
+
+    return 0;
+}
+
+/* Read the data of a variable; if a time mask is given then only the selected samples of the time dimension (which
+ * should be the first dimension) are read using one hyperslab read per contiguous range of selected samples.
+ */
+static int read_variable_data(int ncid, int varid, harp_data_type data_type, int netcdf_num_dimensions,
+                              const size_t *netcdf_dimension, const harp_dimension_mask *time_mask, void *buffer)
+{
+    size_t start[NC_MAX_VAR_DIMS];
+    size_t count[NC_MAX_VAR_DIMS];
+    long block_size;
+    long offset = 0;
+    long i;
+    int result;
+
+    if (time_mask == NULL)
+    {
+        switch (data_type)
+        {
+            case harp_type_int8:
+                result = nc_get_var_schar(ncid, varid, buffer);
+                break;
+            case harp_type_int16:
+                result = nc_get_var_short(ncid, varid, buffer);
+                break;
+            case harp_type_int32:
+                result = nc_get_var_int(ncid, varid, buffer);
+                break;
+            case harp_type_float:
+                result = nc_get_var_float(ncid, varid, buffer);
+                break;
+            case harp_type_double:
+                result = nc_get_var_double(ncid, varid, buffer);
+                break;
+            case harp_type_string:
+                result = nc_get_var_text(ncid, varid, buffer);
+                break;
+            default:
+                assert(0);
+                exit(1);
+        }
+
+        if (result != NC_NOERR)
+        {
+            harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
+            return -1;
+        }
+
+        return 0;
+    }
+
+    assert(netcdf_num_dimensions > 0);
+
+    block_size = (data_type == harp_type_string ? 1 : harp_get_size_for_type(data_type));
+    for (i = 0; i < netcdf_num_dimensions; i++)
+    {
+        start[i] = 0;
+        count[i] = netcdf_dimension[i];
+        if (i > 0)
+        {
+            block_size *= (long)netcdf_dimension[i];
+        }
+    }
+
+    i = 0;
+    while (i < time_mask->num_elements)
+    {
+        char *ptr = &((char *)buffer)[offset * block_size];
+
+        if (!time_mask->mask[i])
+        {
+            i++;
+            continue;
+        }
+        start[0] = i;
+        while (i < time_mask->num_elements && time_mask->mask[i])
+        {
+            i++;
+        }
+        count[0] = i - start[0];
+
+        switch (data_type)
+        {
+            case harp_type_int8:
+                result = nc_get_vara_schar(ncid, varid, start, count, (signed char *)ptr);
+                break;
+            case harp_type_int16:
+                result = nc_get_vara_short(ncid, varid, start, count, (short *)ptr);
+                break;
+            case harp_type_int32:
+                result = nc_get_vara_int(ncid, varid, start, count, (int *)ptr);
+                break;
+            case harp_type_float:
+                result = nc_get_vara_float(ncid, varid, start, count, (float *)ptr);
+                break;
+            case harp_type_double:
+                result = nc_get_vara_double(ncid, varid, start, count, (double *)ptr);
+                break;
+            case harp_type_string:
+                result = nc_get_vara_text(ncid, varid, start, count, ptr);
+                break;
+            default:
+                assert(0);
+                exit(1);
+        }
+
+        if (result != NC_NOERR)
+        {
+            harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
+            return -1;
+        }
+
+        offset += (long)count[0];
+    }
+
+    return 0;
+}
+
+static int read_variable(harp_product *product, int ncid, int varid, netcdf_dimensions *dimensions,
+                         const harp_dimension_mask *time_mask)
+{
+    harp_variable *variable;
+    harp_data_type data_type;
+    int num_dimensions;
+    harp_dimension_type dimension_type[HARP_MAX_NUM_DIMS];
+    long dimension[HARP_MAX_NUM_DIMS];
+    char netcdf_name[NC_MAX_NAME + 1];
+    size_t netcdf_dimension[NC_MAX_VAR_DIMS];
+    int netcdf_num_dimensions;
+    int result;
+    long i;
+
+    if (read_variable_definition(ncid, varid, dimensions, netcdf_name, &data_type, &num_dimensions, dimension_type,
+                                 dimension, netcdf_dimension) != 0)
+    {
+        return -1;
+    }
+    netcdf_num_dimensions = (data_type == harp_type_string ? num_dimensions + 1 : num_dimensions);
+
+    if (time_mask != NULL)
+    {
+        if (num_dimensions > 0 && dimension_type[0] == harp_dimension_time)
+        {
+            dimension[0] = time_mask->masked_dimension_length;
+        }
+        else
+        {
+            /* variable does not depend on time */
+            time_mask = NULL;
+        }
+        for (i = 1; i < num_dimensions; i++)
+        {
+            if (dimension_type[i] == harp_dimension_time)
+            {
+                harp_set_error(HARP_ERROR_IMPORT, "variable '%s' should have time dimension as first dimension",
+                               netcdf_name);
+                return -1;
+            }
+        }
+    }
+
     if (harp_variable_new(netcdf_name, data_type, num_dimensions, dimension_type, dimension, &variable) != 0)
     {
         return -1;
@@ -512,7 +679,7 @@ static int read_variable(harp_product *product, int ncid, int varid, netcdf_dime
         long length;
 
         assert(netcdf_num_dimensions > 0);
-        length = dimensions->length[netcdf_dim_id[netcdf_num_dimensions - 1]];
+        length = (long)netcdf_dimension[netcdf_num_dimensions - 1];
 
         buffer = malloc(variable->num_elements * length * sizeof(char));
         if (buffer == NULL)
@@ -522,10 +689,9 @@ static int read_variable(harp_product *product, int ncid, int varid, netcdf_dime
             return -1;
         }
 
-        result = nc_get_var_text(ncid, varid, buffer);
-        if (result != NC_NOERR)
+        if (read_variable_data(ncid, varid, data_type, netcdf_num_dimensions, netcdf_dimension, time_mask, buffer)
+            != 0)
         {
-            harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
             free(buffer);
             return -1;
         }
@@ -552,31 +718,9 @@ static int read_variable(harp_product *product, int ncid, int varid, netcdf_dime
     }
     else
     {
-        switch (data_type)
+        if (read_variable_data(ncid, varid, data_type, netcdf_num_dimensions, netcdf_dimension, time_mask,
+                               variable->data.ptr) != 0)
         {
-            case harp_type_int8:
-                result = nc_get_var_schar(ncid, varid, variable->data.int8_data);
-                break;
-            case harp_type_int16:
-                result = nc_get_var_short(ncid, varid, variable->data.int16_data);
-                break;
-            case harp_type_int32:
-                result = nc_get_var_int(ncid, varid, variable->data.int32_data);
-                break;
-            case harp_type_float:
-                result = nc_get_var_float(ncid, varid, variable->data.float_data);
-                break;
-            case harp_type_double:
-                result = nc_get_var_double(ncid, varid, variable->data.double_data);
-                break;
-            default:
-                assert(0);
-                exit(1);
-        }
-
-        if (result != NC_NOERR)
-        {
-            harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
             return -1;
         }
     }
@@ -714,7 +858,129 @@ static int verify_product(int ncid)
     return -1;
 }
 
-static int read_product(int ncid, harp_product *product, netcdf_dimensions *dimensions)
+/* Only read the variables (and the time samples) that remain after the leading keep/exclude/filter operations of the
+ * program. The variables needed for the filters are read first; on success program->current_index is moved beyond the
+ * operations that were applied.
+ */
+static int read_variables_with_program(int ncid, int num_variables, harp_product *product,
+                                       netcdf_dimensions *dimensions, harp_program *program)
+{
+    harp_program_import_mask *mask;
+    harp_product *filter_product = NULL;
+    int i;
+
+    if (harp_program_import_mask_new(&mask) != 0)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < num_variables; i++)
+    {
+        harp_data_type data_type;
+        int num_dimensions;
+        harp_dimension_type dimension_type[HARP_MAX_NUM_DIMS];
+        long dimension[HARP_MAX_NUM_DIMS];
+        char netcdf_name[NC_MAX_NAME + 1];
+
+        if (read_variable_definition(ncid, i, dimensions, netcdf_name, &data_type, &num_dimensions, dimension_type,
+                                     dimension, NULL) != 0)
+        {
+            harp_program_import_mask_delete(mask);
+            return -1;
+        }
+        if (harp_program_import_mask_add_variable(mask, netcdf_name, num_dimensions, dimension_type, dimension) != 0)
+        {
+            harp_program_import_mask_delete(mask);
+            return -1;
+        }
+    }
+
+    if (harp_program_import_mask_apply_variable_operations(mask, program) != 0)
+    {
+        harp_program_import_mask_delete(mask);
+        return -1;
+    }
+
+    if (mask->has_filter)
+    {
+        if (harp_product_new(&filter_product) != 0)
+        {
+            harp_program_import_mask_delete(mask);
+            return -1;
+        }
+        for (i = 0; i < num_variables; i++)
+        {
+            if (mask->filter_variable_mask[i])
+            {
+                if (read_variable(filter_product, ncid, i, dimensions, NULL) != 0)
+                {
+                    harp_product_delete(filter_product);
+                    harp_program_import_mask_delete(mask);
+                    return -1;
+                }
+            }
+        }
+        if (harp_program_import_mask_apply_filter_operations(mask, program, filter_product) != 0)
+        {
+            harp_product_delete(filter_product);
+            harp_program_import_mask_delete(mask);
+            return -1;
+        }
+    }
+
+    if (!mask->is_empty)
+    {
+        for (i = 0; i < num_variables; i++)
+        {
+            if (!mask->variable_mask[i])
+            {
+                continue;
+            }
+            if (mask->filter_variable_mask[i])
+            {
+                /* move the variable that was already read for the filter operations */
+                if (harp_program_import_mask_move_variable(mask, i, filter_product, product) != 0)
+                {
+                    harp_product_delete(filter_product);
+                    harp_program_import_mask_delete(mask);
+                    return -1;
+                }
+            }
+            else if (mask->time_mask != NULL && !mask->read_time_ranges)
+            {
+                /* read the full variable and filter it afterwards */
+                if (read_variable(filter_product, ncid, i, dimensions, NULL) != 0 ||
+                    harp_program_import_mask_move_variable(mask, i, filter_product, product) != 0)
+                {
+                    harp_product_delete(filter_product);
+                    harp_program_import_mask_delete(mask);
+                    return -1;
+                }
+            }
+            else if (read_variable(product, ncid, i, dimensions, mask->time_mask) != 0)
+            {
+                if (filter_product != NULL)
+                {
+                    harp_product_delete(filter_product);
+                }
+                harp_program_import_mask_delete(mask);
+                return -1;
+            }
+        }
+    }
+
+    program->current_index += mask->num_operations;
+
+    if (filter_product != NULL)
+    {
+        harp_product_delete(filter_product);
+    }
+    harp_program_import_mask_delete(mask);
+
+    return 0;
+}
+
+static int read_product(int ncid, harp_product *product, netcdf_dimensions *dimensions, harp_program *program)
 {
     int num_dimensions;
     int num_variables;
@@ -755,13 +1021,23 @@ static int read_product(int ncid, harp_product *product, netcdf_dimensions *dime
         }
     }
 
-    for (i = 0; i < num_variables; i++)
+    if (program != NULL && program->current_index < program->num_operations)
     {
-        if (read_variable(product, ncid, i, dimensions) != 0)
+        if (read_variables_with_program(ncid, num_variables, product, dimensions, program) != 0)
         {
             return -1;
         }
     }
+    else
+    {
+        for (i = 0; i < num_variables; i++)
+        {
+            if (read_variable(product, ncid, i, dimensions, NULL) != 0)
+            {
+                return -1;
+            }
+        }
+    }
 
     result = nc_inq_att(ncid, NC_GLOBAL, "source_product", NULL, NULL);
     if (result == NC_NOERR)
@@ -794,7 +1070,7 @@ static int read_product(int ncid, harp_product *product, netcdf_dimensions *dime
     return 0;
 }
 
-int harp_import_netcdf(const char *filename, harp_product **product)
+int harp_import_netcdf(const char *filename, harp_program *program, harp_product **product)
 {
     harp_product *new_product;
     netcdf_dimensions dimensions;
@@ -828,7 +1104,7 @@ int harp_import_netcdf(const char *filename, harp_product **product)
 
     dimensions_init(&dimensions);
 
-    if (read_product(ncid, new_product, &dimensions) != 0)
+    if (read_product(ncid, new_product, &dimensions, program) != 0)
     {
         dimensions_done(&dimensions);
         harp_product_delete(new_product);
@@ -1017,7 +1293,7 @@ int harp_import_metadata_netcdf(const char *filename, harp_product_metadata *met
     return 0;
 }
 
-static int write_dimensions(int ncid, const netcdf_dimensions *dimensions)
+static int write_dimensions(int ncid, const netcdf_dimensions *dimensions, int unlimited_time)
 {
     int result;
     int i;
@@ -1040,6 +1316,10 @@ static int write_dimensions(int ncid, const netcdf_dimensions *dimensions)
             sprintf(name, "string_%ld", dimensions->length[i]);
             result = nc_def_dim(ncid, name, dimensions->length[i], &dim_id);
         }
+        else if (dimensions->type[i] == netcdf_dimension_time && unlimited_time)
+        {
+            result = nc_def_dim(ncid, get_dimension_type_name(dimensions->type[i]), NC_UNLIMITED, &dim_id);
+        }
         else
         {
             result = nc_def_dim(ncid, get_dimension_type_name(dimensions->type[i]), dimensions->length[i], &dim_id);
@@ -1286,11 +1566,32 @@ static int write_variable(int ncid, int varid, const harp_variable *variable)
     return 0;
 }
 
-static int write_product(int ncid, const harp_product *product, netcdf_dimensions *dimensions)
+static int write_datetime_range_attributes(int ncid, double datetime_start, double datetime_stop)
+{
+    harp_scalar value;
+
+    value.double_data = datetime_start;
+    if (write_numeric_attribute(ncid, NC_GLOBAL, "datetime_start", harp_type_double, value) != 0)
+    {
+        return -1;
+    }
+
+    value.double_data = datetime_stop;
+    if (write_numeric_attribute(ncid, NC_GLOBAL, "datetime_stop", harp_type_double, value) != 0)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Write attributes, dimensions, and variable definitions of the product.
+ * If 'unlimited_time' is set, the time dimension is created as the (unlimited) record dimension and the datetime range
+ * attributes are not written.
+ */
+static int write_product_definition(int ncid, const harp_product *product, netcdf_dimensions *dimensions,
+                                    int unlimited_time)
 {
-    harp_scalar datetime_start;
-    harp_scalar datetime_stop;
-    int result;
     int i;
 
     /* write conventions */
@@ -1300,16 +1601,17 @@ static int write_product(int ncid, const harp_product *product, netcdf_dimension
     }
 
     /* write attributes */
-    if (harp_product_get_datetime_range(product, &datetime_start.double_data, &datetime_stop.double_data) == 0)
+    if (!unlimited_time)
     {
-        if (write_numeric_attribute(ncid, NC_GLOBAL, "datetime_start", harp_type_double, datetime_start) != 0)
-        {
-            return -1;
-        }
+        double datetime_start;
+        double datetime_stop;
 
-        if (write_numeric_attribute(ncid, NC_GLOBAL, "datetime_stop", harp_type_double, datetime_stop) != 0)
+        if (harp_product_get_datetime_range(product, &datetime_start, &datetime_stop) == 0)
         {
-            return -1;
+            if (write_datetime_range_attributes(ncid, datetime_start, datetime_stop) != 0)
+            {
+                return -1;
+            }
         }
     }
 
@@ -1366,7 +1668,7 @@ static int write_product(int ncid, const harp_product *product, netcdf_dimension
     }
 
     /* write dimensions */
-    if (write_dimensions(ncid, dimensions) != 0)
+    if (write_dimensions(ncid, dimensions, unlimited_time) != 0)
     {
         return -1;
     }
@@ -1383,6 +1685,19 @@ static int write_product(int ncid, const harp_product *product, netcdf_dimension
         assert(varid == i);
     }
 
+    return 0;
+}
+
+static int write_product(int ncid, const harp_product *product, netcdf_dimensions *dimensions)
+{
+    int result;
+    int i;
+
+    if (write_product_definition(ncid, product, dimensions, 0) != 0)
+    {
+        return -1;
+    }
+
     result = nc_enddef(ncid);
     if (result != NC_NOERR)
     {
@@ -1461,3 +1776,381 @@ int harp_export_netcdf(const char *filename, const harp_product *product)
 
     return 0;
 }
+
+/* Streaming export: the time dimension is stored as the netCDF record dimension, so the data of each product can be
+ * written as additional records without keeping the already exported data in memory.
+ */
+struct harp_netcdf_stream_struct
+{
+    char *filename;
+    int ncid;
+    int num_variables;
+    char **variable_name;
+    long *string_length;        /* length of the string dimension for string variables (0 otherwise) */
+    long num_records;
+    int has_datetime_range;
+    double datetime_start;
+    double datetime_stop;
+};
+
+static void netcdf_stream_delete(harp_netcdf_stream *stream)
+{
+    int i;
+
+    if (stream->variable_name != NULL)
+    {
+        for (i = 0; i < stream->num_variables; i++)
+        {
+            if (stream->variable_name[i] != NULL)
+            {
+                free(stream->variable_name[i]);
+            }
+        }
+        free(stream->variable_name);
+    }
+    if (stream->string_length != NULL)
+    {
+        free(stream->string_length);
+    }
+    if (stream->filename != NULL)
+    {
+        free(stream->filename);
+    }
+    free(stream);
+}
+
+static int write_variable_records(int ncid, int varid, const harp_variable *variable, long record_offset,
+                                  long string_length)
+{
+    size_t start[NC_MAX_VAR_DIMS];
+    size_t count[NC_MAX_VAR_DIMS];
+    int result = NC_NOERR;
+    int i;
+
+    assert(variable->num_dimensions > 0 && variable->dimension_type[0] == harp_dimension_time);
+
+    start[0] = (size_t)record_offset;
+    count[0] = (size_t)variable->dimension[0];
+    for (i = 1; i < variable->num_dimensions; i++)
+    {
+        start[i] = 0;
+        count[i] = (size_t)variable->dimension[i];
+    }
+
+    switch (variable->data_type)
+    {
+        case harp_type_int8:
+            result = nc_put_vara_schar(ncid, varid, start, count, variable->data.ptr);
+            break;
+        case harp_type_int16:
+            result = nc_put_vara_short(ncid, varid, start, count, variable->data.ptr);
+            break;
+        case harp_type_int32:
+            result = nc_put_vara_int(ncid, varid, start, count, variable->data.ptr);
+            break;
+        case harp_type_float:
+            result = nc_put_vara_float(ncid, varid, start, count, variable->data.ptr);
+            break;
+        case harp_type_double:
+            result = nc_put_vara_double(ncid, varid, start, count, variable->data.ptr);
+            break;
+        case harp_type_string:
+            {
+                char *buffer;
+
+                if (harp_get_char_array_from_string_array(variable->num_elements, variable->data.string_data,
+                                                          string_length, NULL, &buffer) != 0)
+                {
+                    return -1;
+                }
+
+                start[variable->num_dimensions] = 0;
+                count[variable->num_dimensions] = (size_t)string_length;
+                result = nc_put_vara_text(ncid, varid, start, count, buffer);
+                free(buffer);
+            }
+            break;
+    }
+
+    if (result != NC_NOERR)
+    {
+        harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
+        return -1;
+    }
+
+    return 0;
+}
+
+static void netcdf_stream_update_datetime_range(harp_netcdf_stream *stream, const harp_product *product)
+{
+    double datetime_start;
+    double datetime_stop;
+
+    if (harp_product_get_datetime_range(product, &datetime_start, &datetime_stop) != 0)
+    {
+        /* product does not contribute to the datetime range */
+        return;
+    }
+    if (!stream->has_datetime_range || datetime_start < stream->datetime_start)
+    {
+        stream->datetime_start = datetime_start;
+    }
+    if (!stream->has_datetime_range || datetime_stop > stream->datetime_stop)
+    {
+        stream->datetime_stop = datetime_stop;
+    }
+    stream->has_datetime_range = 1;
+}
+
+/* Create a netCDF file with the definitions of the (time dependent) product variables and write the product data as
+ * the first records of the file.
+ */
+int harp_export_netcdf_stream_open(const char *filename, const harp_product *product, harp_netcdf_stream **new_stream)
+{
+    harp_netcdf_stream *stream;
+    netcdf_dimensions dimensions;
+    int result;
+    int i;
+
+    if (filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "filename is NULL");
+        return -1;
+    }
+
+    if (product == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "product is NULL");
+        return -1;
+    }
+
+    stream = (harp_netcdf_stream *)malloc(sizeof(harp_netcdf_stream));
+    if (stream == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(harp_netcdf_stream), __FILE__, __LINE__);
+        return -1;
+    }
+    stream->filename = NULL;
+    stream->ncid = -1;
+    stream->num_variables = 0;
+    stream->variable_name = NULL;
+    stream->string_length = NULL;
+    stream->num_records = 0;
+    stream->has_datetime_range = 0;
+    stream->datetime_start = 0;
+    stream->datetime_stop = 0;
+
+    stream->filename = strdup(filename);
+    if (stream->filename == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        netcdf_stream_delete(stream);
+        return -1;
+    }
+
+    if (product->num_variables > 0)
+    {
+        stream->variable_name = (char **)malloc(product->num_variables * sizeof(char *));
+        if (stream->variable_name == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           product->num_variables * sizeof(char *), __FILE__, __LINE__);
+            netcdf_stream_delete(stream);
+            return -1;
+        }
+        stream->string_length = (long *)malloc(product->num_variables * sizeof(long));
+        if (stream->string_length == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           product->num_variables * sizeof(long), __FILE__, __LINE__);
+            netcdf_stream_delete(stream);
+            return -1;
+        }
+    }
+    for (i = 0; i < product->num_variables; i++)
+    {
+        harp_variable *variable = product->variable[i];
+
+        if (variable->num_dimensions == 0 || variable->dimension_type[0] != harp_dimension_time)
+        {
+            harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "variable '%s' should have time as first dimension",
+                           variable->name);
+            netcdf_stream_delete(stream);
+            return -1;
+        }
+        stream->variable_name[i] = strdup(variable->name);
+        if (stream->variable_name[i] == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                           __LINE__);
+            netcdf_stream_delete(stream);
+            return -1;
+        }
+        stream->num_variables++;
+        stream->string_length[i] = 0;
+        if (variable->data_type == harp_type_string)
+        {
+            stream->string_length[i] = harp_get_max_string_length(variable->num_elements, variable->data.string_data);
+            if (stream->string_length[i] == 0)
+            {
+                stream->string_length[i] = 1;
+            }
+        }
+    }
+
+    /* the total size is not known in advance, so always use 64-bit offsets */
+    result = nc_create(filename, NC_64BIT_OFFSET, &stream->ncid);
+    if (result != NC_NOERR)
+    {
+        harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
+        harp_add_error_message(" (%s)", filename);
+        netcdf_stream_delete(stream);
+        return -1;
+    }
+
+    /* all records will be written explicitly */
+    result = nc_set_fill(stream->ncid, NC_NOFILL, NULL);
+    if (result != NC_NOERR)
+    {
+        harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
+        harp_add_error_message(" (%s)", filename);
+        nc_close(stream->ncid);
+        netcdf_stream_delete(stream);
+        return -1;
+    }
+
+    dimensions_init(&dimensions);
+    if (write_product_definition(stream->ncid, product, &dimensions, 1) != 0)
+    {
+        harp_add_error_message(" (%s)", filename);
+        dimensions_done(&dimensions);
+        nc_close(stream->ncid);
+        netcdf_stream_delete(stream);
+        return -1;
+    }
+    dimensions_done(&dimensions);
+
+    /* reserve header space for the datetime range attributes that are written when the stream is closed */
+    result = nc__enddef(stream->ncid, 256, 4, 0, 4);
+    if (result != NC_NOERR)
+    {
+        harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
+        harp_add_error_message(" (%s)", filename);
+        nc_close(stream->ncid);
+        netcdf_stream_delete(stream);
+        return -1;
+    }
+
+    for (i = 0; i < product->num_variables; i++)
+    {
+        if (write_variable_records(stream->ncid, i, product->variable[i], 0, stream->string_length[i]) != 0)
+        {
+            harp_add_error_message(" (%s)", filename);
+            nc_close(stream->ncid);
+            netcdf_stream_delete(stream);
+            return -1;
+        }
+    }
+    stream->num_records = product->dimension[harp_dimension_time];
+    netcdf_stream_update_datetime_range(stream, product);
+
+    *new_stream = stream;
+
+    return 0;
+}
+
+/* Append the data of the product as new records.
+ * The product should have the same variables and (non-time) dimensions as the product that was used to open the stream.
+ * If the data can not be stored without changing the already written data (i.e. if a string is longer than the
+ * string dimension) then nothing is written and 'appended' is set to 0.
+ */
+int harp_export_netcdf_stream_append(harp_netcdf_stream *stream, const harp_product *product, int *appended)
+{
+    int i;
+
+    *appended = 0;
+
+    if (product->num_variables != stream->num_variables)
+    {
+        return 0;
+    }
+    for (i = 0; i < stream->num_variables; i++)
+    {
+        harp_variable *variable;
+
+        if (harp_product_get_variable_by_name(product, stream->variable_name[i], &variable) != 0)
+        {
+            return 0;
+        }
+        if (variable->data_type == harp_type_string)
+        {
+            if (harp_get_max_string_length(variable->num_elements, variable->data.string_data) >
+                stream->string_length[i])
+            {
+                return 0;
+            }
+        }
+    }
+
+    for (i = 0; i < stream->num_variables; i++)
+    {
+        harp_variable *variable;
+
+        if (harp_product_get_variable_by_name(product, stream->variable_name[i], &variable) != 0)
+        {
+            return -1;
+        }
+        if (write_variable_records(stream->ncid, i, variable, stream->num_records, stream->string_length[i]) != 0)
+        {
+            harp_add_error_message(" (%s)", stream->filename);
+            return -1;
+        }
+    }
+    stream->num_records += product->dimension[harp_dimension_time];
+    netcdf_stream_update_datetime_range(stream, product);
+
+    *appended = 1;
+
+    return 0;
+}
+
+/* Write the datetime range attributes, close the file, and free the stream. */
+int harp_export_netcdf_stream_close(harp_netcdf_stream *stream)
+{
+    int result;
+
+    if (stream->has_datetime_range)
+    {
+        result = nc_redef(stream->ncid);
+        if (result != NC_NOERR)
+        {
+            harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
+            harp_add_error_message(" (%s)", stream->filename);
+            nc_close(stream->ncid);
+            netcdf_stream_delete(stream);
+            return -1;
+        }
+        if (write_datetime_range_attributes(stream->ncid, stream->datetime_start, stream->datetime_stop) != 0)
+        {
+            harp_add_error_message(" (%s)", stream->filename);
+            nc_close(stream->ncid);
+            netcdf_stream_delete(stream);
+            return -1;
+        }
+    }
+
+    result = nc_close(stream->ncid);
+    if (result != NC_NOERR)
+    {
+        harp_set_error(HARP_ERROR_NETCDF, "%s", nc_strerror(result));
+        harp_add_error_message(" (%s)", stream->filename);
+        netcdf_stream_delete(stream);
+        return -1;
+    }
+
+    netcdf_stream_delete(stream);
+
+    return 0;
+}
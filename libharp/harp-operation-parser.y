@@ -1775,6 +1775,8 @@ int harp_program_from_string(const char *str, harp_program **program)
     /* if this doesn't hold we need to introduce a separate harp_sized_array for enums */
     assert(sizeof(int32_t) == sizeof(harp_dimension_type));
 
+    /* the generated scanner and parser use global state */
+    harp_lock(harp_lock_operation_parser);
     harp_errno = 0;
     parsed_program = NULL;
     bufstate = (void *)harp_operation_parser__scan_string(str);
@@ -1789,10 +1791,12 @@ int harp_program_from_string(const char *str, harp_program **program)
             harp_set_error(HARP_ERROR_OPERATION_SYNTAX, NULL);
         }
         harp_operation_parser__delete_buffer(bufstate);
+        harp_unlock(harp_lock_operation_parser);
         return -1;
     }
     harp_operation_parser__delete_buffer(bufstate);
     *program = parsed_program;
+    harp_unlock(harp_lock_operation_parser);
 
     return 0;
 }
@@ -570,6 +570,205 @@ static int eval_valid_range(harp_operation_valid_range_filter *operation, harp_d
     return (!harp_isnan(double_value) && double_value >= operation->valid_min && double_value <= operation->valid_max);
 }
 
+/* The batch versions of the value filters below process the data in blocks of this number of elements */
+#define VALUE_FILTER_BLOCK_SIZE 1024
+
+static void get_double_block(harp_data_type data_type, const void *data, long offset, long num_elements,
+                             double *block)
+{
+    long i;
+
+    switch (data_type)
+    {
+        case harp_type_int8:
+            for (i = 0; i < num_elements; i++)
+            {
+                block[i] = (double)((int8_t *)data)[offset + i];
+            }
+            break;
+        case harp_type_int16:
+            for (i = 0; i < num_elements; i++)
+            {
+                block[i] = (double)((int16_t *)data)[offset + i];
+            }
+            break;
+        case harp_type_int32:
+            for (i = 0; i < num_elements; i++)
+            {
+                block[i] = (double)((int32_t *)data)[offset + i];
+            }
+            break;
+        case harp_type_float:
+            for (i = 0; i < num_elements; i++)
+            {
+                block[i] = (double)((float *)data)[offset + i];
+            }
+            break;
+        case harp_type_double:
+            memcpy(block, &((double *)data)[offset], num_elements * sizeof(double));
+            break;
+        default:
+            assert(0);
+            exit(1);
+    }
+}
+
+/* retrieves the values as unsigned integers (for bit masks) or as signed integers (for enumeration indices) */
+static void get_int_block(harp_data_type data_type, int is_unsigned, const void *data, long offset,
+                          long num_elements, int64_t *block)
+{
+    long i;
+
+    switch (data_type)
+    {
+        case harp_type_int8:
+            for (i = 0; i < num_elements; i++)
+            {
+                block[i] = is_unsigned ? (int64_t)((uint8_t *)data)[offset + i] : ((int8_t *)data)[offset + i];
+            }
+            break;
+        case harp_type_int16:
+            for (i = 0; i < num_elements; i++)
+            {
+                block[i] = is_unsigned ? (int64_t)((uint16_t *)data)[offset + i] : ((int16_t *)data)[offset + i];
+            }
+            break;
+        case harp_type_int32:
+            for (i = 0; i < num_elements; i++)
+            {
+                block[i] = is_unsigned ? (int64_t)((uint32_t *)data)[offset + i] : ((int32_t *)data)[offset + i];
+            }
+            break;
+        default:
+            assert(0);
+            exit(1);
+    }
+}
+
+static void update_mask_bitmask(harp_operation_bit_mask_filter *operation, long num_elements, const int64_t *value,
+                                uint8_t *mask)
+{
+    uint32_t bit_mask = operation->bit_mask;
+    long i;
+
+    switch (operation->operator_type)
+    {
+        case operator_bit_mask_all:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (((uint32_t)value[i] & bit_mask) == bit_mask);
+            }
+            break;
+        case operator_bit_mask_any:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (((uint32_t)value[i] & bit_mask) != 0);
+            }
+            break;
+        case operator_bit_mask_none:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (((uint32_t)value[i] & bit_mask) == 0);
+            }
+            break;
+    }
+}
+
+static void update_mask_comparison(harp_operation_comparison_filter *operation, long num_elements,
+                                   const double *value, uint8_t *mask)
+{
+    double reference = operation->value;
+    long i;
+
+    switch (operation->operator_type)
+    {
+        case operator_eq:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (value[i] == reference);
+            }
+            break;
+        case operator_ne:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (value[i] != reference);
+            }
+            break;
+        case operator_lt:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (value[i] < reference);
+            }
+            break;
+        case operator_le:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (value[i] <= reference);
+            }
+            break;
+        case operator_gt:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (value[i] > reference);
+            }
+            break;
+        case operator_ge:
+            for (i = 0; i < num_elements; i++)
+            {
+                mask[i] &= (value[i] >= reference);
+            }
+            break;
+    }
+}
+
+static void update_mask_longitude_range(harp_operation_longitude_range_filter *operation, long num_elements,
+                                        const double *value, uint8_t *mask)
+{
+    long i;
+
+    for (i = 0; i < num_elements; i++)
+    {
+        /* map longitude to [min,min+360) */
+        mask[i] &= (value[i] - 360.0 * floor((value[i] - operation->min) / 360.0) <= operation->max);
+    }
+}
+
+static void update_mask_membership(harp_operation_membership_filter *operation, long num_elements,
+                                   const double *value, uint8_t *mask)
+{
+    uint8_t is_in = operation->operator_type == operator_in;
+    long i;
+    int j;
+
+    for (i = 0; i < num_elements; i++)
+    {
+        if (mask[i])
+        {
+            uint8_t found = 0;
+
+            for (j = 0; j < operation->num_values; j++)
+            {
+                found |= (operation->value[j] == value[i]);
+            }
+            mask[i] = (found == is_in);
+        }
+    }
+}
+
+static void update_mask_valid_range(harp_operation_valid_range_filter *operation, long num_elements,
+                                    const double *value, uint8_t *mask)
+{
+    double valid_min = operation->valid_min;
+    double valid_max = operation->valid_max;
+    long i;
+
+    /* a comparison with NaN is always false, so NaN values are filtered out without an explicit check */
+    for (i = 0; i < num_elements; i++)
+    {
+        mask[i] &= (value[i] >= valid_min && value[i] <= valid_max);
+    }
+}
+
 static void area_covers_area_filter_delete(harp_operation_area_covers_area_filter *operation)
 {
     if (operation != NULL)
@@ -727,6 +926,10 @@ static void collocation_filter_delete(harp_operation_collocation_filter *operati
         {
             free(operation->filename);
         }
+        if (operation->collocation_result != NULL && !operation->shared_collocation_result)
+        {
+            harp_collocation_result_delete(operation->collocation_result);
+        }
         if (operation->collocation_mask != NULL)
         {
             harp_collocation_mask_delete(operation->collocation_mask);
@@ -756,6 +959,10 @@ static void comparison_filter_delete(harp_operation_comparison_filter *operation
         {
             harp_unit_converter_delete(operation->unit_converter);
         }
+        if (operation->value_unit != NULL)
+        {
+            free(operation->value_unit);
+        }
 
         free(operation);
     }
@@ -925,6 +1132,10 @@ static void longitude_range_filter_delete(harp_operation_longitude_range_filter
         {
             harp_unit_converter_delete(operation->unit_converter);
         }
+        if (operation->value_unit != NULL)
+        {
+            free(operation->value_unit);
+        }
 
         free(operation);
     }
@@ -950,6 +1161,10 @@ static void membership_filter_delete(harp_operation_membership_filter *operation
         {
             harp_unit_converter_delete(operation->unit_converter);
         }
+        if (operation->value_unit != NULL)
+        {
+            free(operation->value_unit);
+        }
 
         free(operation);
     }
@@ -1927,6 +2142,8 @@ int harp_operation_collocation_filter_new(const char *filename, harp_collocation
     operation->filter_type = filter_type;
     operation->min_collocation_index = min_collocation_index;
     operation->max_collocation_index = max_collocation_index;
+    operation->collocation_result = NULL;
+    operation->shared_collocation_result = 0;
     operation->collocation_mask = NULL;
     operation->num_values = 0;
     operation->value = NULL;
@@ -1965,6 +2182,7 @@ int harp_operation_comparison_filter_new(const char *variable_name, harp_compari
     operation->value = value;
     operation->unit = NULL;
     operation->unit_converter = NULL;
+    operation->value_unit = NULL;
 
     operation->variable_name = strdup(variable_name);
     if (operation->variable_name == NULL)
@@ -2468,6 +2686,7 @@ int harp_operation_longitude_range_filter_new(double min, const char *min_unit,
     operation->min = min;
     operation->max = max;
     operation->unit_converter = NULL;
+    operation->value_unit = NULL;
 
     if (min_unit != NULL)
     {
@@ -2520,6 +2739,7 @@ int harp_operation_membership_filter_new(const char *variable_name, harp_members
     operation->value = NULL;
     operation->unit = NULL;
     operation->unit_converter = NULL;
+    operation->value_unit = NULL;
 
     operation->variable_name = strdup(variable_name);
     if (operation->variable_name == NULL)
@@ -3597,6 +3817,43 @@ int harp_operation_is_value_filter(const harp_operation *operation)
     }
 }
 
+/* Read the collocation result of a collocation filter in advance, such that the filter can be applied to multiple
+ * products without reading the collocation result file again for each product.
+ */
+int harp_operation_preload_collocation_filter(harp_operation *operation)
+{
+    harp_operation_collocation_filter *collocation_operation = (harp_operation_collocation_filter *)operation;
+
+    if (collocation_operation->collocation_result != NULL)
+    {
+        return 0;
+    }
+
+    return harp_collocation_result_read_range(collocation_operation->filename,
+                                              collocation_operation->min_collocation_index,
+                                              collocation_operation->max_collocation_index, NULL, NULL,
+                                              &collocation_operation->collocation_result);
+}
+
+/* Use the preloaded collocation result of another (identical) collocation filter instead of reading it again.
+ * The collocation result is only read when the filter is applied, so both filters can be used by different threads at
+ * the same time. The collocation result remains owned by the source operation, which should therefore not be deleted
+ * before this operation.
+ */
+void harp_operation_share_collocation_filter(harp_operation *operation, const harp_operation *source_operation)
+{
+    harp_operation_collocation_filter *collocation_operation = (harp_operation_collocation_filter *)operation;
+    const harp_operation_collocation_filter *source = (const harp_operation_collocation_filter *)source_operation;
+
+    assert(operation->type == operation_collocation_filter && source_operation->type == operation_collocation_filter);
+    if (collocation_operation->collocation_result != NULL && !collocation_operation->shared_collocation_result)
+    {
+        harp_collocation_result_delete(collocation_operation->collocation_result);
+    }
+    collocation_operation->collocation_result = source->collocation_result;
+    collocation_operation->shared_collocation_result = 1;
+}
+
 int harp_operation_prepare_collocation_filter(harp_operation *operation, const char *source_product)
 {
     harp_operation_collocation_filter *collocation_operation = (harp_operation_collocation_filter *)operation;
@@ -3616,12 +3873,24 @@ int harp_operation_prepare_collocation_filter(harp_operation *operation, const c
     collocation_operation->num_values = 0;
     collocation_operation->value = NULL;
 
-    if (harp_collocation_mask_import(collocation_operation->filename, collocation_operation->filter_type,
-                                     collocation_operation->min_collocation_index,
-                                     collocation_operation->max_collocation_index,
-                                     source_product, &collocation_mask) != 0)
+    if (collocation_operation->collocation_result != NULL)
     {
-        return -1;
+        if (harp_collocation_mask_from_result(collocation_operation->collocation_result,
+                                              collocation_operation->filter_type, source_product,
+                                              &collocation_mask) != 0)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        if (harp_collocation_mask_import(collocation_operation->filename, collocation_operation->filter_type,
+                                         collocation_operation->min_collocation_index,
+                                         collocation_operation->max_collocation_index,
+                                         source_product, &collocation_mask) != 0)
+        {
+            return -1;
+        }
     }
     collocation_operation->collocation_mask = collocation_mask;
 
@@ -3700,44 +3969,294 @@ int harp_operation_set_value_unit(harp_operation *operation, const char *unit)
 {
     const char *target_unit;
     harp_unit_converter **unit_converter;
+    char **value_unit;
 
     switch (operation->type)
     {
         case operation_comparison_filter:
             target_unit = ((harp_operation_comparison_filter *)operation)->unit;
             unit_converter = &((harp_operation_comparison_filter *)operation)->unit_converter;
+            value_unit = &((harp_operation_comparison_filter *)operation)->value_unit;
             break;
         case operation_longitude_range_filter:
             target_unit = "degree_east";
             unit_converter = &((harp_operation_longitude_range_filter *)operation)->unit_converter;
+            value_unit = &((harp_operation_longitude_range_filter *)operation)->value_unit;
             break;
         case operation_membership_filter:
             target_unit = ((harp_operation_membership_filter *)operation)->unit;
             unit_converter = &((harp_operation_membership_filter *)operation)->unit_converter;
+            value_unit = &((harp_operation_membership_filter *)operation)->value_unit;
             break;
         default:
             /* no need to perform unit conversion */
             return 0;
     }
 
+    /* if the operation did not have a unit then we don't have to perform a unit conversion */
+    if (target_unit == NULL)
+    {
+        return 0;
+    }
+
+    /* keep the current unit converter if it was set for the same unit (e.g. when a program is executed for multiple
+     * products) */
+    if (unit != NULL && *value_unit != NULL && strcmp(unit, *value_unit) == 0)
+    {
+        return 0;
+    }
+
     /* remove previous unit converter if there was one */
     if (*unit_converter != NULL)
     {
         harp_unit_converter_delete(*unit_converter);
         *unit_converter = NULL;
     }
+    if (*value_unit != NULL)
+    {
+        free(*value_unit);
+        *value_unit = NULL;
+    }
 
-    /* if the operation did not have a unit then we don't have to perform a unit conversion */
-    if (target_unit == NULL)
+    if (harp_unit_compare(unit, target_unit) != 0)
     {
-        return 0;
+        if (harp_unit_converter_new(unit, target_unit, unit_converter) != 0)
+        {
+            return -1;
+        }
     }
 
-    if (harp_unit_compare(unit, target_unit) == 0)
+    *value_unit = strdup(unit);
+    if (*value_unit == NULL)
     {
-        /* no need to perform unit conversion */
-        return 0;
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Apply a sequence of value filters (that all operate on the same variable) to the values of that variable.
+ * Only elements for which the mask is set (mask values should be 0 or 1) are considered and the mask is cleared for
+ * each element that does not pass all filters. All filters are applied in a single (blocked) pass over the data.
+ * Returns the number of elements for which the mask is set after filtering, or -1 on error.
+ */
+long harp_operation_value_filters_update_mask(int num_operations, harp_operation **operation, int num_enum_values,
+                                              char **enum_name, harp_data_type data_type, long num_elements,
+                                              void *data, uint8_t *mask)
+{
+    double double_block[VALUE_FILTER_BLOCK_SIZE];
+    double converted_block[VALUE_FILTER_BLOCK_SIZE];
+    int64_t int_block[VALUE_FILTER_BLOCK_SIZE];
+    uint8_t *enum_mask = NULL;
+    long num_masked = 0;
+    long offset;
+    long i;
+    int k;
+
+    for (k = 0; k < num_operations; k++)
+    {
+        const char *filter_name = NULL;
+
+        switch (operation[k]->type)
+        {
+            case operation_bit_mask_filter:
+                if (data_type != harp_type_int8 && data_type != harp_type_int16 && data_type != harp_type_int32)
+                {
+                    harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "cannot perform bitmask filter for data type: %s",
+                                   harp_get_data_type_name(data_type));
+                    return -1;
+                }
+                break;
+            case operation_comparison_filter:
+                filter_name = "numerical comparison";
+                break;
+            case operation_longitude_range_filter:
+                filter_name = "longitude range";
+                break;
+            case operation_membership_filter:
+                filter_name = "numerical membership";
+                break;
+            case operation_valid_range_filter:
+                filter_name = "valid range";
+                break;
+            case operation_string_comparison_filter:
+            case operation_string_membership_filter:
+                if (num_enum_values == 0 && data_type != harp_type_string)
+                {
+                    harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "cannot perform string %s filter for data type: %s",
+                                   operation[k]->type == operation_string_comparison_filter ? "comparison" :
+                                   "membership", harp_get_data_type_name(data_type));
+                    return -1;
+                }
+                break;
+            default:
+                assert(0);
+                exit(1);
+        }
+        if (filter_name != NULL && data_type == harp_type_string)
+        {
+            harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "cannot perform %s filter for data type: %s", filter_name,
+                           harp_get_data_type_name(data_type));
+            return -1;
+        }
+    }
+
+    if (num_enum_values > 0)
+    {
+        /* evaluate string filters once per enumeration value; the last entry is for out of range values */
+        enum_mask = (uint8_t *)malloc(num_operations * (num_enum_values + 1) * sizeof(uint8_t));
+        if (enum_mask == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_operations * (num_enum_values + 1) * sizeof(uint8_t), __FILE__, __LINE__);
+            return -1;
+        }
+        for (k = 0; k < num_operations; k++)
+        {
+            if (harp_operation_is_string_value_filter(operation[k]))
+            {
+                harp_operation_string_value_filter *string_operation;
+                int32_t index;
+
+                string_operation = (harp_operation_string_value_filter *)operation[k];
+                for (index = 0; index <= num_enum_values; index++)
+                {
+                    int32_t value = index < num_enum_values ? index : -1;
+
+                    enum_mask[k * (num_enum_values + 1) + index] =
+                        (uint8_t)string_operation->eval(string_operation, num_enum_values, enum_name, harp_type_int32,
+                                                        &value);
+                }
+            }
+        }
+    }
+
+    for (offset = 0; offset < num_elements; offset += VALUE_FILTER_BLOCK_SIZE)
+    {
+        long block_size = num_elements - offset;
+        uint8_t *block_mask = &mask[offset];
+        int has_double_block = 0;
+        int has_int_block = 0;
+
+        if (block_size > VALUE_FILTER_BLOCK_SIZE)
+        {
+            block_size = VALUE_FILTER_BLOCK_SIZE;
+        }
+
+        for (k = 0; k < num_operations; k++)
+        {
+            harp_unit_converter *unit_converter = NULL;
+            const double *value = double_block;
+
+            switch (operation[k]->type)
+            {
+                case operation_bit_mask_filter:
+                    if (!has_int_block)
+                    {
+                        get_int_block(data_type, 1, data, offset, block_size, int_block);
+                        has_int_block = 1;
+                    }
+                    update_mask_bitmask((harp_operation_bit_mask_filter *)operation[k], block_size, int_block,
+                                        block_mask);
+                    continue;
+                case operation_string_comparison_filter:
+                case operation_string_membership_filter:
+                    if (num_enum_values > 0)
+                    {
+                        const uint8_t *operation_enum_mask = &enum_mask[k * (num_enum_values + 1)];
+
+                        /* enumeration indices are signed (unlike bit masks) */
+                        get_int_block(data_type, 0, data, offset, block_size, int_block);
+                        has_int_block = 0;
+                        for (i = 0; i < block_size; i++)
+                        {
+                            if (int_block[i] >= 0 && int_block[i] < num_enum_values)
+                            {
+                                block_mask[i] &= operation_enum_mask[int_block[i]];
+                            }
+                            else
+                            {
+                                block_mask[i] &= operation_enum_mask[num_enum_values];
+                            }
+                        }
+                    }
+                    else
+                    {
+                        harp_operation_string_value_filter *string_operation;
+
+                        string_operation = (harp_operation_string_value_filter *)operation[k];
+                        for (i = 0; i < block_size; i++)
+                        {
+                            if (block_mask[i])
+                            {
+                                block_mask[i] = (uint8_t)string_operation->eval(string_operation, 0, NULL,
+                                                                                harp_type_string,
+                                                                                &((char **)data)[offset + i]);
+                            }
+                        }
+                    }
+                    continue;
+                case operation_comparison_filter:
+                    unit_converter = ((harp_operation_comparison_filter *)operation[k])->unit_converter;
+                    break;
+                case operation_longitude_range_filter:
+                    unit_converter = ((harp_operation_longitude_range_filter *)operation[k])->unit_converter;
+                    break;
+                case operation_membership_filter:
+                    unit_converter = ((harp_operation_membership_filter *)operation[k])->unit_converter;
+                    break;
+                default:
+                    break;
+            }
+
+            if (!has_double_block)
+            {
+                get_double_block(data_type, data, offset, block_size, double_block);
+                has_double_block = 1;
+            }
+            if (unit_converter != NULL)
+            {
+                memcpy(converted_block, double_block, block_size * sizeof(double));
+                harp_unit_converter_convert_array_double(unit_converter, block_size, converted_block);
+                value = converted_block;
+            }
+
+            switch (operation[k]->type)
+            {
+                case operation_comparison_filter:
+                    update_mask_comparison((harp_operation_comparison_filter *)operation[k], block_size, value,
+                                           block_mask);
+                    break;
+                case operation_longitude_range_filter:
+                    update_mask_longitude_range((harp_operation_longitude_range_filter *)operation[k], block_size,
+                                                value, block_mask);
+                    break;
+                case operation_membership_filter:
+                    update_mask_membership((harp_operation_membership_filter *)operation[k], block_size, value,
+                                           block_mask);
+                    break;
+                case operation_valid_range_filter:
+                    update_mask_valid_range((harp_operation_valid_range_filter *)operation[k], block_size, value,
+                                            block_mask);
+                    break;
+                default:
+                    assert(0);
+                    exit(1);
+            }
+        }
+
+        for (i = 0; i < block_size; i++)
+        {
+            num_masked += (block_mask[i] != 0);
+        }
+    }
+
+    if (enum_mask != NULL)
+    {
+        free(enum_mask);
     }
 
-    return harp_unit_converter_new(unit, target_unit, unit_converter);
+    return num_masked;
 }
@@ -283,6 +283,8 @@ typedef struct harp_operation_collocation_filter_struct
     long min_collocation_index;
     long max_collocation_index;
     /* extra */
+    harp_collocation_result *collocation_result;        /* preloaded collocation result (NULL if not preloaded) */
+    int shared_collocation_result;      /* collocation_result is owned by the operation of another program */
     harp_collocation_mask *collocation_mask;
     /* extra (for membership filter that is only used for the ingestion phase) */
     int num_values;
@@ -300,6 +302,7 @@ typedef struct harp_operation_comparison_filter_struct
     char *unit;
     /* extra */
     harp_unit_converter *unit_converter;
+    char *value_unit;   /* unit of the variable for which the unit converter was set */
 } harp_operation_comparison_filter;
 
 typedef struct harp_operation_derive_variable_struct
@@ -396,6 +399,7 @@ typedef struct harp_operation_longitude_range_filter_struct
     double max;
     /* extra */
     harp_unit_converter *unit_converter;
+    char *value_unit;   /* unit of the variable for which the unit converter was set */
 } harp_operation_longitude_range_filter;
 
 typedef struct harp_operation_membership_filter_struct
@@ -410,6 +414,7 @@ typedef struct harp_operation_membership_filter_struct
     char *unit;
     /* extra */
     harp_unit_converter *unit_converter;
+    char *value_unit;   /* unit of the variable for which the unit converter was set */
 } harp_operation_membership_filter;
 
 typedef struct harp_operation_point_distance_filter_struct
@@ -574,6 +579,8 @@ typedef struct harp_operation_wrap_struct
 /* Generic operation */
 void harp_operation_delete(harp_operation *operation);
 int harp_operation_get_variable_name(const harp_operation *operation, const char **variable_name);
+int harp_operation_preload_collocation_filter(harp_operation *operation);
+void harp_operation_share_collocation_filter(harp_operation *operation, const harp_operation *source_operation);
 int harp_operation_prepare_collocation_filter(harp_operation *operation, const char *source_product);
 int harp_operation_is_point_filter(const harp_operation *operation);
 int harp_operation_is_polygon_filter(const harp_operation *operation);
@@ -582,6 +589,9 @@ int harp_operation_is_value_filter(const harp_operation *operation);
 int harp_operation_set_valid_range(harp_operation *operation, harp_data_type data_type, harp_scalar valid_min,
                                    harp_scalar valid_max);
 int harp_operation_set_value_unit(harp_operation *operation, const char *unit);
+long harp_operation_value_filters_update_mask(int num_operations, harp_operation **operation, int num_enum_values,
+                                              char **enum_name, harp_data_type data_type, long num_elements,
+                                              void *data, uint8_t *mask);
 
 /* Specific operations */
 int harp_operation_area_covers_area_filter_new(const char *filename, int num_latitudes, double *latitude,
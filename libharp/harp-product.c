@@ -125,17 +125,21 @@ static int get_arguments(int argc, char *argv[], char **new_arguments)
 }
 
 #define MAX_NUM_COMPARISON_VARIABLES 8
-static int num_comparison_variables;
-static harp_variable *comparison_variable[MAX_NUM_COMPARISON_VARIABLES];
 
-static int compare_variable_elements(const void *a, const void *b)
+typedef struct comparison_info_struct
 {
-    long index_a = *(long *)a;
-    long index_b = *(long *)b;
+    int num_variables;
+    harp_variable *variable[MAX_NUM_COMPARISON_VARIABLES];
+} comparison_info;
+
+static int compare_variable_elements(const void *context, long index_a, long index_b)
+{
+    const comparison_info *info = (const comparison_info *)context;
+    harp_variable *const *comparison_variable = info->variable;
     int i;
 
-    assert(num_comparison_variables <= MAX_NUM_COMPARISON_VARIABLES);
-    for (i = 0; i < num_comparison_variables; i++)
+    assert(info->num_variables <= MAX_NUM_COMPARISON_VARIABLES);
+    for (i = 0; i < info->num_variables; i++)
     {
         switch (comparison_variable[i]->data_type)
         {
@@ -173,26 +177,35 @@ static int compare_variable_elements(const void *a, const void *b)
                 }
                 break;
             case harp_type_float:
-                if (comparison_variable[i]->data.float_data[index_a] < comparison_variable[i]->data.float_data[index_b])
                 {
-                    return -1;
-                }
-                else if (comparison_variable[i]->data.float_data[index_a] >
-                         comparison_variable[i]->data.float_data[index_b])
-                {
-                    return 1;
+                    float value_a = comparison_variable[i]->data.float_data[index_a];
+                    float value_b = comparison_variable[i]->data.float_data[index_b];
+
+                    /* NaN values are sorted after all other values */
+                    if (value_a < value_b || (harp_isnan(value_b) && !harp_isnan(value_a)))
+                    {
+                        return -1;
+                    }
+                    else if (value_a > value_b || (harp_isnan(value_a) && !harp_isnan(value_b)))
+                    {
+                        return 1;
+                    }
                 }
                 break;
             case harp_type_double:
-                if (comparison_variable[i]->data.double_data[index_a] <
-                    comparison_variable[i]->data.double_data[index_b])
-                {
-                    return -1;
-                }
-                else if (comparison_variable[i]->data.double_data[index_a] >
-                         comparison_variable[i]->data.double_data[index_b])
                 {
-                    return 1;
+                    double value_a = comparison_variable[i]->data.double_data[index_a];
+                    double value_b = comparison_variable[i]->data.double_data[index_b];
+
+                    /* NaN values are sorted after all other values */
+                    if (value_a < value_b || (harp_isnan(value_b) && !harp_isnan(value_a)))
+                    {
+                        return -1;
+                    }
+                    else if (value_a > value_b || (harp_isnan(value_a) && !harp_isnan(value_b)))
+                    {
+                        return 1;
+                    }
                 }
                 break;
             case harp_type_string:
@@ -211,6 +224,311 @@ static int compare_variable_elements(const void *a, const void *b)
     return 0;
 }
 
+/* Stable LSD radix sort (8 bits per pass) of 'key' and the permutation 'index' that goes with it.
+ * 'key_buffer' and 'index_buffer' should have the same size as 'key' and 'index'.
+ */
+static void radix_sort_keys(long num_elements, uint64_t *key, long *index, uint64_t *key_buffer, long *index_buffer)
+{
+    uint64_t min_key, max_key;
+    uint64_t range;
+    long count[256];
+    uint64_t *source_key = key;
+    uint64_t *target_key = key_buffer;
+    long *source_index = index;
+    long *target_index = index_buffer;
+    int shift;
+    long i;
+
+    if (num_elements < 2)
+    {
+        return;
+    }
+
+    min_key = key[0];
+    max_key = min_key;
+    for (i = 1; i < num_elements; i++)
+    {
+        if (key[i] < min_key)
+        {
+            min_key = key[i];
+        }
+        else if (key[i] > max_key)
+        {
+            max_key = key[i];
+        }
+    }
+    range = max_key - min_key;
+
+    /* only perform passes for the bytes that are used by the (offset) keys */
+    for (shift = 0; shift < 64 && (range >> shift) != 0; shift += 8)
+    {
+        uint64_t *swap_key;
+        long *swap_index;
+        long offset;
+        int k;
+
+        for (k = 0; k < 256; k++)
+        {
+            count[k] = 0;
+        }
+        for (i = 0; i < num_elements; i++)
+        {
+            count[((source_key[i] - min_key) >> shift) & 0xff]++;
+        }
+        if (count[((source_key[0] - min_key) >> shift) & 0xff] == num_elements)
+        {
+            /* all keys have the same value for this byte */
+            continue;
+        }
+        offset = 0;
+        for (k = 0; k < 256; k++)
+        {
+            long num = count[k];
+
+            count[k] = offset;
+            offset += num;
+        }
+        for (i = 0; i < num_elements; i++)
+        {
+            long target = count[((source_key[i] - min_key) >> shift) & 0xff]++;
+
+            target_key[target] = source_key[i];
+            target_index[target] = source_index[i];
+        }
+        swap_key = source_key;
+        source_key = target_key;
+        target_key = swap_key;
+        swap_index = source_index;
+        source_index = target_index;
+        target_index = swap_index;
+    }
+    if (source_index != index)
+    {
+        memcpy(index, source_index, num_elements * sizeof(long));
+    }
+}
+
+static int compare_string_elements(const void *context, long index_a, long index_b)
+{
+    char **string_data = (char **)context;
+
+    return strcmp(string_data[index_a], string_data[index_b]);
+}
+
+/* Store key[i] = rank of string_data[i] within the sorted set of distinct values of string_data */
+static int get_string_rank_keys(long num_elements, char **string_data, uint64_t *key)
+{
+    long *index;
+    uint64_t rank = 0;
+    long i;
+
+    index = malloc(num_elements * sizeof(long));
+    if (index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_elements * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+    for (i = 0; i < num_elements; i++)
+    {
+        index[i] = i;
+    }
+    if (harp_index_sort(num_elements, index, compare_string_elements, string_data) != 0)
+    {
+        free(index);
+        return -1;
+    }
+    for (i = 0; i < num_elements; i++)
+    {
+        if (i > 0 && strcmp(string_data[index[i - 1]], string_data[index[i]]) != 0)
+        {
+            rank++;
+        }
+        key[index[i]] = rank;
+    }
+    free(index);
+
+    return 0;
+}
+
+/* Store key[i] = the value of element index[i] of the variable, encoded as an unsigned integer that sorts in the same
+ * order as the value (using the ordering of compare_variable_elements()).
+ * 'string_rank' should contain the rank keys for string variables (and is ignored otherwise).
+ */
+static void get_sort_keys(const harp_variable *variable, long num_elements, const long *index,
+                          const uint64_t *string_rank, uint64_t *key)
+{
+    long i;
+
+    switch (variable->data_type)
+    {
+        case harp_type_int8:
+            for (i = 0; i < num_elements; i++)
+            {
+                key[i] = (uint64_t)((int64_t)variable->data.int8_data[index[i]] + 128);
+            }
+            break;
+        case harp_type_int16:
+            for (i = 0; i < num_elements; i++)
+            {
+                key[i] = (uint64_t)((int64_t)variable->data.int16_data[index[i]] + 32768);
+            }
+            break;
+        case harp_type_int32:
+            for (i = 0; i < num_elements; i++)
+            {
+                key[i] = (uint64_t)((int64_t)variable->data.int32_data[index[i]] + 2147483648LL);
+            }
+            break;
+        case harp_type_float:
+            for (i = 0; i < num_elements; i++)
+            {
+                float value = variable->data.float_data[index[i]];
+                uint32_t bits;
+
+                if (harp_isnan(value))
+                {
+                    /* sort NaN values after all other values */
+                    key[i] = 0xffffffff;
+                    continue;
+                }
+                if (value == 0)
+                {
+                    /* make sure that -0 and +0 are considered equal */
+                    value = 0;
+                }
+                memcpy(&bits, &value, sizeof(bits));
+                key[i] = (bits & 0x80000000) ? (uint64_t)(~bits) : (uint64_t)(bits | 0x80000000);
+            }
+            break;
+        case harp_type_double:
+            for (i = 0; i < num_elements; i++)
+            {
+                double value = variable->data.double_data[index[i]];
+                uint64_t bits;
+
+                if (harp_isnan(value))
+                {
+                    key[i] = UINT64_C(0xffffffffffffffff);
+                    continue;
+                }
+                if (value == 0)
+                {
+                    value = 0;
+                }
+                memcpy(&bits, &value, sizeof(bits));
+                key[i] = (bits & UINT64_C(0x8000000000000000)) ? ~bits : (bits | UINT64_C(0x8000000000000000));
+            }
+            break;
+        case harp_type_string:
+            for (i = 0; i < num_elements; i++)
+            {
+                key[i] = string_rank[index[i]];
+            }
+            break;
+    }
+}
+
+/* Determine the permutation that sorts the elements of the given (one dimensional) variables.
+ * Sets *is_sorted to 1 (and leaves 'index' untouched) if the elements are already sorted.
+ */
+static int get_sort_index(const comparison_info *info, long num_elements, long *index, int *is_sorted)
+{
+    uint64_t *key;
+    uint64_t *key_buffer;
+    uint64_t *string_rank = NULL;
+    long *index_buffer;
+    long i;
+    int k;
+
+    /* the product is often already sorted (e.g. after merging), which we can check in O(n) */
+    for (i = 1; i < num_elements; i++)
+    {
+        if (compare_variable_elements(info, i - 1, i) > 0)
+        {
+            break;
+        }
+    }
+    *is_sorted = i >= num_elements;
+    if (*is_sorted)
+    {
+        return 0;
+    }
+
+    key = malloc(num_elements * sizeof(uint64_t));
+    if (key == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_elements * sizeof(uint64_t), __FILE__, __LINE__);
+        return -1;
+    }
+    key_buffer = malloc(num_elements * sizeof(uint64_t));
+    if (key_buffer == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_elements * sizeof(uint64_t), __FILE__, __LINE__);
+        free(key);
+        return -1;
+    }
+    index_buffer = malloc(num_elements * sizeof(long));
+    if (index_buffer == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_elements * sizeof(long), __FILE__, __LINE__);
+        free(key_buffer);
+        free(key);
+        return -1;
+    }
+
+    for (i = 0; i < num_elements; i++)
+    {
+        index[i] = i;
+    }
+
+    /* sort from the least significant variable to the most significant variable (each sort is stable) */
+    for (k = info->num_variables - 1; k >= 0; k--)
+    {
+        const harp_variable *variable = info->variable[k];
+
+        if (variable->data_type == harp_type_string)
+        {
+            if (string_rank == NULL)
+            {
+                string_rank = malloc(num_elements * sizeof(uint64_t));
+                if (string_rank == NULL)
+                {
+                    harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                                   num_elements * sizeof(uint64_t), __FILE__, __LINE__);
+                    free(index_buffer);
+                    free(key_buffer);
+                    free(key);
+                    return -1;
+                }
+            }
+            if (get_string_rank_keys(num_elements, variable->data.string_data, string_rank) != 0)
+            {
+                free(string_rank);
+                free(index_buffer);
+                free(key_buffer);
+                free(key);
+                return -1;
+            }
+        }
+        get_sort_keys(variable, num_elements, index, string_rank, key);
+        radix_sort_keys(num_elements, key, index, key_buffer, index_buffer);
+    }
+
+    if (string_rank != NULL)
+    {
+        free(string_rank);
+    }
+    free(index_buffer);
+    free(key_buffer);
+    free(key);
+
+    return 0;
+}
+
 static void sync_product_dimensions_on_variable_add(harp_product *product, const harp_variable *variable)
 {
     int i;
@@ -342,10 +660,279 @@ int harp_product_make_time_dependent(harp_product *product)
     return 0;
 }
 
+typedef struct dimension_gather_info_struct
+{
+    long dimension_length;      /* current length of the dimension */
+    long num_dim_elements;      /* new length of the dimension */
+    const long *dim_element_ids;        /* ids of the elements in the new arrangement */
+    int is_range;       /* the ids form a contiguous range starting at dim_element_ids[0] */
+    int is_increasing;  /* the ids are strictly increasing, so elements can be moved in place */
+    harp_variable **variable;   /* variables with a single occurrence of the dimension */
+    int *dim_index;
+    size_t *failed_size;        /* size of the allocation that failed for a variable (0 on success) */
+} dimension_gather_info;
+
+static void gather_blocks(const char *from_ptr, char *to_ptr, long block_size, long num_dim_elements,
+                          const long *dim_element_ids)
+{
+    long i;
+
+    /* for the typed loops it is safe if source and target overlap as long as the ids are increasing */
+    switch (block_size)
+    {
+        case 1:
+            for (i = 0; i < num_dim_elements; i++)
+            {
+                ((int8_t *)to_ptr)[i] = ((int8_t *)from_ptr)[dim_element_ids[i]];
+            }
+            break;
+        case 2:
+            for (i = 0; i < num_dim_elements; i++)
+            {
+                ((int16_t *)to_ptr)[i] = ((int16_t *)from_ptr)[dim_element_ids[i]];
+            }
+            break;
+        case 4:
+            for (i = 0; i < num_dim_elements; i++)
+            {
+                ((int32_t *)to_ptr)[i] = ((int32_t *)from_ptr)[dim_element_ids[i]];
+            }
+            break;
+        case 8:
+            for (i = 0; i < num_dim_elements; i++)
+            {
+                ((int64_t *)to_ptr)[i] = ((int64_t *)from_ptr)[dim_element_ids[i]];
+            }
+            break;
+        default:
+            for (i = 0; i < num_dim_elements; i++)
+            {
+                memmove(&to_ptr[i * block_size], &from_ptr[dim_element_ids[i] * block_size], (size_t)block_size);
+            }
+            break;
+    }
+}
+
+/* Task for harp_parallel_for() that filters/rearranges a single variable.
+ * Since this can run in a worker thread, a failed allocation is only recorded and reported by the calling thread.
+ */
+static void gather_variable(void *context, long index)
+{
+    dimension_gather_info *info = (dimension_gather_info *)context;
+    harp_variable *variable = info->variable[index];
+    int dim_index = info->dim_index[index];
+    long element_size = harp_get_size_for_type(variable->data_type);
+    long new_num_elements = (variable->num_elements / info->dimension_length) * info->num_dim_elements;
+    long num_groups = 1;
+    long block_size;
+    char *new_data;
+    long i;
+
+    info->failed_size[index] = 0;
+    if (info->is_increasing)
+    {
+        new_data = (char *)variable->data.ptr;
+    }
+    else
+    {
+        new_data = (char *)malloc((size_t)new_num_elements * element_size);
+        if (new_data == NULL)
+        {
+            info->failed_size[index] = (size_t)new_num_elements * element_size;
+            return;
+        }
+    }
+
+    for (i = 0; i < dim_index; i++)
+    {
+        num_groups *= variable->dimension[i];
+    }
+    block_size = (variable->num_elements / (num_groups * info->dimension_length)) * element_size;
+
+    for (i = 0; i < num_groups; i++)
+    {
+        const char *from_ptr = (char *)variable->data.ptr + i * info->dimension_length * block_size;
+        char *to_ptr = new_data + i * info->num_dim_elements * block_size;
+
+        if (info->is_range)
+        {
+            from_ptr += info->dim_element_ids[0] * block_size;
+            if (to_ptr != from_ptr)
+            {
+                memmove(to_ptr, from_ptr, (size_t)(info->num_dim_elements * block_size));
+            }
+        }
+        else
+        {
+            gather_blocks(from_ptr, to_ptr, block_size, info->num_dim_elements, info->dim_element_ids);
+        }
+    }
+
+    if (new_data != variable->data.ptr)
+    {
+        free(variable->data.ptr);
+        variable->data.ptr = new_data;
+    }
+    else if (new_num_elements < variable->num_elements)
+    {
+        /* if shrinking the buffer fails we just keep using the larger buffer */
+        new_data = (char *)realloc(variable->data.ptr, (size_t)new_num_elements * element_size);
+        if (new_data != NULL)
+        {
+            variable->data.ptr = new_data;
+        }
+    }
+    variable->dimension[dim_index] = info->num_dim_elements;
+    variable->num_elements = new_num_elements;
+}
+
+/* Filter/rearrange the given dimension for all variables of the product.
+ * The element ids are checked once, after which all (non-string) variables are processed in parallel. Elements are
+ * moved in place if the ids are increasing (e.g. for a filter), with a single move per block if the ids form a
+ * contiguous range. If \a mask is provided (which should match the ids) then string variables are filtered using the
+ * mask instead of being rearranged.
+ */
+static int product_gather_dimension(harp_product *product, harp_dimension_type dimension_type, long num_dim_elements,
+                                    const long *dim_element_ids, const uint8_t *mask)
+{
+    dimension_gather_info info;
+    long num_variables = 0;
+    long work_size = 0;
+    long i;
+    int k;
+
+    info.dimension_length = product->dimension[dimension_type];
+    info.num_dim_elements = num_dim_elements;
+    info.dim_element_ids = dim_element_ids;
+    info.is_range = 1;
+    info.is_increasing = 1;
+    for (i = 1; i < num_dim_elements; i++)
+    {
+        if (dim_element_ids[i] != dim_element_ids[i - 1] + 1)
+        {
+            info.is_range = 0;
+            if (dim_element_ids[i] <= dim_element_ids[i - 1])
+            {
+                info.is_increasing = 0;
+                break;
+            }
+        }
+    }
+    if (info.is_range && dim_element_ids[0] == 0 && num_dim_elements == info.dimension_length)
+    {
+        /* all elements are already in the right location */
+        return 0;
+    }
+
+    if (product->num_variables == 0)
+    {
+        return 0;
+    }
+    info.variable = (harp_variable **)malloc(product->num_variables * sizeof(harp_variable *));
+    if (info.variable == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       product->num_variables * sizeof(harp_variable *), __FILE__, __LINE__);
+        return -1;
+    }
+    info.dim_index = (int *)malloc(product->num_variables * sizeof(int));
+    if (info.dim_index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       product->num_variables * sizeof(int), __FILE__, __LINE__);
+        free(info.variable);
+        return -1;
+    }
+    info.failed_size = (size_t *)malloc(product->num_variables * sizeof(size_t));
+    if (info.failed_size == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       product->num_variables * sizeof(size_t), __FILE__, __LINE__);
+        free(info.dim_index);
+        free(info.variable);
+        return -1;
+    }
+
+    for (k = 0; k < product->num_variables; k++)
+    {
+        harp_variable *variable = product->variable[k];
+        int num_occurrences = 0;
+        int dim_index = -1;
+        int j;
+
+        for (j = 0; j < variable->num_dimensions; j++)
+        {
+            if (variable->dimension_type[j] == dimension_type)
+            {
+                num_occurrences++;
+                dim_index = j;
+            }
+        }
+        if (num_occurrences == 0)
+        {
+            continue;
+        }
+
+        if (num_occurrences > 1 || variable->data_type == harp_type_string || variable->num_elements == 0)
+        {
+            /* handle these variables directly (string data needs to be freed/duplicated) */
+            for (j = 0; j < variable->num_dimensions; j++)
+            {
+                if (variable->dimension_type[j] != dimension_type)
+                {
+                    continue;
+                }
+                if (mask != NULL)
+                {
+                    if (harp_variable_filter_dimension(variable, j, mask) != 0)
+                    {
+                        break;
+                    }
+                }
+                else if (harp_variable_rearrange_dimension(variable, j, num_dim_elements, dim_element_ids) != 0)
+                {
+                    break;
+                }
+            }
+            if (j < variable->num_dimensions)
+            {
+                free(info.failed_size);
+                free(info.dim_index);
+                free(info.variable);
+                return -1;
+            }
+            continue;
+        }
+
+        info.variable[num_variables] = variable;
+        info.dim_index[num_variables] = dim_index;
+        num_variables++;
+        work_size += variable->num_elements * harp_get_size_for_type(variable->data_type);
+    }
+
+    harp_parallel_for(num_variables, work_size, gather_variable, &info);
+
+    for (i = 0; i < num_variables; i++)
+    {
+        if (info.failed_size[i] != 0)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           info.failed_size[i], __FILE__, __LINE__);
+            break;
+        }
+    }
+
+    free(info.failed_size);
+    free(info.dim_index);
+    free(info.variable);
+
+    return i < num_variables ? -1 : 0;
+}
+
 int harp_product_rearrange_dimension(harp_product *product, harp_dimension_type dimension_type, long num_dim_elements,
                                      const long *dim_element_ids)
 {
-    int i;
+    long i;
 
     if (dimension_type == harp_dimension_independent)
     {
@@ -374,25 +961,22 @@ int harp_product_rearrange_dimension(harp_product *product, harp_dimension_type
         return 0;
     }
 
-    for (i = 0; i < product->num_variables; i++)
+    for (i = 0; i < num_dim_elements; i++)
     {
-        harp_variable *variable = product->variable[i];
-        int j;
-
-        for (j = 0; j < variable->num_dimensions; j++)
+        if (dim_element_ids[i] < 0 || dim_element_ids[i] >= product->dimension[dimension_type])
         {
-            if (variable->dimension_type[j] != dimension_type)
-            {
-                continue;
-            }
-
-            if (harp_variable_rearrange_dimension(variable, j, num_dim_elements, dim_element_ids) != 0)
-            {
-                return -1;
-            }
+            harp_set_error(HARP_ERROR_INVALID_ARGUMENT,
+                           "dim_element_ids[%ld] argument (%ld) is not in the range [0,%ld) (%s:%u)", i,
+                           dim_element_ids[i], product->dimension[dimension_type], __FILE__, __LINE__);
+            return -1;
         }
     }
 
+    if (product_gather_dimension(product, dimension_type, num_dim_elements, dim_element_ids, NULL) != 0)
+    {
+        return -1;
+    }
+
     product->dimension[dimension_type] = num_dim_elements;
 
     return 0;
@@ -486,7 +1070,8 @@ int harp_product_resize_dimension(harp_product *product, harp_dimension_type dim
 int harp_product_filter_dimension(harp_product *product, harp_dimension_type dimension_type, const uint8_t *mask)
 {
     long masked_dimension_length;
-    int i;
+    long *dim_element_ids;
+    long i;
 
     if (dimension_type == harp_dimension_independent)
     {
@@ -523,26 +1108,37 @@ int harp_product_filter_dimension(harp_product *product, harp_dimension_type dim
         harp_product_remove_all_variables(product);
         return 0;
     }
-
-    for (i = 0; i < product->num_variables; i++)
+    if (masked_dimension_length == product->dimension[dimension_type])
     {
-        harp_variable *variable = product->variable[i];
-        int j;
+        /* everything is included -> no filtering needed */
+        return 0;
+    }
 
-        for (j = 0; j < variable->num_dimensions; j++)
+    /* determine the ids of the elements to keep once for all variables */
+    dim_element_ids = (long *)malloc(masked_dimension_length * sizeof(long));
+    if (dim_element_ids == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       masked_dimension_length * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+    masked_dimension_length = 0;
+    for (i = 0; i < product->dimension[dimension_type]; i++)
+    {
+        if (mask[i])
         {
-            if (variable->dimension_type[j] != dimension_type)
-            {
-                continue;
-            }
-
-            if (harp_variable_filter_dimension(variable, j, mask) != 0)
-            {
-                return -1;
-            }
+            dim_element_ids[masked_dimension_length] = i;
+            masked_dimension_length++;
         }
     }
 
+    if (product_gather_dimension(product, dimension_type, masked_dimension_length, dim_element_ids, mask) != 0)
+    {
+        free(dim_element_ids);
+        return -1;
+    }
+    free(dim_element_ids);
+
     product->dimension[dimension_type] = masked_dimension_length;
 
     return 0;
@@ -919,7 +1515,7 @@ LIBHARP_API int harp_product_copy(const harp_product *other_product, harp_produc
  * @}
  */
 
-static int add_missing_count_and_weight_variables(harp_product *product, harp_product *other_product)
+static int add_missing_count_and_weight_variables(harp_product *product, const harp_product *other_product)
 {
     int i, j;
 
@@ -1063,6 +1659,109 @@ static int add_missing_count_and_weight_variables(harp_product *product, harp_pr
     return 0;
 }
 
+/* Prepare 'other_product' for being appended to 'product' without making any changes to 'product'.
+ * This performs the same modifications to 'other_product' as harp_product_append() (i.e. remove 'index', add missing
+ * '*_count' and '*_weight' variables, add 'time' dimension, and extend non-time dimensions).
+ * If appending would require changes to 'product' (additional variables or larger non-time dimensions) or if the
+ * variables of both products do not match then 'compatible' is set to 0, otherwise it is set to 1.
+ */
+int harp_product_prepare_append(const harp_product *product, harp_product *other_product, int *compatible)
+{
+    harp_dimension_type dimension_type;
+    int i, j;
+
+    *compatible = 0;
+
+    if (harp_product_has_variable(other_product, "index"))
+    {
+        if (harp_product_remove_variable_by_name(other_product, "index") != 0)
+        {
+            return -1;
+        }
+    }
+    if (add_missing_count_and_weight_variables(other_product, product) != 0)
+    {
+        return -1;
+    }
+    if (product->num_variables != other_product->num_variables)
+    {
+        return 0;
+    }
+    for (i = 0; i < product->num_variables; i++)
+    {
+        if (!harp_product_has_variable(other_product, product->variable[i]->name))
+        {
+            return 0;
+        }
+    }
+
+    if (harp_product_make_time_dependent(other_product) != 0)
+    {
+        return -1;
+    }
+
+    for (dimension_type = 0; dimension_type < HARP_NUM_DIM_TYPES; dimension_type++)
+    {
+        if (dimension_type != harp_dimension_time)
+        {
+            if (product->dimension[dimension_type] < other_product->dimension[dimension_type])
+            {
+                return 0;
+            }
+            if (product->dimension[dimension_type] > other_product->dimension[dimension_type])
+            {
+                if (harp_product_resize_dimension(other_product, dimension_type, product->dimension[dimension_type]) !=
+                    0)
+                {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    /* perform the same checks as harp_variable_append() */
+    for (i = 0; i < product->num_variables; i++)
+    {
+        harp_variable *variable = product->variable[i];
+        harp_variable *other_variable;
+
+        if (harp_product_get_variable_by_name(other_product, variable->name, &other_variable) != 0)
+        {
+            return -1;
+        }
+        if (variable->data_type != other_variable->data_type ||
+            variable->num_dimensions != other_variable->num_dimensions ||
+            variable->num_enum_values != other_variable->num_enum_values)
+        {
+            return 0;
+        }
+        if (variable->unit != NULL || other_variable->unit != NULL)
+        {
+            if (variable->unit == NULL || other_variable->unit == NULL ||
+                harp_unit_compare(variable->unit, other_variable->unit) != 0)
+            {
+                return 0;
+            }
+        }
+        if (variable->num_dimensions == 0 || variable->dimension_type[0] != harp_dimension_time)
+        {
+            return 0;
+        }
+        for (j = 1; j < variable->num_dimensions; j++)
+        {
+            if (variable->dimension_type[j] != other_variable->dimension_type[j] ||
+                variable->dimension[j] != other_variable->dimension[j])
+            {
+                return 0;
+            }
+        }
+    }
+
+    *compatible = 1;
+
+    return 0;
+}
+
 /** \addtogroup harp_product
  * @{
  */
@@ -2071,7 +2770,8 @@ LIBHARP_API int harp_product_flatten_dimension(harp_product *product, harp_dimen
  * variables, all using the same dimension. The dimension that will be reordered is this single dimension of the
  * referenced variables.
  *
- * Only up to eight variables can be used for sorting.
+ * Only up to eight variables can be used for sorting. The sort is stable and NaN values are sorted after all other
+ * values. If the product is already sorted then it is left untouched.
  *
  * \param product HARP product
  * \param num_variables Number of variables to use for sorting (1 <= num_variables <= 8)
@@ -2082,18 +2782,21 @@ LIBHARP_API int harp_product_flatten_dimension(harp_product *product, harp_dimen
  */
 LIBHARP_API int harp_product_sort(harp_product *product, int num_variables, const char **variable_name)
 {
+    comparison_info info;
+    harp_variable **comparison_variable = info.variable;
     long num_elements;
     long *dim_element_ids;
+    int is_sorted;
     long i;
 
-    if (num_variables < 1 || num_comparison_variables > MAX_NUM_COMPARISON_VARIABLES)
+    if (num_variables < 1 || num_variables > MAX_NUM_COMPARISON_VARIABLES)
     {
         harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "invalid number of variables for sorting (%d not in range [1,%d])",
                        num_variables, MAX_NUM_COMPARISON_VARIABLES);
         return -1;
     }
 
-    num_comparison_variables = num_variables;
+    info.num_variables = num_variables;
     for (i = 0; i < num_variables; i++)
     {
         if (harp_product_get_variable_by_name(product, variable_name[i], &comparison_variable[i]) != 0)
@@ -2131,12 +2834,16 @@ LIBHARP_API int harp_product_sort(harp_product *product, int num_variables, cons
                        num_elements * sizeof(long), __FILE__, __LINE__);
         return -1;
     }
-    for (i = 0; i < num_elements; i++)
+    if (get_sort_index(&info, num_elements, dim_element_ids, &is_sorted) != 0)
     {
-        dim_element_ids[i] = i;
+        free(dim_element_ids);
+        return -1;
+    }
+    if (is_sorted)
+    {
+        free(dim_element_ids);
+        return 0;
     }
-
-    qsort(dim_element_ids, num_elements, sizeof(long), compare_variable_elements);
 
     if (harp_product_rearrange_dimension(product, comparison_variable[0]->dimension_type[0], num_elements,
                                          dim_element_ids) != 0)
@@ -40,6 +40,41 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* when importing, the remaining time samples are only read per contiguous range if, on average, a range covers at least
+ * this many time samples of the file */
+#define IMPORT_TIME_SAMPLES_PER_RANGE 8
+
+/* make the calling thread use a private copy of the HARP options for the duration of the program, such that set()
+ * operations do not affect the global options (or other threads that execute a program at the same time) */
+static void save_options(harp_program *program)
+{
+    program->options.bin_spatial_weight_cache = harp_get_option_bin_spatial_weight_cache();
+    program->options.create_collocation_datetime = harp_get_option_create_collocation_datetime();
+    program->options.enable_aux_afgl86 = harp_get_option_enable_aux_afgl86();
+    program->options.enable_aux_usstd76 = harp_get_option_enable_aux_usstd76();
+    program->options.propagate_uncertainty = harp_get_option_propagate_uncertainty();
+    /* we only explicitly set the regrid options */
+    program->options.regrid_out_of_bounds = 0;
+    program->options.regrid_precision = 0;
+    program->previous_options = harp_set_program_options(&program->options);
+    program->options_active = 1;
+}
+
+/* reinstate the HARP options that the calling thread used before the program started */
+static void restore_options(harp_program *program)
+{
+    if (program->options_active)
+    {
+        harp_set_program_options(program->previous_options);
+        program->options_active = 0;
+        /* release the grid cell weights that were cached because of a set() operation in this program */
+        if (program->options.bin_spatial_weight_cache && !harp_get_option_bin_spatial_weight_cache())
+        {
+            harp_bin_spatial_clear_weight_cache();
+        }
+    }
+}
+
 int harp_program_new(harp_program **new_program)
 {
     harp_program *program;
@@ -55,26 +90,30 @@ int harp_program_new(harp_program **new_program)
     program->num_operations = 0;
     program->operation = NULL;
     program->current_index = 0;
+    program->derived_variable_cache = NULL;
+    program->operations = NULL;
+    program->options_active = 0;
 
-    program->option_enable_aux_afgl86 = harp_get_option_enable_aux_afgl86();
-    program->option_enable_aux_usstd76 = harp_get_option_enable_aux_usstd76();
-    program->option_regrid_out_of_bounds = harp_get_option_regrid_out_of_bounds();
-
-    /* we only explicitly set the regrid_out_of_bounds option */
-    harp_set_option_regrid_out_of_bounds(0);
+    save_options(program);
 
     *new_program = program;
     return 0;
 }
 
-void harp_program_delete(harp_program *program)
+/** Delete a compiled program.
+ * \ingroup harp_product
+ * \param program Program that should be deleted.
+ */
+LIBHARP_API void harp_program_delete(harp_program *program)
 {
     if (program != NULL)
     {
-        /* reset global HARP options to initial values */
-        harp_set_option_enable_aux_afgl86(program->option_enable_aux_afgl86);
-        harp_set_option_enable_aux_usstd76(program->option_enable_aux_usstd76);
-        harp_set_option_regrid_out_of_bounds(program->option_regrid_out_of_bounds);
+        restore_options(program);
+
+        if (program->derived_variable_cache != NULL)
+        {
+            harp_derived_variable_cache_delete(program->derived_variable_cache);
+        }
 
         if (program->operation != NULL)
         {
@@ -88,10 +127,35 @@ void harp_program_delete(harp_program *program)
             free(program->operation);
         }
 
+        if (program->operations != NULL)
+        {
+            free(program->operations);
+        }
+
         free(program);
     }
 }
 
+/* Prepare the program for an execution from the first operation onwards (e.g. for the next product when a compiled
+ * program is used for multiple products). The global HARP options that the program may change are restored by
+ * harp_program_end_execution().
+ */
+void harp_program_begin_execution(harp_program *program)
+{
+    program->current_index = 0;
+    if (program->derived_variable_cache != NULL)
+    {
+        harp_derived_variable_cache_clear(program->derived_variable_cache);
+    }
+    restore_options(program);
+    save_options(program);
+}
+
+void harp_program_end_execution(harp_program *program)
+{
+    restore_options(program);
+}
+
 int harp_program_add_operation(harp_program *program, harp_operation *operation)
 {
     if (program->num_operations % BLOCK_SIZE == 0)
@@ -123,7 +187,7 @@ static int execute_value_filter(harp_product *product, harp_program *program)
     const char *variable_name;
     int num_operations = 1;
     int data_type_size;
-    long i, j;
+    long i;
     int k;
 
     if (harp_operation_get_variable_name(program->operation[program->current_index], &variable_name) != 0)
@@ -176,40 +240,28 @@ static int execute_value_filter(harp_product *product, harp_program *program)
 
     if (variable->num_dimensions == 0)
     {
-        for (k = 0; k < num_operations; k++)
-        {
-            int result;
+        uint8_t mask = 1;
+        long num_masked;
 
-            if (harp_operation_is_string_value_filter(program->operation[program->current_index + k]))
-            {
-                harp_operation_string_value_filter *operation;
-
-                operation = (harp_operation_string_value_filter *)program->operation[program->current_index + k];
-                result = operation->eval(operation, variable->num_enum_values, variable->enum_name,
-                                         variable->data_type, variable->data.ptr);
-            }
-            else
-            {
-                harp_operation_numeric_value_filter *operation;
-
-                operation = (harp_operation_numeric_value_filter *)program->operation[program->current_index + k];
-                result = operation->eval(operation, variable->data_type, variable->data.ptr);
-            }
-            if (result < 0)
-            {
-                return -1;
-            }
-            if (result == 0)
-            {
-                /* the full product is masked out so remove all variables to make it empty */
-                harp_product_remove_all_variables(product);
-                return 0;
-            }
+        num_masked = harp_operation_value_filters_update_mask(num_operations,
+                                                              &program->operation[program->current_index],
+                                                              variable->num_enum_values, variable->enum_name,
+                                                              variable->data_type, 1, variable->data.ptr, &mask);
+        if (num_masked < 0)
+        {
+            return -1;
+        }
+        if (num_masked == 0)
+        {
+            /* the full product is masked out so remove all variables to make it empty */
+            harp_product_remove_all_variables(product);
+            return 0;
         }
     }
     else if (variable->num_dimensions == 1 && variable->dimension_type[0] != harp_dimension_independent)
     {
         harp_dimension_mask *dimension_mask;
+        long num_masked;
 
         if (harp_dimension_mask_set_new(&dimension_mask_set) != 0)
         {
@@ -223,46 +275,17 @@ static int execute_value_filter(harp_product *product, harp_program *program)
         }
         dimension_mask_set[variable->dimension_type[0]] = dimension_mask;
 
-        for (i = 0; i < variable->num_elements; i++)
+        num_masked = harp_operation_value_filters_update_mask(num_operations,
+                                                              &program->operation[program->current_index],
+                                                              variable->num_enum_values, variable->enum_name,
+                                                              variable->data_type, variable->num_elements,
+                                                              variable->data.ptr, dimension_mask->mask);
+        if (num_masked < 0)
         {
-            for (k = 0; k < num_operations; k++)
-            {
-                if (dimension_mask->mask[i])
-                {
-                    harp_operation *operation;
-                    int result;
-
-                    operation = program->operation[program->current_index + k];
-                    if (harp_operation_is_string_value_filter(operation))
-                    {
-                        harp_operation_string_value_filter *string_operation;
-
-                        string_operation = (harp_operation_string_value_filter *)operation;
-                        result = string_operation->eval(string_operation, variable->num_enum_values,
-                                                        variable->enum_name, variable->data_type,
-                                                        &variable->data.int8_data[i * data_type_size]);
-                    }
-                    else
-                    {
-                        harp_operation_numeric_value_filter *numeric_operation;
-
-                        numeric_operation = (harp_operation_numeric_value_filter *)operation;
-                        result = numeric_operation->eval(numeric_operation, variable->data_type,
-                                                         &variable->data.int8_data[i * data_type_size]);
-                    }
-                    if (result < 0)
-                    {
-                        harp_dimension_mask_set_delete(dimension_mask_set);
-                        return -1;
-                    }
-                    dimension_mask->mask[i] = result;
-                }
-            }
-            if (!dimension_mask->mask[i])
-            {
-                dimension_mask->masked_dimension_length--;
-            }
+            harp_dimension_mask_set_delete(dimension_mask_set);
+            return -1;
         }
+        dimension_mask->masked_dimension_length = num_masked;
 
         if (harp_product_filter(product, dimension_mask_set) != 0)
         {
@@ -279,7 +302,7 @@ static int execute_value_filter(harp_product *product, harp_program *program)
         harp_dimension_type dimension_type;
         harp_dimension_mask *time_mask;
         harp_dimension_mask *dimension_mask;
-        long index = 0;
+        long num_elements = variable->dimension[1];
 
         dimension_type = variable->dimension_type[1];
 
@@ -304,48 +327,18 @@ static int execute_value_filter(harp_product *product, harp_program *program)
         dimension_mask->masked_dimension_length = 0;
         for (i = 0; i < variable->dimension[0]; i++)
         {
-            long new_dimension_length = 0;
-
-            for (j = 0; j < variable->dimension[1]; j++)
+            long new_dimension_length;
+
+            new_dimension_length =
+                harp_operation_value_filters_update_mask(num_operations, &program->operation[program->current_index],
+                                                         variable->num_enum_values, variable->enum_name,
+                                                         variable->data_type, num_elements,
+                                                         &variable->data.int8_data[i * num_elements * data_type_size],
+                                                         &dimension_mask->mask[i * num_elements]);
+            if (new_dimension_length < 0)
             {
-                for (k = 0; k < num_operations; k++)
-                {
-                    if (dimension_mask->mask[index])
-                    {
-                        harp_operation *operation;
-                        int result;
-
-                        operation = program->operation[program->current_index + k];
-                        if (harp_operation_is_string_value_filter(operation))
-                        {
-                            harp_operation_string_value_filter *string_operation;
-
-                            string_operation = (harp_operation_string_value_filter *)operation;
-                            result = string_operation->eval(string_operation, variable->num_enum_values,
-                                                            variable->enum_name, variable->data_type,
-                                                            &variable->data.int8_data[index * data_type_size]);
-                        }
-                        else
-                        {
-                            harp_operation_numeric_value_filter *numeric_operation;
-
-                            numeric_operation = (harp_operation_numeric_value_filter *)operation;
-                            result = numeric_operation->eval(numeric_operation, variable->data_type,
-                                                             &variable->data.int8_data[index * data_type_size]);
-                        }
-                        if (result < 0)
-                        {
-                            harp_dimension_mask_set_delete(dimension_mask_set);
-                            return -1;
-                        }
-                        dimension_mask->mask[index] = result;
-                    }
-                }
-                if (dimension_mask->mask[index])
-                {
-                    new_dimension_length++;
-                }
-                index++;
+                harp_dimension_mask_set_delete(dimension_mask_set);
+                return -1;
             }
             if (new_dimension_length == 0)
             {
@@ -716,7 +709,8 @@ static int execute_clamp(harp_product *product, harp_operation_clamp *operation)
                                         operation->axis_unit, operation->bounds[0], operation->bounds[1]);
 }
 
-static int execute_derive_variable(harp_product *product, harp_operation_derive_variable *operation)
+static int execute_derive_variable(harp_product *product, harp_program *program,
+                                   harp_operation_derive_variable *operation)
 {
     if (!operation->has_dimensions)
     {
@@ -757,13 +751,18 @@ static int execute_derive_variable(harp_product *product, harp_operation_derive_
         }
         return 0;
     }
-    if (operation->has_data_type)
+    if (program->derived_variable_cache == NULL)
     {
-        return harp_product_add_derived_variable(product, operation->variable_name, &operation->data_type,
-                                                 operation->unit, operation->num_dimensions, operation->dimension_type);
+        if (harp_derived_variable_cache_new(&program->derived_variable_cache) != 0)
+        {
+            return -1;
+        }
     }
-    return harp_product_add_derived_variable(product, operation->variable_name, NULL, operation->unit,
-                                             operation->num_dimensions, operation->dimension_type);
+    return harp_product_add_derived_variable_with_cache(product, program->derived_variable_cache,
+                                                        operation->variable_name,
+                                                        operation->has_data_type ? &operation->data_type : NULL,
+                                                        operation->unit, operation->num_dimensions,
+                                                        operation->dimension_type);
 }
 
 static int execute_derive_smoothed_column_collocated_dataset
@@ -1084,6 +1083,23 @@ static int execute_set(harp_product *product, harp_operation_set *operation)
             return -1;
         }
     }
+    else if (strcmp(operation->option, "bin_spatial_weight_cache") == 0)
+    {
+        if (strcmp(operation->value, "enabled") == 0)
+        {
+            harp_set_option_bin_spatial_weight_cache(1);
+        }
+        else if (strcmp(operation->value, "disabled") == 0)
+        {
+            harp_set_option_bin_spatial_weight_cache(0);
+        }
+        else
+        {
+            harp_set_error(HARP_ERROR_OPERATION, "invalid value '%s' for option '%s'", operation->value,
+                           operation->option);
+            return -1;
+        }
+    }
     else if (strcmp(operation->option, "collocation_datetime") == 0)
     {
         if (strcmp(operation->value, "enabled") == 0)
@@ -1139,6 +1155,23 @@ static int execute_set(harp_product *product, harp_operation_set *operation)
             return -1;
         }
     }
+    else if (strcmp(operation->option, "regrid_precision") == 0)
+    {
+        if (strcmp(operation->value, "double") == 0)
+        {
+            harp_set_option_regrid_precision(0);
+        }
+        else if (strcmp(operation->value, "float") == 0)
+        {
+            harp_set_option_regrid_precision(1);
+        }
+        else
+        {
+            harp_set_error(HARP_ERROR_OPERATION, "invalid value '%s' for option '%s'", operation->value,
+                           operation->option);
+            return -1;
+        }
+    }
     else
     {
         harp_set_error(HARP_ERROR_OPERATION, "invalid option '%s'", operation->option);
@@ -1285,12 +1318,18 @@ static int execute_wrap(harp_product *product, harp_operation_wrap *operation)
 }
 
 /* this will start with the operation at program->current_index */
-int harp_product_execute_program(harp_product *product, harp_program *program)
+int harp_product_continue_program(harp_product *product, harp_program *program)
 {
     while (program->current_index < program->num_operations)
     {
         harp_operation *operation = program->operation[program->current_index];
 
+        if (operation->type != operation_derive_variable && program->derived_variable_cache != NULL)
+        {
+            /* intermediate variables can only be reused by consecutive derive operations */
+            harp_derived_variable_cache_clear(program->derived_variable_cache);
+        }
+
         /* note that some consecutive filter operations can be executed together for optimization purposes */
         /* so the filter functions below may increase program->current_index itself */
         switch (operation->type)
@@ -1367,7 +1406,7 @@ int harp_product_execute_program(harp_product *product, harp_program *program)
                 }
                 break;
             case operation_derive_variable:
-                if (execute_derive_variable(product, (harp_operation_derive_variable *)operation) != 0)
+                if (execute_derive_variable(product, program, (harp_operation_derive_variable *)operation) != 0)
                 {
                     return -1;
                 }
@@ -1479,11 +1518,527 @@ int harp_product_execute_program(harp_product *product, harp_program *program)
         if (harp_product_is_empty(product))
         {
             /* don't perform any of the remaining actions; just return the empty product */
-            return 0;
+            break;
         }
         program->current_index++;
     }
 
+    if (program->derived_variable_cache != NULL)
+    {
+        harp_derived_variable_cache_clear(program->derived_variable_cache);
+    }
+
+    return 0;
+}
+
+int harp_program_import_mask_new(harp_program_import_mask **new_mask)
+{
+    harp_program_import_mask *mask;
+
+    mask = (harp_program_import_mask *)malloc(sizeof(harp_program_import_mask));
+    if (mask == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(harp_program_import_mask), __FILE__, __LINE__);
+        return -1;
+    }
+
+    mask->num_variables = 0;
+    mask->variable_name = NULL;
+    mask->num_dimensions = NULL;
+    mask->dimension_type = NULL;
+    mask->dimension = NULL;
+    mask->num_operations = 0;
+    mask->has_filter = 0;
+    mask->variable_mask = NULL;
+    mask->filter_variable_mask = NULL;
+    mask->is_empty = 0;
+    mask->time_mask = NULL;
+    mask->read_time_ranges = 0;
+
+    *new_mask = mask;
+    return 0;
+}
+
+void harp_program_import_mask_delete(harp_program_import_mask *mask)
+{
+    if (mask != NULL)
+    {
+        if (mask->variable_name != NULL)
+        {
+            int i;
+
+            for (i = 0; i < mask->num_variables; i++)
+            {
+                if (mask->variable_name[i] != NULL)
+                {
+                    free(mask->variable_name[i]);
+                }
+            }
+            free(mask->variable_name);
+        }
+        if (mask->num_dimensions != NULL)
+        {
+            free(mask->num_dimensions);
+        }
+        if (mask->dimension_type != NULL)
+        {
+            free(mask->dimension_type);
+        }
+        if (mask->dimension != NULL)
+        {
+            free(mask->dimension);
+        }
+        if (mask->variable_mask != NULL)
+        {
+            free(mask->variable_mask);
+        }
+        if (mask->filter_variable_mask != NULL)
+        {
+            free(mask->filter_variable_mask);
+        }
+        if (mask->time_mask != NULL)
+        {
+            harp_dimension_mask_delete(mask->time_mask);
+        }
+        free(mask);
+    }
+}
+
+int harp_program_import_mask_add_variable(harp_program_import_mask *mask, const char *name, int num_dimensions,
+                                          const harp_dimension_type *dimension_type, const long *dimension)
+{
+    int i;
+
+    assert(num_dimensions <= HARP_MAX_NUM_DIMS);
+
+    if (mask->num_variables % BLOCK_SIZE == 0)
+    {
+        int new_size = mask->num_variables + BLOCK_SIZE;
+        char **new_variable_name;
+        int *new_num_dimensions;
+        harp_dimension_type (*new_dimension_type)[HARP_MAX_NUM_DIMS];
+        long (*new_dimension)[HARP_MAX_NUM_DIMS];
+
+        new_variable_name = (char **)realloc(mask->variable_name, new_size * sizeof(char *));
+        if (new_variable_name == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           new_size * sizeof(char *), __FILE__, __LINE__);
+            return -1;
+        }
+        mask->variable_name = new_variable_name;
+
+        new_num_dimensions = (int *)realloc(mask->num_dimensions, new_size * sizeof(int));
+        if (new_num_dimensions == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           new_size * sizeof(int), __FILE__, __LINE__);
+            return -1;
+        }
+        mask->num_dimensions = new_num_dimensions;
+
+        new_dimension_type = realloc(mask->dimension_type, new_size * sizeof(*new_dimension_type));
+        if (new_dimension_type == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           new_size * sizeof(*new_dimension_type), __FILE__, __LINE__);
+            return -1;
+        }
+        mask->dimension_type = new_dimension_type;
+
+        new_dimension = realloc(mask->dimension, new_size * sizeof(*new_dimension));
+        if (new_dimension == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           new_size * sizeof(*new_dimension), __FILE__, __LINE__);
+            return -1;
+        }
+        mask->dimension = new_dimension;
+    }
+
+    mask->variable_name[mask->num_variables] = strdup(name);
+    if (mask->variable_name[mask->num_variables] == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        return -1;
+    }
+    mask->num_dimensions[mask->num_variables] = num_dimensions;
+    for (i = 0; i < num_dimensions; i++)
+    {
+        mask->dimension_type[mask->num_variables][i] = dimension_type[i];
+        mask->dimension[mask->num_variables][i] = dimension[i];
+    }
+    mask->num_variables++;
+
+    return 0;
+}
+
+static int import_mask_find_variable(const harp_program_import_mask *mask, const char *name)
+{
+    int i;
+
+    for (i = 0; i < mask->num_variables; i++)
+    {
+        if (mask->variable_mask[i] && strcmp(mask->variable_name[i], name) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int import_mask_has_time_dimension(const harp_program_import_mask *mask)
+{
+    int i, j;
+
+    for (i = 0; i < mask->num_variables; i++)
+    {
+        if (mask->variable_mask[i])
+        {
+            for (j = 0; j < mask->num_dimensions[i]; j++)
+            {
+                if (mask->dimension_type[i][j] == harp_dimension_time)
+                {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Determine the leading operations of the program (starting at program->current_index) that can be applied during
+ * import. These are keep/exclude operations, value filters on scalar variables or variables that only depend on the
+ * time dimension, and index filters on the time dimension. Operations that would fail (such as keeping or filtering on
+ * a non-existent variable) are not included, so their error is raised when the remaining operations are executed.
+ * This sets the variables that remain after the keep/exclude operations and the variables that need to be read in
+ * order to evaluate the filters.
+ */
+int harp_program_import_mask_apply_variable_operations(harp_program_import_mask *mask, const harp_program *program)
+{
+    int k;
+    int i, j;
+
+    if (mask->num_variables > 0)
+    {
+        mask->variable_mask = malloc(mask->num_variables * sizeof(uint8_t));
+        if (mask->variable_mask == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           mask->num_variables * sizeof(uint8_t), __FILE__, __LINE__);
+            return -1;
+        }
+        memset(mask->variable_mask, 1, mask->num_variables * sizeof(uint8_t));
+        mask->filter_variable_mask = malloc(mask->num_variables * sizeof(uint8_t));
+        if (mask->filter_variable_mask == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           mask->num_variables * sizeof(uint8_t), __FILE__, __LINE__);
+            return -1;
+        }
+        memset(mask->filter_variable_mask, 0, mask->num_variables * sizeof(uint8_t));
+    }
+
+    for (k = program->current_index; k < program->num_operations; k++)
+    {
+        harp_operation *operation = program->operation[k];
+
+        if (operation->type == operation_keep_variable)
+        {
+            harp_operation_keep_variable *keep_operation = (harp_operation_keep_variable *)operation;
+
+            for (j = 0; j < keep_operation->num_variables; j++)
+            {
+                if (strchr(keep_operation->variable_name[j], '*') == NULL &&
+                    strchr(keep_operation->variable_name[j], '?') == NULL &&
+                    import_mask_find_variable(mask, keep_operation->variable_name[j]) < 0)
+                {
+                    break;
+                }
+            }
+            if (j < keep_operation->num_variables)
+            {
+                break;
+            }
+            for (i = 0; i < mask->num_variables; i++)
+            {
+                int included = 0;
+
+                for (j = 0; j < keep_operation->num_variables; j++)
+                {
+                    if (harp_match_wildcard(keep_operation->variable_name[j], mask->variable_name[i]))
+                    {
+                        included = 1;
+                        break;
+                    }
+                }
+                if (!included)
+                {
+                    mask->variable_mask[i] = 0;
+                }
+            }
+        }
+        else if (operation->type == operation_exclude_variable)
+        {
+            harp_operation_exclude_variable *exclude_operation = (harp_operation_exclude_variable *)operation;
+
+            for (i = 0; i < mask->num_variables; i++)
+            {
+                for (j = 0; j < exclude_operation->num_variables; j++)
+                {
+                    if (harp_match_wildcard(exclude_operation->variable_name[j], mask->variable_name[i]))
+                    {
+                        mask->variable_mask[i] = 0;
+                        break;
+                    }
+                }
+            }
+        }
+        else if (harp_operation_is_value_filter(operation))
+        {
+            const char *variable_name;
+
+            if (harp_operation_get_variable_name(operation, &variable_name) != 0)
+            {
+                return -1;
+            }
+            i = import_mask_find_variable(mask, variable_name);
+            if (i < 0)
+            {
+                break;
+            }
+            if (mask->num_dimensions[i] != 0 &&
+                (mask->num_dimensions[i] != 1 || mask->dimension_type[i][0] != harp_dimension_time))
+            {
+                break;
+            }
+            mask->filter_variable_mask[i] = 1;
+            mask->has_filter = 1;
+        }
+        else if (operation->type == operation_index_comparison_filter ||
+                 operation->type == operation_index_membership_filter)
+        {
+            if (((harp_operation_index_filter *)operation)->dimension_type != harp_dimension_time ||
+                !import_mask_has_time_dimension(mask))
+            {
+                break;
+            }
+            mask->has_filter = 1;
+        }
+        else
+        {
+            break;
+        }
+        mask->num_operations++;
+    }
+
+    return 0;
+}
+
+/* Evaluate the filter operations that were selected by harp_program_import_mask_apply_variable_operations().
+ * The filter_product should contain (the full data of) all variables for which filter_variable_mask is set.
+ */
+int harp_program_import_mask_apply_filter_operations(harp_program_import_mask *mask, const harp_program *program,
+                                                     const harp_product *filter_product)
+{
+    harp_dimension_mask *time_mask;
+    int k;
+    long i;
+
+    if (!mask->has_filter)
+    {
+        return 0;
+    }
+
+    for (k = program->current_index; k < program->current_index + mask->num_operations; k++)
+    {
+        harp_operation *operation = program->operation[k];
+        harp_variable *variable = NULL;
+
+        if (harp_operation_is_value_filter(operation))
+        {
+            const char *variable_name;
+
+            if (harp_operation_get_variable_name(operation, &variable_name) != 0)
+            {
+                return -1;
+            }
+            if (harp_product_get_variable_by_name(filter_product, variable_name, &variable) != 0)
+            {
+                return -1;
+            }
+            if (harp_operation_set_valid_range(operation, variable->data_type, variable->valid_min,
+                                               variable->valid_max) != 0)
+            {
+                return -1;
+            }
+            if (variable->unit != NULL)
+            {
+                if (harp_operation_set_value_unit(operation, variable->unit) != 0)
+                {
+                    return -1;
+                }
+            }
+
+            if (variable->num_dimensions == 0)
+            {
+                uint8_t scalar_mask = 1;
+                long num_masked;
+
+                num_masked = harp_operation_value_filters_update_mask(1, &operation, variable->num_enum_values,
+                                                                      variable->enum_name, variable->data_type, 1,
+                                                                      variable->data.ptr, &scalar_mask);
+                if (num_masked < 0)
+                {
+                    return -1;
+                }
+                if (num_masked == 0)
+                {
+                    mask->is_empty = 1;
+                    return 0;
+                }
+                continue;
+            }
+        }
+        else if (operation->type != operation_index_comparison_filter &&
+                 operation->type != operation_index_membership_filter)
+        {
+            /* keep/exclude operations have already been applied */
+            continue;
+        }
+
+        if (mask->time_mask == NULL)
+        {
+            long time_length = 0;
+            int j;
+
+            for (i = 0; i < mask->num_variables && time_length == 0; i++)
+            {
+                for (j = 0; j < mask->num_dimensions[i]; j++)
+                {
+                    if (mask->dimension_type[i][j] == harp_dimension_time)
+                    {
+                        time_length = mask->dimension[i][j];
+                        break;
+                    }
+                }
+            }
+            if (harp_dimension_mask_new(1, &time_length, &mask->time_mask) != 0)
+            {
+                return -1;
+            }
+        }
+        time_mask = mask->time_mask;
+
+        if (variable != NULL)
+        {
+            long num_masked;
+
+            num_masked = harp_operation_value_filters_update_mask(1, &operation, variable->num_enum_values,
+                                                                  variable->enum_name, variable->data_type,
+                                                                  time_mask->num_elements, variable->data.ptr,
+                                                                  time_mask->mask);
+            if (num_masked < 0)
+            {
+                return -1;
+            }
+            time_mask->masked_dimension_length = num_masked;
+        }
+        else
+        {
+            harp_operation_index_filter *index_operation = (harp_operation_index_filter *)operation;
+            long index = 0;
+
+            /* the index is relative to the time samples that remain after the previous filters */
+            for (i = 0; i < time_mask->num_elements; i++)
+            {
+                if (time_mask->mask[i])
+                {
+                    int result;
+
+                    result = index_operation->eval(index_operation, index);
+                    if (result < 0)
+                    {
+                        return -1;
+                    }
+                    if (!result)
+                    {
+                        time_mask->mask[i] = 0;
+                        time_mask->masked_dimension_length--;
+                    }
+                    index++;
+                }
+            }
+        }
+
+        if (time_mask->masked_dimension_length == 0)
+        {
+            mask->is_empty = 1;
+            return 0;
+        }
+    }
+
+    if (mask->time_mask != NULL)
+    {
+        long num_ranges = 0;
+
+        for (i = 0; i < mask->time_mask->num_elements; i++)
+        {
+            if (mask->time_mask->mask[i] && (i == 0 || !mask->time_mask->mask[i - 1]))
+            {
+                num_ranges++;
+            }
+        }
+        /* reading many small ranges is slower than reading everything and filtering in memory */
+        mask->read_time_ranges = (num_ranges * IMPORT_TIME_SAMPLES_PER_RANGE <= mask->time_mask->num_elements);
+    }
+
+    return 0;
+}
+
+/* Move a variable that was read in full (e.g. because it was needed for the filter operations) from the source product
+ * to the product, keeping only the time samples that remain after the filter operations.
+ */
+int harp_program_import_mask_move_variable(const harp_program_import_mask *mask, int index,
+                                           harp_product *source_product, harp_product *product)
+{
+    harp_variable *variable;
+    int i;
+
+    if (harp_product_get_variable_by_name(source_product, mask->variable_name[index], &variable) != 0)
+    {
+        return -1;
+    }
+    if (harp_product_detach_variable(source_product, variable) != 0)
+    {
+        return -1;
+    }
+
+    if (mask->time_mask != NULL)
+    {
+        for (i = 0; i < variable->num_dimensions; i++)
+        {
+            if (variable->dimension_type[i] == harp_dimension_time)
+            {
+                if (harp_variable_filter_dimension(variable, i, mask->time_mask->mask) != 0)
+                {
+                    harp_variable_delete(variable);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    if (harp_product_add_variable(product, variable) != 0)
+    {
+        harp_variable_delete(variable);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -1522,7 +2077,7 @@ LIBHARP_API int harp_product_execute_operations(harp_product *product, const cha
         return -1;
     }
 
-    if (harp_product_execute_program(product, program) != 0)
+    if (harp_product_continue_program(product, program) != 0)
     {
         harp_program_delete(program);
         return -1;
@@ -1533,6 +2088,169 @@ LIBHARP_API int harp_product_execute_operations(harp_product *product, const cha
     return 0;
 }
 
+/**
+ * Compile one or more operations into a program.
+ *
+ * The resulting program can be passed to harp_import_with_program() and harp_product_execute_program() to apply the
+ * same operations to many products without having to parse the operations again for each product. Resources that
+ * are referenced by the operations, such as the polygons of area mask files and the collocation results used by
+ * collocate_left()/collocate_right() filters, are only read once, when the program is compiled.
+ *
+ * A compiled program keeps state while it is executed and should therefore not be used by multiple threads at the
+ * same time.
+ * \param operations Operations to compile; should be specified as a semi-colon separated string of operations.
+ * \param program Pointer to the C variable where the compiled program will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_program_compile(const char *operations, harp_program **program)
+{
+    harp_program *new_program;
+    int i;
+
+    if (operations == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "operations is NULL");
+        return -1;
+    }
+    if (program == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "program is NULL");
+        return -1;
+    }
+
+    if (harp_program_from_string(operations, &new_program) != 0)
+    {
+        return -1;
+    }
+
+    new_program->operations = strdup(operations);
+    if (new_program->operations == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        harp_program_delete(new_program);
+        return -1;
+    }
+
+    for (i = 0; i < new_program->num_operations; i++)
+    {
+        if (new_program->operation[i]->type == operation_collocation_filter)
+        {
+            if (harp_operation_preload_collocation_filter(new_program->operation[i]) != 0)
+            {
+                harp_program_delete(new_program);
+                return -1;
+            }
+        }
+    }
+
+    /* the global options are only changed while the program is being executed */
+    harp_program_end_execution(new_program);
+
+    *program = new_program;
+    return 0;
+}
+
+/**
+ * Create a copy of a compiled program.
+ *
+ * Since a compiled program keeps state while it is executed, each thread that applies the same operations at the same
+ * time needs its own program. The copy shares the collocation results that were read for collocate_left() and
+ * collocate_right() filters with the original program (these results are only read during execution), so these are
+ * not read again. The original program should therefore not be deleted before the copy.
+ * \param program Compiled program (created with harp_program_compile()) that should be copied.
+ * \param new_program Pointer to the C variable where the copy of the program will be stored.
+ * 
+eturn
+ *   rg \c 0, Success.
+ *   rg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_program_copy(const harp_program *program, harp_program **new_program)
+{
+    harp_program *program_copy;
+    int i;
+
+    if (program == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "program is NULL");
+        return -1;
+    }
+    if (new_program == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "new_program is NULL");
+        return -1;
+    }
+    if (program->operations == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "program was not created by harp_program_compile()");
+        return -1;
+    }
+
+    if (harp_program_from_string(program->operations, &program_copy) != 0)
+    {
+        return -1;
+    }
+    assert(program_copy->num_operations == program->num_operations);
+
+    program_copy->operations = strdup(program->operations);
+    if (program_copy->operations == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not duplicate string) (%s:%u)", __FILE__,
+                       __LINE__);
+        harp_program_delete(program_copy);
+        return -1;
+    }
+
+    for (i = 0; i < program_copy->num_operations; i++)
+    {
+        if (program_copy->operation[i]->type == operation_collocation_filter)
+        {
+            harp_operation_share_collocation_filter(program_copy->operation[i], program->operation[i]);
+        }
+    }
+
+    /* the global options are only changed while the program is being executed */
+    harp_program_end_execution(program_copy);
+
+    *new_program = program_copy;
+    return 0;
+}
+
+/**
+ * Execute a compiled program on a product.
+ *
+ * This is equivalent to harp_product_execute_operations(), but uses operations that were already compiled using
+ * harp_program_compile().
+ * \param product Product that the operations should be executed on.
+ * \param program Compiled program containing the operations to execute.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_product_execute_program(harp_product *product, harp_program *program)
+{
+    int result;
+
+    if (product == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "product is NULL");
+        return -1;
+    }
+    if (program == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "program is NULL");
+        return -1;
+    }
+
+    harp_program_begin_execution(program);
+    result = harp_product_continue_program(product, program);
+    harp_program_end_execution(program);
+
+    return result;
+}
+
 /**
  * @}
  */
@@ -33,29 +33,72 @@
 #define HARP_PROGRAM_H
 
 #include "harp-operation.h"
+#include "harp-dimension-mask.h"
 
 /* HARP programs are lists of harp_operations */
-typedef struct harp_program_struct
+struct harp_program_struct
 {
     int num_operations;
     harp_operation **operation;
 
     /* state information used during execution of the program */
     int current_index;  /* index of operation that is next to be executed */
-    /* initial global HARP options */
-    int option_enable_aux_afgl86;
-    int option_enable_aux_usstd76;
-    int option_regrid_out_of_bounds;
-} harp_program;
+    /* intermediate variables of consecutive derive operations (only valid while the product is only being extended) */
+    harp_derived_variable_cache *derived_variable_cache;
+    /* operations that the program was compiled from (NULL if the program was not created by harp_program_compile()) */
+    char *operations;
+    /* HARP options as seen (and changed by set() operations) by the executing thread (only valid if options_active is
+     * set) together with the options that were in use by that thread before the program started */
+    int options_active;
+    harp_program_options options;
+    harp_program_options *previous_options;
+};
 
 int harp_program_new(harp_program **new_program);
-void harp_program_delete(harp_program *program);
 int harp_program_add_operation(harp_program *program, harp_operation *operation);
 
 /* Parser */
 int harp_program_from_string(const char *str, harp_program **new_program);
 
 /* Execution */
-int harp_product_execute_program(harp_product *product, harp_program *program);
+void harp_program_begin_execution(harp_program *program);
+void harp_program_end_execution(harp_program *program);
+int harp_product_continue_program(harp_product *product, harp_program *program);
+
+/* Selection of the data that needs to be read when importing a product in HARP format.
+ * The leading keep/exclude and time filter operations of a program can be applied while reading the product, such that
+ * only the variables that are kept and only the time samples that pass the filters need to be read from the file.
+ */
+typedef struct harp_program_import_mask_struct
+{
+    /* variables in the file (in the order in which they are stored) */
+    int num_variables;
+    char **variable_name;
+    int *num_dimensions;
+    harp_dimension_type (*dimension_type)[HARP_MAX_NUM_DIMS];
+    long (*dimension)[HARP_MAX_NUM_DIMS];
+
+    /* set by harp_program_import_mask_apply_variable_operations() */
+    int num_operations; /* number of operations (starting at program->current_index) that are applied during import */
+    int has_filter;     /* whether any of these operations is a filter operation */
+    uint8_t *variable_mask;     /* variables that remain after the keep/exclude operations */
+    uint8_t *filter_variable_mask;      /* variables that are needed to evaluate the filter operations */
+
+    /* set by harp_program_import_mask_apply_filter_operations() */
+    int is_empty;       /* whether the filters removed the full product */
+    harp_dimension_mask *time_mask;     /* time samples that remain (NULL if the time dimension is not filtered) */
+    int read_time_ranges;       /* whether to only read the contiguous ranges of remaining time samples (if not, then
+                                 * variables are read in full and filtered afterwards) */
+} harp_program_import_mask;
+
+int harp_program_import_mask_new(harp_program_import_mask **new_mask);
+void harp_program_import_mask_delete(harp_program_import_mask *mask);
+int harp_program_import_mask_add_variable(harp_program_import_mask *mask, const char *name, int num_dimensions,
+                                          const harp_dimension_type *dimension_type, const long *dimension);
+int harp_program_import_mask_apply_variable_operations(harp_program_import_mask *mask, const harp_program *program);
+int harp_program_import_mask_apply_filter_operations(harp_program_import_mask *mask, const harp_program *program,
+                                                     const harp_product *filter_product);
+int harp_program_import_mask_move_variable(const harp_program_import_mask *mask, int index,
+                                           harp_product *source_product, harp_product *product);
 
 #endif
@@ -831,6 +831,263 @@ static int regrid_with_multi_dim_source_axis(harp_product *product, harp_variabl
     return -1;
 }
 
+/* number of blocks (i.e. profiles) that are regridded per task when regridding using multiple threads */
+#define REGRID_BLOCK_SIZE 64
+
+/* Regrid a single [max_dim_elements, num_elements] block of float or double data in place.
+ * The source values of the block are copied to source_buffer first. For float data the interpolated values are
+ * written to target_buffer and then rounded to float, for double data they are written directly into the block.
+ * Both buffers need to be able to hold max_dim_elements * num_elements values.
+ */
+static void regrid_block(const harp_interpolation_plan *plan, long source_length, long target_length,
+                         long max_dim_elements, long num_elements, harp_data_type data_type, harp_array block,
+                         double *source_buffer, double *target_buffer)
+{
+    double nan_value = harp_nan();
+    long k;
+
+    if (data_type == harp_type_float)
+    {
+        for (k = 0; k < source_length * num_elements; k++)
+        {
+            source_buffer[k] = block.float_data[k];
+        }
+        harp_interpolation_plan_apply(plan, num_elements, source_buffer, target_buffer);
+        for (k = 0; k < target_length * num_elements; k++)
+        {
+            block.float_data[k] = (float)target_buffer[k];
+        }
+        for (k = target_length * num_elements; k < max_dim_elements * num_elements; k++)
+        {
+            block.float_data[k] = (float)nan_value;
+        }
+        return;
+    }
+
+    assert(data_type == harp_type_double);
+    memcpy(source_buffer, block.double_data, source_length * num_elements * sizeof(double));
+    harp_interpolation_plan_apply(plan, num_elements, source_buffer, block.double_data);
+    for (k = target_length * num_elements; k < max_dim_elements * num_elements; k++)
+    {
+        block.double_data[k] = nan_value;
+    }
+}
+
+typedef struct regrid_info_struct
+{
+    const harp_interpolation_plan *plan;
+    long source_length; /* unpadded source grid length */
+    long target_length; /* unpadded target grid length */
+    long num_blocks;
+    long max_dim_elements;
+    long num_elements;
+    harp_data_type data_type;
+    harp_array data;
+    double *buffer;     /* source and target block buffer for each task */
+} regrid_info;
+
+/* Task for harp_parallel_for() that regrids a range of blocks of a variable */
+static void regrid_blocks_task(void *context, long index)
+{
+    regrid_info *info = (regrid_info *)context;
+    long block_size = info->max_dim_elements * info->num_elements;
+    double *source_buffer = &info->buffer[2 * index * block_size];
+    double *target_buffer = &source_buffer[block_size];
+    long last_block = (index + 1) * REGRID_BLOCK_SIZE;
+    long j;
+
+    if (last_block > info->num_blocks)
+    {
+        last_block = info->num_blocks;
+    }
+    for (j = index * REGRID_BLOCK_SIZE; j < last_block; j++)
+    {
+        harp_array block;
+
+        if (info->data_type == harp_type_float)
+        {
+            block.float_data = &info->data.float_data[j * block_size];
+        }
+        else
+        {
+            block.double_data = &info->data.double_data[j * block_size];
+        }
+        regrid_block(info->plan, info->source_length, info->target_length, info->max_dim_elements,
+                     info->num_elements, info->data_type, block, source_buffer, target_buffer);
+    }
+}
+
+/* Axis data (grid values or grid bounds) and unpadded axis lengths for each grid time index.
+ * The axis data for time index i starts at source_axis[i * source_axis_stride] and target_axis[i * target_axis_stride]
+ * (a stride of 0 is used for a time independent grid).
+ */
+typedef struct regrid_axis_struct
+{
+    const long *source_length;
+    const double *source_axis;
+    long source_axis_stride;
+    const long *target_length;
+    const double *target_axis;
+    long target_axis_stride;
+    long num_axis_values;       /* number of axis values per grid element (1 for grid values, 2 for grid bounds) */
+} regrid_axis;
+
+/* returns 1 if the source and target axis for the given time index are the same as for the previous time index */
+static int regrid_axis_equals_previous(const regrid_axis *axis, long time_index)
+{
+    const double *source = &axis->source_axis[time_index * axis->source_axis_stride];
+    const double *target = &axis->target_axis[time_index * axis->target_axis_stride];
+
+    if (axis->source_length[time_index] != axis->source_length[time_index - 1] ||
+        axis->target_length[time_index] != axis->target_length[time_index - 1])
+    {
+        return 0;
+    }
+    if (axis->source_axis_stride != 0 && memcmp(source, source - axis->source_axis_stride,
+                                                axis->num_axis_values * axis->source_length[time_index] *
+                                                sizeof(double)) != 0)
+    {
+        return 0;
+    }
+    if (axis->target_axis_stride != 0 && memcmp(target, target - axis->target_axis_stride,
+                                                axis->num_axis_values * axis->target_length[time_index] *
+                                                sizeof(double)) != 0)
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+static int create_interpolation_plan(resample_type type, const char *axis_name, const regrid_axis *axis,
+                                     long time_index, int out_of_bound_flag, harp_interpolation_plan **new_plan)
+{
+    const double *source = &axis->source_axis[time_index * axis->source_axis_stride];
+    const double *target = &axis->target_axis[time_index * axis->target_axis_stride];
+    long source_length = axis->source_length[time_index];
+    long target_length = axis->target_length[time_index];
+
+    if (source_length <= 1 && target_length > 0)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "dimension length for %s needs to be > 1 to allow regridding",
+                       axis_name);
+        return -1;
+    }
+    if (type == resample_linear)
+    {
+        return harp_interpolation_plan_new_linear(source_length, source, target_length, target, out_of_bound_flag,
+                                                  new_plan);
+    }
+    if (type == resample_loglog)
+    {
+        return harp_interpolation_plan_new_logloglinear(source_length, source, target_length, target,
+                                                        out_of_bound_flag, new_plan);
+    }
+    assert(type == resample_interval);
+    return harp_interval_interpolation_plan_new_linear(source_length, source, target_length, target, new_plan);
+}
+
+/* Regrid the data of a variable that is treated as a [num_blocks, max_dim_elements, num_elements] array.
+ * The variable data can be either float or double; float data is interpolated per block using double buffers, such that
+ * the variable itself never needs to be converted to double.
+ * The interpolation weights are determined once for each distinct source/target grid pair.
+ * If the grids are the same for all time indices (which is the case for time independent grids) then the weights are
+ * determined only once and all blocks are regridded in parallel using the same interpolation plan.
+ */
+static int regrid_variable_data(resample_type type, const char *axis_name, const regrid_axis *axis,
+                                long num_time_elements, int shared_grid, int out_of_bound_flag, long num_blocks,
+                                long max_dim_elements, long num_elements, harp_variable *variable)
+{
+    harp_interpolation_plan *plan = NULL;
+    long block_size = max_dim_elements * num_elements;
+    long element_size = harp_get_size_for_type(variable->data_type);
+    double *buffer;
+    long num_blocks_per_time;
+    long i;
+
+    if (shared_grid)
+    {
+        regrid_info info;
+        long num_tasks = (num_blocks + REGRID_BLOCK_SIZE - 1) / REGRID_BLOCK_SIZE;
+
+        /* allocate memory for the source and target block buffers of each task */
+        info.buffer = (double *)malloc(num_tasks * 2 * block_size * sizeof(double));
+        if (info.buffer == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_tasks * 2 * block_size * sizeof(double), __FILE__, __LINE__);
+            return -1;
+        }
+        if (create_interpolation_plan(type, axis_name, axis, 0, out_of_bound_flag, &plan) != 0)
+        {
+            free(info.buffer);
+            return -1;
+        }
+        info.plan = plan;
+        info.source_length = axis->source_length[0];
+        info.target_length = axis->target_length[0];
+        info.num_blocks = num_blocks;
+        info.max_dim_elements = max_dim_elements;
+        info.num_elements = num_elements;
+        info.data_type = variable->data_type;
+        info.data = variable->data;
+        harp_parallel_for(num_tasks, variable->num_elements * element_size, regrid_blocks_task, &info);
+        harp_interpolation_plan_delete(plan);
+        free(info.buffer);
+        return 0;
+    }
+
+    /* regrid in place, using buffers for the source (and target) values of a block */
+    buffer = (double *)malloc(2 * block_size * sizeof(double));
+    if (buffer == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       2 * block_size * sizeof(double), __FILE__, __LINE__);
+        return -1;
+    }
+
+    /* num_blocks can capture more than just the time dimension */
+    num_blocks_per_time = num_blocks / num_time_elements;
+    for (i = 0; i < num_blocks; i++)
+    {
+        long time_index = i / num_blocks_per_time;
+        harp_array block;
+
+        if (i % num_blocks_per_time == 0 && (plan == NULL || !regrid_axis_equals_previous(axis, time_index)))
+        {
+            if (plan != NULL)
+            {
+                harp_interpolation_plan_delete(plan);
+                plan = NULL;
+            }
+            if (create_interpolation_plan(type, axis_name, axis, time_index, out_of_bound_flag, &plan) != 0)
+            {
+                free(buffer);
+                return -1;
+            }
+        }
+
+        if (variable->data_type == harp_type_float)
+        {
+            block.float_data = &variable->data.float_data[i * block_size];
+        }
+        else
+        {
+            block.double_data = &variable->data.double_data[i * block_size];
+        }
+        regrid_block(plan, axis->source_length[time_index], axis->target_length[time_index], max_dim_elements,
+                     num_elements, variable->data_type, block, buffer, &buffer[block_size]);
+    }
+
+    if (plan != NULL)
+    {
+        harp_interpolation_plan_delete(plan);
+    }
+    free(buffer);
+
+    return 0;
+}
+
 /** \addtogroup harp_product
  * @{
  */
@@ -868,13 +1125,16 @@ LIBHARP_API int harp_product_regrid_with_axis_variable(harp_product *product, ha
     harp_dimension_type dimension_type;
     long max_dim_elements;      /* max(source_grid_max_dim_elements, target_grid_max_dim_elements) */
     long source_grid_max_dim_elements;  /* actual elems + NaN padding */
-    long source_grid_num_dim_elements;  /* actual elems */
     long target_grid_max_dim_elements;  /* actual elems + NaN padding */
-    long target_grid_num_dim_elements;  /* actual elems */
+    regrid_axis point_axis;
+    regrid_axis interval_axis;
+    int point_shared_grid = 1;
+    int interval_shared_grid = 1;
     long grid_num_time_elements = 1;
     int source_grid_num_dims = 1;
     int target_grid_num_dims;
     int out_of_bound_flag;
+    int keep_float;
     harp_variable *variable;
     long i;
 
@@ -883,10 +1143,11 @@ LIBHARP_API int harp_product_regrid_with_axis_variable(harp_product *product, ha
     harp_variable *source_bounds = NULL;
     harp_variable *local_target_grid = NULL;
     harp_variable *local_target_bounds = NULL;
-    double *source_buffer = NULL;
-    double *target_buffer = NULL;
+    long *source_length = NULL;
+    long *target_length = NULL;
 
     out_of_bound_flag = harp_get_option_regrid_out_of_bounds();
+    keep_float = harp_get_option_regrid_precision() == 1;
 
     if (target_grid->data_type != harp_type_double)
     {
@@ -1089,28 +1350,68 @@ LIBHARP_API int harp_product_regrid_with_axis_variable(harp_product *product, ha
         }
     }
 
-    /* allocate the buffers for the interpolation */
-    source_buffer = (double *)malloc(source_grid_max_dim_elements * (size_t)sizeof(double));
-    if (source_buffer == NULL)
+    /* determine the unpadded grid lengths for each time index of the grids */
+    if (grid_num_time_elements > 0)
     {
-        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       source_grid_max_dim_elements * sizeof(double), __FILE__, __LINE__);
-        goto error;
+        source_length = (long *)malloc(grid_num_time_elements * sizeof(long));
+        if (source_length == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           grid_num_time_elements * sizeof(long), __FILE__, __LINE__);
+            goto error;
+        }
+        target_length = (long *)malloc(grid_num_time_elements * sizeof(long));
+        if (target_length == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           grid_num_time_elements * sizeof(long), __FILE__, __LINE__);
+            goto error;
+        }
     }
-    target_buffer = (double *)malloc(target_grid_max_dim_elements * (size_t)sizeof(double));
-    if (target_buffer == NULL)
+    for (i = 0; i < grid_num_time_elements; i++)
     {
-        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       target_grid_max_dim_elements * sizeof(double), __FILE__, __LINE__);
-        goto error;
+        source_length[i] = get_unpadded_length(&source_grid->data.double_data[source_grid_num_dims == 2 ?
+                                                                              i * source_grid_max_dim_elements : 0],
+                                               source_grid_max_dim_elements);
+        target_length[i] = get_unpadded_length(&target_grid->data.double_data[target_grid_num_dims == 2 ?
+                                                                              i * target_grid_max_dim_elements : 0],
+                                               target_grid_max_dim_elements);
+    }
+    point_axis.source_length = source_length;
+    point_axis.source_axis = source_grid->data.double_data;
+    point_axis.source_axis_stride = source_grid_num_dims == 2 ? source_grid_max_dim_elements : 0;
+    point_axis.target_length = target_length;
+    point_axis.target_axis = local_target_grid->data.double_data;
+    point_axis.target_axis_stride = target_grid_num_dims == 2 ? target_grid_max_dim_elements : 0;
+    point_axis.num_axis_values = 1;
+    if (source_bounds != NULL)
+    {
+        interval_axis.source_length = source_length;
+        interval_axis.source_axis = source_bounds->data.double_data;
+        interval_axis.source_axis_stride = 2 * point_axis.source_axis_stride;
+        interval_axis.target_length = target_length;
+        interval_axis.target_axis = local_target_bounds->data.double_data;
+        interval_axis.target_axis_stride = 2 * point_axis.target_axis_stride;
+        interval_axis.num_axis_values = 2;
+    }
+
+    /* check whether the grids are the same for all time indices */
+    for (i = 1; i < grid_num_time_elements && (point_shared_grid || interval_shared_grid); i++)
+    {
+        if (!regrid_axis_equals_previous(&point_axis, i))
+        {
+            point_shared_grid = 0;
+        }
+        if (source_bounds != NULL && !regrid_axis_equals_previous(&interval_axis, i))
+        {
+            interval_shared_grid = 0;
+        }
     }
 
     /* regrid each variable */
     for (i = 0; i < product->num_variables; i++)
     {
         resample_type type;
-        long source_time_index;
-        long target_time_index;
         long num_blocks;
         long num_elements;
         long j;
@@ -1126,10 +1427,13 @@ LIBHARP_API int harp_product_regrid_with_axis_variable(harp_product *product, ha
             continue;
         }
 
-        /* Ensure that the variable data consists of doubles */
-        if (variable->data_type != harp_type_double && harp_variable_convert_data_type(variable, harp_type_double) != 0)
+        /* Ensure that the variable data consists of doubles (or floats if we are allowed to keep float precision) */
+        if (variable->data_type != harp_type_double && !(variable->data_type == harp_type_float && keep_float))
         {
-            goto error;
+            if (harp_variable_convert_data_type(variable, harp_type_double) != 0)
+            {
+                goto error;
+            }
         }
 
         /* Make time independent variables time dependent if source grid or target grid is 2D (i.e. time dependent) */
@@ -1163,93 +1467,15 @@ LIBHARP_API int harp_product_regrid_with_axis_variable(harp_product *product, ha
         }
 
         /* interpolate the data of the variable over the given dimension */
-        /* keep track of time index separately since num_blocks can capture more than just the time dimension */
-        source_time_index = 0;
-        target_time_index = 0;
-        source_grid_num_dim_elements = get_unpadded_length(source_grid->data.double_data, source_grid_max_dim_elements);
-        target_grid_num_dim_elements = get_unpadded_length(target_grid->data.double_data, target_grid_max_dim_elements);
-        for (j = 0; j < num_blocks; j++)
+        if (num_blocks > 0)
         {
-            long k, l;
-
-            /* keep track of time index for 2D grids */
-            if (j % (num_blocks / grid_num_time_elements) == 0)
-            {
-                if (source_grid_num_dims == 2 && j > 0)
-                {
-                    source_time_index++;
-                    source_grid_num_dim_elements =
-                        get_unpadded_length(&source_grid->data.double_data[source_time_index *
-                                                                           source_grid_max_dim_elements],
-                                            source_grid_max_dim_elements);
-                }
-                if (target_grid_num_dims == 2 && j > 0)
-                {
-                    target_time_index++;
-                    target_grid_num_dim_elements =
-                        get_unpadded_length(&target_grid->data.double_data[target_time_index *
-                                                                           target_grid_max_dim_elements],
-                                            target_grid_max_dim_elements);
-                }
-            }
-
-            if (source_grid_num_dim_elements <= 1 && target_grid_num_dim_elements > 0)
+            if (regrid_variable_data(type, target_grid->name, type == resample_interval ? &interval_axis : &point_axis,
+                                     grid_num_time_elements,
+                                     type == resample_interval ? interval_shared_grid : point_shared_grid,
+                                     out_of_bound_flag, num_blocks, max_dim_elements, num_elements, variable) != 0)
             {
-                harp_set_error(HARP_ERROR_INVALID_ARGUMENT,
-                               "dimension length for %s needs to be > 1 to allow regridding", target_grid->name);
                 goto error;
             }
-
-            for (l = 0; l < num_elements; l++)
-            {
-                /* we need to regrid by taking a slice for each sub element 'l' */
-                for (k = 0; k < source_grid_num_dim_elements; k++)
-                {
-                    source_buffer[k] = variable->data.double_data[(j * max_dim_elements + k) * num_elements + l];
-                }
-                if (type == resample_linear)
-                {
-                    harp_interpolate_array_linear
-                        (source_grid_num_dim_elements,
-                         &source_grid->data.double_data[source_time_index * source_grid_max_dim_elements],
-                         source_buffer, target_grid_num_dim_elements,
-                         &local_target_grid->data.double_data[target_time_index * target_grid_max_dim_elements],
-                         out_of_bound_flag, target_buffer);
-                }
-                else if (type == resample_loglog)
-                {
-                    harp_interpolate_array_logloglinear
-                        (source_grid_num_dim_elements,
-                         &source_grid->data.double_data[source_time_index * source_grid_max_dim_elements],
-                         source_buffer, target_grid_num_dim_elements,
-                         &local_target_grid->data.double_data[target_time_index * target_grid_max_dim_elements],
-                         out_of_bound_flag, target_buffer);
-                }
-                else if (type == resample_interval)
-                {
-                    harp_interval_interpolate_array_linear
-                        (source_grid_num_dim_elements,
-                         &source_bounds->data.double_data[source_time_index * source_grid_max_dim_elements * 2],
-                         source_buffer, target_grid_num_dim_elements,
-                         &local_target_bounds->data.double_data[target_time_index * target_grid_max_dim_elements * 2],
-                         target_buffer);
-                }
-                else
-                {
-                    /* other resampling methods are not supported, but should also never be set */
-                    assert(0);
-                    exit(1);
-                }
-
-                for (k = 0; k < target_grid_num_dim_elements; k++)
-                {
-                    variable->data.double_data[(j * max_dim_elements + k) * num_elements + l] = target_buffer[k];
-                }
-                for (k = target_grid_num_dim_elements; k < target_grid_max_dim_elements; k++)
-                {
-                    variable->data.double_data[(j * max_dim_elements + k) * num_elements + l] = harp_nan();
-                }
-            }
         }
     }
 
@@ -1313,8 +1539,14 @@ LIBHARP_API int harp_product_regrid_with_axis_variable(harp_product *product, ha
     harp_variable_delete(source_bounds);
     harp_variable_delete(local_target_grid);
     harp_variable_delete(local_target_bounds);
-    free(source_buffer);
-    free(target_buffer);
+    if (source_length != NULL)
+    {
+        free(source_length);
+    }
+    if (target_length != NULL)
+    {
+        free(target_length);
+    }
 
     return 0;
 
@@ -1323,13 +1555,13 @@ LIBHARP_API int harp_product_regrid_with_axis_variable(harp_product *product, ha
     harp_variable_delete(source_bounds);
     harp_variable_delete(local_target_grid);
     harp_variable_delete(local_target_bounds);
-    if (source_buffer != NULL)
+    if (source_length != NULL)
     {
-        free(source_buffer);
+        free(source_length);
     }
-    if (target_buffer != NULL)
+    if (target_length != NULL)
     {
-        free(target_buffer);
+        free(target_length);
     }
 
     return -1;
@@ -30,24 +30,50 @@
  */
 
 #include "harp-internal.h"
+#include "hashtable.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <locale.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "udunits2.h"
 
+/* maximum number of (from, to) unit pairs for which the unit converter is cached */
+#define MAX_UNIT_CONVERTER_CACHE_SIZE 1024
+
+typedef enum unit_conversion_type_enum
+{
+    unit_conversion_identity,   /* y = x */
+    unit_conversion_scale,      /* y = scale * x */
+    unit_conversion_offset,     /* y = offset + x */
+    unit_conversion_affine,     /* y = scale * x + offset */
+    unit_conversion_log,        /* y = log(x) * scale */
+    unit_conversion_exp,        /* y = pow(scale, x) */
+    unit_conversion_generic     /* conversion is performed by udunits2 */
+} unit_conversion_type;
+
 static char *harp_udunits2_xml_path = NULL;
 
 static ut_system *unit_system = NULL;
 
 struct harp_unit_converter_struct
 {
+    unit_conversion_type type;
+    double scale;
+    double offset;
     cv_converter *converter;
+    int is_cached;      /* if set, the udunits2 converter is owned by the unit converter cache */
 };
 
+/* cache of unit converters, using "<from_unit>\n<to_unit>" as key */
+static hashtable *unit_converter_cache_hash = NULL;
+static long unit_converter_cache_size = 0;
+static char **unit_converter_cache_key = NULL;
+static harp_unit_converter **unit_converter_cache = NULL;
+
 static void handle_udunits_error(void)
 {
     switch (ut_get_status())
@@ -273,8 +299,39 @@ static int unit_system_init(void)
     return 0;
 }
 
+static void unit_converter_cache_done(void)
+{
+    long i;
+
+    if (unit_converter_cache_hash != NULL)
+    {
+        hashtable_delete(unit_converter_cache_hash);
+        unit_converter_cache_hash = NULL;
+    }
+    for (i = 0; i < unit_converter_cache_size; i++)
+    {
+        free(unit_converter_cache_key[i]);
+        cv_free(unit_converter_cache[i]->converter);
+        free(unit_converter_cache[i]);
+    }
+    if (unit_converter_cache_key != NULL)
+    {
+        free(unit_converter_cache_key);
+        unit_converter_cache_key = NULL;
+    }
+    if (unit_converter_cache != NULL)
+    {
+        free(unit_converter_cache);
+        unit_converter_cache = NULL;
+    }
+    unit_converter_cache_size = 0;
+}
+
 static void unit_system_done(void)
 {
+    /* cached converters refer to the unit system */
+    unit_converter_cache_done();
+
     if (unit_system != NULL)
     {
         ut_free_system(unit_system);
@@ -317,12 +374,15 @@ int harp_unit_is_valid(const char *str)
 {
     ut_unit *unit;
 
+    harp_lock(harp_lock_units);
     if (parse_unit(str, &unit) != 0)
     {
+        harp_unlock(harp_lock_units);
         return 0;
     }
 
     ut_free(unit);
+    harp_unlock(harp_lock_units);
 
     return 1;
 }
@@ -331,7 +391,7 @@ void harp_unit_converter_delete(harp_unit_converter *unit_converter)
 {
     if (unit_converter != NULL)
     {
-        if (unit_converter->converter != NULL)
+        if (unit_converter->converter != NULL && !unit_converter->is_cached)
         {
             cv_free(unit_converter->converter);
         }
@@ -340,7 +400,132 @@ void harp_unit_converter_delete(harp_unit_converter *unit_converter)
     }
 }
 
-int harp_unit_converter_new(const char *from_unit, const char *to_unit, harp_unit_converter **new_unit_converter)
+static int is_same_value(double a, double b)
+{
+    /* NaN values compare equal */
+    return a == b || (a != a && b != b);
+}
+
+/* Determine whether the udunits2 conversion is of a simple form (scale and/or offset, log, or exp) that we can apply
+ * ourselves on arrays of values. The parameters of the form are derived from converted sample values and the form is
+ * only used if it reproduces the udunits2 result for a set of test values exactly.
+ */
+static void unit_converter_detect_type(harp_unit_converter *unit_converter)
+{
+    static const double test_value[] = { -2.5, 1.0e-7, 0.1, 3.0, 7.25, 1234.5678, 3.0e9 };
+    int num_test_values = sizeof(test_value) / sizeof(test_value[0]);
+    cv_converter *converter = unit_converter->converter;
+    double y0, y1;
+    int i;
+
+    unit_converter->type = unit_conversion_generic;
+    unit_converter->scale = 1.0;
+    unit_converter->offset = 0.0;
+
+    y0 = cv_convert_double(converter, 0.0);
+    y1 = cv_convert_double(converter, 1.0);
+
+    if (y0 == 0)
+    {
+        /* y = scale * x */
+        for (i = 0; i < num_test_values; i++)
+        {
+            if (!is_same_value(cv_convert_double(converter, test_value[i]), y1 * test_value[i]))
+            {
+                break;
+            }
+        }
+        if (i == num_test_values)
+        {
+            unit_converter->type = (y1 == 1.0 ? unit_conversion_identity : unit_conversion_scale);
+            unit_converter->scale = y1;
+            return;
+        }
+    }
+
+    if (y0 == y0 && y0 != HUGE_VAL && y0 != -HUGE_VAL && y0 != 0)
+    {
+        double candidate_scale[2];
+        int k;
+
+        /* y = offset + x */
+        for (i = 0; i < num_test_values; i++)
+        {
+            if (!is_same_value(cv_convert_double(converter, test_value[i]), y0 + test_value[i]))
+            {
+                break;
+            }
+        }
+        if (i == num_test_values)
+        {
+            unit_converter->type = unit_conversion_offset;
+            unit_converter->offset = y0;
+            return;
+        }
+
+        /* y = scale * x + offset */
+        candidate_scale[0] = y1 - y0;
+        candidate_scale[1] = (cv_convert_double(converter, 1048576.0) - y0) / 1048576.0;
+        for (k = 0; k < 2; k++)
+        {
+            for (i = 0; i < num_test_values; i++)
+            {
+                if (!is_same_value(cv_convert_double(converter, test_value[i]),
+                                   candidate_scale[k] * test_value[i] + y0))
+                {
+                    break;
+                }
+            }
+            if (i == num_test_values)
+            {
+                unit_converter->type = unit_conversion_affine;
+                unit_converter->scale = candidate_scale[k];
+                unit_converter->offset = y0;
+                return;
+            }
+        }
+
+        if (y0 == 1.0)
+        {
+            /* y = pow(base, x) */
+            for (i = 0; i < num_test_values; i++)
+            {
+                if (!is_same_value(cv_convert_double(converter, test_value[i]), pow(y1, test_value[i])))
+                {
+                    break;
+                }
+            }
+            if (i == num_test_values)
+            {
+                unit_converter->type = unit_conversion_exp;
+                unit_converter->scale = y1;
+                return;
+            }
+        }
+    }
+
+    if (y1 == 0)
+    {
+        double factor = cv_convert_double(converter, M_E) / log(M_E);
+
+        /* y = log(x) * factor */
+        for (i = 0; i < num_test_values; i++)
+        {
+            if (!is_same_value(cv_convert_double(converter, test_value[i]), log(test_value[i]) * factor))
+            {
+                break;
+            }
+        }
+        if (i == num_test_values)
+        {
+            unit_converter->type = unit_conversion_log;
+            unit_converter->scale = factor;
+            return;
+        }
+    }
+}
+
+static int unit_converter_create(const char *from_unit, const char *to_unit, harp_unit_converter **new_unit_converter)
 {
     harp_unit_converter *unit_converter;
     ut_unit *from_udunit;
@@ -374,6 +559,7 @@ int harp_unit_converter_new(const char *from_unit, const char *to_unit, harp_uni
         ut_free(from_udunit);
         return -1;
     }
+    unit_converter->is_cached = 0;
 
     unit_converter->converter = ut_get_converter(from_udunit, to_udunit);
     if (unit_converter->converter == NULL)
@@ -388,10 +574,148 @@ int harp_unit_converter_new(const char *from_unit, const char *to_unit, harp_uni
     ut_free(to_udunit);
     ut_free(from_udunit);
 
+    unit_converter_detect_type(unit_converter);
+
+    *new_unit_converter = unit_converter;
+    return 0;
+}
+
+static int unit_converter_cache_add(char *key, harp_unit_converter *unit_converter)
+{
+    if (unit_converter_cache_hash == NULL)
+    {
+        unit_converter_cache_hash = hashtable_new(1);
+        if (unit_converter_cache_hash == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not create hashtable) (%s:%u)", __FILE__,
+                           __LINE__);
+            return -1;
+        }
+    }
+
+    if (unit_converter_cache_size % BLOCK_SIZE == 0)
+    {
+        char **new_key;
+        harp_unit_converter **new_cache;
+
+        new_key = realloc(unit_converter_cache_key, (unit_converter_cache_size + BLOCK_SIZE) * sizeof(char *));
+        if (new_key == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           (unit_converter_cache_size + BLOCK_SIZE) * sizeof(char *), __FILE__, __LINE__);
+            return -1;
+        }
+        unit_converter_cache_key = new_key;
+
+        new_cache = realloc(unit_converter_cache,
+                            (unit_converter_cache_size + BLOCK_SIZE) * sizeof(harp_unit_converter *));
+        if (new_cache == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           (unit_converter_cache_size + BLOCK_SIZE) * sizeof(harp_unit_converter *), __FILE__,
+                           __LINE__);
+            return -1;
+        }
+        unit_converter_cache = new_cache;
+    }
+
+    if (hashtable_add_name(unit_converter_cache_hash, key) != 0)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not add key to hashtable) (%s:%u)", __FILE__,
+                       __LINE__);
+        return -1;
+    }
+    unit_converter_cache_key[unit_converter_cache_size] = key;
+    unit_converter_cache[unit_converter_cache_size] = unit_converter;
+    unit_converter_cache_size++;
+
+    return 0;
+}
+
+/* Converters are cached per (from_unit, to_unit) pair, such that repeated conversions between the same units do not
+ * need to parse the units again.
+ */
+static int unit_converter_new(const char *from_unit, const char *to_unit, harp_unit_converter **new_unit_converter)
+{
+    harp_unit_converter *cached_unit_converter;
+    harp_unit_converter *unit_converter;
+    char *key;
+    long index = -1;
+
+    if (from_unit == NULL || to_unit == NULL)
+    {
+        /* let parse_unit() raise the error */
+        return unit_converter_create(from_unit, to_unit, new_unit_converter);
+    }
+
+    key = malloc(strlen(from_unit) + strlen(to_unit) + 2);
+    if (key == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       strlen(from_unit) + strlen(to_unit) + 2, __FILE__, __LINE__);
+        return -1;
+    }
+    sprintf(key, "%s\n%s", from_unit, to_unit);
+
+    if (unit_converter_cache_hash != NULL)
+    {
+        index = hashtable_get_index_from_name(unit_converter_cache_hash, key);
+    }
+    if (index >= 0)
+    {
+        free(key);
+        cached_unit_converter = unit_converter_cache[index];
+    }
+    else
+    {
+        if (unit_converter_create(from_unit, to_unit, &unit_converter) != 0)
+        {
+            free(key);
+            return -1;
+        }
+        if (unit_converter_cache_size >= MAX_UNIT_CONVERTER_CACHE_SIZE)
+        {
+            /* cache is full; just return an uncached converter */
+            free(key);
+            *new_unit_converter = unit_converter;
+            return 0;
+        }
+        if (unit_converter_cache_add(key, unit_converter) != 0)
+        {
+            harp_unit_converter_delete(unit_converter);
+            free(key);
+            return -1;
+        }
+        cached_unit_converter = unit_converter;
+    }
+
+    unit_converter = (harp_unit_converter *)malloc(sizeof(harp_unit_converter));
+    if (unit_converter == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(harp_unit_converter), __FILE__, __LINE__);
+        return -1;
+    }
+    *unit_converter = *cached_unit_converter;
+    unit_converter->is_cached = 1;
+
     *new_unit_converter = unit_converter;
     return 0;
 }
 
+int harp_unit_converter_new(const char *from_unit, const char *to_unit, harp_unit_converter **new_unit_converter)
+{
+    int result;
+
+    /* udunits2 is not thread safe and the converter cache is shared; once created, a converter can be used
+     * concurrently without locking */
+    harp_lock(harp_lock_units);
+    result = unit_converter_new(from_unit, to_unit, new_unit_converter);
+    harp_unlock(harp_lock_units);
+
+    return result;
+}
+
 float harp_unit_converter_convert_float(const harp_unit_converter *unit_converter, float value)
 {
     return cv_convert_float(unit_converter->converter, value);
@@ -402,23 +726,97 @@ double harp_unit_converter_convert_double(const harp_unit_converter *unit_conver
     return cv_convert_double(unit_converter->converter, value);
 }
 
+/* the expressions below match the ones used by the udunits2 converters (which compute float conversions in double
+ * precision), so results are identical to a conversion of each value using udunits2 */
 void harp_unit_converter_convert_array_float(const harp_unit_converter *unit_converter, long num_values, float *value)
 {
-    float *value_end;
+    double scale = unit_converter->scale;
+    double offset = unit_converter->offset;
+    long i;
 
-    for (value_end = value + num_values; value != value_end; value++)
+    switch (unit_converter->type)
     {
-        *value = cv_convert_float(unit_converter->converter, *value);
+        case unit_conversion_identity:
+            break;
+        case unit_conversion_scale:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = (float)(scale * value[i]);
+            }
+            break;
+        case unit_conversion_offset:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = (float)(offset + value[i]);
+            }
+            break;
+        case unit_conversion_affine:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = (float)(scale * value[i] + offset);
+            }
+            break;
+        case unit_conversion_log:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = (float)(log(value[i]) * scale);
+            }
+            break;
+        case unit_conversion_exp:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = (float)pow(scale, value[i]);
+            }
+            break;
+        case unit_conversion_generic:
+            cv_convert_floats(unit_converter->converter, value, (size_t)num_values, value);
+            break;
     }
 }
 
 void harp_unit_converter_convert_array_double(const harp_unit_converter *unit_converter, long num_values, double *value)
 {
-    double *value_end;
+    double scale = unit_converter->scale;
+    double offset = unit_converter->offset;
+    long i;
 
-    for (value_end = value + num_values; value != value_end; value++)
+    switch (unit_converter->type)
     {
-        *value = cv_convert_double(unit_converter->converter, *value);
+        case unit_conversion_identity:
+            break;
+        case unit_conversion_scale:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = scale * value[i];
+            }
+            break;
+        case unit_conversion_offset:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = offset + value[i];
+            }
+            break;
+        case unit_conversion_affine:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = scale * value[i] + offset;
+            }
+            break;
+        case unit_conversion_log:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = log(value[i]) * scale;
+            }
+            break;
+        case unit_conversion_exp:
+            for (i = 0; i < num_values; i++)
+            {
+                value[i] = pow(scale, value[i]);
+            }
+            break;
+        case unit_conversion_generic:
+            cv_convert_doubles(unit_converter->converter, value, (size_t)num_values, value);
+            break;
     }
 }
 
@@ -436,14 +834,17 @@ int harp_unit_compare(const char *unit_a, const char *unit_b)
     ut_unit *udunit_b;
     int result;
 
+    harp_lock(harp_lock_units);
     if (parse_unit(unit_a, &udunit_a) != 0)
     {
+        harp_unlock(harp_lock_units);
         return -1;
     }
 
     if (parse_unit(unit_b, &udunit_b) != 0)
     {
         ut_free(udunit_a);
+        harp_unlock(harp_lock_units);
         return -1;
     }
 
@@ -451,6 +852,7 @@ int harp_unit_compare(const char *unit_a, const char *unit_b)
 
     ut_free(udunit_b);
     ut_free(udunit_a);
+    harp_unlock(harp_lock_units);
     return result;
 }
 
@@ -1672,3 +1672,111 @@ int harp_array_transpose(harp_data_type data_type, int num_dimensions, const lon
 
     return 0;
 }
+
+/* number of elements below which insertion sort is used for the initial runs of the merge sort */
+#define INDEX_SORT_RUN_LENGTH 16
+
+/** Sort an array of indices using a comparison function that receives a context argument.
+ * This is a stable (merge) sort. In contrast to qsort(), the comparison function does not need any global state to
+ * access the data that is being sorted, which keeps the sort reentrant.
+ * \param num_elements Number of elements in \a index.
+ * \param index Array of indices that will be reordered such that the elements that they refer to are sorted.
+ * \param compare Comparison function that returns <0, 0, or >0 when the element for \a index_a is considered less
+ *   than, equal to, or greater than the element for \a index_b.
+ * \param context Context argument that will be passed to \a compare.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+int harp_index_sort(long num_elements, long *index, int (*compare)(const void *context, long index_a, long index_b),
+                    const void *context)
+{
+    long *buffer;
+    long *src;
+    long *dst;
+    long width;
+    long i;
+
+    /* insertion sort of fixed length runs */
+    for (i = 0; i < num_elements; i += INDEX_SORT_RUN_LENGTH)
+    {
+        long end = i + INDEX_SORT_RUN_LENGTH < num_elements ? i + INDEX_SORT_RUN_LENGTH : num_elements;
+        long j;
+
+        for (j = i + 1; j < end; j++)
+        {
+            long value = index[j];
+            long k = j;
+
+            while (k > i && compare(context, index[k - 1], value) > 0)
+            {
+                index[k] = index[k - 1];
+                k--;
+            }
+            index[k] = value;
+        }
+    }
+    if (num_elements <= INDEX_SORT_RUN_LENGTH)
+    {
+        return 0;
+    }
+
+    buffer = malloc(num_elements * sizeof(long));
+    if (buffer == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_elements * sizeof(long), __FILE__, __LINE__);
+        return -1;
+    }
+
+    /* bottom-up merging of runs, alternating between index and buffer */
+    src = index;
+    dst = buffer;
+    for (width = INDEX_SORT_RUN_LENGTH; width < num_elements; width *= 2)
+    {
+        for (i = 0; i < num_elements; i += 2 * width)
+        {
+            long middle = i + width < num_elements ? i + width : num_elements;
+            long end = i + 2 * width < num_elements ? i + 2 * width : num_elements;
+            long a = i;
+            long b = middle;
+            long k = i;
+
+            if (middle == end || compare(context, src[middle - 1], src[middle]) <= 0)
+            {
+                /* runs are already in order */
+                memcpy(&dst[i], &src[i], (end - i) * sizeof(long));
+                continue;
+            }
+            while (a < middle && b < end)
+            {
+                if (compare(context, src[b], src[a]) < 0)
+                {
+                    dst[k++] = src[b++];
+                }
+                else
+                {
+                    dst[k++] = src[a++];
+                }
+            }
+            while (a < middle)
+            {
+                dst[k++] = src[a++];
+            }
+            while (b < end)
+            {
+                dst[k++] = src[b++];
+            }
+        }
+        src = dst;
+        dst = (dst == buffer ? index : buffer);
+    }
+    if (src != index)
+    {
+        memcpy(index, src, num_elements * sizeof(long));
+    }
+
+    free(buffer);
+
+    return 0;
+}
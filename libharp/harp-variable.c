@@ -1207,24 +1207,10 @@ int harp_variable_squash_dimension(harp_variable *variable, int dim_index)
     return harp_variable_remove_dimension(variable, dim_index, 0);
 }
 
-/** \addtogroup harp_variable
- * @{
- */
-
-/** Create new variable.
- * \param name Name of the variable.
- * \param data_type Storage type of the variable data.
- * \param num_dimensions Number of array dimensions (use '0' for scalar data).
- * \param dimension_type Array with the dimension type for each of the dimensions.
- * \param dimension Array with length for each of the dimensions.
- * \param new_variable Pointer to the C variable where the new HARP variable will be stored.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
- */
-LIBHARP_API int harp_variable_new(const char *name, harp_data_type data_type, int num_dimensions,
-                                  const harp_dimension_type *dimension_type, const long *dimension,
-                                  harp_variable **new_variable)
+/* If data is NULL a zero initialized data block is allocated, otherwise the variable takes ownership of data. */
+static int variable_new(const char *name, harp_data_type data_type, int num_dimensions,
+                        const harp_dimension_type *dimension_type, const long *dimension, void *data,
+                        harp_variable **new_variable)
 {
     harp_variable *variable;
     int i;
@@ -1307,15 +1293,22 @@ LIBHARP_API int harp_variable_new(const char *name, harp_data_type data_type, in
         return -1;
     }
 
-    variable->data.ptr = malloc((size_t)variable->num_elements * harp_get_size_for_type(data_type));
-    if (variable->data.ptr == NULL)
+    if (data != NULL)
     {
-        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       variable->num_elements * harp_get_size_for_type(data_type), __FILE__, __LINE__);
-        harp_variable_delete(variable);
-        return -1;
+        variable->data.ptr = data;
+    }
+    else
+    {
+        variable->data.ptr = malloc((size_t)variable->num_elements * harp_get_size_for_type(data_type));
+        if (variable->data.ptr == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           variable->num_elements * harp_get_size_for_type(data_type), __FILE__, __LINE__);
+            harp_variable_delete(variable);
+            return -1;
+        }
+        memset(variable->data.ptr, 0, (size_t)variable->num_elements * harp_get_size_for_type(data_type));
     }
-    memset(variable->data.ptr, 0, (size_t)variable->num_elements * harp_get_size_for_type(data_type));
 
     if (data_type != harp_type_string)
     {
@@ -1327,6 +1320,59 @@ LIBHARP_API int harp_variable_new(const char *name, harp_data_type data_type, in
     return 0;
 }
 
+/** \addtogroup harp_variable
+ * @{
+ */
+
+/** Create new variable.
+ * \param name Name of the variable.
+ * \param data_type Storage type of the variable data.
+ * \param num_dimensions Number of array dimensions (use '0' for scalar data).
+ * \param dimension_type Array with the dimension type for each of the dimensions.
+ * \param dimension Array with length for each of the dimensions.
+ * \param new_variable Pointer to the C variable where the new HARP variable will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_variable_new(const char *name, harp_data_type data_type, int num_dimensions,
+                                  const harp_dimension_type *dimension_type, const long *dimension,
+                                  harp_variable **new_variable)
+{
+    return variable_new(name, data_type, num_dimensions, dimension_type, dimension, NULL, new_variable);
+}
+
+/** Create new variable using an existing data block.
+ * The variable takes ownership of \a data, which should have been allocated with malloc() and should contain
+ * (the product of all dimension lengths) elements of type \a data_type. The data block will be freed when the
+ * variable is deleted, unless the caller resets the data pointer of the variable to NULL before deleting it (this
+ * allows the variable to temporarily borrow a data block that is owned by someone else, as long as the variable is
+ * only used in a read-only way, e.g. by harp_export()).
+ * If an error occurs, ownership of \a data remains with the caller.
+ * \param name Name of the variable.
+ * \param data_type Storage type of the variable data.
+ * \param num_dimensions Number of array dimensions (use '0' for scalar data).
+ * \param dimension_type Array with the dimension type for each of the dimensions.
+ * \param dimension Array with length for each of the dimensions.
+ * \param data Data block with the variable data.
+ * \param new_variable Pointer to the C variable where the new HARP variable will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_variable_new_with_data(const char *name, harp_data_type data_type, int num_dimensions,
+                                            const harp_dimension_type *dimension_type, const long *dimension,
+                                            void *data, harp_variable **new_variable)
+{
+    if (data == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "data is NULL (%s:%u)", __FILE__, __LINE__);
+        return -1;
+    }
+
+    return variable_new(name, data_type, num_dimensions, dimension_type, dimension, data, new_variable);
+}
+
 /** Delete variable.
  * Remove variable and all attached attributes.
  * \param variable HARP variable
@@ -908,6 +908,177 @@ static long get_unpadded_vector_length(double *vector, long vector_length)
     return vector_length;
 }
 
+/* number of profiles (time indices) that are smoothed per task when smoothing using multiple threads */
+#define SMOOTH_BLOCK_SIZE 64
+
+typedef struct smooth_info_struct
+{
+    long num_profiles;
+    long max_vertical_elements;
+    long num_blocks;    /* number of vertical profiles of the variable per time index */
+    double *vertical_axis;      /* optional */
+    const double *averaging_kernel;
+    const double *apriori;      /* optional */
+    double *data;
+    double *vector;     /* [num_tasks, num_blocks, max_vertical_elements] buffer */
+    long *valid_index;  /* [num_tasks, max_vertical_elements] buffer */
+} smooth_info;
+
+/* Apply the averaging kernel to a single profile (with all its blocks) in place.
+ * The apriori (if available) is subtracted before and added again after the multiplication by the averaging kernel.
+ * Elements that are NaN remain NaN and are excluded from the matrix-vector product. The sums are accumulated in
+ * the same order as a plain row-by-row matrix-vector product, but for profiles without NaN values four rows are
+ * computed at once (and without any NaN checks in the inner loop).
+ */
+static void smooth_profile(long num_vertical_elements, long max_vertical_elements, long num_blocks,
+                           const double *averaging_kernel, const double *apriori, double *data, double *vector,
+                           long *valid_index)
+{
+    long i, j, l;
+
+    /* store profiles in temporary vectors (with the apriori subtracted) */
+    for (l = 0; l < num_blocks; l++)
+    {
+        const double *profile = &data[l * max_vertical_elements];
+        double *block_vector = &vector[l * max_vertical_elements];
+
+        if (apriori != NULL)
+        {
+            for (i = 0; i < num_vertical_elements; i++)
+            {
+                block_vector[i] = profile[i] - apriori[i];
+            }
+        }
+        else
+        {
+            for (i = 0; i < num_vertical_elements; i++)
+            {
+                block_vector[i] = profile[i];
+            }
+        }
+    }
+
+    for (l = 0; l < num_blocks; l++)
+    {
+        const double *block_vector = &vector[l * max_vertical_elements];
+        double *profile = &data[l * max_vertical_elements];
+        long num_valid = 0;
+
+        for (j = 0; j < num_vertical_elements; j++)
+        {
+            if (!harp_isnan(block_vector[j]))
+            {
+                valid_index[num_valid] = j;
+                num_valid++;
+            }
+        }
+
+        if (num_valid == num_vertical_elements)
+        {
+            /* all elements are valid: multiply by avk using four rows at a time */
+            for (i = 0; i + 3 < num_vertical_elements; i += 4)
+            {
+                const double *avk_row0 = &averaging_kernel[i * max_vertical_elements];
+                const double *avk_row1 = avk_row0 + max_vertical_elements;
+                const double *avk_row2 = avk_row1 + max_vertical_elements;
+                const double *avk_row3 = avk_row2 + max_vertical_elements;
+                double sum0 = 0;
+                double sum1 = 0;
+                double sum2 = 0;
+                double sum3 = 0;
+
+                for (j = 0; j < num_vertical_elements; j++)
+                {
+                    sum0 += avk_row0[j] * block_vector[j];
+                    sum1 += avk_row1[j] * block_vector[j];
+                    sum2 += avk_row2[j] * block_vector[j];
+                    sum3 += avk_row3[j] * block_vector[j];
+                }
+                profile[i] = sum0;
+                profile[i + 1] = sum1;
+                profile[i + 2] = sum2;
+                profile[i + 3] = sum3;
+            }
+            for (; i < num_vertical_elements; i++)
+            {
+                const double *avk_row = &averaging_kernel[i * max_vertical_elements];
+                double sum = 0;
+
+                for (j = 0; j < num_vertical_elements; j++)
+                {
+                    sum += avk_row[j] * block_vector[j];
+                }
+                profile[i] = sum;
+            }
+            /* add the apriori again */
+            if (apriori != NULL)
+            {
+                for (i = 0; i < num_vertical_elements; i++)
+                {
+                    profile[i] += apriori[i];
+                }
+            }
+            continue;
+        }
+
+        /* multiply by avk using only the valid elements */
+        for (i = 0; i < num_vertical_elements; i++)
+        {
+            if (!harp_isnan(block_vector[i]))
+            {
+                const double *avk_row = &averaging_kernel[i * max_vertical_elements];
+                double sum = 0;
+
+                for (j = 0; j < num_valid; j++)
+                {
+                    sum += avk_row[valid_index[j]] * block_vector[valid_index[j]];
+                }
+                profile[i] = sum;
+
+                /* add the apriori again */
+                if (apriori != NULL)
+                {
+                    profile[i] += apriori[i];
+                }
+                else if (num_valid == 0)
+                {
+                    profile[i] = harp_nan();
+                }
+            }
+        }
+    }
+}
+
+/* Task for harp_parallel_for() that smooths a range of profiles */
+static void smooth_profiles_task(void *context, long index)
+{
+    smooth_info *info = (smooth_info *)context;
+    long max_vertical_elements = info->max_vertical_elements;
+    long last_profile = (index + 1) * SMOOTH_BLOCK_SIZE;
+    long k;
+
+    if (last_profile > info->num_profiles)
+    {
+        last_profile = info->num_profiles;
+    }
+    for (k = index * SMOOTH_BLOCK_SIZE; k < last_profile; k++)
+    {
+        long num_vertical_elements = max_vertical_elements;
+
+        if (info->vertical_axis != NULL)
+        {
+            num_vertical_elements = get_unpadded_vector_length(&info->vertical_axis[k * max_vertical_elements],
+                                                               max_vertical_elements);
+        }
+        smooth_profile(num_vertical_elements, max_vertical_elements, info->num_blocks,
+                       &info->averaging_kernel[k * max_vertical_elements * max_vertical_elements],
+                       info->apriori == NULL ? NULL : &info->apriori[k * max_vertical_elements],
+                       &info->data[k * info->num_blocks * max_vertical_elements],
+                       &info->vector[index * info->num_blocks * max_vertical_elements],
+                       &info->valid_index[index * max_vertical_elements]);
+    }
+}
+
 /** \addtogroup harp_variable
  * @{
  */
@@ -933,10 +1104,10 @@ static long get_unpadded_vector_length(double *vector, long vector_length)
 LIBHARP_API int harp_variable_smooth_vertical(harp_variable *variable, harp_variable *vertical_axis,
                                               harp_variable *averaging_kernel, harp_variable *apriori)
 {
-    double *vector = NULL;
+    smooth_info info;
     long max_vertical_elements;
     long num_blocks;
-    long k, l;
+    long num_tasks;
 
     if (variable == NULL)
     {
@@ -1026,84 +1197,44 @@ LIBHARP_API int harp_variable_smooth_vertical(harp_variable *variable, harp_vari
         }
     }
 
-    /* allocate memory for the temporary vertical profile vector */
-    vector = malloc(max_vertical_elements * sizeof(double));
-    if (!vector)
+    if (variable->dimension[0] == 0 || max_vertical_elements == 0)
     {
-        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       max_vertical_elements * sizeof(double), __FILE__, __LINE__);
-        return -1;
+        return 0;
     }
 
     /* calculate the number of blocks in this datetime slice of the variable */
     num_blocks = variable->num_elements / variable->dimension[0] / max_vertical_elements;
+    num_tasks = (variable->dimension[0] + SMOOTH_BLOCK_SIZE - 1) / SMOOTH_BLOCK_SIZE;
 
-    for (k = 0; k < variable->dimension[0]; k++)
+    /* allocate memory for the temporary vertical profile vectors of each task */
+    info.vector = malloc(num_tasks * num_blocks * max_vertical_elements * sizeof(double));
+    if (info.vector == NULL)
     {
-        long num_vertical_elements = max_vertical_elements;
-
-        if (vertical_axis != NULL)
-        {
-            num_vertical_elements =
-                get_unpadded_vector_length(&vertical_axis->data.double_data[k * max_vertical_elements],
-                                           max_vertical_elements);
-        }
-
-        for (l = 0; l < num_blocks; l++)
-        {
-            long blockoffset = (k * num_blocks + l) * max_vertical_elements;
-            long i, j;
-
-            /* store profile in temporary vector */
-            for (i = 0; i < num_vertical_elements; i++)
-            {
-                vector[i] = variable->data.double_data[blockoffset + i];
-            }
-
-            /* subtract a priori */
-            if (apriori != NULL)
-            {
-                for (i = 0; i < num_vertical_elements; i++)
-                {
-                    vector[i] -= apriori->data.double_data[k * max_vertical_elements + i];
-                }
-            }
-
-            /* multiply by avk */
-            for (i = 0; i < num_vertical_elements; i++)
-            {
-                if (!harp_isnan(vector[i]))
-                {
-                    long avk_offset = (k * max_vertical_elements + i) * max_vertical_elements;
-                    long num_valid = 0;
-
-                    variable->data.double_data[blockoffset + i] = 0;
-                    for (j = 0; j < num_vertical_elements; j++)
-                    {
-                        if (!harp_isnan(vector[j]))
-                        {
-                            variable->data.double_data[blockoffset + i] +=
-                                averaging_kernel->data.double_data[avk_offset + j] * vector[j];
-                            num_valid++;
-                        }
-                    }
-
-                    /* add the apriori again */
-                    if (apriori != NULL)
-                    {
-                        variable->data.double_data[blockoffset + i] +=
-                            apriori->data.double_data[k * max_vertical_elements + i];
-                    }
-                    else if (num_valid == 0)
-                    {
-                        variable->data.double_data[blockoffset + i] = harp_nan();
-                    }
-                }
-            }
-        }
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_tasks * num_blocks * max_vertical_elements * sizeof(double), __FILE__, __LINE__);
+        return -1;
+    }
+    info.valid_index = malloc(num_tasks * max_vertical_elements * sizeof(long));
+    if (info.valid_index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_tasks * max_vertical_elements * sizeof(long), __FILE__, __LINE__);
+        free(info.vector);
+        return -1;
     }
 
-    free(vector);
+    info.num_profiles = variable->dimension[0];
+    info.max_vertical_elements = max_vertical_elements;
+    info.num_blocks = num_blocks;
+    info.vertical_axis = vertical_axis == NULL ? NULL : vertical_axis->data.double_data;
+    info.averaging_kernel = averaging_kernel->data.double_data;
+    info.apriori = apriori == NULL ? NULL : apriori->data.double_data;
+    info.data = variable->data.double_data;
+    harp_parallel_for(num_tasks, (averaging_kernel->num_elements + variable->num_elements) * (long)sizeof(double),
+                      smooth_profiles_task, &info);
+
+    free(info.valid_index);
+    free(info.vector);
 
     return 0;
 }
@@ -1286,6 +1417,15 @@ LIBHARP_API int harp_product_smooth_vertical_with_collocated_product(harp_produc
         snprintf(apriori_name, MAX_NAME_LENGTH, "%s_apriori", smooth_variables[i]);
 
         harp_product_get_variable_by_name(product, smooth_variables[i], &variable);
+        if (variable->data_type != harp_type_double)
+        {
+            /* regridding may have kept the variable in float precision */
+            if (harp_variable_convert_data_type(variable, harp_type_double) != 0)
+            {
+                harp_product_delete(temp_product);
+                return -1;
+            }
+        }
         harp_product_get_variable_by_name(temp_product, avk_name, &avk);
         apriori = NULL;
         if (harp_product_has_variable(temp_product, apriori_name))
@@ -1523,6 +1663,16 @@ LIBHARP_API int harp_product_smooth_vertical_with_collocated_dataset(harp_produc
         snprintf(apriori_name, MAX_NAME_LENGTH, "%s_apriori", smooth_variables[i]);
 
         harp_product_get_variable_by_name(product, smooth_variables[i], &variable);
+        if (variable->data_type != harp_type_double)
+        {
+            /* regridding may have kept the variable in float precision */
+            if (harp_variable_convert_data_type(variable, harp_type_double) != 0)
+            {
+                harp_product_delete(merged_product);
+                harp_collocation_result_shallow_delete(filtered_collocation_result);
+                return -1;
+            }
+        }
         harp_product_get_variable_by_name(merged_product, avk_name, &avk);
         apriori = NULL;
         if (harp_product_has_variable(merged_product, apriori_name))
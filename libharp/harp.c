@@ -30,6 +30,7 @@
  */
 
 #include "harp-internal.h"
+#include "harp-program.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -42,21 +43,49 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include "coda.h"
 
 #define DETECTION_BLOCK_SIZE 12
 
+/* minimum amount of work (in bytes of data that is processed) before tasks are distributed over multiple threads */
+#define MIN_PARALLEL_WORK_SIZE (4 * 1024 * 1024)
+
+#ifndef THREAD_LOCAL
+#define THREAD_LOCAL
+#endif
+
 LIBHARP_API const char *libharp_version = HARP_VERSION;
 
 static int harp_init_counter = 0;
 
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t harp_lock_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t harp_lock_mutex[HARP_NUM_LOCKS];
+#endif
+
+int harp_option_bin_spatial_weight_cache = 0;
 int harp_option_create_collocation_datetime = 0;
+int harp_option_dataset_index = 0;
 int harp_option_enable_aux_afgl86 = 0;
 int harp_option_enable_aux_usstd76 = 0;
+int harp_option_hdf5_chunk_size = 0;
 int harp_option_hdf5_compression = 0;
+int harp_option_hdf5_compression_filter = 0;
+int harp_option_hdf5_shuffle = 0;
+int harp_option_num_threads = 1;
 int harp_option_propagate_uncertainty = 0;
 int harp_option_regrid_out_of_bounds = 0;
+int harp_option_regrid_precision = 0;
+
+/* While a program is being executed, the options that can be changed by set() operations are taken from the program
+ * (for the thread that executes the program) instead of from the global options. This way, programs that are executed
+ * concurrently by different threads do not change each others options (see harp_set_program_options()).
+ */
+static THREAD_LOCAL harp_program_options *program_options = NULL;
 
 typedef enum file_format_enum
 {
@@ -66,6 +95,12 @@ typedef enum file_format_enum
     format_netcdf
 } file_format;
 
+struct harp_export_stream_struct
+{
+    harp_product *template_product;     /* first time sample of the first product */
+    harp_netcdf_stream *netcdf_stream;
+};
+
 static file_format format_from_string(const char *format)
 {
     if (strcasecmp(format, "hdf4") == 0)
@@ -161,6 +196,23 @@ static int determine_file_format(const char *filename, file_format *format)
     return 0;
 }
 
+/* Non-HARP HDF4/HDF5 files are ingested via CODA, which then also uses the HDF4/HDF5 libraries */
+static int ingest(const char *filename, file_format format, harp_program *program, const char *options,
+                  harp_product **product)
+{
+    int result;
+
+    if (format == format_hdf4 || format == format_hdf5)
+    {
+        harp_lock(harp_lock_io);
+        result = harp_ingest(filename, program, options, product);
+        harp_unlock(harp_lock_io);
+        return result;
+    }
+
+    return harp_ingest(filename, program, options, product);
+}
+
 static int auxiliary_data_init(void)
 {
     if (getenv("HARP_AUX_AFGL86") != NULL)
@@ -174,8 +226,189 @@ static int auxiliary_data_init(void)
     return 0;
 }
 
+#ifdef HAVE_PTHREAD_H
+static void lock_init(void)
+{
+    pthread_mutexattr_t attr;
+    int i;
+
+    /* locks are recursive, since e.g. an ingestion can trigger a (nested) lazy initialisation */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (i = 0; i < HARP_NUM_LOCKS; i++)
+    {
+        pthread_mutex_init(&harp_lock_mutex[i], &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+}
+#endif
+
+/* Locks should always be taken in the order: io, init, operation_parser, units, conversion_plans,
+ * bin_spatial_weights */
+void harp_lock(harp_lock_id id)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_once(&harp_lock_once, lock_init);
+    pthread_mutex_lock(&harp_lock_mutex[id]);
+#else
+    (void)id;
+#endif
+}
+
+void harp_unlock(harp_lock_id id)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&harp_lock_mutex[id]);
+#else
+    (void)id;
+#endif
+}
+
+#ifdef HAVE_PTHREAD_H
+/* parallel loops should not run tasks in parallel when called from a task of another parallel loop */
+static THREAD_LOCAL int in_parallel_for = 0;
+
+typedef struct parallel_for_info_struct
+{
+    pthread_mutex_t mutex;
+    long num_tasks;
+    long next_task;
+    void (*task)(void *context, long index);
+    void *context;
+    harp_program_options *program_options;
+} parallel_for_info;
+
+static void *parallel_for_worker(void *arg)
+{
+    parallel_for_info *info = (parallel_for_info *)arg;
+
+    in_parallel_for = 1;
+    /* tasks use the same program options as the thread that started the parallel loop */
+    program_options = info->program_options;
+    for (;;)
+    {
+        long index;
+
+        pthread_mutex_lock(&info->mutex);
+        index = info->next_task;
+        info->next_task++;
+        pthread_mutex_unlock(&info->mutex);
+        if (index >= info->num_tasks)
+        {
+            break;
+        }
+        info->task(info->context, index);
+    }
+    in_parallel_for = 0;
+
+    return NULL;
+}
+
+static int get_num_threads(void)
+{
+    long num_threads = harp_option_num_threads;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    if (num_threads == 0)
+    {
+        num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+
+    return (int)num_threads;
+}
+#endif
+
+/* Call task(context, index) for each index in [0, num_tasks).
+ * The tasks are distributed over multiple threads (see harp_set_option_num_threads()) if the total amount of work
+ * (work_size, in bytes) is large enough. Tasks should be independent of each other and should not fail (any memory
+ * that a task needs should be allocated in advance).
+ */
+void harp_parallel_for(long num_tasks, long work_size, void (*task)(void *context, long index), void *context)
+{
+#ifdef HAVE_PTHREAD_H
+    parallel_for_info info;
+    pthread_t *thread;
+    long num_threads = 1;
+    long num_threads_started = 0;
+#endif
+    long i;
+
+#ifdef HAVE_PTHREAD_H
+    if (num_tasks > 1 && work_size >= MIN_PARALLEL_WORK_SIZE && !in_parallel_for)
+    {
+        num_threads = get_num_threads();
+        if (num_threads > num_tasks)
+        {
+            num_threads = num_tasks;
+        }
+    }
+    if (num_threads > 1)
+    {
+        thread = (pthread_t *)malloc((num_threads - 1) * sizeof(pthread_t));
+        if (thread != NULL)
+        {
+            pthread_mutex_init(&info.mutex, NULL);
+            info.num_tasks = num_tasks;
+            info.next_task = 0;
+            info.task = task;
+            info.context = context;
+            info.program_options = program_options;
+            for (i = 0; i < num_threads - 1; i++)
+            {
+                if (pthread_create(&thread[num_threads_started], NULL, parallel_for_worker, &info) != 0)
+                {
+                    /* just continue with the threads that we have */
+                    break;
+                }
+                num_threads_started++;
+            }
+            /* the calling thread also takes part */
+            parallel_for_worker(&info);
+            for (i = 0; i < num_threads_started; i++)
+            {
+                pthread_join(thread[i], NULL);
+            }
+            pthread_mutex_destroy(&info.mutex);
+            free(thread);
+            return;
+        }
+    }
+#endif
+
+    for (i = 0; i < num_tasks; i++)
+    {
+        task(context, i);
+    }
+}
+
+/* Make the calling thread use the given program options (or the global options if options is NULL) for the options
+ * that can be changed by set() operations. Returns the program options that were in use before, such that these can be
+ * reinstated once the program has finished (nested programs should thus finish in reverse order of starting).
+ */
+harp_program_options *harp_set_program_options(harp_program_options *options)
+{
+    harp_program_options *previous_options = program_options;
+
+    program_options = options;
+
+    return previous_options;
+}
+
 /** \defgroup harp_general HARP General
  * The HARP General module contains all general and miscellaneous functions and procedures of HARP.
+ *
+ * When HARP is built with pthreads support, the HARP C library can be used from multiple threads at the same time
+ * (e.g. harp_import(), harp_export(), and harp_product_execute_operations() can be called concurrently, as long as
+ * each thread works on its own products). The error state (#harp_errno and the error message) is kept per thread.
+ * Access to the netCDF, HDF4, and HDF5 libraries is serialized internally, so imports/exports of files in these
+ * formats will not run in parallel. Ingestion of non-HARP products relies on CODA also being thread safe.
+ * The functions harp_init(), harp_done(), the harp_set_option_...() functions, and the functions that set search
+ * paths or handlers should only be called while no other thread is using HARP.
  */
 
 /** \defgroup harp_documentation HARP Generated documentation
@@ -287,6 +520,59 @@ LIBHARP_API int harp_set_coda_definition_path_conditional(const char *file, cons
     return 0;
 }
 
+/** Enable/Disable the caching of grid cell weights for spatial binning
+ * When performing an area binning (i.e. the product has latitude_bounds and longitude_bounds variables), most of the
+ * time is spent in determining the overlap of each sample polygon with the grid cells. If this option is enabled, the
+ * grid cells and weights of the last area binning are kept in memory, and a subsequent spatial binning of a product
+ * with exactly the same latitude/longitude bounds onto the same grid will reuse them instead of recomputing them.
+ * By default the caching of grid cell weights is disabled. Disabling the option releases any cached weights.
+ * \param enable
+ *   \arg 0: Disable caching of grid cell weights.
+ *   \arg 1: Enable caching of grid cell weights.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_set_option_bin_spatial_weight_cache(int enable)
+{
+    if (enable != 0 && enable != 1)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "enable argument (%d) is not valid (%s:%u)", enable, __FILE__,
+                       __LINE__);
+        return -1;
+    }
+
+    if (program_options != NULL)
+    {
+        program_options->bin_spatial_weight_cache = enable;
+    }
+    else
+    {
+        harp_option_bin_spatial_weight_cache = enable;
+    }
+    if (!enable)
+    {
+        harp_bin_spatial_clear_weight_cache();
+    }
+
+    return 0;
+}
+
+/** Retrieve the current setting for the caching of grid cell weights for spatial binning.
+ * \see harp_set_option_bin_spatial_weight_cache()
+ * \return
+ *   \arg \c 0, Caching of grid cell weights is disabled.
+ *   \arg \c 1, Caching of grid cell weights is enabled.
+ */
+LIBHARP_API int harp_get_option_bin_spatial_weight_cache(void)
+{
+    if (program_options != NULL)
+    {
+        return program_options->bin_spatial_weight_cache;
+    }
+    return harp_option_bin_spatial_weight_cache;
+}
+
 /** Enable/Disable the creation of collocation_datetime variables
  * Enabling this option will create a collocation_datetime variable when a collocate_left or collocation_right operation is performed.
  * The collocation_datetime variable will contain the datetime of the sample from the other dataset for the collocated pair.
@@ -308,7 +594,14 @@ LIBHARP_API int harp_set_option_create_collocation_datetime(int enable)
         return -1;
     }
 
-    harp_option_create_collocation_datetime = enable;
+    if (program_options != NULL)
+    {
+        program_options->create_collocation_datetime = enable;
+    }
+    else
+    {
+        harp_option_create_collocation_datetime = enable;
+    }
 
     return 0;
 }
@@ -321,9 +614,53 @@ LIBHARP_API int harp_set_option_create_collocation_datetime(int enable)
  */
 LIBHARP_API int harp_get_option_create_collocation_datetime(void)
 {
+    if (program_options != NULL)
+    {
+        return program_options->create_collocation_datetime;
+    }
     return harp_option_create_collocation_datetime;
 }
 
+/** Enable/Disable the use of persistent metadata indices when importing directories into a dataset
+ * If enabled, harp_dataset_import() will store the metadata of all product files in a directory in a hidden index
+ * file ('.harp_dataset_index') in that same directory. On subsequent imports of the directory, the metadata is taken
+ * from this index for all files whose size and modification time did not change, and only new or changed files are
+ * opened. If the index file cannot be written (e.g. for read-only directories), the directory is scanned as usual.
+ * By default the use of dataset indices is disabled.
+ * The use of dataset indices can also be enabled by setting the HARP_DATASET_INDEX environment variable to 1 (a value
+ * of 0 keeps it disabled).
+ * \param enable
+ *   \arg 0: Disable use of dataset indices.
+ *   \arg 1: Enable use of dataset indices.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_set_option_dataset_index(int enable)
+{
+    if (enable != 0 && enable != 1)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "enable argument (%d) is not valid (%s:%u)", enable, __FILE__,
+                       __LINE__);
+        return -1;
+    }
+
+    harp_option_dataset_index = enable;
+
+    return 0;
+}
+
+/** Retrieve the current setting for the usage of dataset indices option.
+ * \see harp_set_option_dataset_index()
+ * \return
+ *   \arg \c 0, Use of dataset indices is disabled.
+ *   \arg \c 1, Use of dataset indices is enabled.
+ */
+LIBHARP_API int harp_get_option_dataset_index(void)
+{
+    return harp_option_dataset_index;
+}
+
 /** Enable/Disable the use of AFGL86 climatology in variable conversions
  * Enabling this option will allow the derived variable functions to create variables using the built-in AFGL86
  * profiles. If datetime, latitude, and altitude variables are available then altitude regridded versions of the
@@ -357,7 +694,14 @@ LIBHARP_API int harp_set_option_enable_aux_afgl86(int enable)
         return -1;
     }
 
-    harp_option_enable_aux_afgl86 = enable;
+    if (program_options != NULL)
+    {
+        program_options->enable_aux_afgl86 = enable;
+    }
+    else
+    {
+        harp_option_enable_aux_afgl86 = enable;
+    }
 
     return 0;
 }
@@ -370,6 +714,10 @@ LIBHARP_API int harp_set_option_enable_aux_afgl86(int enable)
  */
 LIBHARP_API int harp_get_option_enable_aux_afgl86(void)
 {
+    if (program_options != NULL)
+    {
+        return program_options->enable_aux_afgl86;
+    }
     return harp_option_enable_aux_afgl86;
 }
 
@@ -406,7 +754,14 @@ LIBHARP_API int harp_set_option_enable_aux_usstd76(int enable)
         return -1;
     }
 
-    harp_option_enable_aux_usstd76 = enable;
+    if (program_options != NULL)
+    {
+        program_options->enable_aux_usstd76 = enable;
+    }
+    else
+    {
+        harp_option_enable_aux_usstd76 = enable;
+    }
 
     return 0;
 }
@@ -419,9 +774,47 @@ LIBHARP_API int harp_set_option_enable_aux_usstd76(int enable)
  */
 LIBHARP_API int harp_get_option_enable_aux_usstd76(void)
 {
+    if (program_options != NULL)
+    {
+        return program_options->enable_aux_usstd76;
+    }
     return harp_option_enable_aux_usstd76;
 }
 
+/** Set the target size of the chunks that are used for storing compressed variables in HDF5 files.
+ * By default (or when \a chunk_size is 0) each compressed variable is stored as a single chunk (as far as the HDF5
+ * limits allow). With a target chunk size, a variable is split into chunks along its first (e.g. time) dimension such
+ * that each chunk is (close to) \a chunk_size bytes. This allows reading back a subset of the time samples of a
+ * variable without having to decompress the whole variable.
+ * This option is only used if compression is enabled (see harp_set_option_hdf5_compression()).
+ * \param chunk_size The target chunk size in bytes or 0 to store each variable as a single chunk.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_set_option_hdf5_chunk_size(int chunk_size)
+{
+    if (chunk_size < 0)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "chunk_size argument (%d) is not valid (%s:%u)", chunk_size,
+                       __FILE__, __LINE__);
+        return -1;
+    }
+
+    harp_option_hdf5_chunk_size = chunk_size;
+
+    return 0;
+}
+
+/** Retrieve the target chunk size that is used for storing compressed variables in HDF5 files.
+ * \see harp_set_option_hdf5_chunk_size()
+ * \return The target chunk size in bytes (0 means that each variable is stored as a single chunk).
+ */
+LIBHARP_API int harp_get_option_hdf5_chunk_size(void)
+{
+    return harp_option_hdf5_chunk_size;
+}
+
 /** Set the compression level to use for storing variables in HDF5 files.
  * \param level The compression level (1=low, ..., 9=high) or 0 to disable compression.
  * \return
@@ -451,6 +844,121 @@ LIBHARP_API int harp_get_option_hdf5_compression(void)
     return harp_option_hdf5_compression;
 }
 
+/** Set the compression filter to use for storing variables in HDF5 files.
+ * Filters other than deflate are only available if the HDF5 library supports them (szip) or if the corresponding HDF5
+ * filter plugin can be found (lz4, zstd; see the HDF5_PLUGIN_PATH environment variable). Exporting a product will fail
+ * if the filter is not available. String variables are always compressed using deflate.
+ * If the deflate filter is used, the chunks of a variable are compressed using multiple threads
+ * (see harp_set_option_num_threads()).
+ * This option is only used if compression is enabled (see harp_set_option_hdf5_compression()).
+ * \param filter
+ *   \arg 0: deflate (default)
+ *   \arg 1: szip
+ *   \arg 2: lz4
+ *   \arg 3: zstd
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_set_option_hdf5_compression_filter(int filter)
+{
+    if (filter < 0 || filter > 3)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "filter argument (%d) is not valid (%s:%u)", filter, __FILE__,
+                       __LINE__);
+        return -1;
+    }
+
+    harp_option_hdf5_compression_filter = filter;
+
+    return 0;
+}
+
+/** Retrieve the compression filter that is used for storing variables in HDF5 files.
+ * \see harp_set_option_hdf5_compression_filter()
+ * \return
+ *   \arg \c 0 deflate
+ *   \arg \c 1 szip
+ *   \arg \c 2 lz4
+ *   \arg \c 3 zstd
+ */
+LIBHARP_API int harp_get_option_hdf5_compression_filter(void)
+{
+    return harp_option_hdf5_compression_filter;
+}
+
+/** Enable/disable the use of the byte shuffle filter for storing compressed variables in HDF5 files.
+ * The shuffle filter reorders the bytes of the values in a chunk before compression (first the first byte of all
+ * values, then the second byte of all values, etc.), which often improves the compression ratio of numerical data.
+ * This option is only used if compression is enabled (see harp_set_option_hdf5_compression()).
+ * \param enable
+ *   \arg 0: Disable use of the shuffle filter (default).
+ *   \arg 1: Enable use of the shuffle filter.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_set_option_hdf5_shuffle(int enable)
+{
+    if (enable != 0 && enable != 1)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "enable argument (%d) is not valid (%s:%u)", enable, __FILE__,
+                       __LINE__);
+        return -1;
+    }
+
+    harp_option_hdf5_shuffle = enable;
+
+    return 0;
+}
+
+/** Retrieve the current setting for the use of the byte shuffle filter for storing variables in HDF5 files.
+ * \see harp_set_option_hdf5_shuffle()
+ * \return
+ *   \arg \c 0, Use of the shuffle filter is disabled.
+ *   \arg \c 1, Use of the shuffle filter is enabled.
+ */
+LIBHARP_API int harp_get_option_hdf5_shuffle(void)
+{
+    return harp_option_hdf5_shuffle;
+}
+
+/** Set the maximum number of threads that HARP may use to process data.
+ * Some operations (such as filtering the variables of a product) can distribute their work over multiple threads.
+ * This is only done when there is enough work to do. By default (or when \a num_threads is 1) HARP does not use
+ * multiple threads. A value of 0 means that HARP will use as many threads as there are processors available.
+ * New threads are started for each piece of work that is distributed. HARP does not limit the total number of threads
+ * over concurrent calls, so an application that calls HARP from multiple threads itself should normally keep this
+ * option at 1.
+ * The number of threads can also be set using the HARP_NUM_THREADS environment variable.
+ * \param num_threads Maximum number of threads to use (or 0 to use the number of available processors).
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_set_option_num_threads(int num_threads)
+{
+    if (num_threads < 0)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "num_threads argument (%d) is not valid (%s:%u)", num_threads,
+                       __FILE__, __LINE__);
+        return -1;
+    }
+
+    harp_option_num_threads = num_threads;
+
+    return 0;
+}
+
+/** Retrieve the maximum number of threads that HARP may use to process data.
+ * \see harp_set_option_num_threads()
+ * \return Maximum number of threads (0 means that the number of available processors is used).
+ */
+LIBHARP_API int harp_get_option_num_threads(void)
+{
+    return harp_option_num_threads;
+}
+
 /** Set how to propagate uncertainty.
  * This is only applicable for operations that support propagation of uncertainties. And then only if there is a choice.
  * The propagation can either assume uncertainties to be fully uncorrelated (the default) or fully correlated.
@@ -470,7 +978,14 @@ LIBHARP_API int harp_set_option_propagate_uncertainty(int method)
         return -1;
     }
 
-    harp_option_propagate_uncertainty = method;
+    if (program_options != NULL)
+    {
+        program_options->propagate_uncertainty = method;
+    }
+    else
+    {
+        harp_option_propagate_uncertainty = method;
+    }
 
     return 0;
 }
@@ -483,6 +998,10 @@ LIBHARP_API int harp_set_option_propagate_uncertainty(int method)
  */
 LIBHARP_API int harp_get_option_propagate_uncertainty(void)
 {
+    if (program_options != NULL)
+    {
+        return program_options->propagate_uncertainty;
+    }
     return harp_option_propagate_uncertainty;
 }
 
@@ -507,7 +1026,14 @@ LIBHARP_API int harp_set_option_regrid_out_of_bounds(int method)
         return -1;
     }
 
-    harp_option_regrid_out_of_bounds = method;
+    if (program_options != NULL)
+    {
+        program_options->regrid_out_of_bounds = method;
+    }
+    else
+    {
+        harp_option_regrid_out_of_bounds = method;
+    }
 
     return 0;
 }
@@ -521,9 +1047,62 @@ LIBHARP_API int harp_set_option_regrid_out_of_bounds(int method)
  */
 LIBHARP_API int harp_get_option_regrid_out_of_bounds(void)
 {
+    if (program_options != NULL)
+    {
+        return program_options->regrid_out_of_bounds;
+    }
     return harp_option_regrid_out_of_bounds;
 }
 
+/** Set the precision that is used to store the result of regridding operations.
+ * By default all regridded variables are converted to double precision. When float precision is enabled, variables
+ * that are stored as float are kept as float. The interpolation itself is still performed in double precision, so the
+ * only difference with the default is that each regridded value is rounded to the nearest float (i.e. a relative
+ * difference of at most 2^-24, about 6e-8). This halves the memory needed for the regridded float variables.
+ * Variables of other data types are always converted to double.
+ * \param precision
+ *   \arg 0: Store regridded variables as double (the default)
+ *   \arg 1: Keep regridded float variables as float
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_set_option_regrid_precision(int precision)
+{
+    if (precision < 0 || precision > 1)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "precision argument (%d) is not valid (%s:%u)", precision,
+                       __FILE__, __LINE__);
+        return -1;
+    }
+
+    if (program_options != NULL)
+    {
+        program_options->regrid_precision = precision;
+    }
+    else
+    {
+        harp_option_regrid_precision = precision;
+    }
+
+    return 0;
+}
+
+/** Retrieve the current setting for the precision of the result of regridding operations.
+ * \see harp_set_option_regrid_precision()
+ * \return
+ *   \arg \c 0 Store regridded variables as double
+ *   \arg \c 1 Keep regridded float variables as float
+ */
+LIBHARP_API int harp_get_option_regrid_precision(void)
+{
+    if (program_options != NULL)
+    {
+        return program_options->regrid_precision;
+    }
+    return harp_option_regrid_precision;
+}
+
 /** Initializes the HARP C library.
  * This function should be called before any other HARP C library function is called (except for
  * harp_set_coda_definition_path(), harp_set_coda_definition_path_conditional(), and harp_set_warning_handler()).
@@ -551,15 +1130,30 @@ LIBHARP_API int harp_get_option_regrid_out_of_bounds(void)
  */
 LIBHARP_API int harp_init(void)
 {
+    harp_lock(harp_lock_init);
     if (harp_init_counter == 0)
     {
         if (auxiliary_data_init() != 0)
         {
+            harp_unlock(harp_lock_init);
             return -1;
         }
+        if (getenv("HARP_DATASET_INDEX") != NULL)
+        {
+            harp_option_dataset_index = (atoi(getenv("HARP_DATASET_INDEX")) != 0);
+        }
+        if (getenv("HARP_NUM_THREADS") != NULL)
+        {
+            harp_option_num_threads = atoi(getenv("HARP_NUM_THREADS"));
+            if (harp_option_num_threads < 0)
+            {
+                harp_option_num_threads = 0;
+            }
+        }
     }
 
     harp_init_counter++;
+    harp_unlock(harp_lock_init);
 
     return 0;
 }
@@ -577,6 +1171,7 @@ LIBHARP_API int harp_init(void)
  */
 LIBHARP_API void harp_done(void)
 {
+    harp_lock(harp_lock_init);
     if (harp_init_counter > 0)
     {
         harp_init_counter--;
@@ -584,38 +1179,20 @@ LIBHARP_API void harp_done(void)
         {
             harp_unit_done();
             harp_derived_variable_list_done();
+            harp_bin_spatial_clear_weight_cache();
             harp_ingestion_done();
             /* explicitly clear search paths in case unit and/or ingestion init() routines were never called */
             harp_set_coda_definition_path(NULL);
             harp_set_udunits2_xml_path(NULL);
         }
     }
+    harp_unlock(harp_lock_init);
 }
 
 /** @} */
 
-/** Import a product from a file.
- * \ingroup harp_product
- * This will first try to import the file as an HDF4, HDF5, or netCDF file that complies to the HARP Data Format.
- * If the file is not stored using the HARP format then it will try to import it using one of the available ingestion
- * modules.
- * The \a options parameter is optional (can be NULL) and describes the ingestion options. The parameter is only
- * applicable if the file is not already using the HARP format and needs to be converted using one of the ingestion
- * modules.
- * The \a operations parameter is optional (can be NULL) and provides the list of operations that will be performed as
- * part of the import. Some operations, such as filters, can already be performed as part of an import and this may thus
- * be faster than using a harp_product_execute_operations() after a full import of the product.
- * \param[in] filename Path to the file that is to be imported.
- * \param[in] operations string (optional) containing actions to apply as part of the import; should be specified as a
- * semi-colon separated string of operations.
- * \param[in] options Ingestion module specific options (optional); should be specified as a semi-colon separated
- * string of key=value pair; only used if the file is not in HARP format.
- * \param[out] product Pointer to a location where a pointer to the ingested product will be stored.
- * \return
- *   \arg \c 0, Success.
- *   \arg \c -1, Error occurred (check #harp_errno).
- */
-LIBHARP_API int harp_import(const char *filename, const char *operations, const char *options, harp_product **product)
+/* the program is optional (can be NULL); its execution should already have been started */
+static int import(const char *filename, harp_program *program, const char *options, harp_product **product)
 {
     harp_product *imported_product;
     file_format format;
@@ -626,6 +1203,7 @@ LIBHARP_API int harp_import(const char *filename, const char *operations, const
         return -1;
     }
 
+    harp_lock(harp_lock_io);
     switch (format)
     {
         case format_hdf4:
@@ -638,19 +1216,21 @@ LIBHARP_API int harp_import(const char *filename, const char *operations, const
             break;
         case format_hdf5:
 #ifdef HAVE_HDF5
-            result = harp_import_hdf5(filename, &imported_product);
+            /* the importers for these formats can already apply the leading keep/exclude/filter operations */
+            result = harp_import_hdf5(filename, program, &imported_product);
 #else
             harp_set_error(HARP_ERROR_UNSUPPORTED_PRODUCT, NULL);
             result = -1;
 #endif
             break;
         case format_netcdf:
-            result = harp_import_netcdf(filename, &imported_product);
+            result = harp_import_netcdf(filename, program, &imported_product);
             break;
         default:
             harp_set_error(HARP_ERROR_UNSUPPORTED_PRODUCT, NULL);
             result = -1;
     }
+    harp_unlock(harp_lock_io);
 
     if (result != 0)
     {
@@ -660,7 +1240,11 @@ LIBHARP_API int harp_import(const char *filename, const char *operations, const
         }
 
         /* try ingest */
-        if (harp_ingest(filename, operations, options, &imported_product) != 0)
+        if (program != NULL)
+        {
+            harp_program_begin_execution(program);
+        }
+        if (ingest(filename, format, program, options, &imported_product) != 0)
         {
             return -1;
         }
@@ -683,12 +1267,17 @@ LIBHARP_API int harp_import(const char *filename, const char *operations, const
             }
         }
 
-        if (operations != NULL)
+        if (program != NULL)
         {
-            if (harp_product_execute_operations(imported_product, operations) != 0)
+            /* the import may have already executed the first operations of the program; just as for a full
+             * execution of the program we stop once an operation has resulted in an empty product */
+            if (program->current_index == 0 || !harp_product_is_empty(imported_product))
             {
-                harp_product_delete(imported_product);
-                return -1;
+                if (harp_product_continue_program(imported_product, program) != 0)
+                {
+                    harp_product_delete(imported_product);
+                    return -1;
+                }
             }
         }
     }
@@ -698,6 +1287,81 @@ LIBHARP_API int harp_import(const char *filename, const char *operations, const
     return 0;
 }
 
+/** Import a product from a file.
+ * \ingroup harp_product
+ * This will first try to import the file as an HDF4, HDF5, or netCDF file that complies to the HARP Data Format.
+ * If the file is not stored using the HARP format then it will try to import it using one of the available ingestion
+ * modules.
+ * The \a options parameter is optional (can be NULL) and describes the ingestion options. The parameter is only
+ * applicable if the file is not already using the HARP format and needs to be converted using one of the ingestion
+ * modules.
+ * The \a operations parameter is optional (can be NULL) and provides the list of operations that will be performed as
+ * part of the import. Some operations, such as filters, can already be performed as part of an import and this may thus
+ * be faster than using a harp_product_execute_operations() after a full import of the product.
+ * \param[in] filename Path to the file that is to be imported.
+ * \param[in] operations string (optional) containing actions to apply as part of the import; should be specified as a
+ * semi-colon separated string of operations.
+ * \param[in] options Ingestion module specific options (optional); should be specified as a semi-colon separated
+ * string of key=value pair; only used if the file is not in HARP format.
+ * \param[out] product Pointer to a location where a pointer to the ingested product will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_import(const char *filename, const char *operations, const char *options, harp_product **product)
+{
+    harp_program *program = NULL;
+    int result;
+
+    if (operations != NULL)
+    {
+        if (harp_program_from_string(operations, &program) != 0)
+        {
+            return -1;
+        }
+    }
+
+    result = import(filename, program, options, product);
+
+    if (program != NULL)
+    {
+        harp_program_delete(program);
+    }
+
+    return result;
+}
+
+/** Import a product from a file using a compiled program.
+ * \ingroup harp_product
+ * This is equivalent to harp_import(), but uses operations that were already compiled using harp_program_compile().
+ * This avoids parsing the operations (and reading any files that are referenced by the operations) again for each
+ * product when the same operations are applied to many products.
+ * \param[in] filename Path to the file that is to be imported.
+ * \param[in] program Compiled program (optional) containing the actions to apply as part of the import.
+ * \param[in] options Ingestion module specific options (optional); should be specified as a semi-colon separated
+ * string of key=value pair; only used if the file is not in HARP format.
+ * \param[out] product Pointer to a location where a pointer to the ingested product will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_import_with_program(const char *filename, harp_program *program, const char *options,
+                                         harp_product **product)
+{
+    int result;
+
+    if (program == NULL)
+    {
+        return import(filename, NULL, options, product);
+    }
+
+    harp_program_begin_execution(program);
+    result = import(filename, program, options, product);
+    harp_program_end_execution(program);
+
+    return result;
+}
+
 /** Test import of a product.
  * \ingroup harp_product
  * If the product is a HARP product then verify that the product is a HARP compliant netCDF/HDF4/HDF5 product.
@@ -726,6 +1390,7 @@ LIBHARP_API int harp_import_test(const char *filename, int (*print)(const char *
         return -1;
     }
 
+    harp_lock(harp_lock_io);
     switch (format)
     {
         case format_hdf4:
@@ -738,19 +1403,20 @@ LIBHARP_API int harp_import_test(const char *filename, int (*print)(const char *
             break;
         case format_hdf5:
 #ifdef HAVE_HDF5
-            result = harp_import_hdf5(filename, &product);
+            result = harp_import_hdf5(filename, NULL, &product);
 #else
             harp_set_error(HARP_ERROR_UNSUPPORTED_PRODUCT, NULL);
             result = -1;
 #endif
             break;
         case format_netcdf:
-            result = harp_import_netcdf(filename, &product);
+            result = harp_import_netcdf(filename, NULL, &product);
             break;
         default:
             harp_set_error(HARP_ERROR_UNSUPPORTED_PRODUCT, NULL);
             result = -1;
     }
+    harp_unlock(harp_lock_io);
 
     if (result != 0)
     {
@@ -759,6 +1425,13 @@ LIBHARP_API int harp_import_test(const char *filename, int (*print)(const char *
             return -1;
         }
         /* try ingest */
+        if (format == format_hdf4 || format == format_hdf5)
+        {
+            harp_lock(harp_lock_io);
+            result = harp_ingest_test(filename, print);
+            harp_unlock(harp_lock_io);
+            return result;
+        }
         return harp_ingest_test(filename, print);
     }
 
@@ -823,6 +1496,7 @@ LIBHARP_API int harp_import_product_metadata(const char *filename, const char *o
         return -1;
     }
 
+    harp_lock(harp_lock_io);
     switch (format)
     {
         case format_hdf4:
@@ -848,6 +1522,7 @@ LIBHARP_API int harp_import_product_metadata(const char *filename, const char *o
             harp_set_error(HARP_ERROR_UNSUPPORTED_PRODUCT, NULL);
             result = -1;
     }
+    harp_unlock(harp_lock_io);
 
     if (result != 0)
     {
@@ -858,7 +1533,17 @@ LIBHARP_API int harp_import_product_metadata(const char *filename, const char *o
         }
 
         /* try ingest */
-        if (harp_ingest_metadata(filename, options, metadata) != 0)
+        if (format == format_hdf4 || format == format_hdf5)
+        {
+            harp_lock(harp_lock_io);
+            result = harp_ingest_metadata(filename, options, metadata);
+            harp_unlock(harp_lock_io);
+        }
+        else
+        {
+            result = harp_ingest_metadata(filename, options, metadata);
+        }
+        if (result != 0)
         {
             harp_product_metadata_delete(metadata);
             return -1;
@@ -883,6 +1568,7 @@ LIBHARP_API int harp_import_product_metadata(const char *filename, const char *o
 LIBHARP_API int harp_export(const char *filename, const char *export_format, const harp_product *product)
 {
     file_format format;
+    int result;
 
     format = format_from_string(export_format);
     if (format == format_unknown)
@@ -891,32 +1577,203 @@ LIBHARP_API int harp_export(const char *filename, const char *export_format, con
         return -1;
     }
 
+    harp_lock(harp_lock_io);
     switch (format)
     {
         case format_hdf4:
 #ifdef HAVE_HDF4
-            return harp_export_hdf4(filename, product);
+            result = harp_export_hdf4(filename, product);
 #else
             harp_set_error(HARP_ERROR_NO_HDF4_SUPPORT, NULL);
-            return -1;
+            result = -1;
 #endif
+            break;
         case format_hdf5:
 #ifdef HAVE_HDF5
-            return harp_export_hdf5(filename, product);
+            result = harp_export_hdf5(filename, product);
 #else
             harp_set_error(HARP_ERROR_NO_HDF5_SUPPORT, NULL);
-            return -1;
+            result = -1;
 #endif
+            break;
         case format_netcdf:
-            return harp_export_netcdf(filename, product);
+            result = harp_export_netcdf(filename, product);
+            break;
         default:
             assert(0);
             exit(1);
     }
+    harp_unlock(harp_lock_io);
+
+    return result;
+}
+
+/** Create a file to which products can be exported incrementally.
+ * \ingroup harp_product
+ * The file will contain the concatenation (along the time dimension) of \a product and all products that are
+ * subsequently passed to harp_export_stream_append(), as if all products were combined using harp_product_append().
+ * The data of each product is written to the file directly, so the combined product is never kept in memory.
+ * \a product will be updated as if it was the result of a merge (see harp_product_append()) before it is written.
+ * Streaming export is only supported for the netCDF format (where the time dimension is stored as the unlimited
+ * dimension).
+ * \param filename Path to the file to which the products are to be exported.
+ * \param export_format Export format (only "netcdf" is supported).
+ * \param product First product that should be exported to file.
+ * \param stream Pointer to the location where the export stream will be stored.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_export_stream_open(const char *filename, const char *export_format, harp_product *product,
+                                        harp_export_stream **stream)
+{
+    harp_export_stream *new_stream;
+    int result;
+
+    if (product == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "product is NULL");
+        return -1;
+    }
+    if (format_from_string(export_format) != format_netcdf)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "unsupported streaming export format '%s'", export_format);
+        return -1;
+    }
+
+    if (harp_product_append(product, NULL) != 0)
+    {
+        return -1;
+    }
+
+    new_stream = (harp_export_stream *)malloc(sizeof(harp_export_stream));
+    if (new_stream == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(harp_export_stream), __FILE__, __LINE__);
+        return -1;
+    }
+    new_stream->template_product = NULL;
+    new_stream->netcdf_stream = NULL;
+
+    if (harp_product_copy(product, &new_stream->template_product) != 0)
+    {
+        free(new_stream);
+        return -1;
+    }
+    if (product->dimension[harp_dimension_time] > 1)
+    {
+        uint8_t *mask;
+
+        /* only keep the first sample; the template is just used to check the variables of appended products */
+        mask = (uint8_t *)calloc(product->dimension[harp_dimension_time], sizeof(uint8_t));
+        if (mask == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           product->dimension[harp_dimension_time] * sizeof(uint8_t), __FILE__, __LINE__);
+            harp_product_delete(new_stream->template_product);
+            free(new_stream);
+            return -1;
+        }
+        mask[0] = 1;
+        if (harp_product_filter_dimension(new_stream->template_product, harp_dimension_time, mask) != 0)
+        {
+            free(mask);
+            harp_product_delete(new_stream->template_product);
+            free(new_stream);
+            return -1;
+        }
+        free(mask);
+    }
+
+    harp_lock(harp_lock_io);
+    result = harp_export_netcdf_stream_open(filename, product, &new_stream->netcdf_stream);
+    harp_unlock(harp_lock_io);
+    if (result != 0)
+    {
+        harp_product_delete(new_stream->template_product);
+        free(new_stream);
+        return -1;
+    }
+
+    *stream = new_stream;
 
     return 0;
 }
 
+/** Append a product to an export stream.
+ * \ingroup harp_product
+ * \a product will be modified in the same way as harp_product_append() modifies the product that gets appended.
+ * If the product cannot be appended without modifying the data that was already written to the file (e.g. because
+ * it has a larger non-time dimension, different variables, or longer strings) then nothing is written and \a appended
+ * is set to 0. In that case the product can only be combined with the data in the file using harp_product_append()
+ * (after closing the stream and importing the file).
+ * \param stream Export stream to which the product should be appended.
+ * \param product Product that should be appended.
+ * \param appended Pointer to the location where a flag is stored whether the product was appended (1) or not (0).
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_export_stream_append(harp_export_stream *stream, harp_product *product, int *appended)
+{
+    int compatible;
+    int result;
+
+    if (stream == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "stream is NULL");
+        return -1;
+    }
+    if (product == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "product is NULL");
+        return -1;
+    }
+
+    if (harp_product_prepare_append(stream->template_product, product, &compatible) != 0)
+    {
+        return -1;
+    }
+    if (!compatible)
+    {
+        *appended = 0;
+        return 0;
+    }
+
+    harp_lock(harp_lock_io);
+    result = harp_export_netcdf_stream_append(stream->netcdf_stream, product, appended);
+    harp_unlock(harp_lock_io);
+
+    return result;
+}
+
+/** Finalize the file of an export stream and free the export stream.
+ * \ingroup harp_product
+ * \param stream Export stream that should be closed.
+ * \return
+ *   \arg \c 0, Success.
+ *   \arg \c -1, Error occurred (check #harp_errno).
+ */
+LIBHARP_API int harp_export_stream_close(harp_export_stream *stream)
+{
+    int result;
+
+    if (stream == NULL)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "stream is NULL");
+        return -1;
+    }
+
+    harp_lock(harp_lock_io);
+    result = harp_export_netcdf_stream_close(stream->netcdf_stream);
+    harp_unlock(harp_lock_io);
+    harp_product_delete(stream->template_product);
+    free(stream);
+
+    return result;
+}
+
 /**
  * Return a string describing the dimension type.
  */
@@ -6,5 +6,6 @@ AC_DEFUN([ST_CHECK_LIBZ],
 AC_CHECK_LIB(z, compress, ac_cv_lib_z=yes, ac_cv_lib_z=no)
 if test $ac_cv_lib_z = yes ; then
   ZLIB="-lz"
+  AC_CHECK_HEADERS(zlib.h)
 fi
 ])# ST_CHECK_LIBZ
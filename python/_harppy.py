@@ -68,7 +68,7 @@ class CLibraryError(Error):
     """
     def __init__(self, errno=None, strerror=None):
         if errno is None:
-            errno = _lib.harp_errno
+            errno = _lib.harp_get_errno()[0]
 
         if strerror is None:
             strerror = _decode_string(_ffi.string(_lib.harp_errno_to_string(errno)))
@@ -603,6 +603,17 @@ def _get_c_dimension_type(dimension_type):
         raise UnsupportedDimensionError("unsupported dimension %r" % dimension_type)
 
 
+def _get_c_hdf5_compression_filter(name):
+    """Return the C HDF5 compression filter code corresponding to the specified
+    filter name.
+
+    """
+    try:
+        return {"deflate": 0, "szip": 1, "lz4": 2, "zstd": 3}[name]
+    except KeyError:
+        raise Error("unsupported hdf5 compression filter %r" % name)
+
+
 def _get_py_data_type(data_type):
     """Return the Python type corresponding to the specified C data type code."""
     try:
@@ -878,9 +889,33 @@ def _import_array(c_data_type, c_num_elements, c_data):
     return numpy.copy(numpy.frombuffer(c_data_buffer, dtype=_get_py_data_type(c_data_type)))
 
 
-def _import_variable(c_variable):
+class _CVariableData(object):
+    """Array interface on the data of a (detached) C variable.
+
+    NumPy arrays that are created from an instance of this class keep a reference to it (as their base object), which
+    keeps the C variable alive until the last array that refers to its data has been deleted.
+
+    """
+    def __init__(self, c_variable_ptr):
+        c_variable = c_variable_ptr[0]
+        self._c_variable_ptr = _ffi.gc(c_variable_ptr, _lib.harp_variable_delete)
+        self.__array_interface__ = {
+            'version': 3,
+            'shape': (c_variable.num_elements,),
+            'typestr': numpy.dtype(_get_py_data_type(c_variable.data_type)).str,
+            'data': (int(_ffi.cast("uintptr_t", c_variable.data.ptr)), False)
+        }
+
+
+def _can_import_without_copy(c_variable):
+    return (c_variable.data_type != _lib.harp_type_string and c_variable.num_dimensions > 0 and
+            c_variable.num_elements > 0)
+
+
+def _import_variable(c_variable, data=None):
     # Import variable data.
-    data = _import_array(c_variable.data_type, c_variable.num_elements, c_variable.data)
+    if data is None:
+        data = _import_array(c_variable.data_type, c_variable.num_elements, c_variable.data)
 
     num_dimensions = c_variable.num_dimensions
     if num_dimensions == 0:
@@ -919,9 +954,17 @@ def _import_product(c_product):
         product.history = _decode_string(_ffi.string(c_product.history))
 
     # Import variables.
-    for i in range(c_product.num_variables):
-        c_variable_ptr = c_product.variable[i]
-        variable = _import_variable(c_variable_ptr[0])
+    #
+    # NB. The data of numeric array variables is not copied. Instead, such a C variable is detached from the C product
+    # and the resulting NumPy array takes ownership of the C variable (see _CVariableData).
+    c_variable_ptrs = [c_product.variable[i] for i in range(c_product.num_variables)]
+    for c_variable_ptr in c_variable_ptrs:
+        data = None
+        if _can_import_without_copy(c_variable_ptr[0]):
+            if _lib.harp_product_detach_variable(c_product, c_variable_ptr) != 0:
+                raise CLibraryError()
+            data = numpy.asarray(_CVariableData(c_variable_ptr))
+        variable = _import_variable(c_variable_ptr[0], data)
         setattr(product, _decode_string(_ffi.string(c_variable_ptr[0].name)), variable)
 
     return product
@@ -993,7 +1036,21 @@ def _export_array(data, c_variable):
             raise CLibraryError()
 
 
-def _export_variable(name, variable, c_product):
+def _can_export_without_copy(data, c_data_type):
+    return (isinstance(data, numpy.ndarray) and data.ndim > 0 and data.size > 0 and
+            c_data_type != _lib.harp_type_string and data.dtype == numpy.dtype(_get_py_data_type(c_data_type)) and
+            data.flags.c_contiguous and data.flags.aligned)
+
+
+def _release_borrowed_data(borrowed):
+    # Detach the NumPy data from C variables that were created by _export_variable() with borrow_data enabled. This
+    # should be done before the C variables are deleted, to prevent the C library from freeing memory owned by NumPy.
+    for c_variable, data in borrowed:
+        c_variable.data.ptr = _ffi.NULL
+    del borrowed[:]
+
+
+def _export_variable(name, variable, c_product, borrowed=None):
     data = getattr(variable, "data", None)
     if data is None:
         raise Error("no data or data is None")
@@ -1017,14 +1074,24 @@ def _export_variable(name, variable, c_product):
     c_dimension_type = [_get_c_dimension_type(dimension_name) for dimension_name in dimension]
     c_dimension = _ffi.NULL if not dimension else data.shape
 
-    # Create C variable of the proper size.
+    # Create C variable of the proper size. If borrowing is enabled, a contiguous NumPy array of the right dtype is
+    # passed to the C library as is (the caller should call _release_borrowed_data() before deleting the C product).
     c_variable_ptr = _ffi.new("harp_variable **")
-    if _lib.harp_variable_new(c_name, c_data_type, c_num_dimensions, c_dimension_type, c_dimension,
-                              c_variable_ptr) != 0:
+    borrow_data = borrowed is not None and _can_export_without_copy(data, c_data_type)
+    if borrow_data:
+        if _lib.harp_variable_new_with_data(c_name, c_data_type, c_num_dimensions, c_dimension_type, c_dimension,
+                                            _ffi.cast("void *", data.ctypes.data), c_variable_ptr) != 0:
+            raise CLibraryError()
+        borrowed.append((c_variable_ptr[0], data))
+    elif _lib.harp_variable_new(c_name, c_data_type, c_num_dimensions, c_dimension_type, c_dimension,
+                                c_variable_ptr) != 0:
         raise CLibraryError()
 
     # Add C variable to C product.
     if _lib.harp_product_add_variable(c_product, c_variable_ptr[0]) != 0:
+        if borrow_data:
+            c_variable_ptr[0].data.ptr = _ffi.NULL
+            borrowed.pop()
         _lib.harp_variable_delete(c_variable_ptr[0])
         raise CLibraryError()
 
@@ -1034,7 +1101,8 @@ def _export_variable(name, variable, c_product):
     c_variable = c_variable_ptr[0]
 
     # Copy data into the C variable.
-    _export_array(data, c_variable)
+    if not borrow_data:
+        _export_array(data, c_variable)
 
     # Variable attributes.
     if c_data_type != _lib.harp_type_string:
@@ -1101,7 +1169,7 @@ def _export_variable(name, variable, c_product):
             raise CLibraryError()
 
 
-def _export_product(product, c_product):
+def _export_product(product, c_product, borrowed=None):
     # Export product attributes.
     try:
         source_product = product.source_product
@@ -1122,7 +1190,7 @@ def _export_product(product, c_product):
     # Export variables.
     for name in product:
         try:
-            _export_variable(name, product[name], c_product)
+            _export_variable(name, product[name], c_product, borrowed)
         except Error as _error:
             raise Error("variable '%r' could not be exported (%s)" % (name, str(_error)))
 
@@ -1267,13 +1335,26 @@ def import_product(filename, operations="", options="", reduce_operations="", po
             raise Error("no files matching '%s'" % (filename))
         # Return the merged concatenation of all products
         merged_product_ptr = None
+        # Compile the operations once, so they don't have to be parsed again for each product
+        program = _ffi.NULL
+        reduce_program = _ffi.NULL
         try:
+            if operations:
+                c_program_ptr = _ffi.new("harp_program **")
+                if _lib.harp_program_compile(_encode_string(operations), c_program_ptr) != 0:
+                    raise CLibraryError()
+                program = c_program_ptr[0]
+            if reduce_operations:
+                c_program_ptr = _ffi.new("harp_program **")
+                if _lib.harp_program_compile(_encode_string(reduce_operations), c_program_ptr) != 0:
+                    raise CLibraryError()
+                reduce_program = c_program_ptr[0]
             for file in filenames:
                 c_product_ptr = _ffi.new("harp_product **")
 
                 # Import the product as a C product.
-                if _lib.harp_import(_encode_path(file), _encode_string(operations), _encode_string(options),
-                                    c_product_ptr) != 0:
+                if _lib.harp_import_with_program(_encode_path(file), program, _encode_string(options),
+                                                 c_product_ptr) != 0:
                     raise CLibraryError()
                 if _lib.harp_product_is_empty(c_product_ptr[0]) == 1:
                     _lib.harp_product_delete(c_product_ptr[0])
@@ -1291,13 +1372,17 @@ def import_product(filename, operations="", options="", reduce_operations="", po
                             _lib.harp_product_delete(c_product_ptr[0])
                     if reduce_operations:
                         # perform reduction operations on the partially merged product after each append
-                        if _lib.harp_product_execute_operations(merged_product_ptr[0],
-                                                                _encode_string(reduce_operations)) != 0:
+                        if _lib.harp_product_execute_program(merged_product_ptr[0], reduce_program) != 0:
                             raise CLibraryError()
         except Exception:
             if merged_product_ptr is not None:
                 _lib.harp_product_delete(merged_product_ptr[0])
             raise
+        finally:
+            if program != _ffi.NULL:
+                _lib.harp_program_delete(program)
+            if reduce_program != _ffi.NULL:
+                _lib.harp_program_delete(reduce_program)
 
         if merged_product_ptr is None:
             raise NoDataError()
@@ -1389,7 +1474,8 @@ def import_product_metadata(filename, options=""):
         _lib.harp_product_metadata_delete(c_metadata_ptr[0])
 
 
-def export_product(product, filename, file_format="netcdf", operations="", hdf5_compression=0):
+def export_product(product, filename, file_format="netcdf", operations="", hdf5_compression=0,
+                   hdf5_compression_filter="deflate", hdf5_chunk_size=0, hdf5_shuffle=False):
     """Export a HARP compliant product.
 
     Arguments:
@@ -1399,6 +1485,11 @@ def export_product(product, filename, file_format="netcdf", operations="", hdf5_
     operations       -- Actions to apply as part of the export; should be specified as a
                         semi-colon separated string of operations.
     hdf5_compression -- Compression level when exporting to hdf5 (0=disabled, 1=low, ..., 9=high).
+    hdf5_compression_filter -- Compression filter to use when exporting to hdf5; one of 'deflate', 'szip', 'lz4',
+                               or 'zstd'.
+    hdf5_chunk_size  -- Target size in bytes of the chunks of compressed variables when exporting to hdf5
+                        (0=one chunk per variable).
+    hdf5_shuffle     -- Apply the byte shuffle filter before compression when exporting to hdf5.
 
     """
     if not isinstance(product, Product):
@@ -1414,9 +1505,13 @@ def export_product(product, filename, file_format="netcdf", operations="", hdf5_
     if _lib.harp_product_new(c_product_ptr) != 0:
         raise CLibraryError()
 
+    # Operations may modify variable data in place (or reallocate it), so the NumPy data can only be passed to the C
+    # library without making a copy if there are no operations to perform.
+    borrowed = None if operations else []
+
     try:
         # Convert the Python product to its C representation.
-        _export_product(product, c_product_ptr[0])
+        _export_product(product, c_product_ptr[0], borrowed)
 
         if operations:
             # Apply operations to the product before export
@@ -1430,10 +1525,16 @@ def export_product(product, filename, file_format="netcdf", operations="", hdf5_
         # Export the C product to a file.
         if file_format == 'hdf5':
             _lib.harp_set_option_hdf5_compression(int(hdf5_compression))
+            _lib.harp_set_option_hdf5_compression_filter(_get_c_hdf5_compression_filter(hdf5_compression_filter))
+            if _lib.harp_set_option_hdf5_chunk_size(int(hdf5_chunk_size)) != 0:
+                raise CLibraryError()
+            _lib.harp_set_option_hdf5_shuffle(1 if hdf5_shuffle else 0)
         if _lib.harp_export(_encode_path(filename), _encode_string(file_format), c_product_ptr[0]) != 0:
             raise CLibraryError()
 
     finally:
+        if borrowed:
+            _release_borrowed_data(borrowed)
         _lib.harp_product_delete(c_product_ptr[0])
 
 
@@ -1549,6 +1650,10 @@ def execute_operations(products, operations="", post_operations=""):
     else:
         # Return the merged concatenation of all products
         merged_product_ptr = None
+        # Compile the operations once, so they don't have to be parsed again for each product
+        c_program_ptr = _ffi.new("harp_program **")
+        if _lib.harp_program_compile(_encode_string(operations), c_program_ptr) != 0:
+            raise CLibraryError()
         try:
             for product in products:
                 c_product_ptr = _ffi.new("harp_product **")
@@ -1556,7 +1661,7 @@ def execute_operations(products, operations="", post_operations=""):
                     raise CLibraryError()
                 try:
                     _export_product(product, c_product_ptr[0])
-                    if _lib.harp_product_execute_operations(c_product_ptr[0], _encode_string(operations)) != 0:
+                    if _lib.harp_product_execute_program(c_product_ptr[0], c_program_ptr[0]) != 0:
                         raise CLibraryError()
                 except Exception:
                     _lib.harp_product_delete(c_product_ptr[0])
@@ -1579,6 +1684,8 @@ def execute_operations(products, operations="", post_operations=""):
             if merged_product_ptr is not None:
                 _lib.harp_product_delete(merged_product_ptr[0])
             raise
+        finally:
+            _lib.harp_program_delete(c_program_ptr[0])
 
         if merged_product_ptr is None:
             raise NoDataError()
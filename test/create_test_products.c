@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Creates the products that are used as input for the tests of the command line tools.
+ * The products are written to the current working directory.
+ */
+
+#define NUM_SAMPLES_A 200
+#define NUM_SAMPLES_B 10
+
+static int create_collocation_product_a(void)
+{
+    harp_dimension_type dimension_type[1] = { harp_dimension_time };
+    long dimension[1] = { NUM_SAMPLES_A };
+    double latitude[NUM_SAMPLES_A];
+    double longitude[NUM_SAMPLES_A];
+    double datetime[NUM_SAMPLES_A];
+    harp_product *product;
+    long i;
+
+    for (i = 0; i < NUM_SAMPLES_A; i++)
+    {
+        latitude[i] = -80.0 + 160.0 * i / NUM_SAMPLES_A;
+        longitude[i] = -170.0 + 340.0 * i / NUM_SAMPLES_A;
+        datetime[i] = 9000.0 + (double)i / NUM_SAMPLES_A;
+    }
+
+    TEST_CALL(harp_product_new(&product));
+    if (test_add_variable(product, "latitude", harp_type_double, 1, dimension_type, dimension, "degree_north",
+                          latitude) != 0 ||
+        test_add_variable(product, "longitude", harp_type_double, 1, dimension_type, dimension, "degree_east",
+                          longitude) != 0 ||
+        test_add_variable(product, "datetime", harp_type_double, 1, dimension_type, dimension, "days since 2000-01-01",
+                          datetime) != 0 ||
+        harp_export("collocation_a.nc", "netcdf", product) != 0)
+    {
+        test_fail_harp("create collocation_a.nc", __FILE__, __LINE__);
+        harp_product_delete(product);
+        return -1;
+    }
+    harp_product_delete(product);
+
+    return 0;
+}
+
+/* Product with degenerate areas (the corner points of each bounding rect share the same latitude), which will make
+ * every area based collocation criterium fail with an error.
+ */
+static int create_collocation_product_b_invalid_area(void)
+{
+    harp_dimension_type dimension_type[2] = { harp_dimension_time, harp_dimension_independent };
+    long dimension[2] = { NUM_SAMPLES_B, 2 };
+    double latitude_bounds[NUM_SAMPLES_B * 2];
+    double longitude_bounds[NUM_SAMPLES_B * 2];
+    double datetime[NUM_SAMPLES_B];
+    harp_product *product;
+    long i;
+
+    for (i = 0; i < NUM_SAMPLES_B; i++)
+    {
+        latitude_bounds[i * 2] = -80.0 + 16.0 * i;
+        latitude_bounds[i * 2 + 1] = latitude_bounds[i * 2];
+        longitude_bounds[i * 2] = -170.0 + 34.0 * i;
+        longitude_bounds[i * 2 + 1] = longitude_bounds[i * 2] + 10.0;
+        datetime[i] = 9000.0 + (double)i / NUM_SAMPLES_B;
+    }
+
+    TEST_CALL(harp_product_new(&product));
+    if (test_add_variable(product, "latitude_bounds", harp_type_double, 2, dimension_type, dimension, "degree_north",
+                          latitude_bounds) != 0 ||
+        test_add_variable(product, "longitude_bounds", harp_type_double, 2, dimension_type, dimension, "degree_east",
+                          longitude_bounds) != 0 ||
+        test_add_variable(product, "datetime", harp_type_double, 1, dimension_type, dimension, "days since 2000-01-01",
+                          datetime) != 0 ||
+        harp_export("collocation_b_invalid_area.nc", "netcdf", product) != 0)
+    {
+        test_fail_harp("create collocation_b_invalid_area.nc", __FILE__, __LINE__);
+        harp_product_delete(product);
+        return -1;
+    }
+    harp_product_delete(product);
+
+    return 0;
+}
+
+int main(void)
+{
+    int result = 0;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+    if (create_collocation_product_a() != 0 || create_collocation_product_b_invalid_area() != 0)
+    {
+        result = 1;
+    }
+
+    harp_done();
+
+    return result;
+}
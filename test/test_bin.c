@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Tests bin() with variables against a straightforward grouping that compares each sample against the first sample of
+ * all previous bins (NaN values are all in the same bin and -0 equals +0) */
+
+#define NUM_SAMPLES 5000
+#define NUM_SITE_NAMES 13
+#define NUM_KEY_VARIABLES 4
+
+static const char *site_name[NUM_SITE_NAMES] = {
+    "Cabauw", "De Bilt", "Lauder", "Mauna Loa", "Izana", "Ny-Alesund", "Paramaribo", "Reunion", "Sodankyla",
+    "Uccle", "Hohenpeissenberg", "Payerne", "Lindenberg"
+};
+
+static const char *key_variable_name[NUM_KEY_VARIABLES] = { "site_id", "site_name", "altitude", "pressure" };
+
+static int create_product(harp_product **product)
+{
+    harp_dimension_type dimension_type[1] = { harp_dimension_time };
+    long dimension[1] = { NUM_SAMPLES };
+    harp_variable *variable;
+    int32_t site_id[NUM_SAMPLES];
+    double altitude[NUM_SAMPLES];
+    float pressure[NUM_SAMPLES];
+    double value[NUM_SAMPLES];
+    long i;
+
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        site_id[i] = (int32_t)((i * 37) % 101);
+        /* a small set of values that includes NaN, -0 and +0 */
+        switch (i % 7)
+        {
+            case 0:
+                altitude[i] = harp_nan();
+                break;
+            case 1:
+                altitude[i] = -0.0;
+                break;
+            case 2:
+                altitude[i] = 0.0;
+                break;
+            default:
+                altitude[i] = 0.25 * ((i * 11) % 9);
+                break;
+        }
+        pressure[i] = (i % 13 == 0) ? (float)harp_nan() : (float)(1000.0 - 50.0 * ((i * 3) % 5));
+        value[i] = 1.0e18 * (1.0 + (double)i / NUM_SAMPLES);
+    }
+
+    TEST_CALL(harp_product_new(product));
+    if (test_add_variable(*product, "site_id", harp_type_int32, 1, dimension_type, dimension, NULL, site_id) != 0 ||
+        test_add_variable(*product, "altitude", harp_type_double, 1, dimension_type, dimension, "km", altitude) != 0 ||
+        test_add_variable(*product, "pressure", harp_type_float, 1, dimension_type, dimension, "hPa", pressure) != 0 ||
+        test_add_variable(*product, "O3_column_number_density", harp_type_double, 1, dimension_type, dimension,
+                          "molec/cm2", value) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+    if (harp_variable_new("site_name", harp_type_string, 1, dimension_type, dimension, &variable) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        /* some samples have an empty site name */
+        if (harp_variable_set_string_data_element(variable, i, i % 29 == 0 ? "" :
+                                                  site_name[(i * 5) % NUM_SITE_NAMES]) != 0)
+        {
+            harp_variable_delete(variable);
+            harp_product_delete(*product);
+            TEST_CALL(-1);
+        }
+    }
+    if (harp_product_add_variable(*product, variable) != 0)
+    {
+        harp_variable_delete(variable);
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+
+    return 0;
+}
+
+static int values_equal(const harp_variable *variable, long index_a, long index_b)
+{
+    switch (variable->data_type)
+    {
+        case harp_type_int32:
+            return variable->data.int32_data[index_a] == variable->data.int32_data[index_b];
+        case harp_type_float:
+            if (harp_isnan(variable->data.float_data[index_a]) || harp_isnan(variable->data.float_data[index_b]))
+            {
+                return harp_isnan(variable->data.float_data[index_a]) &&
+                    harp_isnan(variable->data.float_data[index_b]);
+            }
+            return variable->data.float_data[index_a] == variable->data.float_data[index_b];
+        case harp_type_double:
+            if (harp_isnan(variable->data.double_data[index_a]) || harp_isnan(variable->data.double_data[index_b]))
+            {
+                return harp_isnan(variable->data.double_data[index_a]) &&
+                    harp_isnan(variable->data.double_data[index_b]);
+            }
+            return variable->data.double_data[index_a] == variable->data.double_data[index_b];
+        case harp_type_string:
+            return strcmp(variable->data.string_data[index_a], variable->data.string_data[index_b]) == 0;
+        default:
+            break;
+    }
+    return 0;
+}
+
+/* bin the product using the key variables with the given indices and compare with the expected grouping */
+static int check_bin(const harp_product *product, int num_keys, const int *key_index)
+{
+    const harp_variable *key_variable[NUM_KEY_VARIABLES];
+    harp_variable *variable;
+    harp_product *binned_product = NULL;
+    char operation[128];
+    long bin_first_sample[NUM_SAMPLES];
+    long bin_count[NUM_SAMPLES];
+    double bin_sum[NUM_SAMPLES];
+    long num_bins = 0;
+    long i, j;
+    int k;
+
+    strcpy(operation, "bin((");
+    for (k = 0; k < num_keys; k++)
+    {
+        int index;
+
+        TEST_CALL(harp_product_get_variable_index_by_name(product, key_variable_name[key_index[k]], &index));
+        key_variable[k] = product->variable[index];
+        if (k > 0)
+        {
+            strcat(operation, ", ");
+        }
+        strcat(operation, key_variable_name[key_index[k]]);
+    }
+    strcat(operation, "))");
+
+    /* determine the expected bins, in order of their first sample */
+    TEST_CALL(harp_product_get_variable_by_name(product, "O3_column_number_density", &variable));
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        for (j = 0; j < num_bins; j++)
+        {
+            for (k = 0; k < num_keys; k++)
+            {
+                if (!values_equal(key_variable[k], bin_first_sample[j], i))
+                {
+                    break;
+                }
+            }
+            if (k == num_keys)
+            {
+                break;
+            }
+        }
+        if (j == num_bins)
+        {
+            bin_first_sample[j] = i;
+            bin_count[j] = 0;
+            bin_sum[j] = 0;
+            num_bins++;
+        }
+        bin_count[j]++;
+        bin_sum[j] += variable->data.double_data[i];
+    }
+
+    TEST_CALL(harp_product_copy(product, &binned_product));
+    if (harp_product_execute_operations(binned_product, operation) != 0)
+    {
+        harp_product_delete(binned_product);
+        TEST_CALL(-1);
+    }
+    if (binned_product->dimension[harp_dimension_time] != num_bins)
+    {
+        fprintf(stderr, "FAILED: %s resulted in %ld bins instead of %ld\n", operation,
+                binned_product->dimension[harp_dimension_time], num_bins);
+        harp_product_delete(binned_product);
+        return -1;
+    }
+    if (harp_product_get_variable_by_name(binned_product, "count", &variable) != 0)
+    {
+        harp_product_delete(binned_product);
+        TEST_CALL(-1);
+    }
+    for (j = 0; j < num_bins; j++)
+    {
+        if (variable->data.int32_data[j] != bin_count[j])
+        {
+            fprintf(stderr, "FAILED: %s bin %ld has count %ld instead of %ld\n", operation, j,
+                    (long)variable->data.int32_data[j], bin_count[j]);
+            harp_product_delete(binned_product);
+            return -1;
+        }
+    }
+    if (harp_product_get_variable_by_name(binned_product, "O3_column_number_density", &variable) != 0)
+    {
+        harp_product_delete(binned_product);
+        TEST_CALL(-1);
+    }
+    for (j = 0; j < num_bins; j++)
+    {
+        double mean = bin_sum[j] / bin_count[j];
+
+        if (fabs(variable->data.double_data[j] - mean) > 1.0e-12 * mean)
+        {
+            fprintf(stderr, "FAILED: %s bin %ld has average %.17g instead of %.17g\n", operation, j,
+                    variable->data.double_data[j], mean);
+            harp_product_delete(binned_product);
+            return -1;
+        }
+    }
+    harp_product_delete(binned_product);
+
+    return 0;
+}
+
+static int test_bin_with_variables(void)
+{
+    int site_id_key[1] = { 0 };
+    int site_name_key[1] = { 1 };
+    int altitude_key[1] = { 2 };
+    int pressure_key[1] = { 3 };
+    int composite_key[3] = { 0, 1, 2 };
+    int all_keys[4] = { 3, 2, 1, 0 };
+    harp_product *product;
+    int result = 0;
+
+    if (create_product(&product) != 0)
+    {
+        return -1;
+    }
+    if (check_bin(product, 1, site_id_key) != 0 || check_bin(product, 1, site_name_key) != 0 ||
+        check_bin(product, 1, altitude_key) != 0 || check_bin(product, 1, pressure_key) != 0 ||
+        check_bin(product, 3, composite_key) != 0 || check_bin(product, 4, all_keys) != 0)
+    {
+        result = -1;
+    }
+    harp_product_delete(product);
+
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+    if (test_bin_with_variables() != 0)
+    {
+        result = 1;
+    }
+
+    harp_done();
+
+    return result;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Tests that spatial binning gives the same result with and without the cache of grid cell weights */
+
+#define NUM_PRODUCTS 3
+#define NUM_SAMPLES 500
+#define BIN_SPATIAL_OPERATION "bin_spatial(19, -90, 10, 37, -180, 10)"
+
+/* create a product with slanted quadrilateral footprints that each overlap several grid cells */
+static int create_product(double longitude_offset, double value_offset, harp_product **product)
+{
+    harp_dimension_type dimension_type[2] = { harp_dimension_time, harp_dimension_independent };
+    long dimension[2] = { NUM_SAMPLES, 4 };
+    double datetime[NUM_SAMPLES];
+    double value[NUM_SAMPLES];
+    double latitude_bounds[NUM_SAMPLES * 4];
+    double longitude_bounds[NUM_SAMPLES * 4];
+    long i;
+
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        double latitude = -80.0 + (i * 7.7 - 160.0 * (long)(i * 7.7 / 160.0));
+        double longitude = -170.0 + (i * 13.3 - 340.0 * (long)(i * 13.3 / 340.0)) + longitude_offset;
+
+        datetime[i] = 100.0 * i;
+        value[i] = value_offset + i;
+        latitude_bounds[i * 4] = latitude - 4.0;
+        latitude_bounds[i * 4 + 1] = latitude - 3.0;
+        latitude_bounds[i * 4 + 2] = latitude + 4.0;
+        latitude_bounds[i * 4 + 3] = latitude + 3.0;
+        longitude_bounds[i * 4] = longitude - 6.0;
+        longitude_bounds[i * 4 + 1] = longitude + 7.0;
+        longitude_bounds[i * 4 + 2] = longitude + 6.0;
+        longitude_bounds[i * 4 + 3] = longitude - 7.0;
+    }
+
+    TEST_CALL(harp_product_new(product));
+    if (test_add_variable(*product, "datetime", harp_type_double, 1, dimension_type, dimension,
+                          "seconds since 2020-01-01", datetime) != 0 ||
+        test_add_variable(*product, "O3_column_number_density", harp_type_double, 1, dimension_type, dimension,
+                          "molec/cm2", value) != 0 ||
+        test_add_variable(*product, "latitude_bounds", harp_type_double, 2, dimension_type, dimension,
+                          "degree_north", latitude_bounds) != 0 ||
+        test_add_variable(*product, "longitude_bounds", harp_type_double, 2, dimension_type, dimension,
+                          "degree_east", longitude_bounds) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+
+    return 0;
+}
+
+static int bin_product(const harp_product *product, const char *operations, harp_product **binned_product)
+{
+    TEST_CALL(harp_product_copy(product, binned_product));
+    if (harp_product_execute_operations(*binned_product, operations) != 0)
+    {
+        harp_product_delete(*binned_product);
+        TEST_CALL(-1);
+    }
+
+    return 0;
+}
+
+static int test_bin_spatial_weight_cache(void)
+{
+    /* the second product has the same footprints as the first (so the cached weights can be reused) and the third
+     * product has different footprints (so the cached weights should not be used) */
+    double longitude_offset[NUM_PRODUCTS] = { 0.0, 0.0, 2.5 };
+    double value_offset[NUM_PRODUCTS] = { 0.0, 1000.0, 0.0 };
+    harp_product *product[NUM_PRODUCTS] = { NULL, NULL, NULL };
+    harp_product *reference[NUM_PRODUCTS] = { NULL, NULL, NULL };
+    harp_product *binned_product;
+    int result = -1;
+    int i, j;
+
+    for (i = 0; i < NUM_PRODUCTS; i++)
+    {
+        if (create_product(longitude_offset[i], value_offset[i], &product[i]) != 0)
+        {
+            goto done;
+        }
+    }
+
+    /* results without the cache */
+    if (harp_set_option_bin_spatial_weight_cache(0) != 0)
+    {
+        test_fail_harp("harp_set_option_bin_spatial_weight_cache(0)", __FILE__, __LINE__);
+        goto done;
+    }
+    for (i = 0; i < NUM_PRODUCTS; i++)
+    {
+        if (bin_product(product[i], BIN_SPATIAL_OPERATION, &reference[i]) != 0)
+        {
+            goto done;
+        }
+    }
+
+    /* bin each product twice with the cache enabled, such that the second time the cached weights are used */
+    if (harp_set_option_bin_spatial_weight_cache(1) != 0)
+    {
+        test_fail_harp("harp_set_option_bin_spatial_weight_cache(1)", __FILE__, __LINE__);
+        goto done;
+    }
+    for (i = 0; i < NUM_PRODUCTS; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            if (bin_product(product[i], BIN_SPATIAL_OPERATION, &binned_product) != 0)
+            {
+                goto done;
+            }
+            if (test_compare_products(reference[i], binned_product, 0) != 0)
+            {
+                fprintf(stderr, "FAILED: binning of product %d with weight cache (pass %d)\n", i, j);
+                harp_product_delete(binned_product);
+                goto done;
+            }
+            harp_product_delete(binned_product);
+        }
+    }
+
+    /* enabling the cache using a set() operation should give the same result */
+    if (harp_set_option_bin_spatial_weight_cache(0) != 0)
+    {
+        test_fail_harp("harp_set_option_bin_spatial_weight_cache(0)", __FILE__, __LINE__);
+        goto done;
+    }
+    for (i = 0; i < NUM_PRODUCTS; i++)
+    {
+        if (bin_product(product[i], "set(\"bin_spatial_weight_cache\", \"enabled\"); " BIN_SPATIAL_OPERATION,
+                        &binned_product) != 0)
+        {
+            goto done;
+        }
+        if (test_compare_products(reference[i], binned_product, 0) != 0)
+        {
+            fprintf(stderr, "FAILED: binning of product %d with weight cache enabled by set()\n", i);
+            harp_product_delete(binned_product);
+            goto done;
+        }
+        harp_product_delete(binned_product);
+    }
+
+    result = 0;
+
+  done:
+    for (i = 0; i < NUM_PRODUCTS; i++)
+    {
+        if (product[i] != NULL)
+        {
+            harp_product_delete(product[i]);
+        }
+        if (reference[i] != NULL)
+        {
+            harp_product_delete(reference[i]);
+        }
+    }
+
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+    if (test_bin_spatial_weight_cache() != 0)
+    {
+        result = 1;
+    }
+
+    harp_done();
+
+    return result;
+}
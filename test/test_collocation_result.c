@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Tests access to the pairs of a collocation result (which are stored per column) */
+
+#define NUM_PAIRS 6
+
+static int check_pair(const harp_collocation_result *collocation_result, long index, long collocation_index,
+                      const char *source_product_a, long sample_index_a, const char *source_product_b,
+                      long sample_index_b, double difference)
+{
+    harp_collocation_pair pair;
+
+    TEST_CALL(harp_collocation_result_get_pair(collocation_result, index, &pair));
+    TEST_ASSERT(pair.collocation_index == collocation_index);
+    TEST_ASSERT(pair.collocation_index == collocation_result->collocation_index[index]);
+    TEST_ASSERT(strcmp(collocation_result->dataset_a->source_product[pair.product_index_a], source_product_a) == 0);
+    TEST_ASSERT(pair.sample_index_a == sample_index_a);
+    TEST_ASSERT(strcmp(collocation_result->dataset_b->source_product[pair.product_index_b], source_product_b) == 0);
+    TEST_ASSERT(pair.sample_index_b == sample_index_b);
+    TEST_ASSERT(pair.num_differences == 1);
+    TEST_ASSERT(pair.difference != NULL && pair.difference[0] == difference);
+    TEST_ASSERT(pair.difference == &collocation_result->difference[index]);
+
+    return 0;
+}
+
+static int test_collocation_result(void)
+{
+    const char *difference_variable_name[1] = { "datetime" };
+    const char *difference_unit[1] = { "s" };
+    harp_collocation_result *collocation_result;
+    harp_collocation_pair pair;
+    uint8_t mask[NUM_PAIRS] = { 1, 0, 1, 1, 0, 1 };
+    long i;
+
+    TEST_CALL(harp_collocation_result_new(&collocation_result, 1, difference_variable_name, difference_unit));
+    for (i = 0; i < NUM_PAIRS; i++)
+    {
+        double difference = 10.0 * i;
+
+        /* add the pairs in reverse order of collocation index */
+        if (harp_collocation_result_add_pair(collocation_result, NUM_PAIRS - i, i % 2 == 0 ? "a0" : "a1", i,
+                                             i < 3 ? "b0" : "b1", 100 + i, 1, &difference) != 0)
+        {
+            harp_collocation_result_delete(collocation_result);
+            TEST_CALL(-1);
+        }
+    }
+    if (collocation_result->num_pairs != NUM_PAIRS ||
+        check_pair(collocation_result, 0, NUM_PAIRS, "a0", 0, "b0", 100, 0.0) != 0 ||
+        check_pair(collocation_result, 5, 1, "a1", 5, "b1", 105, 50.0) != 0)
+    {
+        harp_collocation_result_delete(collocation_result);
+        return -1;
+    }
+
+    /* a pair outside the range of the collocation result should give an error */
+    if (harp_collocation_result_get_pair(collocation_result, NUM_PAIRS, &pair) == 0)
+    {
+        harp_collocation_result_delete(collocation_result);
+        TEST_ASSERT(!"get_pair out of range fails");
+    }
+
+    /* sorting and filtering should keep the columns of a pair together */
+    if (harp_collocation_result_sort_by_collocation_index(collocation_result) != 0 ||
+        harp_collocation_result_filter_with_mask(collocation_result, mask) != 0)
+    {
+        harp_collocation_result_delete(collocation_result);
+        TEST_CALL(-1);
+    }
+    if (collocation_result->num_pairs != 4 ||
+        check_pair(collocation_result, 0, 1, "a1", 5, "b1", 105, 50.0) != 0 ||
+        check_pair(collocation_result, 1, 3, "a1", 3, "b1", 103, 30.0) != 0 ||
+        check_pair(collocation_result, 2, 4, "a0", 2, "b0", 102, 20.0) != 0 ||
+        check_pair(collocation_result, 3, 6, "a0", 0, "b0", 100, 0.0) != 0)
+    {
+        harp_collocation_result_delete(collocation_result);
+        return -1;
+    }
+    if (harp_collocation_result_remove_pair_at_index(collocation_result, 1) != 0)
+    {
+        harp_collocation_result_delete(collocation_result);
+        TEST_CALL(-1);
+    }
+    if (collocation_result->num_pairs != 3 || check_pair(collocation_result, 1, 4, "a0", 2, "b0", 102, 20.0) != 0)
+    {
+        harp_collocation_result_delete(collocation_result);
+        return -1;
+    }
+
+    harp_collocation_result_delete(collocation_result);
+
+    return 0;
+}
+
+int main(void)
+{
+    int result = 0;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+    if (test_collocation_result() != 0)
+    {
+        result = 1;
+    }
+
+    harp_done();
+
+    return result;
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef WIN32
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+/* Tests importing a directory into a dataset, with and without the dataset index and with multiple threads */
+
+#define NUM_PRODUCTS 24
+#define NUM_SAMPLES 32000
+
+static int create_dataset_directory(void)
+{
+    harp_dimension_type dimension_type[1] = { harp_dimension_time };
+    double *value;
+    int i;
+
+    mkdir("dataset", 0777);
+    /* start without an index */
+    remove("dataset/.harp_dataset_index");
+
+    value = malloc(NUM_SAMPLES * sizeof(double));
+    TEST_ASSERT(value != NULL);
+    for (i = 0; i < NUM_PRODUCTS; i++)
+    {
+        /* vary the number of samples such that each product has different metadata */
+        long dimension[1] = { NUM_SAMPLES - i };
+        harp_product *product;
+        char filename[64];
+        long j;
+
+        for (j = 0; j < dimension[0]; j++)
+        {
+            value[j] = 5000.0 + i + (double)j / NUM_SAMPLES;
+        }
+        sprintf(filename, "dataset/product_%02d.nc", i);
+        if (harp_product_new(&product) != 0)
+        {
+            free(value);
+            TEST_CALL(-1);
+        }
+        if (test_add_variable(product, "datetime", harp_type_double, 1, dimension_type, dimension,
+                              "days since 2000-01-01", value) != 0 || harp_export(filename, "netcdf", product) != 0)
+        {
+            harp_product_delete(product);
+            free(value);
+            TEST_CALL(-1);
+        }
+        harp_product_delete(product);
+    }
+    free(value);
+
+    return 0;
+}
+
+static int compare_datasets(harp_dataset *dataset_a, harp_dataset *dataset_b)
+{
+    long i;
+
+    TEST_ASSERT(dataset_a->num_products == NUM_PRODUCTS);
+    TEST_ASSERT(dataset_b->num_products == dataset_a->num_products);
+    for (i = 0; i < dataset_a->num_products; i++)
+    {
+        harp_product_metadata *metadata_a = dataset_a->metadata[i];
+        harp_product_metadata *metadata_b;
+        long index;
+        int k;
+
+        TEST_CALL(harp_dataset_get_index_from_source_product(dataset_b, dataset_a->source_product[i], &index));
+        metadata_b = dataset_b->metadata[index];
+        TEST_ASSERT(metadata_a != NULL && metadata_b != NULL);
+        TEST_ASSERT(strcmp(metadata_a->filename, metadata_b->filename) == 0);
+        TEST_ASSERT(strcmp(metadata_a->format, metadata_b->format) == 0);
+        TEST_ASSERT(metadata_a->datetime_start == metadata_b->datetime_start);
+        TEST_ASSERT(metadata_a->datetime_stop == metadata_b->datetime_stop);
+        for (k = 0; k < HARP_NUM_DIM_TYPES; k++)
+        {
+            TEST_ASSERT(metadata_a->dimension[k] == metadata_b->dimension[k]);
+        }
+    }
+
+    return 0;
+}
+
+static int import_dataset(int num_threads, int use_index, harp_dataset **dataset)
+{
+    TEST_CALL(harp_set_option_num_threads(num_threads));
+    TEST_CALL(harp_set_option_dataset_index(use_index));
+    TEST_CALL(harp_dataset_new(dataset));
+    TEST_CALL(harp_dataset_import(*dataset, "dataset", NULL));
+
+    return 0;
+}
+
+static int test_dataset_import(void)
+{
+    harp_dataset *reference = NULL;
+    harp_dataset *dataset = NULL;
+    FILE *stream;
+    int result = -1;
+
+    if (import_dataset(1, 0, &reference) != 0)
+    {
+        goto done;
+    }
+
+    /* cold scan using multiple threads, which creates the index */
+    if (import_dataset(4, 1, &dataset) != 0 || compare_datasets(reference, dataset) != 0)
+    {
+        goto done;
+    }
+    harp_dataset_delete(dataset);
+    dataset = NULL;
+    stream = fopen("dataset/.harp_dataset_index", "r");
+    if (stream == NULL)
+    {
+        test_fail("dataset index was created", __FILE__, __LINE__);
+        goto done;
+    }
+    fclose(stream);
+
+    /* warm scan using the index */
+    if (import_dataset(4, 1, &dataset) != 0 || compare_datasets(reference, dataset) != 0)
+    {
+        goto done;
+    }
+    harp_dataset_delete(dataset);
+    dataset = NULL;
+
+    /* a file that cannot be read should make the import fail with the error for that file */
+    stream = fopen("dataset/product_99.nc", "w");
+    if (stream == NULL)
+    {
+        test_fail("create dataset/product_99.nc", __FILE__, __LINE__);
+        goto done;
+    }
+    fputs("not a product", stream);
+    fclose(stream);
+    harp_set_option_num_threads(4);
+    harp_dataset_new(&dataset);
+    if (harp_dataset_import(dataset, "dataset", NULL) == 0)
+    {
+        test_fail("import of dataset with invalid file fails", __FILE__, __LINE__);
+        goto done;
+    }
+    if (harp_errno == HARP_SUCCESS || strlen(harp_errno_to_string(harp_errno)) == 0)
+    {
+        test_fail("error of invalid file is reported", __FILE__, __LINE__);
+        goto done;
+    }
+    printf("expected error: %s\n", harp_errno_to_string(harp_errno));
+
+    result = 0;
+
+  done:
+    remove("dataset/product_99.nc");
+    if (reference != NULL)
+    {
+        harp_dataset_delete(reference);
+    }
+    if (dataset != NULL)
+    {
+        harp_dataset_delete(dataset);
+    }
+
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+    /* the test is run with HARP_DATASET_INDEX=0, which should not enable the dataset index */
+    if (harp_get_option_dataset_index() != 0)
+    {
+        test_fail("HARP_DATASET_INDEX=0 keeps the dataset index disabled", __FILE__, __LINE__);
+        result = 1;
+    }
+    if (create_dataset_directory() != 0 || test_dataset_import() != 0)
+    {
+        result = 1;
+    }
+
+    harp_done();
+
+    return result;
+}
@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_HDF5
+#include "hdf5.h"
+#endif
+
+/* Tests that products exported to HDF5 with the chunk size, shuffle and compression filter options (using one or
+ * multiple threads) are imported again unchanged, and that the options end up in the dataset creation properties */
+
+#define NUM_SAMPLES 50003
+#define NUM_LEVELS 24
+#define NUM_WAVELENGTHS 4
+#define CHUNK_SIZE 65536
+
+#define EXPORT_FILENAME "hdf5_export.h5"
+#define SUBSET_OPERATIONS "datetime >= 20000 [s since 2020-01-01]; datetime < 20500 [s since 2020-01-01]"
+
+#ifdef HAVE_HDF5
+static int create_product(harp_product **product)
+{
+    harp_dimension_type dimension_type[2] = { harp_dimension_time, harp_dimension_vertical };
+    harp_dimension_type spectral_dimension_type[1] = { harp_dimension_spectral };
+    long dimension[2] = { NUM_SAMPLES, NUM_LEVELS };
+    long spectral_dimension[1] = { NUM_WAVELENGTHS };
+    double wavelength[NUM_WAVELENGTHS] = { 320.0, 325.5, 331.25, 340.0 };
+    harp_variable *variable;
+    long i, j;
+
+    TEST_CALL(harp_product_new(product));
+
+    if (harp_variable_new("datetime", harp_type_double, 1, dimension_type, dimension, &variable) != 0 ||
+        harp_product_add_variable(*product, variable) != 0 ||
+        harp_variable_set_unit(variable, "s since 2020-01-01") != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        variable->data.double_data[i] = 10.0 * i + 0.001 * (i % 7);
+    }
+
+    if (harp_variable_new("O3_number_density", harp_type_float, 2, dimension_type, dimension, &variable) != 0 ||
+        harp_product_add_variable(*product, variable) != 0 || harp_variable_set_unit(variable, "molec/cm3") != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        for (j = 0; j < NUM_LEVELS; j++)
+        {
+            variable->data.float_data[i * NUM_LEVELS + j] = (i % 101 == 0) ? (float)harp_nan() :
+                (float)(1.0e12 * (1.0 + sin(0.01 * i + 0.2 * j)));
+        }
+    }
+
+    if (harp_variable_new("site_id", harp_type_int32, 1, dimension_type, dimension, &variable) != 0 ||
+        harp_product_add_variable(*product, variable) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        variable->data.int32_data[i] = (int32_t)((i / 10) % 1000 - 500);
+    }
+
+    if (harp_variable_new("scan_subindex", harp_type_int16, 1, dimension_type, dimension, &variable) != 0 ||
+        harp_product_add_variable(*product, variable) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        variable->data.int16_data[i] = (int16_t)(i % 32);
+    }
+
+    if (harp_variable_new("validity", harp_type_int8, 1, dimension_type, dimension, &variable) != 0 ||
+        harp_product_add_variable(*product, variable) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        variable->data.int8_data[i] = (int8_t)(i % 3 - 1);
+    }
+
+    if (harp_variable_new("site_name", harp_type_string, 1, dimension_type, dimension, &variable) != 0 ||
+        harp_product_add_variable(*product, variable) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        char name[32];
+
+        sprintf(name, "site %ld", (i / 100) % 17);
+        if (harp_variable_set_string_data_element(variable, i, name) != 0)
+        {
+            harp_product_delete(*product);
+            TEST_CALL(-1);
+        }
+    }
+
+    /* a variable without time dimension */
+    if (test_add_variable(*product, "wavelength", harp_type_double, 1, spectral_dimension_type, spectral_dimension,
+                          "nm", wavelength) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+
+    return 0;
+}
+
+/* check the layout and filters of a dataset of the exported file */
+static int check_dataset(hid_t file_id, const char *name, int compression, int chunk_size, int shuffle, int filter)
+{
+    H5Z_filter_t filter_id[3];
+    hsize_t dimension[H5S_MAX_RANK];
+    hsize_t chunk_dimension[H5S_MAX_RANK];
+    hid_t dataset_id;
+    hid_t space_id;
+    hid_t plist_id;
+    H5D_layout_t layout;
+    int num_dimensions;
+    int num_filters;
+    int i;
+
+    dataset_id = H5Dopen2(file_id, name, H5P_DEFAULT);
+    TEST_ASSERT(dataset_id >= 0);
+    space_id = H5Dget_space(dataset_id);
+    plist_id = H5Dget_create_plist(dataset_id);
+    H5Dclose(dataset_id);
+    TEST_ASSERT(space_id >= 0 && plist_id >= 0);
+    num_dimensions = H5Sget_simple_extent_dims(space_id, dimension, NULL);
+    H5Sclose(space_id);
+    layout = H5Pget_layout(plist_id);
+    num_filters = H5Pget_nfilters(plist_id);
+    for (i = 0; i < num_filters && i < 3; i++)
+    {
+        unsigned int flags;
+        size_t num_values = 0;
+        unsigned int filter_config;
+
+        filter_id[i] = H5Pget_filter2(plist_id, i, &flags, &num_values, NULL, 0, NULL, &filter_config);
+    }
+    if (layout == H5D_CHUNKED)
+    {
+        TEST_ASSERT(H5Pget_chunk(plist_id, num_dimensions, chunk_dimension) == num_dimensions);
+    }
+    H5Pclose(plist_id);
+
+    if (compression == 0)
+    {
+        TEST_ASSERT(layout != H5D_CHUNKED);
+        TEST_ASSERT(num_filters == 0);
+        return 0;
+    }
+
+    TEST_ASSERT(layout == H5D_CHUNKED);
+    TEST_ASSERT(num_filters == (shuffle ? 2 : 1));
+    if (shuffle)
+    {
+        TEST_ASSERT(filter_id[0] == H5Z_FILTER_SHUFFLE);
+    }
+    TEST_ASSERT(filter_id[num_filters - 1] == (filter == 1 ? H5Z_FILTER_SZIP : H5Z_FILTER_DEFLATE));
+    if (chunk_size == 0)
+    {
+        /* a single chunk for the whole variable */
+        for (i = 0; i < num_dimensions; i++)
+        {
+            TEST_ASSERT(chunk_dimension[i] == dimension[i]);
+        }
+    }
+    else
+    {
+        /* chunks are split along the time dimension only */
+        TEST_ASSERT(chunk_dimension[0] < dimension[0]);
+        for (i = 1; i < num_dimensions; i++)
+        {
+            TEST_ASSERT(chunk_dimension[i] == dimension[i]);
+        }
+    }
+
+    return 0;
+}
+
+static int check_layout(int compression, int chunk_size, int shuffle, int filter)
+{
+    hid_t file_id;
+    int result;
+
+    file_id = H5Fopen(EXPORT_FILENAME, H5F_ACC_RDONLY, H5P_DEFAULT);
+    TEST_ASSERT(file_id >= 0);
+    result = check_dataset(file_id, "datetime", compression, chunk_size, shuffle, filter);
+    if (result == 0)
+    {
+        result = check_dataset(file_id, "O3_number_density", compression, chunk_size, shuffle, filter);
+    }
+    if (result == 0)
+    {
+        result = check_dataset(file_id, "site_id", compression, chunk_size, shuffle, filter);
+    }
+    H5Fclose(file_id);
+
+    return result;
+}
+
+static int test_export(const harp_product *product, int compression, int chunk_size, int shuffle, int filter,
+                       int num_threads)
+{
+    harp_product *imported_product = NULL;
+    harp_product *subset_product = NULL;
+    int result = -1;
+
+    TEST_CALL(harp_set_option_num_threads(num_threads));
+    TEST_CALL(harp_set_option_hdf5_compression(compression));
+    TEST_CALL(harp_set_option_hdf5_chunk_size(chunk_size));
+    TEST_CALL(harp_set_option_hdf5_shuffle(shuffle));
+    TEST_CALL(harp_set_option_hdf5_compression_filter(filter));
+    TEST_CALL(harp_export(EXPORT_FILENAME, "hdf5", product));
+
+    if (check_layout(compression, chunk_size, shuffle, filter) != 0)
+    {
+        goto done;
+    }
+
+    /* import the whole product */
+    if (harp_import(EXPORT_FILENAME, NULL, NULL, &imported_product) != 0)
+    {
+        test_fail_harp("harp_import", __FILE__, __LINE__);
+        goto done;
+    }
+    if (test_compare_products(product, imported_product, 0) != 0)
+    {
+        goto done;
+    }
+    harp_product_delete(imported_product);
+    imported_product = NULL;
+
+    /* import a range of samples (which only reads part of the chunks) */
+    if (harp_import(EXPORT_FILENAME, SUBSET_OPERATIONS, NULL, &imported_product) != 0 ||
+        harp_product_copy(product, &subset_product) != 0 ||
+        harp_product_execute_operations(subset_product, SUBSET_OPERATIONS) != 0)
+    {
+        test_fail_harp("import of subset", __FILE__, __LINE__);
+        goto done;
+    }
+    if (imported_product->dimension[harp_dimension_time] != 50 ||
+        test_compare_products(subset_product, imported_product, 0) != 0)
+    {
+        test_fail("subset matches", __FILE__, __LINE__);
+        goto done;
+    }
+
+    result = 0;
+
+  done:
+    if (result != 0)
+    {
+        fprintf(stderr, "FAILED: export with compression=%d, chunk_size=%d, shuffle=%d, filter=%d using %d "
+                "thread(s)\n", compression, chunk_size, shuffle, filter, num_threads);
+    }
+    if (imported_product != NULL)
+    {
+        harp_product_delete(imported_product);
+    }
+    if (subset_product != NULL)
+    {
+        harp_product_delete(subset_product);
+    }
+    remove(EXPORT_FILENAME);
+
+    return result;
+}
+
+static int test_hdf5_export(void)
+{
+    harp_product *product;
+    unsigned int filter_config = 0;
+    int num_filters = 1;
+    int compression, chunk_size, shuffle, filter;
+    int result = 0;
+
+    if (create_product(&product) != 0)
+    {
+        return -1;
+    }
+
+    /* szip is only tested if the HDF5 library can encode it */
+    if (H5Zfilter_avail(H5Z_FILTER_SZIP) > 0 && H5Zget_filter_info(H5Z_FILTER_SZIP, &filter_config) >= 0 &&
+        (filter_config & H5Z_FILTER_CONFIG_ENCODE_ENABLED))
+    {
+        num_filters = 2;
+    }
+
+    if (test_export(product, 0, 0, 0, 0, 1) != 0)
+    {
+        result = -1;
+    }
+    for (compression = 1; compression <= 9; compression += 5)
+    {
+        for (chunk_size = 0; chunk_size <= CHUNK_SIZE; chunk_size += CHUNK_SIZE)
+        {
+            for (shuffle = 0; shuffle <= 1; shuffle++)
+            {
+                for (filter = 0; filter < num_filters; filter++)
+                {
+                    if (test_export(product, compression, chunk_size, shuffle, filter, 1) != 0 ||
+                        test_export(product, compression, chunk_size, shuffle, filter, 4) != 0)
+                    {
+                        result = -1;
+                    }
+                }
+            }
+        }
+    }
+
+    harp_product_delete(product);
+
+    /* reset the options to their defaults */
+    harp_set_option_hdf5_compression(0);
+    harp_set_option_hdf5_chunk_size(0);
+    harp_set_option_hdf5_shuffle(0);
+    harp_set_option_hdf5_compression_filter(0);
+
+    return result;
+}
+#endif
+
+int main(void)
+{
+    int result = 0;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+#ifdef HAVE_HDF5
+    if (test_hdf5_export() != 0)
+    {
+        result = 1;
+    }
+#else
+    printf("HDF5 support not available; test skipped\n");
+#endif
+
+    harp_done();
+
+    return result;
+}
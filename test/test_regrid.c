@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Tests that regridding with regrid_precision set to float gives the same results as the default (double) regridding,
+ * within float precision */
+
+#define NUM_SAMPLES 20000
+#define NUM_LEVELS 30
+
+#define REGRID_OPERATION "regrid(vertical, altitude [km], (0.5, 3.2, 7.7, 12.1, 18.4, 25, 33.3, 41.9, 50, 61.5))"
+#define FLOAT_TOLERANCE 1.0e-6
+
+/* if 'shared_grid' is set all profiles use the same altitude grid, otherwise each profile has its own altitude grid */
+static int create_product(int shared_grid, harp_product **product)
+{
+    harp_dimension_type dimension_type[2] = { harp_dimension_time, harp_dimension_vertical };
+    long dimension[2] = { NUM_SAMPLES, NUM_LEVELS };
+    double *altitude = NULL;
+    double *pressure = NULL;
+    float *number_density = NULL;
+    long i, j;
+
+    altitude = malloc(NUM_SAMPLES * NUM_LEVELS * sizeof(double));
+    pressure = malloc(NUM_SAMPLES * NUM_LEVELS * sizeof(double));
+    number_density = malloc(NUM_SAMPLES * NUM_LEVELS * sizeof(float));
+    if (altitude == NULL || pressure == NULL || number_density == NULL)
+    {
+        test_fail("allocation of product data", __FILE__, __LINE__);
+        goto error;
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        for (j = 0; j < NUM_LEVELS; j++)
+        {
+            long index = i * NUM_LEVELS + j;
+
+            altitude[index] = 2.0 * j + (shared_grid ? 0.0 : 0.37 * (i % 5));
+            pressure[index] = 101325.0 * exp(-altitude[index] / 7.0);
+            number_density[index] = (float)(1.0e12 * (1.0 + sin(0.1 * i + 0.3 * j)) + 1.0e11 * j);
+            if (i % 97 == 0 && j == 4)
+            {
+                number_density[index] = (float)harp_nan();
+            }
+        }
+    }
+
+    if (harp_product_new(product) != 0)
+    {
+        test_fail_harp("harp_product_new", __FILE__, __LINE__);
+        goto error;
+    }
+    if (test_add_variable(*product, "altitude", harp_type_double, 2, dimension_type, dimension, "km", altitude) != 0 ||
+        test_add_variable(*product, "pressure", harp_type_double, 2, dimension_type, dimension, "Pa", pressure) != 0 ||
+        test_add_variable(*product, "O3_number_density", harp_type_float, 2, dimension_type, dimension, "molec/cm3",
+                          number_density) != 0)
+    {
+        test_fail_harp("create product", __FILE__, __LINE__);
+        harp_product_delete(*product);
+        goto error;
+    }
+    free(altitude);
+    free(pressure);
+    free(number_density);
+
+    return 0;
+
+  error:
+    if (altitude != NULL)
+    {
+        free(altitude);
+    }
+    if (pressure != NULL)
+    {
+        free(pressure);
+    }
+    if (number_density != NULL)
+    {
+        free(number_density);
+    }
+    return -1;
+}
+
+static int regrid_product(const harp_product *product, const char *operations, harp_product **regridded_product)
+{
+    TEST_CALL(harp_product_copy(product, regridded_product));
+    if (harp_product_execute_operations(*regridded_product, operations) != 0)
+    {
+        harp_product_delete(*regridded_product);
+        TEST_CALL(-1);
+    }
+
+    return 0;
+}
+
+static int compare_regrid_results(const harp_product *product_double, const harp_product *product_float)
+{
+    harp_variable *variable_double;
+    harp_variable *variable_float;
+    long i;
+
+    /* double variables are not affected by the regrid_precision option */
+    TEST_CALL(harp_product_get_variable_by_name(product_double, "pressure", &variable_double));
+    TEST_CALL(harp_product_get_variable_by_name(product_float, "pressure", &variable_float));
+    TEST_ASSERT(variable_double->data_type == harp_type_double);
+    TEST_ASSERT(test_compare_variables(variable_double, variable_float, 0) == 0);
+
+    /* float variables are converted to double by default and stay float with regrid_precision set to float */
+    TEST_CALL(harp_product_get_variable_by_name(product_double, "O3_number_density", &variable_double));
+    TEST_CALL(harp_product_get_variable_by_name(product_float, "O3_number_density", &variable_float));
+    TEST_ASSERT(variable_double->data_type == harp_type_double);
+    TEST_ASSERT(variable_float->data_type == harp_type_float);
+    TEST_ASSERT(test_compare_variables(variable_double, variable_float, FLOAT_TOLERANCE) == 0);
+
+    /* the interpolation itself is still performed in double precision, so the float result should be the double
+     * result rounded to float */
+    for (i = 0; i < variable_double->num_elements; i++)
+    {
+        float value = (float)variable_double->data.double_data[i];
+
+        if (harp_isnan(value))
+        {
+            TEST_ASSERT(harp_isnan(variable_float->data.float_data[i]));
+        }
+        else
+        {
+            TEST_ASSERT(variable_float->data.float_data[i] == value);
+        }
+    }
+
+    return 0;
+}
+
+static int test_regrid_precision(int shared_grid, int num_threads)
+{
+    harp_product *product;
+    harp_product *product_double = NULL;
+    harp_product *product_float = NULL;
+    int result = -1;
+
+    TEST_CALL(harp_set_option_num_threads(num_threads));
+    if (create_product(shared_grid, &product) != 0)
+    {
+        return -1;
+    }
+    if (regrid_product(product, REGRID_OPERATION, &product_double) != 0 ||
+        regrid_product(product, "set(\"regrid_precision\", \"float\"); " REGRID_OPERATION, &product_float) != 0)
+    {
+        goto done;
+    }
+    if (compare_regrid_results(product_double, product_float) != 0)
+    {
+        fprintf(stderr, "FAILED: regrid precision with%s shared grid using %d thread(s)\n",
+                shared_grid ? "" : "out", num_threads);
+        goto done;
+    }
+
+    result = 0;
+
+  done:
+    harp_product_delete(product);
+    if (product_double != NULL)
+    {
+        harp_product_delete(product_double);
+    }
+    if (product_float != NULL)
+    {
+        harp_product_delete(product_float);
+    }
+
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+    if (test_regrid_precision(0, 1) != 0 || test_regrid_precision(1, 1) != 0 || test_regrid_precision(1, 4) != 0)
+    {
+        result = 1;
+    }
+
+    harp_done();
+
+    return result;
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Tests vertical smoothing with averaging kernels against a plain row-by-row matrix-vector product (with NaN checks
+ * on every element), for full profiles, profiles with NaN values, padded profiles, and multiple threads */
+
+#define NUM_PROFILES 2000
+#define NUM_BLOCKS 3
+#define NUM_LEVELS 23
+
+/* straightforward implementation of harp_variable_smooth_vertical() to compare against */
+static void reference_smooth(harp_variable *variable, harp_variable *vertical_axis, harp_variable *averaging_kernel,
+                             harp_variable *apriori)
+{
+    double vector[NUM_LEVELS];
+    long i, j, k, l;
+
+    for (k = 0; k < NUM_PROFILES; k++)
+    {
+        long num_vertical_elements = NUM_LEVELS;
+
+        if (vertical_axis != NULL)
+        {
+            while (num_vertical_elements > 0 &&
+                   harp_isnan(vertical_axis->data.double_data[k * NUM_LEVELS + num_vertical_elements - 1]))
+            {
+                num_vertical_elements--;
+            }
+            if (num_vertical_elements == 0)
+            {
+                num_vertical_elements = NUM_LEVELS;
+            }
+        }
+        for (l = 0; l < NUM_BLOCKS; l++)
+        {
+            double *profile = &variable->data.double_data[(k * NUM_BLOCKS + l) * NUM_LEVELS];
+
+            for (i = 0; i < num_vertical_elements; i++)
+            {
+                vector[i] = profile[i];
+                if (apriori != NULL)
+                {
+                    vector[i] -= apriori->data.double_data[k * NUM_LEVELS + i];
+                }
+            }
+            for (i = 0; i < num_vertical_elements; i++)
+            {
+                const double *avk_row = &averaging_kernel->data.double_data[(k * NUM_LEVELS + i) * NUM_LEVELS];
+                long num_valid = 0;
+
+                if (harp_isnan(vector[i]))
+                {
+                    continue;
+                }
+                profile[i] = 0;
+                for (j = 0; j < num_vertical_elements; j++)
+                {
+                    if (!harp_isnan(vector[j]))
+                    {
+                        profile[i] += avk_row[j] * vector[j];
+                        num_valid++;
+                    }
+                }
+                if (apriori != NULL)
+                {
+                    profile[i] += apriori->data.double_data[k * NUM_LEVELS + i];
+                }
+                else if (num_valid == 0)
+                {
+                    profile[i] = harp_nan();
+                }
+            }
+        }
+    }
+}
+
+/* create the input variables; profiles with NaN values and padded profiles are only included if requested */
+static int create_variables(int with_nan, int with_padding, harp_variable **variable, harp_variable **vertical_axis,
+                            harp_variable **averaging_kernel, harp_variable **apriori)
+{
+    harp_dimension_type dimension_type[3] = { harp_dimension_time, harp_dimension_independent,
+        harp_dimension_vertical
+    };
+    harp_dimension_type avk_dimension_type[3] = { harp_dimension_time, harp_dimension_vertical,
+        harp_dimension_vertical
+    };
+    long dimension[3] = { NUM_PROFILES, NUM_BLOCKS, NUM_LEVELS };
+    long avk_dimension[3] = { NUM_PROFILES, NUM_LEVELS, NUM_LEVELS };
+    long profile_dimension[2] = { NUM_PROFILES, NUM_LEVELS };
+    harp_dimension_type profile_dimension_type[2] = { harp_dimension_time, harp_dimension_vertical };
+    long i, j, k;
+
+    *variable = NULL;
+    *vertical_axis = NULL;
+    *averaging_kernel = NULL;
+    *apriori = NULL;
+    TEST_CALL(harp_variable_new("O3_number_density", harp_type_double, 3, dimension_type, dimension, variable));
+    TEST_CALL(harp_variable_new("altitude", harp_type_double, 2, profile_dimension_type, profile_dimension,
+                                vertical_axis));
+    TEST_CALL(harp_variable_new("O3_number_density_avk", harp_type_double, 3, avk_dimension_type, avk_dimension,
+                                averaging_kernel));
+    TEST_CALL(harp_variable_new("O3_number_density_apriori", harp_type_double, 2, profile_dimension_type,
+                                profile_dimension, apriori));
+
+    for (k = 0; k < NUM_PROFILES; k++)
+    {
+        /* padded profiles have a vertical axis that ends with NaN values */
+        long num_levels = (with_padding && k % 3 == 1) ? NUM_LEVELS - 1 - k % 7 : NUM_LEVELS;
+
+        for (i = 0; i < NUM_LEVELS; i++)
+        {
+            (*vertical_axis)->data.double_data[k * NUM_LEVELS + i] = i < num_levels ? 1.5 * i : harp_nan();
+            (*apriori)->data.double_data[k * NUM_LEVELS + i] = 1.0e12 * (1.0 + 0.01 * i + 0.001 * (k % 11));
+            for (j = 0; j < NUM_LEVELS; j++)
+            {
+                (*averaging_kernel)->data.double_data[(k * NUM_LEVELS + i) * NUM_LEVELS + j] =
+                    (i == j ? 0.6 : 0.3 / (1.0 + (i - j) * (i - j))) + 0.0001 * (k % 13);
+            }
+        }
+        for (j = 0; j < NUM_BLOCKS; j++)
+        {
+            double *profile = &(*variable)->data.double_data[(k * NUM_BLOCKS + j) * NUM_LEVELS];
+
+            for (i = 0; i < NUM_LEVELS; i++)
+            {
+                profile[i] = i < num_levels ? 1.0e12 * (1.0 + sin(0.05 * k + 0.3 * i + j)) : harp_nan();
+            }
+            if (with_nan)
+            {
+                /* NaN values inside the profile and, for some profiles, no valid values at all */
+                if (k % 5 == 0)
+                {
+                    profile[(k + j) % num_levels] = harp_nan();
+                }
+                if (k % 17 == 0 && j == 1)
+                {
+                    for (i = 0; i < NUM_LEVELS; i++)
+                    {
+                        profile[i] = harp_nan();
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void delete_variables(harp_variable *variable, harp_variable *vertical_axis, harp_variable *averaging_kernel,
+                             harp_variable *apriori)
+{
+    if (variable != NULL)
+    {
+        harp_variable_delete(variable);
+    }
+    if (vertical_axis != NULL)
+    {
+        harp_variable_delete(vertical_axis);
+    }
+    if (averaging_kernel != NULL)
+    {
+        harp_variable_delete(averaging_kernel);
+    }
+    if (apriori != NULL)
+    {
+        harp_variable_delete(apriori);
+    }
+}
+
+static int test_smooth_vertical(int with_nan, int with_padding, int with_apriori, int num_threads)
+{
+    harp_variable *variable;
+    harp_variable *vertical_axis;
+    harp_variable *averaging_kernel;
+    harp_variable *apriori;
+    harp_variable *reference = NULL;
+    int result = -1;
+
+    TEST_CALL(harp_set_option_num_threads(num_threads));
+    if (create_variables(with_nan, with_padding, &variable, &vertical_axis, &averaging_kernel, &apriori) != 0)
+    {
+        delete_variables(variable, vertical_axis, averaging_kernel, apriori);
+        return -1;
+    }
+    if (!with_apriori)
+    {
+        harp_variable_delete(apriori);
+        apriori = NULL;
+    }
+    if (harp_variable_copy(variable, &reference) != 0)
+    {
+        test_fail_harp("harp_variable_copy", __FILE__, __LINE__);
+        goto done;
+    }
+    reference_smooth(reference, with_padding ? vertical_axis : NULL, averaging_kernel, apriori);
+    if (harp_variable_smooth_vertical(variable, with_padding ? vertical_axis : NULL, averaging_kernel, apriori) != 0)
+    {
+        test_fail_harp("harp_variable_smooth_vertical", __FILE__, __LINE__);
+        goto done;
+    }
+    /* the sums are accumulated in the same order, so the results should be identical */
+    if (test_compare_variables(reference, variable, 0) != 0)
+    {
+        fprintf(stderr, "FAILED: smoothing with%s NaN values, with%s padding, with%s apriori, using %d thread(s)\n",
+                with_nan ? "" : "out", with_padding ? "" : "out", with_apriori ? "" : "out", num_threads);
+        goto done;
+    }
+
+    result = 0;
+
+  done:
+    if (reference != NULL)
+    {
+        harp_variable_delete(reference);
+    }
+    delete_variables(variable, vertical_axis, averaging_kernel, apriori);
+
+    return result;
+}
+
+int main(void)
+{
+    int result = 0;
+    int with_nan, with_padding, with_apriori;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+    for (with_nan = 0; with_nan <= 1; with_nan++)
+    {
+        for (with_padding = 0; with_padding <= 1; with_padding++)
+        {
+            for (with_apriori = 0; with_apriori <= 1; with_apriori++)
+            {
+                if (test_smooth_vertical(with_nan, with_padding, with_apriori, 1) != 0 ||
+                    test_smooth_vertical(with_nan, with_padding, with_apriori, 4) != 0)
+                {
+                    result = 1;
+                }
+            }
+        }
+    }
+
+    harp_done();
+
+    return result;
+}
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* Stress test for importing and processing products from multiple threads at the same time.
+ * Each thread repeatedly imports the same product, performs operations on it, exports and re-imports the result,
+ * and triggers an error of its own. Results should be identical to those of a single thread and errors should only
+ * be visible in the thread that raised them. Build with -fsanitize=thread to check for data races.
+ */
+
+#define NUM_THREADS 8
+#define NUM_ITERATIONS 10
+#define NUM_SAMPLES 2000
+#define NUM_LEVELS 12
+
+#define INPUT_FILENAME "thread_safety.nc"
+#define IMPORT_OPERATIONS "latitude > -80 [degree_north]; derive(O3_volume_mixing_ratio [ppbv]); " \
+    "derive(pressure [hPa])"
+#define PROCESS_OPERATIONS "regrid(vertical, altitude [km], (1, 5, 10, 20)); sort(latitude); " \
+    "bin_spatial(7, -90, 30, 3, -180, 180)"
+
+typedef struct thread_info_struct
+{
+    int id;
+    const harp_product *reference;
+    int result;
+} thread_info;
+
+static int create_input_product(void)
+{
+    harp_dimension_type dimension_type[2] = { harp_dimension_time, harp_dimension_vertical };
+    long dimension[2] = { NUM_SAMPLES, NUM_LEVELS };
+    harp_product *product;
+    double *buffer;
+    long i, j;
+
+    buffer = malloc(NUM_SAMPLES * NUM_LEVELS * sizeof(double));
+    TEST_ASSERT(buffer != NULL);
+    if (harp_product_new(&product) != 0)
+    {
+        free(buffer);
+        TEST_CALL(-1);
+    }
+
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        buffer[i] = 9000.0 + i / 1440.0;
+    }
+    if (test_add_variable(product, "datetime", harp_type_double, 1, dimension_type, dimension,
+                          "days since 2000-01-01", buffer) != 0)
+    {
+        goto error;
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        buffer[i] = -89.5 + fmod(i * 7.3, 179.0);
+    }
+    if (test_add_variable(product, "latitude", harp_type_double, 1, dimension_type, dimension, "degree_north",
+                          buffer) != 0)
+    {
+        goto error;
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        buffer[i] = -179.5 + fmod(i * 13.1, 359.0);
+    }
+    if (test_add_variable(product, "longitude", harp_type_double, 1, dimension_type, dimension, "degree_east",
+                          buffer) != 0)
+    {
+        goto error;
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        for (j = 0; j < NUM_LEVELS; j++)
+        {
+            buffer[i * NUM_LEVELS + j] = 2.0 * j + 0.001 * (i % 100);
+        }
+    }
+    if (test_add_variable(product, "altitude", harp_type_double, 2, dimension_type, dimension, "km", buffer) != 0)
+    {
+        goto error;
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        for (j = 0; j < NUM_LEVELS; j++)
+        {
+            buffer[i * NUM_LEVELS + j] = 101325.0 * exp(-(2.0 * j + 0.001 * (i % 100)) / 7.0);
+        }
+    }
+    if (test_add_variable(product, "pressure", harp_type_double, 2, dimension_type, dimension, "Pa", buffer) != 0)
+    {
+        goto error;
+    }
+    for (i = 0; i < NUM_SAMPLES; i++)
+    {
+        for (j = 0; j < NUM_LEVELS; j++)
+        {
+            buffer[i * NUM_LEVELS + j] = (i % 50 == 0 && j == 3) ? harp_nan() : 0.1 + 0.5 * j + 0.0001 * i;
+        }
+    }
+    if (test_add_variable(product, "O3_volume_mixing_ratio", harp_type_double, 2, dimension_type, dimension, "ppmv",
+                          buffer) != 0)
+    {
+        goto error;
+    }
+    free(buffer);
+    buffer = NULL;
+
+    if (harp_export(INPUT_FILENAME, "netcdf", product) != 0)
+    {
+        goto error;
+    }
+    harp_product_delete(product);
+
+    return 0;
+
+  error:
+    harp_product_delete(product);
+    if (buffer != NULL)
+    {
+        free(buffer);
+    }
+    test_fail_harp("create input product", __FILE__, __LINE__);
+
+    return -1;
+}
+
+static int process_product(harp_product **product)
+{
+    TEST_CALL(harp_import(INPUT_FILENAME, IMPORT_OPERATIONS, NULL, product));
+    if (harp_product_execute_operations(*product, PROCESS_OPERATIONS) != 0)
+    {
+        harp_product_delete(*product);
+        TEST_CALL(-1);
+    }
+
+    return 0;
+}
+
+static int run_iteration(thread_info *info, int iteration)
+{
+    harp_product *product = NULL;
+    harp_product *exported_product = NULL;
+    char filename[64];
+    int result;
+
+    /* import and process */
+    if (process_product(&product) != 0)
+    {
+        return -1;
+    }
+    result = test_compare_products(info->reference, product, 0);
+
+    /* export and re-import */
+    if (result == 0)
+    {
+        sprintf(filename, "thread_safety_%d.nc", info->id);
+        if (harp_export(filename, "netcdf", product) != 0 || harp_import(filename, NULL, NULL, &exported_product) != 0)
+        {
+            test_fail_harp("export and import of processed product", __FILE__, __LINE__);
+            result = -1;
+        }
+        else
+        {
+            result = test_compare_products(product, exported_product, 0);
+            harp_product_delete(exported_product);
+        }
+        remove(filename);
+    }
+    harp_product_delete(product);
+    if (result != 0)
+    {
+        return -1;
+    }
+
+    /* an error should only be visible in the thread that raised it */
+    sprintf(filename, "missing_%d_%d.nc", info->id, iteration);
+    TEST_ASSERT(harp_import(filename, NULL, NULL, &product) != 0);
+    TEST_ASSERT(harp_errno == HARP_ERROR_FILE_NOT_FOUND);
+    TEST_ASSERT(strstr(harp_errno_to_string(harp_errno), filename) != NULL);
+    harp_errno = HARP_SUCCESS;
+
+    return 0;
+}
+
+#ifdef HAVE_PTHREAD_H
+static void *thread_main(void *arg)
+{
+    thread_info *info = (thread_info *)arg;
+    int i;
+
+    info->result = 0;
+    for (i = 0; i < NUM_ITERATIONS; i++)
+    {
+        if (run_iteration(info, i) != 0)
+        {
+            info->result = -1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+#endif
+
+static int test_thread_safety(void)
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_t thread[NUM_THREADS];
+    thread_info info[NUM_THREADS];
+    harp_product *reference;
+    int num_started;
+    int result = 0;
+    int i;
+
+    if (create_input_product() != 0 || process_product(&reference) != 0)
+    {
+        return -1;
+    }
+    /* the product should not be empty, otherwise the test does not cover much */
+    if (reference->dimension[harp_dimension_time] == 0 || reference->dimension[harp_dimension_vertical] != 4)
+    {
+        harp_product_delete(reference);
+        test_fail("processed product has time and vertical dimensions", __FILE__, __LINE__);
+        return -1;
+    }
+
+    harp_errno = HARP_SUCCESS;
+    for (num_started = 0; num_started < NUM_THREADS; num_started++)
+    {
+        info[num_started].id = num_started;
+        info[num_started].reference = reference;
+        info[num_started].result = -1;
+        if (pthread_create(&thread[num_started], NULL, thread_main, &info[num_started]) != 0)
+        {
+            test_fail("pthread_create", __FILE__, __LINE__);
+            result = -1;
+            break;
+        }
+    }
+    for (i = 0; i < num_started; i++)
+    {
+        pthread_join(thread[i], NULL);
+        if (info[i].result != 0)
+        {
+            fprintf(stderr, "FAILED: thread %d\n", i);
+            result = -1;
+        }
+    }
+    harp_product_delete(reference);
+
+    /* errors of the other threads should not have ended up in this thread */
+    TEST_ASSERT(harp_errno == HARP_SUCCESS);
+
+    return result;
+#else
+    printf("pthreads not available; test skipped\n");
+    return 0;
+#endif
+}
+
+/* options that are changed by set() operations should only apply to the list of operations itself */
+static int test_program_options(void)
+{
+    harp_product *product;
+
+    TEST_CALL(harp_product_new(&product));
+    if (harp_product_execute_operations(product, "set(\"bin_spatial_weight_cache\", \"enabled\"); "
+                                        "set(\"collocation_datetime\", \"enabled\"); "
+                                        "set(\"propagate_uncertainty\", \"correlated\"); "
+                                        "set(\"regrid_precision\", \"float\")") != 0)
+    {
+        harp_product_delete(product);
+        TEST_CALL(-1);
+    }
+    harp_product_delete(product);
+    TEST_ASSERT(harp_get_option_bin_spatial_weight_cache() == 0);
+    TEST_ASSERT(harp_get_option_create_collocation_datetime() == 0);
+    TEST_ASSERT(harp_get_option_propagate_uncertainty() == 0);
+    TEST_ASSERT(harp_get_option_regrid_precision() == 0);
+
+    return 0;
+}
+
+int main(void)
+{
+    int result = 0;
+
+    if (harp_init() != 0)
+    {
+        fprintf(stderr, "ERROR: %s\n", harp_errno_to_string(harp_errno));
+        exit(1);
+    }
+
+    if (test_program_options() != 0 || test_thread_safety() != 0)
+    {
+        result = 1;
+    }
+
+    harp_done();
+
+    return result;
+}
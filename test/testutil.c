@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "testutil.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void test_fail(const char *condition, const char *file, unsigned int line)
+{
+    fprintf(stderr, "FAILED: %s (%s:%u)\n", condition, file, line);
+}
+
+void test_fail_harp(const char *call, const char *file, unsigned int line)
+{
+    fprintf(stderr, "FAILED: %s (%s:%u)\nERROR: %s\n", call, file, line, harp_errno_to_string(harp_errno));
+}
+
+int test_add_variable(harp_product *product, const char *name, harp_data_type data_type, int num_dimensions,
+                      const harp_dimension_type *dimension_type, const long *dimension, const char *unit,
+                      const void *data)
+{
+    harp_variable *variable;
+
+    if (harp_variable_new(name, data_type, num_dimensions, dimension_type, dimension, &variable) != 0)
+    {
+        return -1;
+    }
+    if (data != NULL)
+    {
+        memcpy(variable->data.ptr, data, variable->num_elements * harp_get_size_for_type(data_type));
+    }
+    if (unit != NULL)
+    {
+        if (harp_variable_set_unit(variable, unit) != 0)
+        {
+            harp_variable_delete(variable);
+            return -1;
+        }
+    }
+    if (harp_product_add_variable(product, variable) != 0)
+    {
+        harp_variable_delete(variable);
+        return -1;
+    }
+
+    return 0;
+}
+
+static double get_value(const harp_variable *variable, long index)
+{
+    switch (variable->data_type)
+    {
+        case harp_type_int8:
+            return variable->data.int8_data[index];
+        case harp_type_int16:
+            return variable->data.int16_data[index];
+        case harp_type_int32:
+            return variable->data.int32_data[index];
+        case harp_type_float:
+            return variable->data.float_data[index];
+        case harp_type_double:
+            return variable->data.double_data[index];
+        case harp_type_string:
+            break;
+    }
+    return 0;
+}
+
+/* Compare two variables. Numerical values are allowed to differ by 'tolerance' relative to the largest of both
+ * absolute values (use a tolerance of 0 to require identical values); NaN values only match other NaN values.
+ * The data type of both variables is allowed to differ if a non-zero tolerance is given.
+ * Returns 0 if the variables match and -1 otherwise (after reporting the first difference).
+ */
+int test_compare_variables(const harp_variable *variable_a, const harp_variable *variable_b, double tolerance)
+{
+    long i;
+    int k;
+
+    if (strcmp(variable_a->name, variable_b->name) != 0 || variable_a->num_dimensions != variable_b->num_dimensions ||
+        variable_a->num_elements != variable_b->num_elements)
+    {
+        fprintf(stderr, "variables '%s' and '%s' differ in name or shape\n", variable_a->name, variable_b->name);
+        return -1;
+    }
+    for (k = 0; k < variable_a->num_dimensions; k++)
+    {
+        if (variable_a->dimension_type[k] != variable_b->dimension_type[k] ||
+            variable_a->dimension[k] != variable_b->dimension[k])
+        {
+            fprintf(stderr, "variable '%s' differs in dimension %d\n", variable_a->name, k);
+            return -1;
+        }
+    }
+    if ((variable_a->unit == NULL) != (variable_b->unit == NULL) ||
+        (variable_a->unit != NULL && strcmp(variable_a->unit, variable_b->unit) != 0))
+    {
+        fprintf(stderr, "variable '%s' differs in unit\n", variable_a->name);
+        return -1;
+    }
+    if (variable_a->data_type != variable_b->data_type &&
+        (tolerance == 0 || variable_a->data_type == harp_type_string || variable_b->data_type == harp_type_string))
+    {
+        fprintf(stderr, "variable '%s' differs in data type\n", variable_a->name);
+        return -1;
+    }
+    if (variable_a->data_type == harp_type_string)
+    {
+        for (i = 0; i < variable_a->num_elements; i++)
+        {
+            const char *value_a = variable_a->data.string_data[i];
+            const char *value_b = variable_b->data.string_data[i];
+
+            if ((value_a == NULL) != (value_b == NULL) || (value_a != NULL && strcmp(value_a, value_b) != 0))
+            {
+                fprintf(stderr, "variable '%s' differs at index %ld\n", variable_a->name, i);
+                return -1;
+            }
+        }
+        return 0;
+    }
+    for (i = 0; i < variable_a->num_elements; i++)
+    {
+        double value_a = get_value(variable_a, i);
+        double value_b = get_value(variable_b, i);
+        double scale;
+
+        if (harp_isnan(value_a) || harp_isnan(value_b))
+        {
+            if (harp_isnan(value_a) && harp_isnan(value_b))
+            {
+                continue;
+            }
+        }
+        else if (value_a == value_b)
+        {
+            continue;
+        }
+        else if (tolerance > 0)
+        {
+            scale = fabs(value_a) > fabs(value_b) ? fabs(value_a) : fabs(value_b);
+            if (fabs(value_a - value_b) <= tolerance * scale)
+            {
+                continue;
+            }
+        }
+        fprintf(stderr, "variable '%s' differs at index %ld (%.17g != %.17g)\n", variable_a->name, i, value_a,
+                value_b);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Compare the dimensions and variables of two products (see test_compare_variables() for the use of 'tolerance') */
+int test_compare_products(const harp_product *product_a, const harp_product *product_b, double tolerance)
+{
+    int i;
+
+    for (i = 0; i < HARP_NUM_DIM_TYPES; i++)
+    {
+        if (product_a->dimension[i] != product_b->dimension[i])
+        {
+            fprintf(stderr, "products differ in length of dimension %s\n",
+                    harp_get_dimension_type_name((harp_dimension_type)i));
+            return -1;
+        }
+    }
+    if (product_a->num_variables != product_b->num_variables)
+    {
+        fprintf(stderr, "products differ in number of variables (%d != %d)\n", product_a->num_variables,
+                product_b->num_variables);
+        return -1;
+    }
+    for (i = 0; i < product_a->num_variables; i++)
+    {
+        harp_variable *variable_b;
+
+        if (harp_product_get_variable_by_name(product_b, product_a->variable[i]->name, &variable_b) != 0)
+        {
+            fprintf(stderr, "variable '%s' is missing\n", product_a->variable[i]->name);
+            return -1;
+        }
+        if (test_compare_variables(product_a->variable[i], variable_b, tolerance) != 0)
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
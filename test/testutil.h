@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2015-2025 S[&]T, The Netherlands.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+
+#include "harp.h"
+
+/* Verify a condition in a test; on failure the condition is reported and the test function returns -1 */
+#define TEST_ASSERT(condition) \
+    do { if (!(condition)) { test_fail(#condition, __FILE__, __LINE__); return -1; } } while (0)
+
+/* Verify that a HARP call succeeds; on failure the HARP error is reported and the test function returns -1 */
+#define TEST_CALL(call) \
+    do { if ((call) != 0) { test_fail_harp(#call, __FILE__, __LINE__); return -1; } } while (0)
+
+void test_fail(const char *condition, const char *file, unsigned int line);
+void test_fail_harp(const char *call, const char *file, unsigned int line);
+
+int test_add_variable(harp_product *product, const char *name, harp_data_type data_type, int num_dimensions,
+                      const harp_dimension_type *dimension_type, const long *dimension, const char *unit,
+                      const void *data);
+int test_compare_variables(const harp_variable *variable_a, const harp_variable *variable_b, double tolerance);
+int test_compare_products(const harp_product *product_a, const harp_product *product_b, double tolerance);
+
+#endif
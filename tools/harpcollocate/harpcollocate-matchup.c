@@ -40,6 +40,16 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#define NEAREST_PAIR_BLOCK_SIZE 1024
+#define MATCHUP_CHUNK_BLOCK_SIZE 1024
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
 int resample_nearest_a(harp_collocation_result *collocation_result, int difference_index);
 int resample_nearest_b(harp_collocation_result *collocation_result, int difference_index);
@@ -63,6 +73,27 @@ typedef struct cache_variables_struct
     harp_variable **criterium;  /* references */
 } cache_variables;
 
+typedef struct matchup_index_entry_struct
+{
+    double datetime;
+    long sample_index;
+} matchup_index_entry;
+
+/* Index on the samples of a dataset B product that allows to quickly find the samples that are within the datetime
+ * and point_distance criteria of a sample from dataset A.
+ * Samples are grouped in a regular latitude/longitude grid and are sorted by datetime within each grid cell.
+ * An additional last cell contains all samples for which the latitude is outside the [-90,90] range (or infinite).
+ */
+typedef struct matchup_index_struct
+{
+    long num_latitude_cells;
+    long num_longitude_cells;
+    double latitude_cell_size;  /* [degree] */
+    double longitude_cell_size; /* [degree] */
+    long *cell_offset;  /* offset of the first entry of each cell (num_cells + 2 elements) */
+    matchup_index_entry *entry;
+} matchup_index;
+
 typedef struct collocation_info_struct
 {
     /* options */
@@ -79,6 +110,14 @@ typedef struct collocation_info_struct
     const char *ingest_options_b;
     const char *operations_a;
     const char *operations_b;
+    harp_program *program_a;    /* compiled operations_a (NULL if there are no operations) */
+    harp_program *program_b;    /* compiled operations_b (NULL if there are no operations) */
+
+    int use_matchup_index;      /* use index on dataset B products instead of comparing all sample pairs */
+    int write_binary;   /* write the collocation result in binary format instead of csv */
+    int num_threads;    /* number of threads to use for matching the samples of a pair of products */
+    double datetime_max_difference;     /* [s] maximum datetime difference for the matchup index */
+    double point_distance_max_angle;    /* [degree] maximum angular distance for the matchup index */
 
     int perform_nearest_neighbour_x_first;
     char *nearest_neighbour_x_variable_name;
@@ -95,6 +134,15 @@ typedef struct collocation_info_struct
     long product_a_index;
     harp_product *product_a;    /* we only have one product of dataset A loaded at any moment */
     harp_product **product_b;   /* for dataset B we may have multiple products loaded */
+    matchup_index **index_b;    /* matchup index for each loaded product of dataset B */
+    long *candidate;    /* buffer for the candidate sample indices of a dataset B product */
+    long candidate_size;
+    long num_nearest_pair_products;     /* number of products in the dataset of the first nearest neighbour filter */
+    long **nearest_pair;        /* position in the collocation result of the nearest pair for each 'index' value */
+    long *nearest_pair_size;    /* number of elements in nearest_pair for each product */
+    uint8_t *pair_mask; /* for each pair in the collocation result: 0 if it got replaced by a nearer pair */
+    long pair_mask_size;
+    long num_removed_pairs;
     harp_dataset *dataset_a;
     harp_dataset *dataset_b;
 
@@ -227,6 +275,22 @@ static int collocation_criterium_set_unit(collocation_criterium *criterium, cons
     return 0;
 }
 
+static void matchup_index_delete(matchup_index *index)
+{
+    if (index != NULL)
+    {
+        if (index->cell_offset != NULL)
+        {
+            free(index->cell_offset);
+        }
+        if (index->entry != NULL)
+        {
+            free(index->entry);
+        }
+        free(index);
+    }
+}
+
 static void collocation_info_delete(collocation_info *info)
 {
     int i;
@@ -256,6 +320,14 @@ static void collocation_info_delete(collocation_info *info)
         {
             harp_collocation_result_delete(info->collocation_result);
         }
+        if (info->program_a != NULL)
+        {
+            harp_program_delete(info->program_a);
+        }
+        if (info->program_b != NULL)
+        {
+            harp_program_delete(info->program_b);
+        }
         if (info->sorted_index_a != NULL)
         {
             free(info->sorted_index_a);
@@ -280,6 +352,41 @@ static void collocation_info_delete(collocation_info *info)
             }
             free(info->product_b);
         }
+        if (info->index_b != NULL)
+        {
+            assert(info->dataset_b != NULL);
+            for (i = 0; i < info->dataset_b->num_products; i++)
+            {
+                if (info->index_b[i] != NULL)
+                {
+                    matchup_index_delete(info->index_b[i]);
+                }
+            }
+            free(info->index_b);
+        }
+        if (info->candidate != NULL)
+        {
+            free(info->candidate);
+        }
+        if (info->nearest_pair != NULL)
+        {
+            for (i = 0; i < info->num_nearest_pair_products; i++)
+            {
+                if (info->nearest_pair[i] != NULL)
+                {
+                    free(info->nearest_pair[i]);
+                }
+            }
+            free(info->nearest_pair);
+        }
+        if (info->nearest_pair_size != NULL)
+        {
+            free(info->nearest_pair_size);
+        }
+        if (info->pair_mask != NULL)
+        {
+            free(info->pair_mask);
+        }
         if (info->dataset_a != NULL)
         {
             harp_dataset_delete(info->dataset_a);
@@ -361,6 +468,12 @@ static int collocation_info_new(collocation_info **new_info)
     info->ingest_options_b = NULL;
     info->operations_a = NULL;
     info->operations_b = NULL;
+    info->program_a = NULL;
+    info->program_b = NULL;
+    info->use_matchup_index = 1;
+    info->write_binary = 0;
+    info->datetime_max_difference = harp_plusinf();
+    info->point_distance_max_angle = harp_plusinf();
     info->perform_nearest_neighbour_x_first = 0;
     info->nearest_neighbour_x_variable_name = NULL;
     info->nearest_neighbour_x_criterium_index = -1;
@@ -372,6 +485,16 @@ static int collocation_info_new(collocation_info **new_info)
     info->product_a_index = -1;
     info->product_a = NULL;
     info->product_b = NULL;
+    info->index_b = NULL;
+    info->num_threads = 1;
+    info->candidate = NULL;
+    info->candidate_size = 0;
+    info->num_nearest_pair_products = 0;
+    info->nearest_pair = NULL;
+    info->nearest_pair_size = NULL;
+    info->pair_mask = NULL;
+    info->pair_mask_size = 0;
+    info->num_removed_pairs = 0;
     info->dataset_a = NULL;
     info->dataset_b = NULL;
     info->variables_a.index = NULL;
@@ -609,6 +732,10 @@ static int collocation_info_update(collocation_info *info)
             {
                 return -1;
             }
+            /* the window for the matchup index is slightly widened to be robust against rounding errors */
+            info->datetime_max_difference = info->criterium[info->datetime_index]->value /
+                info->datetime_conversion_factor;
+            info->datetime_max_difference += 1.0e-6 * (1.0 + info->datetime_max_difference);
             break;
         }
     }
@@ -623,6 +750,21 @@ static int collocation_info_update(collocation_info *info)
             {
                 return -1;
             }
+            if (info->criterium[info->point_distance_index]->value < harp_plusinf())
+            {
+                double quarter_circumference;
+
+                /* derive the earth radius from the distance function itself so the index matches the criterium */
+                if (harp_geometry_get_point_distance(0, 0, 0, 90, &quarter_circumference) != 0)
+                {
+                    return -1;
+                }
+                info->point_distance_max_angle = 90.0 * (info->criterium[info->point_distance_index]->value /
+                                                         info->point_distance_conversion_factor) /
+                    quarter_circumference;
+                /* widen the angle to be robust against the limited precision of the distance calculation */
+                info->point_distance_max_angle += 1.0e-4 + 1.0e-6 * info->point_distance_max_angle;
+            }
             break;
         }
     }
@@ -703,6 +845,64 @@ static int collocation_info_update(collocation_info *info)
         {
             info->product_b[i] = NULL;
         }
+
+        if (info->datetime_index < 0 && info->point_distance_index < 0)
+        {
+            /* without datetime or point_distance criteria there is nothing to index on */
+            info->use_matchup_index = 0;
+        }
+        if (info->use_matchup_index)
+        {
+            info->index_b = malloc(info->dataset_b->num_products * sizeof(matchup_index *));
+            if (info->index_b == NULL)
+            {
+                harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                               info->dataset_b->num_products * sizeof(matchup_index *), __FILE__, __LINE__);
+                return -1;
+            }
+            for (i = 0; i < info->dataset_b->num_products; i++)
+            {
+                info->index_b[i] = NULL;
+            }
+        }
+    }
+
+    if (info->nearest_neighbour_x_criterium_index >= 0 || info->nearest_neighbour_y_criterium_index >= 0)
+    {
+        /* lookup table for the first nearest neighbour filter */
+        if (info->perform_nearest_neighbour_x_first)
+        {
+            info->num_nearest_pair_products = info->dataset_a->num_products;
+        }
+        else
+        {
+            info->num_nearest_pair_products = info->dataset_b->num_products;
+        }
+        if (info->num_nearest_pair_products > 0)
+        {
+            info->nearest_pair = malloc(info->num_nearest_pair_products * sizeof(long *));
+            if (info->nearest_pair == NULL)
+            {
+                harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                               info->num_nearest_pair_products * sizeof(long *), __FILE__, __LINE__);
+                return -1;
+            }
+            for (i = 0; i < info->num_nearest_pair_products; i++)
+            {
+                info->nearest_pair[i] = NULL;
+            }
+            info->nearest_pair_size = malloc(info->num_nearest_pair_products * sizeof(long));
+            if (info->nearest_pair_size == NULL)
+            {
+                harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                               info->num_nearest_pair_products * sizeof(long), __FILE__, __LINE__);
+                return -1;
+            }
+            for (i = 0; i < info->num_nearest_pair_products; i++)
+            {
+                info->nearest_pair_size[i] = 0;
+            }
+        }
     }
 
     /* set the differences for the collocation result */
@@ -803,11 +1003,62 @@ static void reindex_collocation_indices(harp_collocation_result *collocation_res
 
     for (i = 0; i < collocation_result->num_pairs; i++)
     {
-        collocation_result->pair[i]->collocation_index = i;
+        collocation_result->collocation_index[i] = i;
     }
 }
 
-static int perform_matchup_on_measurements(collocation_info *info, long index_a, long product_b_index, long index_b)
+/* Get a reference to the entry in the nearest neighbour lookup table for the given product and sample.
+ * The entry contains the position of the current nearest pair in the collocation result, or -1 if there is none.
+ */
+static int get_nearest_pair(collocation_info *info, long product_index, long sample_index, long **nearest_pair)
+{
+    assert(product_index >= 0 && product_index < info->num_nearest_pair_products);
+
+    if (sample_index < 0)
+    {
+        harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "invalid value for 'index' variable (%ld)", sample_index);
+        return -1;
+    }
+    if (sample_index >= info->nearest_pair_size[product_index])
+    {
+        long new_size = 2 * info->nearest_pair_size[product_index];
+        long *nearest_pair_list;
+        long i;
+
+        if (new_size < NEAREST_PAIR_BLOCK_SIZE)
+        {
+            new_size = NEAREST_PAIR_BLOCK_SIZE;
+        }
+        if (new_size <= sample_index)
+        {
+            new_size = sample_index + 1;
+        }
+        nearest_pair_list = realloc(info->nearest_pair[product_index], new_size * sizeof(long));
+        if (nearest_pair_list == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           new_size * sizeof(long), __FILE__, __LINE__);
+            return -1;
+        }
+        for (i = info->nearest_pair_size[product_index]; i < new_size; i++)
+        {
+            nearest_pair_list[i] = -1;
+        }
+        info->nearest_pair[product_index] = nearest_pair_list;
+        info->nearest_pair_size[product_index] = new_size;
+    }
+
+    *nearest_pair = &info->nearest_pair[product_index][sample_index];
+
+    return 0;
+}
+
+/* Determine whether sample 'index_a' of product A matches with sample 'index_b' of the current dataset B product.
+ * The differences for all criteria are stored in 'difference'.
+ * This function only reads from 'info' and can therefore be called concurrently from multiple threads.
+ */
+static int evaluate_measurements(const collocation_info *info, long index_a, long index_b, double *difference,
+                                 int *is_match)
 {
     double *longitude_bounds_a;
     double *latitude_bounds_a;
@@ -817,7 +1068,6 @@ static int perform_matchup_on_measurements(collocation_info *info, long index_a,
     double longitude_a;
     double latitude_b;
     double longitude_b;
-    long collocation_index;
     int num_vertices_a;
     int num_vertices_b;
     int i;
@@ -831,44 +1081,45 @@ static int perform_matchup_on_measurements(collocation_info *info, long index_a,
             latitude_b = info->variables_b.latitude->data.double_data[index_b];
             longitude_b = info->variables_b.longitude->data.double_data[index_b];
 
-            if (harp_geometry_get_point_distance(latitude_a, longitude_a, latitude_b, longitude_b, &info->difference[i])
+            if (harp_geometry_get_point_distance(latitude_a, longitude_a, latitude_b, longitude_b, &difference[i])
                 != 0)
             {
                 return -1;
             }
-            info->difference[i] *= info->point_distance_conversion_factor;
+            difference[i] *= info->point_distance_conversion_factor;
         }
         else
         {
-            info->difference[i] = info->variables_a.criterium[i]->data.double_data[index_a] -
+            difference[i] = info->variables_a.criterium[i]->data.double_data[index_a] -
                 info->variables_b.criterium[i]->data.double_data[index_b];
             if (i == info->datetime_index)
             {
-                info->difference[i] *= info->datetime_conversion_factor;
+                difference[i] *= info->datetime_conversion_factor;
             }
         }
         if (info->criterium[i]->use_modulo)
         {
-            while (info->difference[i] > info->criterium[i]->modulo_value)
+            while (difference[i] > info->criterium[i]->modulo_value)
             {
-                info->difference[i] -= info->criterium[i]->modulo_value;
+                difference[i] -= info->criterium[i]->modulo_value;
             }
-            if (info->difference[i] > info->criterium[i]->modulo_value / 2)
+            if (difference[i] > info->criterium[i]->modulo_value / 2)
             {
-                info->difference[i] = info->criterium[i]->modulo_value - info->difference[i];
+                difference[i] = info->criterium[i]->modulo_value - difference[i];
             }
-            while (info->difference[i] < -info->criterium[i]->modulo_value)
+            while (difference[i] < -info->criterium[i]->modulo_value)
             {
-                info->difference[i] += info->criterium[i]->modulo_value;
+                difference[i] += info->criterium[i]->modulo_value;
             }
-            if (info->difference[i] < -info->criterium[i]->modulo_value / 2)
+            if (difference[i] < -info->criterium[i]->modulo_value / 2)
             {
-                info->difference[i] = -info->criterium[i]->modulo_value - info->difference[i];
+                difference[i] = -info->criterium[i]->modulo_value - difference[i];
             }
         }
         /* we use !(x<=y) instead of x>y so a NaN value for the difference will also result in a mismatch */
-        if (!(fabs(info->difference[i]) <= info->criterium[i]->value))
+        if (!(fabs(difference[i]) <= info->criterium[i]->value))
         {
+            *is_match = 0;
             return 0;
         }
     }
@@ -889,6 +1140,7 @@ static int perform_matchup_on_measurements(collocation_info *info, long index_a,
         }
         if (!in_area)
         {
+            *is_match = 0;
             return 0;
         }
     }
@@ -908,6 +1160,7 @@ static int perform_matchup_on_measurements(collocation_info *info, long index_a,
         }
         if (!in_area)
         {
+            *is_match = 0;
             return 0;
         }
     }
@@ -929,14 +1182,26 @@ static int perform_matchup_on_measurements(collocation_info *info, long index_a,
         }
         if (!has_overlap)
         {
+            *is_match = 0;
             return 0;
         }
     }
+    *is_match = 1;
+
+    return 0;
+}
+
+/* Add a matching pair to the collocation result (taking the first nearest neighbour filter into account) */
+static int add_matching_pair(collocation_info *info, long index_a, long product_b_index, long index_b,
+                             const double *difference)
+{
+    long *nearest_pair = NULL;
+    long collocation_index;
+    long last_pair;
 
     if (info->nearest_neighbour_x_criterium_index >= 0 || info->nearest_neighbour_y_criterium_index >= 0)
     {
-        long product_index;
-        long sample_index;
+        int criterium_index;
 
         /* replace any pair that is not closer for the first nearest neighbour criterium */
         /* since we apply a nearest filter there can only be at most one pair in the collocation result matching */
@@ -945,239 +1210,992 @@ static int perform_matchup_on_measurements(collocation_info *info, long index_a,
         {
             /* select nearest x */
             assert(info->nearest_neighbour_x_criterium_index >= 0);
-
-            if (harp_dataset_has_product(info->collocation_result->dataset_a, info->product_a->source_product))
+            criterium_index = info->nearest_neighbour_x_criterium_index;
+            if (get_nearest_pair(info, info->product_a_index, info->variables_a.index->data.int32_data[index_a],
+                                 &nearest_pair) != 0)
             {
-                if (harp_dataset_get_index_from_source_product(info->collocation_result->dataset_a,
-                                                               info->product_a->source_product, &product_index) != 0)
-                {
-                    return -1;
-                }
-                sample_index = info->variables_a.index->data.int32_data[index_a];
-
-                for (i = 0; i < info->collocation_result->num_pairs; i++)
-                {
-                    harp_collocation_pair *pair = info->collocation_result->pair[i];
-
-                    if (pair->product_index_a == product_index && pair->sample_index_a == sample_index)
-                    {
-                        if (fabs(pair->difference[info->nearest_neighbour_x_criterium_index]) <=
-                            fabs(info->difference[info->nearest_neighbour_x_criterium_index]))
-                        {
-                            /* existing pair is closer -> ignore the new pair */
-                            return 0;
-                        }
-                        /* new pair is closer, remove existing one */
-                        if (harp_collocation_result_remove_pair_at_index(info->collocation_result, i) != 0)
-                        {
-                            return -1;
-                        }
-                        /* stop the search and immediately continue with adding the new pair */
-                        break;
-                    }
-                }
+                return -1;
             }
         }
         else
         {
             /* select nearest y */
             assert(info->nearest_neighbour_y_criterium_index >= 0);
-
-            if (harp_dataset_has_product(info->collocation_result->dataset_b,
-                                         info->product_b[product_b_index]->source_product))
+            criterium_index = info->nearest_neighbour_y_criterium_index;
+            if (get_nearest_pair(info, product_b_index, info->variables_b.index->data.int32_data[index_b],
+                                 &nearest_pair) != 0)
             {
-                if (harp_dataset_get_index_from_source_product(info->collocation_result->dataset_b,
-                                                               info->product_b[product_b_index]->source_product,
-                                                               &product_index) != 0)
-                {
-                    return -1;
-                }
-                sample_index = info->variables_b.index->data.int32_data[index_b];
-
-                for (i = 0; i < info->collocation_result->num_pairs; i++)
-                {
-                    harp_collocation_pair *pair = info->collocation_result->pair[i];
-
-                    if (pair->product_index_b == product_index && pair->sample_index_b == sample_index)
-                    {
-                        if (fabs(pair->difference[info->nearest_neighbour_y_criterium_index]) <=
-                            fabs(info->difference[info->nearest_neighbour_y_criterium_index]))
-                        {
-                            /* existing pair is closer -> ignore the new pair */
-                            return 0;
-                        }
-                        /* new pair is closer, remove existing one */
-                        if (harp_collocation_result_remove_pair_at_index(info->collocation_result, i) != 0)
-                        {
-                            return -1;
-                        }
-                        /* stop the search and immediately continue with adding the new pair */
-                        break;
-                    }
-                }
+                return -1;
+            }
+        }
+        if (*nearest_pair >= 0)
+        {
+            if (fabs(info->collocation_result->difference[*nearest_pair * info->collocation_result->num_differences +
+                                                          criterium_index]) <= fabs(difference[criterium_index]))
+            {
+                /* existing pair is closer -> ignore the new pair */
+                return 0;
             }
+            /* new pair is closer, mark existing one as removed (the collocation result is compacted at the end) */
+            info->pair_mask[*nearest_pair] = 0;
+            info->num_removed_pairs++;
         }
         /* the second nearest neighbour criterium, if it exists, can only be avaluated at the end of the collocation */
     }
 
     /* add new pair to result */
-    if (info->collocation_result->num_pairs == 0)
+    last_pair = info->collocation_result->num_pairs - 1;
+    while (last_pair >= 0 && info->pair_mask != NULL && !info->pair_mask[last_pair])
+    {
+        last_pair--;
+    }
+    if (last_pair < 0)
     {
         collocation_index = 0;
     }
     else
     {
-        collocation_index =
-            info->collocation_result->pair[info->collocation_result->num_pairs - 1]->collocation_index + 1;
+        collocation_index = info->collocation_result->collocation_index[last_pair] + 1;
     }
     if (harp_collocation_result_add_pair(info->collocation_result, collocation_index, info->product_a->source_product,
                                          info->variables_a.index->data.int32_data[index_a],
                                          info->product_b[product_b_index]->source_product,
                                          info->variables_b.index->data.int32_data[index_b], info->num_criteria,
-                                         info->difference) != 0)
+                                         difference) != 0)
     {
         return -1;
     }
-
-    return 0;
-}
-
-static int perform_matchup_on_products(collocation_info *info, long product_b_index)
-{
-    long i, j;
-
-    for (i = 0; i < info->product_a->dimension[harp_dimension_time]; i++)
+    if (nearest_pair != NULL)
     {
-        for (j = 0; j < info->product_b[product_b_index]->dimension[harp_dimension_time]; j++)
+        if (info->collocation_result->num_pairs > info->pair_mask_size)
         {
-            if (perform_matchup_on_measurements(info, i, product_b_index, j) != 0)
+            long new_size = 2 * info->pair_mask_size;
+            uint8_t *pair_mask;
+
+            if (new_size < NEAREST_PAIR_BLOCK_SIZE)
             {
-                harp_add_error_message(" (comparing %s [index=%ld] against %s [index=%ld])",
-                                       info->dataset_a->metadata[info->product_a_index]->filename,
-                                       info->variables_a.index->data.int32_data[i],
-                                       info->dataset_b->metadata[product_b_index]->filename,
-                                       info->variables_b.index->data.int32_data[j]);
+                new_size = NEAREST_PAIR_BLOCK_SIZE;
+            }
+            pair_mask = realloc(info->pair_mask, new_size * sizeof(uint8_t));
+            if (pair_mask == NULL)
+            {
+                harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                               new_size * sizeof(uint8_t), __FILE__, __LINE__);
                 return -1;
             }
+            info->pair_mask = pair_mask;
+            info->pair_mask_size = new_size;
         }
+        info->pair_mask[info->collocation_result->num_pairs - 1] = 1;
+        *nearest_pair = info->collocation_result->num_pairs - 1;
     }
 
     return 0;
 }
 
-static int remove_unused_variables(collocation_info *info, harp_product *product, int include_latlon,
-                                   int include_latlon_bounds)
+static int perform_matchup_on_measurements(collocation_info *info, long index_a, long product_b_index, long index_b)
 {
-    uint8_t *included;
-    int index;
-    int i;
+    int is_match;
 
-    included = (uint8_t *)malloc(product->num_variables);
-    if (included == NULL)
+    if (evaluate_measurements(info, index_a, index_b, info->difference, &is_match) != 0)
     {
-        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
-                       product->num_variables * sizeof(uint8_t), __FILE__, __LINE__);
         return -1;
     }
-
-    /* assume all variables are excluded */
-    for (i = 0; i < product->num_variables; i++)
+    if (!is_match)
     {
-        included[i] = 0;
+        return 0;
     }
 
-    /* always keep 'index' variable */
-    if (harp_product_get_variable_index_by_name(product, "index", &index) != 0)
-    {
-        free(included);
-        return -1;
-    }
-    included[index] = 1;
+    return add_matching_pair(info, index_a, product_b_index, index_b, info->difference);
+}
 
-    /* set the 'keep' flags in the mask */
-    for (i = 0; i < info->num_criteria; i++)
+static int compare_matchup_index_entry(const void *a, const void *b)
+{
+    const matchup_index_entry *entry_a = (const matchup_index_entry *)a;
+    const matchup_index_entry *entry_b = (const matchup_index_entry *)b;
+
+    if (entry_a->datetime < entry_b->datetime)
     {
-        if (i == info->point_distance_index)
-        {
-            continue;
-        }
-        if (harp_product_get_variable_index_by_name(product, info->criterium[i]->variable_name, &index) != 0)
-        {
-            free(included);
-            return -1;
-        }
-        included[index] = 1;
+        return -1;
     }
-
-    if (include_latlon)
+    if (entry_a->datetime > entry_b->datetime)
     {
-        if (harp_product_get_variable_index_by_name(product, "latitude", &index) != 0)
-        {
-            free(included);
-            return -1;
-        }
-        included[index] = 1;
-        if (harp_product_get_variable_index_by_name(product, "longitude", &index) != 0)
-        {
-            free(included);
-            return -1;
-        }
-        included[index] = 1;
+        return 1;
     }
-    if (include_latlon_bounds)
+    if (entry_a->sample_index < entry_b->sample_index)
     {
-        if (harp_product_get_variable_index_by_name(product, "latitude_bounds", &index) != 0)
-        {
-            free(included);
-            return -1;
-        }
-        included[index] = 1;
-        if (harp_product_get_variable_index_by_name(product, "longitude_bounds", &index) != 0)
-        {
-            free(included);
-            return -1;
-        }
-        included[index] = 1;
+        return -1;
     }
-
-    /* filter the variables using the mask */
-    for (i = product->num_variables - 1; i >= 0; i--)
+    if (entry_a->sample_index > entry_b->sample_index)
     {
-        if (!included[i])
-        {
-            if (harp_product_remove_variable(product, product->variable[i]) != 0)
-            {
-                free(included);
-                return -1;
-            }
-        }
+        return 1;
     }
+    return 0;
+}
 
-    free(included);
+static int compare_long(const void *a, const void *b)
+{
+    long value_a = *(const long *)a;
+    long value_b = *(const long *)b;
 
-    return 0;
+    return (value_a > value_b) - (value_a < value_b);
 }
 
-static int filter_product(collocation_info *info, harp_product *product, int is_dataset_a)
+static long get_matchup_index_longitude_cell(const matchup_index *index, double longitude)
 {
-    harp_dimension_type dimension_type[2] = { harp_dimension_time, harp_dimension_independent };
-    harp_data_type data_type;
-    int include_latlon_bounds;
-    int include_latlon;
-    long i;
+    long cell;
 
-    if (is_dataset_a)
+    longitude = fmod(longitude + 180.0, 360.0);
+    if (longitude < 0)
     {
-        include_latlon = info->point_distance_index >= 0 || info->filter_point_in_area_xy;
-        include_latlon_bounds = info->filter_area_intersects || info->filter_point_in_area_yx;
+        longitude += 360.0;
     }
-    else
+    cell = (long)(longitude / index->longitude_cell_size);
+    if (cell >= index->num_longitude_cells)
     {
-        include_latlon = info->point_distance_index >= 0 || info->filter_point_in_area_yx;
-        include_latlon_bounds = info->filter_area_intersects || info->filter_point_in_area_xy;
+        cell = index->num_longitude_cells - 1;
     }
 
-    /* make sure that we have an 'index' variable */
+    return cell;
+}
+
+static long get_matchup_index_latitude_cell(const matchup_index *index, double latitude)
+{
+    long cell;
+
+    cell = (long)floor((latitude + 90.0) / index->latitude_cell_size);
+    if (cell < 0)
+    {
+        cell = 0;
+    }
+    if (cell >= index->num_latitude_cells)
+    {
+        cell = index->num_latitude_cells - 1;
+    }
+
+    return cell;
+}
+
+/* Create a matchup index for the product of dataset B for which the variables are provided in 'cache'.
+ * Samples that can never match (because the datetime or point_distance difference would be NaN) are left out.
+ */
+static int matchup_index_new(collocation_info *info, cache_variables *cache, long num_samples,
+                             matchup_index **new_index)
+{
+    matchup_index *index;
+    long *cell;
+    long num_cells;
+    long i;
+
+    index = (matchup_index *)malloc(sizeof(matchup_index));
+    if (index == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       sizeof(matchup_index), __FILE__, __LINE__);
+        return -1;
+    }
+    index->num_latitude_cells = 1;
+    index->num_longitude_cells = 1;
+    index->latitude_cell_size = 180.0;
+    index->longitude_cell_size = 360.0;
+    index->cell_offset = NULL;
+    index->entry = NULL;
+
+    if (info->point_distance_index >= 0 && info->point_distance_max_angle < 90.0 && num_samples > 0)
+    {
+        double cell_size;
+
+        /* use cells that are at least as large as the search radius, but limit the number of cells to the number of
+         * samples in the product */
+        cell_size = sqrt(180.0 * 360.0 / num_samples);
+        if (cell_size < info->point_distance_max_angle)
+        {
+            cell_size = info->point_distance_max_angle;
+        }
+        index->num_latitude_cells = (long)(180.0 / cell_size);
+        if (index->num_latitude_cells < 1)
+        {
+            index->num_latitude_cells = 1;
+        }
+        index->num_longitude_cells = (long)(360.0 / cell_size);
+        if (index->num_longitude_cells < 1)
+        {
+            index->num_longitude_cells = 1;
+        }
+        index->latitude_cell_size = 180.0 / index->num_latitude_cells;
+        index->longitude_cell_size = 360.0 / index->num_longitude_cells;
+    }
+    num_cells = index->num_latitude_cells * index->num_longitude_cells;
+
+    index->cell_offset = malloc((num_cells + 2) * sizeof(long));
+    if (index->cell_offset == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (num_cells + 2) * sizeof(long), __FILE__, __LINE__);
+        matchup_index_delete(index);
+        return -1;
+    }
+    for (i = 0; i < num_cells + 2; i++)
+    {
+        index->cell_offset[i] = 0;
+    }
+
+    if (num_samples > 0)
+    {
+        index->entry = malloc(num_samples * sizeof(matchup_index_entry));
+        if (index->entry == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_samples * sizeof(matchup_index_entry), __FILE__, __LINE__);
+            matchup_index_delete(index);
+            return -1;
+        }
+    }
+
+    cell = malloc((num_samples > 0 ? num_samples : 1) * sizeof(long));
+    if (cell == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_samples * sizeof(long), __FILE__, __LINE__);
+        matchup_index_delete(index);
+        return -1;
+    }
+
+    /* determine the cell for each sample (-1 if the sample can never match) */
+    for (i = 0; i < num_samples; i++)
+    {
+        cell[i] = 0;
+        if (info->datetime_index >= 0 && harp_isnan(cache->criterium[info->datetime_index]->data.double_data[i]))
+        {
+            cell[i] = -1;
+        }
+        else if (info->point_distance_index >= 0)
+        {
+            double latitude = cache->latitude->data.double_data[i];
+            double longitude = cache->longitude->data.double_data[i];
+
+            if (harp_isnan(latitude) || harp_isnan(longitude))
+            {
+                cell[i] = -1;
+            }
+            else if (!(latitude >= -90.0 && latitude <= 90.0) || !harp_isfinite(longitude))
+            {
+                cell[i] = num_cells;
+            }
+            else
+            {
+                cell[i] = get_matchup_index_latitude_cell(index, latitude) * index->num_longitude_cells +
+                    get_matchup_index_longitude_cell(index, longitude);
+            }
+        }
+        if (cell[i] >= 0)
+        {
+            index->cell_offset[cell[i] + 1]++;
+        }
+    }
+    for (i = 0; i < num_cells + 1; i++)
+    {
+        index->cell_offset[i + 1] += index->cell_offset[i];
+    }
+    for (i = 0; i < num_samples; i++)
+    {
+        if (cell[i] >= 0)
+        {
+            matchup_index_entry *entry = &index->entry[index->cell_offset[cell[i]]];
+
+            entry->datetime = 0;
+            if (info->datetime_index >= 0)
+            {
+                entry->datetime = cache->criterium[info->datetime_index]->data.double_data[i];
+            }
+            entry->sample_index = i;
+            index->cell_offset[cell[i]]++;
+        }
+    }
+    /* restore the cell offsets */
+    for (i = num_cells; i > 0; i--)
+    {
+        index->cell_offset[i] = index->cell_offset[i - 1];
+    }
+    index->cell_offset[0] = 0;
+    free(cell);
+
+    if (info->datetime_index >= 0)
+    {
+        for (i = 0; i < num_cells + 1; i++)
+        {
+            long num_entries = index->cell_offset[i + 1] - index->cell_offset[i];
+
+            if (num_entries > 1)
+            {
+                qsort(&index->entry[index->cell_offset[i]], num_entries, sizeof(matchup_index_entry),
+                      compare_matchup_index_entry);
+            }
+        }
+    }
+
+    *new_index = index;
+
+    return 0;
+}
+
+/* Add all samples from a single cell of the index that are within the datetime window to the list of candidates */
+static void matchup_index_add_cell_candidates(const matchup_index *index, long cell, int use_datetime,
+                                              double datetime_min, double datetime_max, long *candidate,
+                                              long *num_candidates)
+{
+    long first = index->cell_offset[cell];
+    long last = index->cell_offset[cell + 1];
+    long i;
+
+    if (use_datetime)
+    {
+        long upper = last;
+
+        /* binary search for the first entry with datetime >= datetime_min */
+        while (first < upper)
+        {
+            long middle = first + (upper - first) / 2;
+
+            if (index->entry[middle].datetime < datetime_min)
+            {
+                first = middle + 1;
+            }
+            else
+            {
+                upper = middle;
+            }
+        }
+    }
+    for (i = first; i < last; i++)
+    {
+        if (use_datetime && index->entry[i].datetime > datetime_max)
+        {
+            break;
+        }
+        candidate[*num_candidates] = index->entry[i].sample_index;
+        (*num_candidates)++;
+    }
+}
+
+/* Find the samples of the indexed dataset B product that can potentially match with sample 'index_a' of product A.
+ * The candidate list is conservative (it may contain samples that do not match) and is sorted by sample index, such
+ * that evaluating the candidates gives exactly the same result as comparing against all samples.
+ */
+static void matchup_index_find_candidates(const collocation_info *info, const matchup_index *index, long index_a,
+                                          long *candidate, long *num_candidates)
+{
+    double datetime_min = 0;
+    double datetime_max = 0;
+    long first_latitude_cell = 0;
+    long last_latitude_cell = index->num_latitude_cells - 1;
+    long first_longitude_cell = 0;
+    long last_longitude_cell = index->num_longitude_cells - 1;
+    long num_cells = index->num_latitude_cells * index->num_longitude_cells;
+    int use_datetime = 0;
+    long i, j;
+
+    *num_candidates = 0;
+
+    if (info->datetime_index >= 0)
+    {
+        double datetime = info->variables_a.criterium[info->datetime_index]->data.double_data[index_a];
+
+        if (harp_isnan(datetime))
+        {
+            return;
+        }
+        if (info->datetime_max_difference < harp_plusinf())
+        {
+            datetime_min = datetime - info->datetime_max_difference;
+            datetime_max = datetime + info->datetime_max_difference;
+            use_datetime = 1;
+        }
+    }
+
+    if (info->point_distance_index >= 0 && num_cells > 1)
+    {
+        double latitude = info->variables_a.latitude->data.double_data[index_a];
+        double longitude = info->variables_a.longitude->data.double_data[index_a];
+        double radius = info->point_distance_max_angle;
+
+        if (harp_isnan(latitude) || harp_isnan(longitude))
+        {
+            return;
+        }
+        if (latitude >= -90.0 && latitude <= 90.0 && harp_isfinite(longitude))
+        {
+            /* the great circle distance is always at least the latitude difference */
+            first_latitude_cell = get_matchup_index_latitude_cell(index, latitude - radius);
+            last_latitude_cell = get_matchup_index_latitude_cell(index, latitude + radius);
+            if (latitude + radius < 90.0 && latitude - radius > -90.0)
+            {
+                /* maximum longitude difference of all points within the radius (cap does not contain a pole) */
+                double delta_longitude = asin(sin(radius * M_PI / 180.0) / cos(latitude * M_PI / 180.0)) *
+                    180.0 / M_PI + 1.0e-4;
+                long cell = get_matchup_index_longitude_cell(index, longitude);
+                double offset = fmod(longitude + 180.0, 360.0);
+
+                if (offset < 0)
+                {
+                    offset += 360.0;
+                }
+                offset -= cell * index->longitude_cell_size;
+                first_longitude_cell = cell + (long)floor((offset - delta_longitude) / index->longitude_cell_size);
+                last_longitude_cell = cell + (long)floor((offset + delta_longitude) / index->longitude_cell_size);
+                if (!(delta_longitude < 180.0) ||
+                    last_longitude_cell - first_longitude_cell + 1 >= index->num_longitude_cells)
+                {
+                    first_longitude_cell = 0;
+                    last_longitude_cell = index->num_longitude_cells - 1;
+                }
+            }
+        }
+    }
+
+    for (i = first_latitude_cell; i <= last_latitude_cell; i++)
+    {
+        for (j = first_longitude_cell; j <= last_longitude_cell; j++)
+        {
+            long longitude_cell = j % index->num_longitude_cells;
+
+            if (longitude_cell < 0)
+            {
+                longitude_cell += index->num_longitude_cells;
+            }
+            matchup_index_add_cell_candidates(index, i * index->num_longitude_cells + longitude_cell, use_datetime,
+                                              datetime_min, datetime_max, candidate, num_candidates);
+        }
+    }
+    /* samples with out-of-range latitudes are always candidates */
+    matchup_index_add_cell_candidates(index, num_cells, use_datetime, datetime_min, datetime_max, candidate,
+                                      num_candidates);
+
+    if (*num_candidates > 1)
+    {
+        qsort(candidate, *num_candidates, sizeof(long), compare_long);
+    }
+}
+
+#ifdef HAVE_PTHREAD_H
+/* Matching pairs that were found for a consecutive range of samples of product A */
+typedef struct matchup_chunk_struct
+{
+    long num_pairs;
+    long index_a_first; /* first sample of product A in this chunk */
+    long index_a_last;  /* last sample of product A in this chunk (exclusive) */
+    long *index_a;
+    long *index_b;
+    double *difference; /* [num_pairs, num_criteria] */
+} matchup_chunk;
+
+/* Shared state for matching the samples of product A against those of a product of dataset B using multiple threads.
+ * Each thread repeatedly takes the next unprocessed chunk of samples from product A.
+ */
+typedef struct matchup_task_struct
+{
+    const collocation_info *info;
+    long product_b_index;
+    long num_chunks;
+    matchup_chunk *chunk;
+    long next_chunk;    /* index of the next chunk that still needs to be processed */
+    int status; /* will be set to -1 if one of the threads encountered an error */
+    int error_code;      /* harp_errno of the first thread that encountered an error */
+    char *error_message; /* error message of the first thread that encountered an error */
+    pthread_mutex_t mutex;
+} matchup_task;
+
+/* Mark the task as failed. The error state of HARP is thread specific, so the error of the first failing thread is
+ * stored in the task such that it can be reported by the thread that started the matchup.
+ */
+static void matchup_task_set_error(matchup_task *task)
+{
+    pthread_mutex_lock(&task->mutex);
+    if (task->status == 0)
+    {
+        task->status = -1;
+        task->error_code = harp_errno;
+        task->error_message = strdup(harp_errno_to_string(harp_errno));
+    }
+    pthread_mutex_unlock(&task->mutex);
+}
+
+static int matchup_chunk_add_pair(matchup_chunk *chunk, int num_criteria, long index_a, long index_b,
+                                  const double *difference)
+{
+    if (chunk->num_pairs % MATCHUP_CHUNK_BLOCK_SIZE == 0)
+    {
+        long new_size = chunk->num_pairs + MATCHUP_CHUNK_BLOCK_SIZE;
+        long *index;
+        double *new_difference;
+
+        index = realloc(chunk->index_a, new_size * sizeof(long));
+        if (index == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           new_size * sizeof(long), __FILE__, __LINE__);
+            return -1;
+        }
+        chunk->index_a = index;
+        index = realloc(chunk->index_b, new_size * sizeof(long));
+        if (index == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           new_size * sizeof(long), __FILE__, __LINE__);
+            return -1;
+        }
+        chunk->index_b = index;
+        if (num_criteria > 0)
+        {
+            new_difference = realloc(chunk->difference, new_size * num_criteria * sizeof(double));
+            if (new_difference == NULL)
+            {
+                harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                               new_size * num_criteria * sizeof(double), __FILE__, __LINE__);
+                return -1;
+            }
+            chunk->difference = new_difference;
+        }
+    }
+    chunk->index_a[chunk->num_pairs] = index_a;
+    chunk->index_b[chunk->num_pairs] = index_b;
+    if (num_criteria > 0)
+    {
+        memcpy(&chunk->difference[chunk->num_pairs * num_criteria], difference, num_criteria * sizeof(double));
+    }
+    chunk->num_pairs++;
+
+    return 0;
+}
+
+static int perform_matchup_on_chunk(const collocation_info *info, long product_b_index, matchup_chunk *chunk,
+                                    long *candidate, double *difference)
+{
+    long num_samples_b = info->product_b[product_b_index]->dimension[harp_dimension_time];
+    long num_candidates = num_samples_b;
+    long i, j;
+
+    for (i = chunk->index_a_first; i < chunk->index_a_last; i++)
+    {
+        if (info->use_matchup_index)
+        {
+            matchup_index_find_candidates(info, info->index_b[product_b_index], i, candidate, &num_candidates);
+        }
+        for (j = 0; j < num_candidates; j++)
+        {
+            long index_b = info->use_matchup_index ? candidate[j] : j;
+            int is_match;
+
+            if (evaluate_measurements(info, i, index_b, difference, &is_match) != 0)
+            {
+                harp_add_error_message(" (comparing %s [index=%ld] against %s [index=%ld])",
+                                       info->dataset_a->metadata[info->product_a_index]->filename,
+                                       info->variables_a.index->data.int32_data[i],
+                                       info->dataset_b->metadata[product_b_index]->filename,
+                                       info->variables_b.index->data.int32_data[index_b]);
+                return -1;
+            }
+            if (is_match)
+            {
+                if (matchup_chunk_add_pair(chunk, info->num_criteria, i, index_b, difference) != 0)
+                {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void *matchup_worker(void *arg)
+{
+    matchup_task *task = (matchup_task *)arg;
+    const collocation_info *info = task->info;
+    long num_samples_b = info->product_b[task->product_b_index]->dimension[harp_dimension_time];
+    long *candidate = NULL;
+    double *difference;
+
+    /* each thread uses its own buffers */
+    difference = malloc((info->num_criteria > 0 ? info->num_criteria : 1) * sizeof(double));
+    if (difference == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       (info->num_criteria > 0 ? info->num_criteria : 1) * sizeof(double), __FILE__, __LINE__);
+        matchup_task_set_error(task);
+        return NULL;
+    }
+    if (info->use_matchup_index && num_samples_b > 0)
+    {
+        candidate = malloc(num_samples_b * sizeof(long));
+        if (candidate == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_samples_b * sizeof(long), __FILE__, __LINE__);
+            free(difference);
+            matchup_task_set_error(task);
+            return NULL;
+        }
+    }
+
+    for (;;)
+    {
+        long chunk_index;
+
+        pthread_mutex_lock(&task->mutex);
+        if (task->status != 0 || task->next_chunk >= task->num_chunks)
+        {
+            pthread_mutex_unlock(&task->mutex);
+            break;
+        }
+        chunk_index = task->next_chunk;
+        task->next_chunk++;
+        pthread_mutex_unlock(&task->mutex);
+
+        if (perform_matchup_on_chunk(info, task->product_b_index, &task->chunk[chunk_index], candidate, difference)
+            != 0)
+        {
+            matchup_task_set_error(task);
+            break;
+        }
+    }
+
+    if (candidate != NULL)
+    {
+        free(candidate);
+    }
+    free(difference);
+
+    return NULL;
+}
+
+/* Match all samples of product A against the samples of a product of dataset B using multiple threads.
+ * The threads only determine the matching pairs. These pairs are added to the collocation result afterwards (in the
+ * same order as they would be found by a single thread) such that the result does not depend on the number of threads.
+ */
+static int perform_matchup_on_products_threaded(collocation_info *info, long product_b_index)
+{
+    long num_samples_a = info->product_a->dimension[harp_dimension_time];
+    matchup_task task;
+    pthread_t *thread;
+    long num_threads_started = 0;
+    long num_threads;
+    long chunk_size;
+    long i, j;
+
+    /* use more chunks than threads to balance the load between threads */
+    chunk_size = (num_samples_a + 4 * info->num_threads - 1) / (4 * info->num_threads);
+    if (chunk_size < 1)
+    {
+        chunk_size = 1;
+    }
+
+    task.info = info;
+    task.product_b_index = product_b_index;
+    task.num_chunks = (num_samples_a + chunk_size - 1) / chunk_size;
+    task.next_chunk = 0;
+    task.status = 0;
+    task.error_code = 0;
+    task.error_message = NULL;
+    task.chunk = malloc(task.num_chunks * sizeof(matchup_chunk));
+    if (task.chunk == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       task.num_chunks * sizeof(matchup_chunk), __FILE__, __LINE__);
+        return -1;
+    }
+    for (i = 0; i < task.num_chunks; i++)
+    {
+        task.chunk[i].num_pairs = 0;
+        task.chunk[i].index_a_first = i * chunk_size;
+        task.chunk[i].index_a_last = (i + 1) * chunk_size;
+        if (task.chunk[i].index_a_last > num_samples_a)
+        {
+            task.chunk[i].index_a_last = num_samples_a;
+        }
+        task.chunk[i].index_a = NULL;
+        task.chunk[i].index_b = NULL;
+        task.chunk[i].difference = NULL;
+    }
+
+    num_threads = info->num_threads;
+    if (num_threads > task.num_chunks)
+    {
+        num_threads = task.num_chunks;
+    }
+    thread = malloc(num_threads * sizeof(pthread_t));
+    if (thread == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_threads * sizeof(pthread_t), __FILE__, __LINE__);
+        free(task.chunk);
+        return -1;
+    }
+
+    pthread_mutex_init(&task.mutex, NULL);
+    /* the current thread acts as one of the workers */
+    for (i = 1; i < num_threads; i++)
+    {
+        if (pthread_create(&thread[num_threads_started], NULL, matchup_worker, &task) != 0)
+        {
+            /* continue with the threads that we have */
+            break;
+        }
+        num_threads_started++;
+    }
+    matchup_worker(&task);
+    for (i = 0; i < num_threads_started; i++)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    pthread_mutex_destroy(&task.mutex);
+    free(thread);
+
+    if (task.status != 0)
+    {
+        /* report the error of the failing worker thread on the current thread */
+        if (task.error_message != NULL)
+        {
+            harp_set_error(task.error_code, "%s", task.error_message);
+            free(task.error_message);
+        }
+        else
+        {
+            harp_set_error(task.error_code, NULL);
+        }
+    }
+
+    /* add the matching pairs to the collocation result */
+    for (i = 0; i < task.num_chunks && task.status == 0; i++)
+    {
+        matchup_chunk *chunk = &task.chunk[i];
+
+        for (j = 0; j < chunk->num_pairs; j++)
+        {
+            const double *difference = NULL;
+
+            if (info->num_criteria > 0)
+            {
+                difference = &chunk->difference[j * info->num_criteria];
+            }
+            if (add_matching_pair(info, chunk->index_a[j], product_b_index, chunk->index_b[j], difference) != 0)
+            {
+                task.status = -1;
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < task.num_chunks; i++)
+    {
+        if (task.chunk[i].index_a != NULL)
+        {
+            free(task.chunk[i].index_a);
+        }
+        if (task.chunk[i].index_b != NULL)
+        {
+            free(task.chunk[i].index_b);
+        }
+        if (task.chunk[i].difference != NULL)
+        {
+            free(task.chunk[i].difference);
+        }
+    }
+    free(task.chunk);
+
+    return task.status;
+}
+#endif
+
+static int perform_matchup_on_products(collocation_info *info, long product_b_index)
+{
+    long num_samples_b = info->product_b[product_b_index]->dimension[harp_dimension_time];
+    long num_candidates;
+    long i, j;
+
+    if (info->use_matchup_index && info->index_b[product_b_index] == NULL)
+    {
+        if (matchup_index_new(info, &info->variables_b, num_samples_b, &info->index_b[product_b_index]) != 0)
+        {
+            return -1;
+        }
+    }
+#ifdef HAVE_PTHREAD_H
+    if (info->num_threads > 1 && info->product_a->dimension[harp_dimension_time] > 1)
+    {
+        return perform_matchup_on_products_threaded(info, product_b_index);
+    }
+#endif
+
+    if (!info->use_matchup_index)
+    {
+        /* compare all sample pairs */
+        for (i = 0; i < info->product_a->dimension[harp_dimension_time]; i++)
+        {
+            for (j = 0; j < num_samples_b; j++)
+            {
+                if (perform_matchup_on_measurements(info, i, product_b_index, j) != 0)
+                {
+                    harp_add_error_message(" (comparing %s [index=%ld] against %s [index=%ld])",
+                                           info->dataset_a->metadata[info->product_a_index]->filename,
+                                           info->variables_a.index->data.int32_data[i],
+                                           info->dataset_b->metadata[product_b_index]->filename,
+                                           info->variables_b.index->data.int32_data[j]);
+                    return -1;
+                }
+            }
+        }
+        return 0;
+    }
+
+    if (num_samples_b > info->candidate_size)
+    {
+        long *candidate;
+
+        candidate = realloc(info->candidate, num_samples_b * sizeof(long));
+        if (candidate == NULL)
+        {
+            harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                           num_samples_b * sizeof(long), __FILE__, __LINE__);
+            return -1;
+        }
+        info->candidate = candidate;
+        info->candidate_size = num_samples_b;
+    }
+
+    for (i = 0; i < info->product_a->dimension[harp_dimension_time]; i++)
+    {
+        matchup_index_find_candidates(info, info->index_b[product_b_index], i, info->candidate, &num_candidates);
+        for (j = 0; j < num_candidates; j++)
+        {
+            if (perform_matchup_on_measurements(info, i, product_b_index, info->candidate[j]) != 0)
+            {
+                harp_add_error_message(" (comparing %s [index=%ld] against %s [index=%ld])",
+                                       info->dataset_a->metadata[info->product_a_index]->filename,
+                                       info->variables_a.index->data.int32_data[i],
+                                       info->dataset_b->metadata[product_b_index]->filename,
+                                       info->variables_b.index->data.int32_data[info->candidate[j]]);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int remove_unused_variables(collocation_info *info, harp_product *product, int include_latlon,
+                                   int include_latlon_bounds)
+{
+    uint8_t *included;
+    int index;
+    int i;
+
+    included = (uint8_t *)malloc(product->num_variables);
+    if (included == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       product->num_variables * sizeof(uint8_t), __FILE__, __LINE__);
+        return -1;
+    }
+
+    /* assume all variables are excluded */
+    for (i = 0; i < product->num_variables; i++)
+    {
+        included[i] = 0;
+    }
+
+    /* always keep 'index' variable */
+    if (harp_product_get_variable_index_by_name(product, "index", &index) != 0)
+    {
+        free(included);
+        return -1;
+    }
+    included[index] = 1;
+
+    /* set the 'keep' flags in the mask */
+    for (i = 0; i < info->num_criteria; i++)
+    {
+        if (i == info->point_distance_index)
+        {
+            continue;
+        }
+        if (harp_product_get_variable_index_by_name(product, info->criterium[i]->variable_name, &index) != 0)
+        {
+            free(included);
+            return -1;
+        }
+        included[index] = 1;
+    }
+
+    if (include_latlon)
+    {
+        if (harp_product_get_variable_index_by_name(product, "latitude", &index) != 0)
+        {
+            free(included);
+            return -1;
+        }
+        included[index] = 1;
+        if (harp_product_get_variable_index_by_name(product, "longitude", &index) != 0)
+        {
+            free(included);
+            return -1;
+        }
+        included[index] = 1;
+    }
+    if (include_latlon_bounds)
+    {
+        if (harp_product_get_variable_index_by_name(product, "latitude_bounds", &index) != 0)
+        {
+            free(included);
+            return -1;
+        }
+        included[index] = 1;
+        if (harp_product_get_variable_index_by_name(product, "longitude_bounds", &index) != 0)
+        {
+            free(included);
+            return -1;
+        }
+        included[index] = 1;
+    }
+
+    /* filter the variables using the mask */
+    for (i = product->num_variables - 1; i >= 0; i--)
+    {
+        if (!included[i])
+        {
+            if (harp_product_remove_variable(product, product->variable[i]) != 0)
+            {
+                free(included);
+                return -1;
+            }
+        }
+    }
+
+    free(included);
+
+    return 0;
+}
+
+static int filter_product(collocation_info *info, harp_product *product, int is_dataset_a)
+{
+    harp_dimension_type dimension_type[2] = { harp_dimension_time, harp_dimension_independent };
+    harp_data_type data_type;
+    int include_latlon_bounds;
+    int include_latlon;
+    long i;
+
+    if (is_dataset_a)
+    {
+        include_latlon = info->point_distance_index >= 0 || info->filter_point_in_area_xy;
+        include_latlon_bounds = info->filter_area_intersects || info->filter_point_in_area_yx;
+    }
+    else
+    {
+        include_latlon = info->point_distance_index >= 0 || info->filter_point_in_area_yx;
+        include_latlon_bounds = info->filter_area_intersects || info->filter_point_in_area_xy;
+    }
+
+    /* make sure that we have an 'index' variable */
     data_type = harp_type_int32;
     if (harp_product_add_derived_variable(product, "index", &data_type, NULL, 1, dimension_type) != 0)
     {
@@ -1380,8 +2398,8 @@ static int perform_matchup(collocation_info *info)
 
         /* import product of dataset A */
         info->product_a_index = index_a;
-        if (harp_import(info->dataset_a->metadata[index_a]->filename, info->operations_a, info->ingest_options_a,
-                        &info->product_a) != 0)
+        if (harp_import_with_program(info->dataset_a->metadata[index_a]->filename, info->program_a,
+                                     info->ingest_options_a, &info->product_a) != 0)
         {
             return -1;
         }
@@ -1411,8 +2429,8 @@ static int perform_matchup(collocation_info *info)
                 /* overlap */
                 if (info->product_b[index_b] == NULL)
                 {
-                    if (harp_import(info->dataset_b->metadata[index_b]->filename, info->operations_b,
-                                    info->ingest_options_b, &info->product_b[index_b]) != 0)
+                    if (harp_import_with_program(info->dataset_b->metadata[index_b]->filename, info->program_b,
+                                                 info->ingest_options_b, &info->product_b[index_b]) != 0)
                     {
                         return -1;
                     }
@@ -1444,10 +2462,33 @@ static int perform_matchup(collocation_info *info)
             {
                 harp_product_delete(info->product_b[index_b]);
                 info->product_b[index_b] = NULL;
+                if (info->index_b != NULL && info->index_b[index_b] != NULL)
+                {
+                    matchup_index_delete(info->index_b[index_b]);
+                    info->index_b[index_b] = NULL;
+                }
             }
         }
         harp_product_delete(info->product_a);
         info->product_a = NULL;
+        if (info->perform_nearest_neighbour_x_first && info->nearest_pair != NULL &&
+            info->nearest_pair[index_a] != NULL)
+        {
+            /* no new pairs for this product of dataset A can be found anymore */
+            free(info->nearest_pair[index_a]);
+            info->nearest_pair[index_a] = NULL;
+            info->nearest_pair_size[index_a] = 0;
+        }
+    }
+
+    if (info->num_removed_pairs > 0)
+    {
+        /* remove all pairs that got replaced by a nearer pair */
+        if (harp_collocation_result_filter_with_mask(info->collocation_result, info->pair_mask) != 0)
+        {
+            return -1;
+        }
+        info->num_removed_pairs = 0;
     }
 
     return 0;
@@ -1489,6 +2530,25 @@ int matchup(int argc, char *argv[])
         {
             info->filter_point_in_area_yx = 1;
         }
+        else if (strcmp(argv[i], "--brute-force") == 0)
+        {
+            info->use_matchup_index = 0;
+        }
+        else if (strcmp(argv[i], "--binary") == 0)
+        {
+            info->write_binary = 1;
+        }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
+        {
+            info->num_threads = atoi(argv[i + 1]);
+            if (info->num_threads < 1)
+            {
+                harp_set_error(HARP_ERROR_INVALID_ARGUMENT, "invalid number of threads '%s'", argv[i + 1]);
+                collocation_info_delete(info);
+                return -1;
+            }
+            i++;
+        }
         else if (strcmp(argv[i], "-nx") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
         {
             if (info->nearest_neighbour_x_variable_name != NULL)
@@ -1584,6 +2644,24 @@ int matchup(int argc, char *argv[])
         return -1;
     }
 
+    /* the operations are compiled once and then applied to all products of a dataset */
+    if (info->operations_a != NULL)
+    {
+        if (harp_program_compile(info->operations_a, &info->program_a) != 0)
+        {
+            collocation_info_delete(info);
+            return -1;
+        }
+    }
+    if (info->operations_b != NULL)
+    {
+        if (harp_program_compile(info->operations_b, &info->program_b) != 0)
+        {
+            collocation_info_delete(info);
+            return -1;
+        }
+    }
+
     if (collocation_info_update(info) != 0)
     {
         collocation_info_delete(info);
@@ -1626,7 +2704,15 @@ int matchup(int argc, char *argv[])
         reindex_collocation_indices(info->collocation_result);
     }
 
-    if (harp_collocation_result_write(argv[argc - 1], info->collocation_result) != 0)
+    if (info->write_binary)
+    {
+        if (harp_collocation_result_write_binary(argv[argc - 1], info->collocation_result) != 0)
+        {
+            collocation_info_delete(info);
+            return -1;
+        }
+    }
+    else if (harp_collocation_result_write(argv[argc - 1], info->collocation_result) != 0)
     {
         collocation_info_delete(info);
         return -1;
@@ -47,6 +47,7 @@ typedef struct resample_info_struct
     long nearest_neighbour_x_criterium_index;
     char *nearest_neighbour_y_variable_name;
     long nearest_neighbour_y_criterium_index;
+    int write_binary;
 } resample_info;
 
 static void resample_info_delete(resample_info *info)
@@ -86,6 +87,7 @@ static int resample_info_new(resample_info **new_info)
     info->nearest_neighbour_x_criterium_index = -1;
     info->nearest_neighbour_y_variable_name = NULL;
     info->nearest_neighbour_y_criterium_index = -1;
+    info->write_binary = 0;
 
     *new_info = info;
 
@@ -150,69 +152,121 @@ static int resample_info_update(resample_info *info)
 
 int resample_nearest_a(harp_collocation_result *collocation_result, int difference_index)
 {
+    uint8_t *mask;
+    long nearest;
     long i;
+    int num_differences = collocation_result->num_differences;
 
+    if (collocation_result->num_pairs == 0)
+    {
+        return 0;
+    }
     if (harp_collocation_result_sort_by_a(collocation_result) != 0)
     {
         return -1;
     }
-    for (i = collocation_result->num_pairs - 1; i > 0; i--)
+
+    mask = malloc(collocation_result->num_pairs * sizeof(uint8_t));
+    if (mask == NULL)
     {
-        if (collocation_result->pair[i]->product_index_a == collocation_result->pair[i - 1]->product_index_a &&
-            collocation_result->pair[i]->sample_index_a == collocation_result->pair[i - 1]->sample_index_a)
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       collocation_result->num_pairs * sizeof(uint8_t), __FILE__, __LINE__);
+        return -1;
+    }
+
+    /* for each sample of A keep only the nearest pair (for equal distances this is the first pair) */
+    nearest = collocation_result->num_pairs - 1;
+    mask[nearest] = 1;
+    for (i = collocation_result->num_pairs - 2; i >= 0; i--)
+    {
+        mask[i] = 1;
+        if (collocation_result->product_index_a[i] == collocation_result->product_index_a[nearest] &&
+            collocation_result->sample_index_a[i] == collocation_result->sample_index_a[nearest])
         {
-            if (fabs(collocation_result->pair[i]->difference[difference_index]) >=
-                fabs(collocation_result->pair[i - 1]->difference[difference_index]))
+            if (fabs(collocation_result->difference[nearest * num_differences + difference_index]) >=
+                fabs(collocation_result->difference[i * num_differences + difference_index]))
             {
-                if (harp_collocation_result_remove_pair_at_index(collocation_result, i) != 0)
-                {
-                    return -1;
-                }
+                mask[nearest] = 0;
+                nearest = i;
             }
             else
             {
-                if (harp_collocation_result_remove_pair_at_index(collocation_result, i - 1) != 0)
-                {
-                    return -1;
-                }
+                mask[i] = 0;
             }
         }
+        else
+        {
+            nearest = i;
+        }
+    }
+
+    if (harp_collocation_result_filter_with_mask(collocation_result, mask) != 0)
+    {
+        free(mask);
+        return -1;
     }
+    free(mask);
 
     return 0;
 }
 
 int resample_nearest_b(harp_collocation_result *collocation_result, int difference_index)
 {
+    uint8_t *mask;
+    long nearest;
     long i;
+    int num_differences = collocation_result->num_differences;
 
+    if (collocation_result->num_pairs == 0)
+    {
+        return 0;
+    }
     if (harp_collocation_result_sort_by_b(collocation_result) != 0)
     {
         return -1;
     }
-    for (i = collocation_result->num_pairs - 1; i > 0; i--)
+
+    mask = malloc(collocation_result->num_pairs * sizeof(uint8_t));
+    if (mask == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       collocation_result->num_pairs * sizeof(uint8_t), __FILE__, __LINE__);
+        return -1;
+    }
+
+    /* for each sample of B keep only the nearest pair (for equal distances this is the first pair) */
+    nearest = collocation_result->num_pairs - 1;
+    mask[nearest] = 1;
+    for (i = collocation_result->num_pairs - 2; i >= 0; i--)
     {
-        if (collocation_result->pair[i]->product_index_b == collocation_result->pair[i - 1]->product_index_b &&
-            collocation_result->pair[i]->sample_index_b == collocation_result->pair[i - 1]->sample_index_b)
+        mask[i] = 1;
+        if (collocation_result->product_index_b[i] == collocation_result->product_index_b[nearest] &&
+            collocation_result->sample_index_b[i] == collocation_result->sample_index_b[nearest])
         {
-            if (fabs(collocation_result->pair[i]->difference[difference_index]) >=
-                fabs(collocation_result->pair[i - 1]->difference[difference_index]))
+            if (fabs(collocation_result->difference[nearest * num_differences + difference_index]) >=
+                fabs(collocation_result->difference[i * num_differences + difference_index]))
             {
-                if (harp_collocation_result_remove_pair_at_index(collocation_result, i) != 0)
-                {
-                    return -1;
-                }
+                mask[nearest] = 0;
+                nearest = i;
             }
             else
             {
-                if (harp_collocation_result_remove_pair_at_index(collocation_result, i - 1) != 0)
-                {
-                    return -1;
-                }
+                mask[i] = 0;
             }
         }
+        else
+        {
+            nearest = i;
+        }
     }
 
+    if (harp_collocation_result_filter_with_mask(collocation_result, mask) != 0)
+    {
+        free(mask);
+        return -1;
+    }
+    free(mask);
+
     return 0;
 }
 
@@ -228,7 +282,11 @@ int resample(int argc, char *argv[])
     }
     for (i = 2; i < argc; i++)
     {
-        if (strcmp(argv[i], "-nx") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
+        if (strcmp(argv[i], "--binary") == 0)
+        {
+            info->write_binary = 1;
+        }
+        else if (strcmp(argv[i], "-nx") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
         {
             if (info->nearest_neighbour_x_variable_name != NULL)
             {
@@ -334,7 +392,15 @@ int resample(int argc, char *argv[])
         return -1;
     }
 
-    if (harp_collocation_result_write(output, info->collocation_result) != 0)
+    if (info->write_binary)
+    {
+        if (harp_collocation_result_write_binary(output, info->collocation_result) != 0)
+        {
+            resample_info_delete(info);
+            return -1;
+        }
+    }
+    else if (harp_collocation_result_write(output, info->collocation_result) != 0)
     {
         resample_info_delete(info);
         return -1;
@@ -67,7 +67,8 @@ static void print_help(void)
     printf("        Find matching sample pairs between two datasets of HARP files.\n");
     printf("        The path for a dataset can be either a single file or a directory\n");
     printf("        containing files. The results will be written as a comma separated\n");
-    printf("        value (csv) file to the provided output path.\n");
+    printf("        value (csv) file (or a binary file, see --binary) to the provided\n");
+    printf("        output path.\n");
     printf("        If a directory is specified then all files (recursively) from that\n");
     printf("        directory are used for a dataset.\n");
     printf("        If a file is a .pth file then the file paths from that text file\n");
@@ -96,6 +97,19 @@ static void print_help(void)
     printf("            --point-in-area-yx\n");
     printf("                Specifies that latitude/longitude points from dataset B must\n");
     printf("                fall in polygon areas of dataset A\n");
+    printf("            --binary\n");
+    printf("                Write the collocation result in binary format instead of csv.\n");
+    printf("                Binary files are memory mapped and can be read directly for a\n");
+    printf("                range of collocation indices or a single product. Both formats\n");
+    printf("                are detected automatically when a collocation result is read.\n");
+    printf("            --brute-force\n");
+    printf("                Compare all sample pairs instead of using a datetime/location\n");
+    printf("                index on dataset B to find candidate pairs. This gives the same\n");
+    printf("                result but is much slower (only useful for verification).\n");
+    printf("            -j <number of threads>\n");
+    printf("                Use the given number of threads for matching the samples of\n");
+    printf("                each pair of products. Products are still read one at a time.\n");
+    printf("                The result does not depend on the number of threads.\n");
     printf("            -nx <diffvariable>\n");
     printf("                Filter collocation pairs such that for each sample from\n");
     printf("                dataset A only the nearest sample from dataset B (using the\n");
@@ -132,6 +146,8 @@ static void print_help(void)
     printf("        samples.\n");
     printf("\n");
     printf("        Options:\n");
+    printf("            --binary\n");
+    printf("                Write the collocation result in binary format instead of csv.\n");
     printf("            -nx <diffvariable>\n");
     printf("                Filter collocation pairs such that for each sample from\n");
     printf("                dataset A only the nearest sample from dataset B (using the\n");
@@ -142,10 +158,11 @@ static void print_help(void)
     printf("        The order in which -nx and -ny are provided determines the order in\n");
     printf("        which the nearest filters are executed.\n");
     printf("\n");
-    printf("    harpcollocate --update <inputpath> <datasetpath> [<outputpath>]\n");
+    printf("    harpcollocate --update [--binary] <inputpath> <datasetpath> [<outputpath>]\n");
     printf("        Update an existing collocation result file by checking the\n");
     printf("        measurements in the given dataset and only keeping pairs\n");
-    printf("        for which measurements still exist\n");
+    printf("        for which measurements still exist.\n");
+    printf("        Use --binary to write the result in binary format instead of csv.\n");
     printf("\n");
     printf("    harpcollocate -h, --help\n");
     printf("        Show help (this text).\n");
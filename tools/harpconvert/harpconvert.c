@@ -89,6 +89,23 @@ static void print_help(void)
     printf("                Set data compression level for storing in HDF5 format.\n");
     printf("                0=disabled, 1=low, ..., 9=high.\n");
     printf("\n");
+    printf("            --hdf5-compression-filter <filter>\n");
+    printf("                Set the filter that is used for compression in HDF5 format:\n");
+    printf("                    deflate (default)\n");
+    printf("                    szip\n");
+    printf("                    lz4 (requires the HDF5 lz4 filter plugin)\n");
+    printf("                    zstd (requires the HDF5 zstd filter plugin)\n");
+    printf("\n");
+    printf("            --hdf5-chunk-size <bytes>\n");
+    printf("                Split compressed variables in HDF5 format into chunks of\n");
+    printf("                approximately this size along the first (e.g. time)\n");
+    printf("                dimension. This speeds up reading a subset of the data.\n");
+    printf("                0=store each variable as a single chunk (default).\n");
+    printf("\n");
+    printf("            --hdf5-shuffle\n");
+    printf("                Apply the byte shuffle filter before compression in HDF5\n");
+    printf("                format.\n");
+    printf("\n");
     printf("            --no-history\n");
     printf("                Do not update the global history attribute.\n");
     printf("\n");
@@ -177,6 +194,48 @@ static int convert(int argc, char *argv[])
             }
             i++;
         }
+        else if (strcmp(argv[i], "--hdf5-compression-filter") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
+        {
+            int filter = -1;
+
+            if (strcmp(argv[i + 1], "deflate") == 0)
+            {
+                filter = 0;
+            }
+            else if (strcmp(argv[i + 1], "szip") == 0)
+            {
+                filter = 1;
+            }
+            else if (strcmp(argv[i + 1], "lz4") == 0)
+            {
+                filter = 2;
+            }
+            else if (strcmp(argv[i + 1], "zstd") == 0)
+            {
+                filter = 3;
+            }
+            if (harp_set_option_hdf5_compression_filter(filter) != 0)
+            {
+                fprintf(stderr, "ERROR: invalid hdf5 compression filter argument: '%s'\n", argv[i + 1]);
+                print_help();
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--hdf5-chunk-size") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
+        {
+            if (harp_set_option_hdf5_chunk_size(atoi(argv[i + 1])) != 0)
+            {
+                fprintf(stderr, "ERROR: invalid hdf5 chunk size argument: '%s'\n", argv[i + 1]);
+                print_help();
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--hdf5-shuffle") == 0)
+        {
+            harp_set_option_hdf5_shuffle(1);
+        }
         else if (strcmp(argv[i], "--no-history") == 0)
         {
             update_history = 0;
@@ -38,6 +38,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 static int print_warning(const char *message, va_list ap)
 {
@@ -95,6 +100,17 @@ static void print_help(void)
     printf("                of an <option name>=<value> pair. An option list needs to be\n");
     printf("                provided as a single expression.\n");
     printf("\n");
+    printf("            -j <number of threads>\n");
+    printf("                Import (and apply the operations to) multiple products in\n");
+    printf("                parallel. Products are still appended and reduced in the same\n");
+    printf("                order, so the result does not depend on the number of threads.\n");
+    printf("                Level 3 grids can be created in a memory efficient way using\n");
+    printf("                e.g. -a 'bin_spatial(...)' -ar 'bin()'. Since such binned\n");
+    printf("                products keep the count/weight of each cell, they can also\n");
+    printf("                be merged again later on using -ar 'bin()'. Use\n");
+    printf("                -ar 'set(\"propagate_uncertainty\", \"correlated\"); bin()' to\n");
+    printf("                combine uncertainties in the same way as bin_spatial().\n");
+    printf("\n");
     printf("            -l, --list\n");
     printf("                Print to stdout each filename that is currently being merged.\n");
     printf("\n");
@@ -108,9 +124,38 @@ static void print_help(void)
     printf("                Set data compression level for storing in HDF5 format.\n");
     printf("                0=disabled, 1=low, ..., 9=high.\n");
     printf("\n");
+    printf("            --hdf5-compression-filter <filter>\n");
+    printf("                Set the filter that is used for compression in HDF5 format:\n");
+    printf("                    deflate (default)\n");
+    printf("                    szip\n");
+    printf("                    lz4 (requires the HDF5 lz4 filter plugin)\n");
+    printf("                    zstd (requires the HDF5 zstd filter plugin)\n");
+    printf("\n");
+    printf("            --hdf5-chunk-size <bytes>\n");
+    printf("                Split compressed variables in HDF5 format into chunks of\n");
+    printf("                approximately this size along the first (e.g. time)\n");
+    printf("                dimension. This speeds up reading a subset of the data.\n");
+    printf("                0=store each variable as a single chunk (default).\n");
+    printf("\n");
+    printf("            --hdf5-shuffle\n");
+    printf("                Apply the byte shuffle filter before compression in HDF5\n");
+    printf("                format.\n");
+    printf("\n");
     printf("            --no-history\n");
     printf("                Do not update the global history attribute.\n");
     printf("\n");
+    printf("            --stream\n");
+    printf("                Write each product directly to the output file instead of\n");
+    printf("                first combining all products in memory.\n");
+    printf("                Only supported for the netcdf format and cannot be combined\n");
+    printf("                with reduce or post operations.\n");
+    printf("                If a product cannot be appended to the data that was already\n");
+    printf("                written (e.g. because it has a larger vertical dimension),\n");
+    printf("                the written data is read back and merging continues in memory.\n");
+    printf("                The data is written to '<output product file>.tmp', which is\n");
+    printf("                renamed to the output product file once the merge has\n");
+    printf("                succeeded (and removed if the merge fails).\n");
+    printf("\n");
     printf("        If the merged product is empty, a warning will be printed and the\n");
     printf("        tool will return with exit code 2 (without writing a file).\n");
     printf("\n");
@@ -122,8 +167,153 @@ static void print_help(void)
     printf("\n");
 }
 
-int merge_dataset(harp_product **merged_product, harp_dataset *dataset, const char *operations, const char *options,
-                  const char *reduce_operations, int verbose)
+typedef struct merge_state_struct
+{
+    harp_product *merged_product;
+    harp_export_stream *stream;
+    char *stream_filename;      /* temporary file that is renamed to the output file once the merge has finished */
+    int use_stream;
+    int history_updated;
+    const char *output_filename;
+    const char *output_format;
+    int update_history;
+    int argc;
+    char **argv;
+} merge_state;
+
+/* close the output stream and remove the partially written file */
+static void abort_stream(merge_state *state)
+{
+    if (state->stream != NULL)
+    {
+        harp_export_stream_close(state->stream);
+        state->stream = NULL;
+    }
+    if (state->stream_filename != NULL)
+    {
+        remove(state->stream_filename);
+        free(state->stream_filename);
+        state->stream_filename = NULL;
+    }
+}
+
+/* close the output stream and move the written file to its final location */
+static int finish_stream(merge_state *state)
+{
+    if (harp_export_stream_close(state->stream) != 0)
+    {
+        state->stream = NULL;
+        abort_stream(state);
+        return -1;
+    }
+    state->stream = NULL;
+#ifdef WIN32
+    /* rename() on Windows does not replace an existing file */
+    remove(state->output_filename);
+#endif
+    if (rename(state->stream_filename, state->output_filename) != 0)
+    {
+        harp_set_error(HARP_ERROR_FILE_WRITE, "could not rename '%s' (%s)", state->stream_filename, strerror(errno));
+        abort_stream(state);
+        return -1;
+    }
+    free(state->stream_filename);
+    state->stream_filename = NULL;
+
+    return 0;
+}
+
+static int append_product(merge_state *state, harp_product *product)
+{
+    if (state->merged_product == NULL && state->stream == NULL)
+    {
+        if (state->use_stream)
+        {
+            if (state->update_history)
+            {
+                if (harp_product_update_history(product, "harpmerge", state->argc, state->argv) != 0)
+                {
+                    harp_product_delete(product);
+                    return -1;
+                }
+                state->history_updated = 1;
+            }
+            /* write to a temporary file, such that no partial output file remains if the merge fails */
+            state->stream_filename = (char *)malloc(strlen(state->output_filename) + 4 + 1);
+            if (state->stream_filename == NULL)
+            {
+                harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                               (long)strlen(state->output_filename) + 4 + 1, __FILE__, __LINE__);
+                harp_product_delete(product);
+                return -1;
+            }
+            sprintf(state->stream_filename, "%s.tmp", state->output_filename);
+            if (harp_export_stream_open(state->stream_filename, state->output_format, product, &state->stream) != 0)
+            {
+                abort_stream(state);
+                harp_product_delete(product);
+                return -1;
+            }
+            harp_product_delete(product);
+            return 0;
+        }
+
+        state->merged_product = product;
+        /* if this remains the only product then make sure it still looks like it was the result of a merge */
+        return harp_product_append(state->merged_product, NULL);
+    }
+
+    if (state->stream != NULL)
+    {
+        int appended;
+
+        if (harp_export_stream_append(state->stream, product, &appended) != 0)
+        {
+            harp_product_delete(product);
+            return -1;
+        }
+        if (appended)
+        {
+            harp_product_delete(product);
+            return 0;
+        }
+
+        /* continue the merge in memory using the data that was written so far */
+        if (harp_export_stream_close(state->stream) != 0)
+        {
+            state->stream = NULL;
+            abort_stream(state);
+            harp_product_delete(product);
+            return -1;
+        }
+        state->stream = NULL;
+        state->use_stream = 0;
+        if (harp_import(state->stream_filename, NULL, NULL, &state->merged_product) != 0)
+        {
+            abort_stream(state);
+            harp_product_delete(product);
+            return -1;
+        }
+        abort_stream(state);
+        if (harp_product_append(state->merged_product, NULL) != 0)
+        {
+            harp_product_delete(product);
+            return -1;
+        }
+    }
+
+    if (harp_product_append(state->merged_product, product) != 0)
+    {
+        harp_product_delete(product);
+        return -1;
+    }
+    harp_product_delete(product);
+
+    return 0;
+}
+
+int merge_dataset(merge_state *state, harp_dataset *dataset, harp_program *program, const char *options,
+                  harp_program *reduce_program, int verbose)
 {
     int i;
 
@@ -139,50 +329,321 @@ int merge_dataset(harp_product **merged_product, harp_dataset *dataset, const ch
         {
             printf("%s\n", dataset->metadata[index]->filename);
         }
-        if (harp_import(dataset->metadata[index]->filename, operations, options, &product) != 0)
+        if (harp_import_with_program(dataset->metadata[index]->filename, program, options, &product) != 0)
         {
             harp_add_error_message(" (while merging '%s')", dataset->metadata[index]->filename);
             return -1;
         }
-        if (!harp_product_is_empty(product))
+        if (harp_product_is_empty(product))
+        {
+            harp_product_delete(product);
+            continue;
+        }
+        if (append_product(state, product) != 0)
         {
-            if (*merged_product == NULL)
+            harp_add_error_message(" (while merging '%s')", dataset->metadata[index]->filename);
+            return -1;
+        }
+        if (reduce_program != NULL)
+        {
+            /* perform reduction operations on the partially merged product after each append */
+            if (harp_product_execute_program(state->merged_product, reduce_program) != 0)
             {
-                *merged_product = product;
-                /* if this remains the only product then make sure it still looks like it was the result of a merge */
-                if (harp_product_append(*merged_product, NULL) != 0)
-                {
-                    harp_add_error_message(" (while merging '%s')", dataset->metadata[index]->filename);
-                    return -1;
-                }
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+#ifdef HAVE_PTHREAD_H
+/* Shared state for importing the products of a dataset using multiple threads.
+ * Each thread repeatedly imports the next product (applying the operations). The products are appended (and reduced)
+ * by the main thread in the sorted order of the dataset, such that the result does not depend on the number of
+ * threads. To limit the memory usage, a thread will not start importing a product that is more than 'window'
+ * products ahead of the product that is to be appended next.
+ * Since a compiled program can not be shared between threads, each thread uses its own copy of the program (these
+ * copies are created once by merge() and are used for all datasets).
+ */
+typedef struct import_task_struct
+{
+    harp_dataset *dataset;
+    harp_program **program;     /* compiled program for each thread (NULL if there are no operations) */
+    long next_thread;   /* index of the program for the next thread that starts */
+    const char *options;
+    long window;
+    long next_import;   /* index (in sorted order) of the next product that still needs to be imported */
+    long next_append;   /* index (in sorted order) of the next product that needs to be appended */
+    harp_product **product;     /* imported product for each index (in sorted order) */
+    int *status;        /* 0: not imported yet, 1: imported, -1: import failed */
+    int *error_code;    /* harp_errno for each failed import */
+    char **error_message;       /* error message for each failed import */
+    int abort;  /* will be set to 1 if the main thread stops merging */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} import_task;
+
+static void *import_worker(void *arg)
+{
+    import_task *task = (import_task *)arg;
+    harp_program *program;
+
+    pthread_mutex_lock(&task->mutex);
+    program = task->program[task->next_thread];
+    task->next_thread++;
+    for (;;)
+    {
+        harp_product *product = NULL;
+        long i;
+        int result;
+
+        while (!task->abort && task->next_import < task->dataset->num_products &&
+               task->next_import >= task->next_append + task->window)
+        {
+            pthread_cond_wait(&task->cond, &task->mutex);
+        }
+        if (task->abort || task->next_import >= task->dataset->num_products)
+        {
+            break;
+        }
+        i = task->next_import;
+        task->next_import++;
+        pthread_mutex_unlock(&task->mutex);
+
+        result = harp_import_with_program(task->dataset->metadata[task->dataset->sorted_index[i]]->filename, program,
+                                          task->options, &product);
+
+        pthread_mutex_lock(&task->mutex);
+        if (result == 0)
+        {
+            task->product[i] = product;
+            task->status[i] = 1;
+        }
+        else
+        {
+            /* the error state is kept per thread, so pass it on to the main thread */
+            task->error_code[i] = harp_errno;
+            task->error_message[i] = strdup(harp_errno_to_string(harp_errno));
+            task->status[i] = -1;
+        }
+        pthread_cond_broadcast(&task->cond);
+    }
+    pthread_mutex_unlock(&task->mutex);
+
+    return NULL;
+}
+
+static int merge_dataset_with_threads(merge_state *state, harp_dataset *dataset, harp_program **thread_program,
+                                      const char *options, harp_program *reduce_program, int num_threads, int verbose)
+{
+    import_task task;
+    pthread_t *thread;
+    long num_products = dataset->num_products;
+    long num_threads_started = 0;
+    long i;
+    int result = 0;
+
+    task.dataset = dataset;
+    task.program = thread_program;
+    task.next_thread = 0;
+    task.options = options;
+    task.window = 2 * num_threads;
+    task.next_import = 0;
+    task.next_append = 0;
+    task.abort = 0;
+    task.product = calloc(num_products, sizeof(harp_product *));
+    task.status = calloc(num_products, sizeof(int));
+    task.error_code = calloc(num_products, sizeof(int));
+    task.error_message = calloc(num_products, sizeof(char *));
+    thread = malloc(num_threads * sizeof(pthread_t));
+    if (task.product == NULL || task.status == NULL || task.error_code == NULL || task.error_message == NULL ||
+        thread == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate import state for %ld products) "
+                       "(%s:%u)", num_products, __FILE__, __LINE__);
+        result = -1;
+        goto done;
+    }
+    pthread_mutex_init(&task.mutex, NULL);
+    pthread_cond_init(&task.cond, NULL);
+
+    for (i = 0; i < num_threads; i++)
+    {
+        if (pthread_create(&thread[num_threads_started], NULL, import_worker, &task) != 0)
+        {
+            /* just continue with the threads that we have */
+            break;
+        }
+        num_threads_started++;
+    }
+    if (num_threads_started == 0)
+    {
+        pthread_cond_destroy(&task.cond);
+        pthread_mutex_destroy(&task.mutex);
+        free(thread);
+        thread = NULL;
+        result = merge_dataset(state, dataset, thread_program[0], options, reduce_program, verbose);
+        goto done;
+    }
+
+    for (i = 0; i < num_products; i++)
+    {
+        const char *filename = dataset->metadata[dataset->sorted_index[i]]->filename;
+        harp_product *product;
+
+        pthread_mutex_lock(&task.mutex);
+        while (task.status[i] == 0)
+        {
+            pthread_cond_wait(&task.cond, &task.mutex);
+        }
+        product = task.product[i];
+        task.product[i] = NULL;
+        task.next_append = i + 1;
+        pthread_cond_broadcast(&task.cond);
+        pthread_mutex_unlock(&task.mutex);
+
+        if (verbose)
+        {
+            printf("%s\n", filename);
+        }
+        if (task.status[i] < 0)
+        {
+            harp_set_error(task.error_code[i], "%s", task.error_message[i] != NULL ? task.error_message[i] :
+                           harp_errno_to_string(task.error_code[i]));
+            harp_add_error_message(" (while merging '%s')", filename);
+            result = -1;
+            break;
+        }
+        if (harp_product_is_empty(product))
+        {
+            harp_product_delete(product);
+            continue;
+        }
+        if (append_product(state, product) != 0)
+        {
+            harp_add_error_message(" (while merging '%s')", filename);
+            result = -1;
+            break;
+        }
+        if (reduce_program != NULL)
+        {
+            /* perform reduction operations on the partially merged product after each append */
+            if (harp_product_execute_program(state->merged_product, reduce_program) != 0)
+            {
+                result = -1;
+                break;
             }
-            else
+        }
+    }
+
+    pthread_mutex_lock(&task.mutex);
+    task.abort = 1;
+    pthread_cond_broadcast(&task.cond);
+    pthread_mutex_unlock(&task.mutex);
+    for (i = 0; i < num_threads_started; i++)
+    {
+        pthread_join(thread[i], NULL);
+    }
+    pthread_cond_destroy(&task.cond);
+    pthread_mutex_destroy(&task.mutex);
+
+  done:
+    if (task.product != NULL)
+    {
+        for (i = 0; i < num_products; i++)
+        {
+            if (task.product[i] != NULL)
             {
-                if (harp_product_append(*merged_product, product) != 0)
-                {
-                    harp_add_error_message(" (while merging '%s')", dataset->metadata[index]->filename);
-                    harp_product_delete(product);
-                    return -1;
-                }
-                harp_product_delete(product);
+                harp_product_delete(task.product[i]);
             }
-            if (reduce_operations != NULL)
+        }
+        free(task.product);
+    }
+    if (task.error_message != NULL)
+    {
+        for (i = 0; i < num_products; i++)
+        {
+            if (task.error_message[i] != NULL)
             {
-                /* perform reduction operations on the partially merged product after each append */
-                if (harp_product_execute_operations(*merged_product, reduce_operations) != 0)
-                {
-                    return -1;
-                }
+                free(task.error_message[i]);
+            }
+        }
+        free(task.error_message);
+    }
+    if (task.status != NULL)
+    {
+        free(task.status);
+    }
+    if (task.error_code != NULL)
+    {
+        free(task.error_code);
+    }
+    if (thread != NULL)
+    {
+        free(thread);
+    }
+
+    return result;
+}
+#endif
+
+/* Create a program for each thread that imports products. The first thread uses the given program itself (since the
+ * main thread does not import any products when threads are used). The other threads use a copy of the program.
+ */
+static int create_thread_programs(harp_program *program, int num_threads, harp_program ***thread_program)
+{
+    harp_program **new_thread_program;
+    int i;
+
+    new_thread_program = calloc(num_threads, sizeof(harp_program *));
+    if (new_thread_program == NULL)
+    {
+        harp_set_error(HARP_ERROR_OUT_OF_MEMORY, "out of memory (could not allocate %lu bytes) (%s:%u)",
+                       num_threads * sizeof(harp_program *), __FILE__, __LINE__);
+        return -1;
+    }
+    new_thread_program[0] = program;
+    for (i = 1; i < num_threads; i++)
+    {
+        if (program != NULL && harp_program_copy(program, &new_thread_program[i]) != 0)
+        {
+            while (--i > 0)
+            {
+                harp_program_delete(new_thread_program[i]);
             }
+            free(new_thread_program);
+            return -1;
         }
     }
 
+    *thread_program = new_thread_program;
     return 0;
 }
 
+/* Delete the thread programs that were created by create_thread_programs() (except for the program of the first
+ * thread, which is owned by the caller) */
+static void delete_thread_programs(harp_program **thread_program, int num_threads)
+{
+    int i;
+
+    if (thread_program != NULL)
+    {
+        for (i = 1; i < num_threads; i++)
+        {
+            harp_program_delete(thread_program[i]);
+        }
+        free(thread_program);
+    }
+}
+
 static int merge(int argc, char *argv[])
 {
-    harp_product *merged_product = NULL;
+    harp_product *merged_product;
+    harp_program *program = NULL;
+    harp_program *reduce_program = NULL;
+    harp_program **thread_program = NULL;
+    merge_state state;
     const char *operations = NULL;
     const char *reduce_operations = NULL;
     const char *post_operations = NULL;
@@ -190,6 +651,8 @@ static int merge(int argc, char *argv[])
     const char *output_filename = NULL;
     const char *output_format = "netcdf";
     int update_history = 1;
+    int use_stream = 0;
+    int num_threads = 1;
     int verbose = 0;
     int i;
 
@@ -226,6 +689,17 @@ static int merge(int argc, char *argv[])
             output_format = argv[i + 1];
             i++;
         }
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
+        {
+            num_threads = atoi(argv[i + 1]);
+            if (num_threads < 1)
+            {
+                fprintf(stderr, "ERROR: invalid number of threads '%s'\n", argv[i + 1]);
+                print_help();
+                return -1;
+            }
+            i++;
+        }
         else if (strcmp(argv[i], "-l") == 0 || strcmp(argv[i], "--list") == 0)
         {
             verbose = 1;
@@ -240,10 +714,56 @@ static int merge(int argc, char *argv[])
             }
             i++;
         }
+        else if (strcmp(argv[i], "--hdf5-compression-filter") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
+        {
+            int filter = -1;
+
+            if (strcmp(argv[i + 1], "deflate") == 0)
+            {
+                filter = 0;
+            }
+            else if (strcmp(argv[i + 1], "szip") == 0)
+            {
+                filter = 1;
+            }
+            else if (strcmp(argv[i + 1], "lz4") == 0)
+            {
+                filter = 2;
+            }
+            else if (strcmp(argv[i + 1], "zstd") == 0)
+            {
+                filter = 3;
+            }
+            if (harp_set_option_hdf5_compression_filter(filter) != 0)
+            {
+                fprintf(stderr, "ERROR: invalid hdf5 compression filter argument: '%s'\n", argv[i + 1]);
+                print_help();
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--hdf5-chunk-size") == 0 && i + 1 < argc && argv[i + 1][0] != '-')
+        {
+            if (harp_set_option_hdf5_chunk_size(atoi(argv[i + 1])) != 0)
+            {
+                fprintf(stderr, "ERROR: invalid hdf5 chunk size argument: '%s'\n", argv[i + 1]);
+                print_help();
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--hdf5-shuffle") == 0)
+        {
+            harp_set_option_hdf5_shuffle(1);
+        }
         else if (strcmp(argv[i], "--no-history") == 0)
         {
             update_history = 0;
         }
+        else if (strcmp(argv[i], "--stream") == 0)
+        {
+            use_stream = 1;
+        }
         else if (argv[i][0] != '-')
         {
             /* Assume the next argument is the dataset directory path. */
@@ -265,34 +785,133 @@ static int merge(int argc, char *argv[])
     }
     output_filename = argv[argc - 1];
 
+    if (use_stream)
+    {
+        if (strcmp(output_format, "netcdf") != 0)
+        {
+            fprintf(stderr, "ERROR: --stream is only supported for the netcdf format\n");
+            return -1;
+        }
+        if (reduce_operations != NULL || post_operations != NULL)
+        {
+            fprintf(stderr, "ERROR: --stream cannot be combined with reduce or post operations\n");
+            return -1;
+        }
+    }
+
+    state.merged_product = NULL;
+    state.stream = NULL;
+    state.stream_filename = NULL;
+    state.use_stream = use_stream;
+    state.history_updated = 0;
+    state.output_filename = output_filename;
+    state.output_format = output_format;
+    state.update_history = update_history;
+    state.argc = argc;
+    state.argv = argv;
+
+    if (num_threads > 1)
+    {
+        /* products are already processed in parallel, so don't let each worker distribute its work over more threads */
+        harp_set_option_num_threads(1);
+    }
+
+    /* the operations are compiled once and then applied to all products */
+    if (operations != NULL)
+    {
+        if (harp_program_compile(operations, &program) != 0)
+        {
+            return -1;
+        }
+    }
+    if (reduce_operations != NULL)
+    {
+        if (harp_program_compile(reduce_operations, &reduce_program) != 0)
+        {
+            harp_program_delete(program);
+            return -1;
+        }
+    }
+    if (num_threads > 1)
+    {
+        /* the programs for the import threads are also only created once and then used for all datasets */
+        if (create_thread_programs(program, num_threads, &thread_program) != 0)
+        {
+            harp_program_delete(reduce_program);
+            harp_program_delete(program);
+            return -1;
+        }
+    }
+
     while (i < argc - 1)
     {
         harp_dataset *dataset;
+        int result;
 
         if (harp_dataset_new(&dataset) != 0)
         {
+            abort_stream(&state);
+            harp_product_delete(state.merged_product);
+            delete_thread_programs(thread_program, num_threads);
+            harp_program_delete(reduce_program);
+            harp_program_delete(program);
             return -1;
         }
         if (harp_dataset_import(dataset, argv[i], options) != 0)
         {
+            abort_stream(&state);
+            harp_product_delete(state.merged_product);
             harp_dataset_delete(dataset);
+            delete_thread_programs(thread_program, num_threads);
+            harp_program_delete(reduce_program);
+            harp_program_delete(program);
             return -1;
         }
         if (harp_dataset_prefilter(dataset, operations) != 0)
         {
+            abort_stream(&state);
+            harp_product_delete(state.merged_product);
             harp_dataset_delete(dataset);
+            delete_thread_programs(thread_program, num_threads);
+            harp_program_delete(reduce_program);
+            harp_program_delete(program);
             return -1;
         }
-        if (merge_dataset(&merged_product, dataset, operations, options, reduce_operations, verbose) != 0)
+#ifdef HAVE_PTHREAD_H
+        if (num_threads > 1 && dataset->num_products > 1)
         {
-            harp_product_delete(merged_product);
+            result = merge_dataset_with_threads(&state, dataset, thread_program, options, reduce_program, num_threads,
+                                                verbose);
+        }
+        else
+#endif
+        {
+            result = merge_dataset(&state, dataset, program, options, reduce_program, verbose);
+        }
+        if (result != 0)
+        {
+            abort_stream(&state);
+            harp_product_delete(state.merged_product);
             harp_dataset_delete(dataset);
+            delete_thread_programs(thread_program, num_threads);
+            harp_program_delete(reduce_program);
+            harp_program_delete(program);
             return -1;
         }
         harp_dataset_delete(dataset);
         i++;
     }
+    delete_thread_programs(thread_program, num_threads);
+    harp_program_delete(reduce_program);
+    harp_program_delete(program);
+
+    if (state.stream != NULL)
+    {
+        /* all products were written to the output file directly */
+        return finish_stream(&state);
+    }
 
+    merged_product = state.merged_product;
     if (merged_product == NULL)
     {
         return -2;
@@ -316,7 +935,7 @@ static int merge(int argc, char *argv[])
         }
     }
 
-    if (update_history)
+    if (update_history && !state.history_updated)
     {
         /* Update the product history */
         if (harp_product_update_history(merged_product, "harpmerge", argc, argv) != 0)